@@ -0,0 +1,157 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sched.h>
+#include <unistd.h>
+
+#include <boost/program_options.hpp>
+
+#include "cycle_latency_stats.h"
+#include "fake_devices.h"
+#include "fake_indi_server.h"
+#include "indi_device_watchdog.h"
+#include "logging.h"
+
+namespace po = boost::program_options;
+
+
+/**
+ * Pins the calling thread to the given CPUs - all threads started
+ * afterwards (evaluation workers, INDI client, fake INDI server) inherit
+ * the mask. Without CPUs, the first maxCpuCount CPUs of the current mask
+ * are used.
+ */
+static std::vector<int> pinToCpus(std::vector<int> cpus, size_t maxCpuCount) {
+  cpu_set_t cpuSet;
+  CPU_ZERO(& cpuSet);
+
+  if (cpus.empty()) {
+    if (sched_getaffinity(0, sizeof(cpuSet), & cpuSet) != 0) {
+      return cpus;
+    }
+    
+    for (int cpu = 0; cpu < CPU_SETSIZE && cpus.size() < maxCpuCount; ++cpu) {
+      if (CPU_ISSET(cpu, & cpuSet)) {
+	cpus.push_back(cpu);
+      }
+    }
+    CPU_ZERO(& cpuSet);
+  }
+
+  for (int cpu : cpus) {
+    CPU_SET(cpu, & cpuSet);
+  }
+
+  if (sched_setaffinity(0, sizeof(cpuSet), & cpuSet) != 0) {
+    std::cerr << "Cannot pin to the given CPUs." << std::endl;
+    cpus.clear();
+  }
+  return cpus;
+}
+
+
+/**
+ * Cycle latency (p50, p99 and max) of the watchdog for the given numbers
+ * of evaluation threads. The devices are served by a fake INDI server,
+ * all of them connected and healthy - so each cycle evaluates all
+ * devices without recovering any of them.
+ */
+int main(int argc, char *argv[]) {
+  po::options_description desc("Cycle latency benchmark - options");
+
+  desc.add_options()
+    ("help,h", "Print help message")
+    ("devices", po::value<unsigned int>()->default_value(16), "Number of fake INDI devices")
+    ("cycles", po::value<unsigned int>()->default_value(5000), "Measured cycles per number of evaluation threads")
+    ("warm-up", po::value<unsigned int>()->default_value(200), "Cycles before the measurement")
+    ("evaluation-threads", po::value<std::vector<unsigned int> >()->multitoken()->default_value(std::vector<unsigned int>{ 0, 1, 2, 4 }, "0 1 2 4"), "Numbers of evaluation threads to compare (0 = evaluate inline)")
+    ("cpus", po::value<std::vector<int> >()->multitoken(), "CPUs to pin to (default: the first 4 available CPUs)");
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+
+  const unsigned int deviceCount = vm["devices"].as<unsigned int>();
+  const unsigned int cycleCount = vm["cycles"].as<unsigned int>();
+  const unsigned int warmUpCycleCount = vm["warm-up"].as<unsigned int>();
+  
+  std::vector<int> cpus = pinToCpus(vm.count("cpus") ? vm["cpus"].as<std::vector<int> >() : std::vector<int>(), 4);
+
+  std::cout << deviceCount << " devices, " << cycleCount << " cycles (" << warmUpCycleCount << " warm-up), " << sysconf(_SC_NPROCESSORS_ONLN) << " CPUs online, pinned to CPUs";
+
+  for (int cpu : cpus) {
+    std::cout << " " << cpu;
+  }
+  std::cout << std::endl;
+  
+  LoggingT::init(logging::trivial::error, false /*console*/, false /*log file*/);
+
+  FakeIndiServerT indiServer;
+  std::vector<DeviceDataT> devices = addFakeDevices(indiServer, deviceCount);
+
+  for (unsigned int evaluationThreadCount : vm["evaluation-threads"].as<std::vector<unsigned int> >()) {
+    IndiDeviceWatchdogT watchdog("127.0.0.1", indiServer.getPort(), 5, devices, "/usr/bin", "/nonexistent/indiserverFIFO",
+				 RecoveryActionFactoryT(), ReconnectPolicyT(), std::chrono::milliseconds(1000), std::chrono::milliseconds(3000),
+				 evaluationThreadCount);
+
+    if (! watchdog.runCycles(warmUpCycleCount)) {
+      std::cerr << "Cannot connect to the fake INDI server." << std::endl;
+      return 1;
+    }
+
+    // The stats of the watchdog only keep the most recent cycles
+    CycleLatencyStatsT latencyStats(cycleCount);
+    auto startTime = std::chrono::steady_clock::now();
+
+    for (unsigned int cycle = 0; cycle < cycleCount; ++cycle) {
+      auto cycleStartTime = std::chrono::steady_clock::now();
+      watchdog.runCycles(1);
+      latencyStats.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - cycleStartTime));
+    }
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    std::cout << "evaluation threads: " << evaluationThreadCount
+	      << ", p50: " << latencyStats.getPercentile(50).count() << " us"
+	      << ", p99: " << latencyStats.getPercentile(99).count() << " us"
+	      << ", max: " << latencyStats.getPercentile(100).count() << " us"
+	      << ", " << cycleCount / sec << " cycles/s" << std::endl;
+  }
+  
+  return 0;
+}
@@ -0,0 +1,224 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include <boost/program_options.hpp>
+
+#include "log_storage.h"
+#include "logging.h"
+
+namespace po = boost::program_options;
+namespace fs = std::filesystem;
+
+
+/**
+ * Write syscalls and bytes of this process - from /proc/self/io.
+ * write_bytes only counts what went to a block device (not tmpfs).
+ */
+struct ProcessIoT {
+  uint64_t writeCallCount;
+  uint64_t writeCallBytes;
+  uint64_t blockDeviceBytes;
+
+  ProcessIoT() : writeCallCount(0), writeCallBytes(0), blockDeviceBytes(0) {}
+
+  static ProcessIoT read() {
+    ProcessIoT io;
+    std::ifstream procIo("/proc/self/io");
+    std::string key;
+    uint64_t value;
+
+    while (procIo >> key >> value) {
+      if (key == "syscw:") {
+	io.writeCallCount = value;
+      }
+      else if (key == "wchar:") {
+	io.writeCallBytes = value;
+      }
+      else if (key == "write_bytes:") {
+	io.blockDeviceBytes = value;
+      }
+    }
+    return io;
+  }
+};
+
+
+/**
+ * Logs a stream of typical watchdog records for the given time - one
+ * error every errorInterval records, otherwise info and debug records.
+ */
+static void logRecords(unsigned long recordsPerSec, std::chrono::seconds duration, unsigned int errorInterval) {
+  const auto recordInterval = std::chrono::microseconds(1000000 / std::max(recordsPerSec, 1UL));
+  const auto startTime = std::chrono::steady_clock::now();
+  auto nextRecordTime = startTime;
+  unsigned long recordIdx = 0;
+  
+  while (nextRecordTime - startTime < duration) {
+    std::this_thread::sleep_until(nextRecordTime);
+    
+    int device = recordIdx % 4;
+    
+    if (errorInterval > 0 && recordIdx % errorInterval == errorInterval - 1) {
+      LOG(error) << "INDI device 'CCD Simulator " << device << "' is not connected - trying to reconnect (attempt " << recordIdx << ")." << std::endl;
+    }
+    else if (recordIdx % 3 == 0) {
+      LOG(info) << "Sending INDI device 'connect' request for device 'CCD Simulator " << device << "'..." << std::endl;
+    }
+    else {
+      LOG(debug) << "INDI device 'CCD Simulator " << device << "' - CONNECTION: On, Linux device /dev/ttyUSB" << device << " present, cycle latency p50: 31 us, p99: 52 us" << std::endl;
+    }
+    
+    recordIdx++;
+    nextRecordTime += recordInterval;
+  }
+}
+
+
+/**
+ * I/O volume (write syscalls and bytes) of one hour of logging with the
+ * plain log files, with --log-dir and with --log-dir plus
+ * --log-staging-dir. The hour is compressed by the time scale - the spill
+ * interval is scaled along.
+ */
+int main(int argc, char *argv[]) {
+  po::options_description desc("Log storage benchmark - options");
+
+  desc.add_options()
+    ("help,h", "Print help message")
+    ("records-per-hour", po::value<unsigned long>()->default_value(3600), "Logged records per hour")
+    ("error-interval", po::value<unsigned int>()->default_value(200), "Every n-th record is an error (0 = none)")
+    ("time-scale", po::value<unsigned int>()->default_value(60), "Simulated seconds per real second")
+    ("spill-interval", po::value<unsigned int>()->default_value(60), "--log-spill-interval in simulated seconds")
+    ("dir", po::value<std::string>()->default_value("./log_storage_benchmark"), "Directory of the log files (the SD card)")
+    ("staging-dir", po::value<std::string>()->default_value("/dev/shm/log_storage_benchmark"), "Staging directory (tmpfs)");
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+
+  const unsigned long recordsPerHour = vm["records-per-hour"].as<unsigned long>();
+  const unsigned int timeScale = std::max(vm["time-scale"].as<unsigned int>(), 1U);
+  const unsigned int spillInterval = vm["spill-interval"].as<unsigned int>();
+  const fs::path dir = fs::absolute(vm["dir"].as<std::string>());
+  const fs::path stagingDir = vm["staging-dir"].as<std::string>();
+  
+  if (spillInterval % timeScale != 0) {
+    std::cerr << "The spill interval must be a multiple of the time scale." << std::endl;
+    return 1;
+  }
+
+  const std::chrono::seconds duration(3600 / timeScale);
+  const unsigned long recordsPerSec = recordsPerHour * timeScale / 3600;
+
+  std::cout << recordsPerHour << " records per hour (every " << vm["error-interval"].as<unsigned int>() << ". an error), one hour in "
+	    << duration.count() << " s, spill interval " << spillInterval << " s" << std::endl;
+
+  LoggingT::init(logging::trivial::trace, false /*console*/, false /*log file*/);
+
+  const char * modes[] = { "plain log files", "--log-dir", "--log-dir + --log-staging-dir" };
+  
+  for (int mode = 0; mode < 3; ++mode) {
+    fs::remove_all(dir);
+    fs::remove_all(stagingDir);
+    fs::create_directories(dir);
+    
+    std::unique_ptr<LogStorageT> logStorage;
+    fs::path oldWorkingDir = fs::current_path();
+    ProcessIoT ioBefore = ProcessIoT::read();
+
+    if (mode == 0) {
+      // The plain log files are written to the working directory
+      fs::current_path(dir);
+      LoggingT::init(logging::trivial::trace, false /*console*/, true /*log file*/);
+    }
+    else {
+      LogStorageConfigT logStorageConfig;
+      logStorageConfig.logDir = dir.string();
+      logStorageConfig.spillInterval = std::chrono::seconds(spillInterval / timeScale);
+
+      if (mode == 2) {
+	fs::create_directories(stagingDir);
+	logStorageConfig.stagingDir = stagingDir.string();
+      }
+      logStorage = std::make_unique<LogStorageT>(logStorageConfig);
+    }
+
+    logRecords(recordsPerSec, duration, vm["error-interval"].as<unsigned int>());
+
+    LogStorageStatsT stats;
+    
+    if (logStorage) {
+      logStorage->stop();
+      stats = logStorage->getStats();
+      logStorage.reset();
+    }
+    logging::core::get()->remove_all_sinks();
+    fs::current_path(oldWorkingDir);
+
+    ProcessIoT ioAfter = ProcessIoT::read();
+    uintmax_t logDirBytes = 0;
+
+    for (const fs::directory_entry & entry : fs::recursive_directory_iterator(dir)) {
+      logDirBytes += (entry.is_regular_file() ? entry.file_size() : 0);
+    }
+    
+    // Nothing but the plain log files writes in that mode
+    uint64_t writeCallCount = ioAfter.writeCallCount - ioBefore.writeCallCount;
+    uint64_t writeCallBytes = ioAfter.writeCallBytes - ioBefore.writeCallBytes;
+    
+    if (mode > 0) {
+      writeCallCount = stats.writeCount;
+      writeCallBytes = stats.writtenBytes;
+    }
+    
+    std::cout << modes[mode] << ": " << writeCallCount << " writes/h, " << writeCallBytes / 1024 << " KiB/h to the log directory ("
+	      << logDirBytes / 1024 << " KiB in it) / all files: " << (ioAfter.writeCallCount - ioBefore.writeCallCount) << " writes/h, "
+	      << (ioAfter.writeCallBytes - ioBefore.writeCallBytes) / 1024 << " KiB/h, " << (ioAfter.blockDeviceBytes - ioBefore.blockDeviceBytes) / 1024
+	      << " KiB/h to block devices" << std::endl;
+  }
+
+  fs::remove_all(dir);
+  fs::remove_all(stagingDir);
+  
+  return 0;
+}
@@ -0,0 +1,162 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "message_pattern_matcher.h"
+
+namespace po = boost::program_options;
+
+
+/**
+ * Throughput of the message pattern matcher for a stream of typical INDI
+ * driver messages which mostly do not match. Optionally compares it with
+ * one case-insensitive std::regex and one case-insensitive substring
+ * search per pattern.
+ */
+int main(int argc, char *argv[]) {
+  po::options_description desc("Message pattern matcher benchmark - options");
+
+  desc.add_options()
+    ("help,h", "Print help message")
+    ("drivers", po::value<int>()->default_value(10), "Number of INDI drivers")
+    ("patterns-per-driver", po::value<int>()->default_value(50), "Number of patterns of each driver")
+    ("messages", po::value<int>()->default_value(1000), "Number of distinct messages")
+    ("rounds", po::value<int>()->default_value(2000), "Rounds over all messages")
+    ("compare", "Also measure std::regex and substring search per pattern");
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+
+  const int driverCount = vm["drivers"].as<int>();
+  const int patternsPerDriver = vm["patterns-per-driver"].as<int>();
+  const int messageCount = vm["messages"].as<int>();
+  const int rounds = vm["rounds"].as<int>();
+  
+  const char * messageTemplates[] = {
+    "2026-10-19T01:23:45: [INFO] Exposure done, downloading image...",
+    "2026-10-19T01:23:45: [DEBUG] CCD temperature -10.02 C, cooler power 45 %",
+    "2026-10-19T01:23:45: [INFO] Guide pulse N 250 ms",
+    "2026-10-19T01:23:45: [INFO] Focuser at position 12345, temperature 8.5 C"
+  };
+  const char * words[] = { "error", "timeout", "failed", "usb", "port", "disconnected", "not responding", "transfer", "cannot", "unable" };
+
+  std::mt19937 rng(1);
+  std::vector<std::string> messages;
+  size_t messageBytes = 0;
+  
+  for (int messageIdx = 0; messageIdx < messageCount; ++messageIdx) {
+    messages.push_back(messageTemplates[rng() % 4]);
+    messageBytes += messages.back().size();
+  }
+
+  MessagePatternMatcherT matcher;
+  std::vector<std::string> patterns;
+  
+  for (int driver = 0; driver < driverCount; ++driver) {
+    for (int patternIdx = 0; patternIdx < patternsPerDriver; ++patternIdx) {
+      patterns.push_back(std::string(words[patternIdx % 10]) + " " + words[(patternIdx / 10 + patternIdx + 1) % 10] + " " + std::to_string(driver));
+      matcher.addPattern(patterns.back(), driver);
+    }
+  }
+
+  auto startTime = std::chrono::steady_clock::now();
+  matcher.compile();
+  double compileSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  
+  std::cout << patterns.size() << " patterns of " << driverCount << " drivers, " << messageCount << " messages (" << messageBytes / std::max(messageCount, 1)
+	    << " bytes on average), " << rounds << " rounds" << std::endl;
+  std::cout << "compile: " << compileSec * 1e3 << " ms" << std::endl;
+
+  unsigned long hitCount = 0;
+  startTime = std::chrono::steady_clock::now();
+
+  for (int round = 0; round < rounds; ++round) {
+    for (const std::string & message : messages) {
+      hitCount += (matcher.match(message.data(), message.size(), round % std::max(driverCount, 1)) >= 0);
+    }
+  }
+  double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  
+  std::cout << "automaton: " << rounds * messages.size() / sec / 1e6 << " M messages/s, " << rounds * messageBytes / sec / 1e6 << " MB/s (" << hitCount << " hits)" << std::endl;
+
+  if (! vm.count("compare")) {
+    return 0;
+  }
+
+  std::vector<std::regex> regexes;
+
+  for (const std::string & pattern : patterns) {
+    regexes.emplace_back(pattern, std::regex::icase);
+  }
+  
+  startTime = std::chrono::steady_clock::now();
+
+  for (const std::string & message : messages) {
+    for (const std::regex & regex : regexes) {
+      if (std::regex_search(message, regex)) {
+	hitCount++;
+	break;
+      }
+    }
+  }
+  sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  std::cout << "std::regex per pattern: " << messages.size() / sec / 1e3 << " k messages/s" << std::endl;
+
+  startTime = std::chrono::steady_clock::now();
+
+  for (const std::string & message : messages) {
+    for (const std::string & pattern : patterns) {
+      auto equalsIgnoreCase = [](char a, char b) { return tolower(static_cast<unsigned char>(a)) == tolower(static_cast<unsigned char>(b)); };
+      
+      if (std::search(message.begin(), message.end(), pattern.begin(), pattern.end(), equalsIgnoreCase) != message.end()) {
+	hitCount++;
+	break;
+      }
+    }
+  }
+  sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  std::cout << "substring search per pattern: " << messages.size() / sec / 1e3 << " k messages/s" << std::endl;
+  
+  return 0;
+}
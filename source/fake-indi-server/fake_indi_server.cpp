@@ -0,0 +1,489 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include <algorithm>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "fake_indi_server.h"
+
+
+FakeIndiServerT::FakeIndiServerT() : listenFd_(-1), port_(-1), wakeUpFd_(-1), stop_(false), answerDelay_(0), acceptedClientCount_(0) {
+  wakeUpFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if (openListenSocket()) {
+    serverThread_ = std::thread(&FakeIndiServerT::run, this);
+  }
+}
+
+
+FakeIndiServerT::~FakeIndiServerT() {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stop_ = true;
+  }
+  wakeUp();
+
+  if (serverThread_.joinable()) {
+    serverThread_.join();
+  }
+
+  for (const ClientT & client : clients_) {
+    close(client.fd);
+  }
+  
+  if (listenFd_ >= 0) {
+    close(listenFd_);
+  }
+  
+  if (wakeUpFd_ >= 0) {
+    close(wakeUpFd_);
+  }
+}
+
+
+bool FakeIndiServerT::openListenSocket() {
+  struct sockaddr_in addr;
+  socklen_t addrLength = sizeof(addr);
+  
+  memset(& addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0; // Any free port
+
+  listenFd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+
+  if (listenFd_ < 0 || bind(listenFd_, (struct sockaddr *) & addr, sizeof(addr)) != 0 || listen(listenFd_, 16) != 0
+      || getsockname(listenFd_, (struct sockaddr *) & addr, & addrLength) != 0) {
+    return false;
+  }
+  
+  port_ = ntohs(addr.sin_port);
+  return true;
+}
+
+
+int FakeIndiServerT::getPort() const {
+  return port_;
+}
+
+
+void FakeIndiServerT::wakeUp() {
+  uint64_t one = 1;
+
+  if (write(wakeUpFd_, & one, sizeof(one)) < 0) {
+    // The event counter is already set - the server thread wakes up anyway
+  }
+}
+
+
+bool FakeIndiServerT::send(int fd, const std::string & data) {
+  size_t sent = 0;
+
+  while (sent < data.size()) {
+    ssize_t result = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+
+    if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      struct pollfd pollFd = { fd, POLLOUT, 0 };
+      poll(& pollFd, 1, 100);
+      continue;
+    }
+
+    if (result <= 0) {
+      return false;
+    }
+    sent += result;
+  }
+  return true;
+}
+
+
+std::string FakeIndiServerT::getAttribute(const std::string & element, const std::string & name) {
+  std::string key = " " + name + "=";
+  size_t pos = element.find(key);
+
+  if (pos == std::string::npos || pos + key.size() >= element.size()) {
+    return "";
+  }
+
+  char quote = element[pos + key.size()];
+  size_t valueStart = pos + key.size() + 1;
+  size_t valueEnd = element.find(quote, valueStart);
+
+  return (valueEnd == std::string::npos ? "" : element.substr(valueStart, valueEnd - valueStart));
+}
+
+
+std::string FakeIndiServerT::defineDevice(const std::string & indiDeviceName, const FakeDeviceT & device) {
+  return "<defSwitchVector device=\"" + indiDeviceName + "\" name=\"CONNECTION\" label=\"Connection\" group=\"Main Control\" state=\""
+    + (device.connected ? "Ok" : "Idle") + "\" perm=\"rw\" rule=\"OneOfMany\" timeout=\"60\">\n"
+    + "  <defSwitch name=\"CONNECT\" label=\"Connect\">" + (device.connected ? "On" : "Off") + "</defSwitch>\n"
+    + "  <defSwitch name=\"DISCONNECT\" label=\"Disconnect\">" + (device.connected ? "Off" : "On") + "</defSwitch>\n"
+    + "</defSwitchVector>\n";
+}
+
+
+std::string FakeIndiServerT::updateDevice(const std::string & indiDeviceName, const FakeDeviceT & device, const char * state) {
+  return "<setSwitchVector device=\"" + indiDeviceName + "\" name=\"CONNECTION\" state=\"" + state + "\" timeout=\"60\">\n"
+    + "  <oneSwitch name=\"CONNECT\">" + (device.connected ? "On" : "Off") + "</oneSwitch>\n"
+    + "  <oneSwitch name=\"DISCONNECT\">" + (device.connected ? "Off" : "On") + "</oneSwitch>\n"
+    + "</setSwitchVector>\n";
+}
+
+
+void FakeIndiServerT::addDevice(const std::string & indiDeviceName, bool connected) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  FakeDeviceT & device = devices_[indiDeviceName];
+
+  device.connected = connected;
+  
+  for (const ClientT & client : clients_) {
+    send(client.fd, defineDevice(indiDeviceName, device));
+  }
+}
+
+
+void FakeIndiServerT::removeDevice(const std::string & indiDeviceName) {
+  std::lock_guard<std::mutex> guard(mutex_);
+
+  if (devices_.erase(indiDeviceName) == 0) {
+    return;
+  }
+  
+  for (const ClientT & client : clients_) {
+    send(client.fd, "<delProperty device=\"" + indiDeviceName + "\"/>\n");
+  }
+}
+
+
+void FakeIndiServerT::setAnswerDelay(std::chrono::milliseconds answerDelay) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  answerDelay_ = answerDelay;
+}
+
+
+void FakeIndiServerT::setRefuseConnect(const std::string & indiDeviceName, bool refuseConnect) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  devices_[indiDeviceName].refuseConnect = refuseConnect;
+}
+
+
+void FakeIndiServerT::sendUpdate(const std::string & indiDeviceName, const char * state) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto deviceIt = devices_.find(indiDeviceName);
+
+  if (deviceIt == devices_.end()) {
+    return;
+  }
+  
+  for (const ClientT & client : clients_) {
+    send(client.fd, updateDevice(indiDeviceName, deviceIt->second, state));
+  }
+}
+
+
+void FakeIndiServerT::sendMessage(const std::string & indiDeviceName, const std::string & message) {
+  std::string escapedMessage;
+
+  for (char c : message) {
+    switch (c) {
+    case '&': escapedMessage += "&amp;"; break;
+    case '<': escapedMessage += "&lt;"; break;
+    case '>': escapedMessage += "&gt;"; break;
+    case '"': escapedMessage += "&quot;"; break;
+    default: escapedMessage += c;
+    }
+  }
+  
+  std::lock_guard<std::mutex> guard(mutex_);
+
+  for (const ClientT & client : clients_) {
+    send(client.fd, "<message device=\"" + indiDeviceName + "\" timestamp=\"2026-01-01T00:00:00\" message=\"" + escapedMessage + "\"/>\n");
+  }
+}
+
+
+void FakeIndiServerT::dropClients() {
+  std::lock_guard<std::mutex> guard(mutex_);
+
+  // The server thread closes the connections once it sees the EOF
+  for (const ClientT & client : clients_) {
+    shutdown(client.fd, SHUT_RDWR);
+  }
+}
+
+
+bool FakeIndiServerT::isConnected(const std::string & indiDeviceName) const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto deviceIt = devices_.find(indiDeviceName);
+
+  return (deviceIt != devices_.end() && deviceIt->second.connected);
+}
+
+
+unsigned long FakeIndiServerT::getConnectRequestCount(const std::string & indiDeviceName) const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto deviceIt = devices_.find(indiDeviceName);
+
+  return (deviceIt != devices_.end() ? deviceIt->second.connectRequestCount : 0);
+}
+
+
+unsigned long FakeIndiServerT::getDisconnectRequestCount(const std::string & indiDeviceName) const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto deviceIt = devices_.find(indiDeviceName);
+
+  return (deviceIt != devices_.end() ? deviceIt->second.disconnectRequestCount : 0);
+}
+
+
+unsigned long FakeIndiServerT::getAcceptedClientCount() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return acceptedClientCount_;
+}
+
+
+size_t FakeIndiServerT::getClientCount() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return clients_.size();
+}
+
+
+void FakeIndiServerT::acceptClient() {
+  int clientFd = accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+
+  if (clientFd < 0) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> guard(mutex_);
+  clients_.push_back(ClientT { clientFd, "" });
+  acceptedClientCount_++;
+}
+
+
+/**
+ * Returns false once the client closed the connection.
+ */
+bool FakeIndiServerT::receive(ClientT & client) {
+  char buffer[4096];
+
+  while (true) {
+    ssize_t result = recv(client.fd, buffer, sizeof(buffer), 0);
+
+    if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+
+    if (result <= 0) {
+      return false;
+    }
+    client.input.append(buffer, result);
+  }
+
+  // Split the input into complete top-level elements
+  while (true) {
+    size_t start = client.input.find('<');
+    
+    if (start == std::string::npos) {
+      client.input.clear();
+      break;
+    }
+    
+    size_t headEnd = client.input.find('>', start);
+
+    if (headEnd == std::string::npos) {
+      break;
+    }
+
+    size_t nameEnd = client.input.find_first_of(" \t\r\n/>", start + 1);
+    std::string name = client.input.substr(start + 1, nameEnd - start - 1);
+    size_t end;
+    
+    if (client.input[headEnd - 1] == '/') {
+      end = headEnd + 1;
+    }
+    else {
+      size_t closingTag = client.input.find("</" + name + ">", headEnd);
+
+      if (closingTag == std::string::npos) {
+	break;
+      }
+      end = closingTag + name.size() + 3;
+    }
+
+    std::string element = client.input.substr(start, end - start);
+    client.input.erase(0, end);
+
+    handleElement(client, element);
+  }
+  return true;
+}
+
+
+void FakeIndiServerT::handleElement(ClientT & client, const std::string & element) {
+  std::lock_guard<std::mutex> guard(mutex_);
+
+  if (element.compare(0, 14, "<getProperties") == 0) {
+    std::string indiDeviceName = getAttribute(element, "device");
+
+    for (const auto & deviceEntry : devices_) {
+      if (indiDeviceName.empty() || indiDeviceName == deviceEntry.first) {
+	send(client.fd, defineDevice(deviceEntry.first, deviceEntry.second));
+      }
+    }
+    return;
+  }
+
+  if (element.compare(0, 16, "<newSwitchVector") != 0 || getAttribute(element, "name") != "CONNECTION") {
+    return;
+  }
+
+  auto deviceIt = devices_.find(getAttribute(element, "device"));
+
+  if (deviceIt == devices_.end()) {
+    return;
+  }
+
+  size_t connectPos = element.find("name=\"CONNECT\"");
+  bool connect = (connectPos != std::string::npos && element.compare(element.find('>', connectPos) + 1, 2, "On") == 0);
+  FakeDeviceT & device = deviceIt->second;
+  
+  (connect ? device.connectRequestCount : device.disconnectRequestCount)++;
+
+  if (connect && device.refuseConnect) {
+    for (const ClientT & otherClient : clients_) {
+      send(otherClient.fd, updateDevice(deviceIt->first, device, "Alert"));
+    }
+    return;
+  }
+
+  if (answerDelay_.count() > 0) {
+    for (const ClientT & otherClient : clients_) {
+      send(otherClient.fd, updateDevice(deviceIt->first, device, "Busy"));
+    }
+    pendingAnswers_.push_back(PendingAnswerT { std::chrono::steady_clock::now() + answerDelay_, deviceIt->first, connect });
+    return;
+  }
+
+  device.connected = connect;
+
+  for (const ClientT & otherClient : clients_) {
+    send(otherClient.fd, updateDevice(deviceIt->first, device, "Ok"));
+  }
+}
+
+
+void FakeIndiServerT::answerDueRequests(TimePointT now) {
+  std::lock_guard<std::mutex> guard(mutex_);
+
+  for (auto pendingAnswerIt = pendingAnswers_.begin(); pendingAnswerIt != pendingAnswers_.end(); ) {
+    auto deviceIt = devices_.find(pendingAnswerIt->indiDeviceName);
+
+    if (pendingAnswerIt->dueTime > now) {
+      ++pendingAnswerIt;
+      continue;
+    }
+    
+    if (deviceIt != devices_.end()) {
+      deviceIt->second.connected = pendingAnswerIt->connect;
+      
+      for (const ClientT & client : clients_) {
+	send(client.fd, updateDevice(deviceIt->first, deviceIt->second, "Ok"));
+      }
+    }
+    pendingAnswerIt = pendingAnswers_.erase(pendingAnswerIt);
+  }
+}
+
+
+void FakeIndiServerT::run() {
+  std::vector<struct pollfd> pollFds;
+  
+  while (true) {
+    int timeoutMs = -1;
+    
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+
+      if (stop_) {
+	break;
+      }
+      
+      pollFds.assign({ { listenFd_, POLLIN, 0 }, { wakeUpFd_, POLLIN, 0 } });
+
+      for (const ClientT & client : clients_) {
+	pollFds.push_back({ client.fd, POLLIN, 0 });
+      }
+
+      for (const PendingAnswerT & pendingAnswer : pendingAnswers_) {
+	auto dueInMs = std::chrono::duration_cast<std::chrono::milliseconds>(pendingAnswer.dueTime - std::chrono::steady_clock::now()).count() + 1;
+	timeoutMs = static_cast<int>(std::max(0L, timeoutMs < 0 ? static_cast<long>(dueInMs) : std::min(static_cast<long>(timeoutMs), static_cast<long>(dueInMs))));
+      }
+    }
+
+    poll(pollFds.data(), pollFds.size(), timeoutMs);
+
+    if (pollFds[1].revents & POLLIN) {
+      uint64_t value;
+
+      if (read(wakeUpFd_, & value, sizeof(value)) < 0) {
+	// Nothing to read - woken up by a timeout
+      }
+    }
+    
+    if (pollFds[0].revents & POLLIN) {
+      acceptClient();
+    }
+
+    for (size_t pollFdIdx = 2; pollFdIdx < pollFds.size(); ++pollFdIdx) {
+      if (pollFds[pollFdIdx].revents == 0) {
+	continue;
+      }
+
+      // Only the server thread changes the list of clients
+      auto clientIt = std::find_if(clients_.begin(), clients_.end(), [& pollFds, pollFdIdx](const ClientT & client) { return client.fd == pollFds[pollFdIdx].fd; });
+
+      if (clientIt == clients_.end() || receive(*clientIt)) {
+	continue;
+      }
+
+      std::lock_guard<std::mutex> guard(mutex_);
+      close(clientIt->fd);
+      clients_.erase(clientIt);
+    }
+
+    answerDueRequests(std::chrono::steady_clock::now());
+  }
+}
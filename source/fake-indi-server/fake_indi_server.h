@@ -0,0 +1,151 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#ifndef SOURCE_FAKE_INDI_SERVER_FAKE_INDI_SERVER_H_
+#define SOURCE_FAKE_INDI_SERVER_FAKE_INDI_SERVER_H_ SOURCE_FAKE_INDI_SERVER_FAKE_INDI_SERVER_H_
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * INDI server for the tests and benchmarks. It listens on a free port of
+ * the loopback interface and speaks just enough of the INDI protocol for
+ * the watchdog: each device only has a CONNECTION switch. Connect and
+ * disconnect requests are answered like a driver does - optionally busy
+ * first and only after a delay, or refused. A device which is removed
+ * (e.g. its USB cable was pulled) disappears with a delProperty.
+ *
+ * All clients see the same devices. The server runs its own thread,
+ * all methods may be called from any thread.
+ */
+class FakeIndiServerT {
+ public:
+  typedef std::chrono::steady_clock::time_point TimePointT;
+
+ private:
+  struct FakeDeviceT {
+    bool connected;
+    bool refuseConnect;
+    unsigned long connectRequestCount;
+    unsigned long disconnectRequestCount;
+
+    FakeDeviceT() : connected(false), refuseConnect(false), connectRequestCount(0), disconnectRequestCount(0) {}
+  };
+
+  struct PendingAnswerT {
+    TimePointT dueTime;
+    std::string indiDeviceName;
+    bool connect;
+  };
+
+  struct ClientT {
+    int fd;
+    std::string input;
+  };
+  
+  int listenFd_;
+  int port_;
+  int wakeUpFd_;
+  std::thread serverThread_;
+  
+  mutable std::mutex mutex_;
+  bool stop_;
+  std::chrono::milliseconds answerDelay_;
+  std::map<std::string, FakeDeviceT> devices_;
+  std::vector<PendingAnswerT> pendingAnswers_;
+  std::vector<ClientT> clients_;
+  std::string broadcast_; // Written to all clients by the server thread
+  bool dropClients_;
+  unsigned long acceptedClientCount_;
+
+  static std::string getAttribute(const std::string & element, const std::string & name);
+  static std::string defineDevice(const std::string & indiDeviceName, const FakeDeviceT & device);
+  static std::string updateDevice(const std::string & indiDeviceName, const FakeDeviceT & device, const char * state);
+  
+  bool openListenSocket();
+  void wakeUp();
+  void run();
+  void acceptClient();
+  bool receive(ClientT & client);
+  void handleElement(ClientT & client, const std::string & element);
+  void answerDueRequests(TimePointT now);
+  static bool send(int fd, const std::string & data);
+
+  // We do not want copies
+  FakeIndiServerT(const FakeIndiServerT &);
+  FakeIndiServerT &operator=(const FakeIndiServerT &);
+
+ public:
+  FakeIndiServerT();
+  ~FakeIndiServerT();
+
+  /**
+   * The port the server listens on (-1 if the listen socket cannot be
+   * opened).
+   */
+  int getPort() const;
+
+  void addDevice(const std::string & indiDeviceName, bool connected);
+  void removeDevice(const std::string & indiDeviceName);
+
+  /**
+   * Connect and disconnect requests are answered busy at once and only
+   * after the given delay with the new state (0 = answer at once).
+   */
+  void setAnswerDelay(std::chrono::milliseconds answerDelay);
+
+  /**
+   * Connect requests of the device fail (the switch stays off, the state
+   * is Alert).
+   */
+  void setRefuseConnect(const std::string & indiDeviceName, bool refuseConnect);
+
+  /**
+   * Sends a switch update with the current state of the device without
+   * a request - e.g. a driver which repeats its state.
+   */
+  void sendUpdate(const std::string & indiDeviceName, const char * state);
+  void sendMessage(const std::string & indiDeviceName, const std::string & message);
+
+  /**
+   * Closes the connections of all clients - the server keeps listening.
+   */
+  void dropClients();
+
+  bool isConnected(const std::string & indiDeviceName) const;
+  unsigned long getConnectRequestCount(const std::string & indiDeviceName) const;
+  unsigned long getDisconnectRequestCount(const std::string & indiDeviceName) const;
+  unsigned long getAcceptedClientCount() const;
+  size_t getClientCount() const;
+};
+
+#endif /* SOURCE_FAKE_INDI_SERVER_FAKE_INDI_SERVER_H_ */
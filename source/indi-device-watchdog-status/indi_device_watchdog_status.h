@@ -0,0 +1,267 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_STATUS_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_STATUS_H_ SOURCE_INDI_DEVICE_WATCHDOG_STATUS_H_
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/**
+ * Layout of the status table which the INDI device watchdog publishes in
+ * POSIX shared memory - and a header-only reader for it.
+ *
+ * Each device has a fixed slot which is protected by a sequence lock:
+ * the writer makes the sequence odd, updates the slot and makes it even
+ * again. A reader copies the slot and retries if the sequence was odd or
+ * changed meanwhile. Hence the writer never waits for readers and reading
+ * a slot does not need any syscall once the table is mapped.
+ *
+ * Usage:
+ *
+ *   IndiDeviceWatchdogStatusReaderT reader;
+ *
+ *   if (reader.open()) {
+ *     for (uint32_t idx = 0; idx < reader.getDeviceCount(); ++idx) {
+ *       IndiDeviceWatchdogStatusRecordT record;
+ *
+ *       if (reader.readDevice(idx, record) && record.state != IndiDeviceWatchdogDeviceStateT::HEALTHY) { ... }
+ *     }
+ *   }
+ */
+
+#define INDI_DEVICE_WATCHDOG_STATUS_DEFAULT_NAME "/indi_device_watchdog"
+
+
+struct IndiDeviceWatchdogDeviceStateT {
+  typedef enum {
+    UNKNOWN,
+    HEALTHY,
+    LINUX_DEVICE_MISSING,
+    INDI_DEVICE_MISSING,
+    DISCONNECTED,
+    PAUSED,
+    QUARANTINED,
+    _Count
+  } TypeE;
+
+  static const char *asStr(const TypeE &inType) {
+    switch (inType) {
+    case UNKNOWN:
+      return "UNKNOWN";
+    case HEALTHY:
+      return "HEALTHY";
+    case LINUX_DEVICE_MISSING:
+      return "LINUX_DEVICE_MISSING";
+    case INDI_DEVICE_MISSING:
+      return "INDI_DEVICE_MISSING";
+    case DISCONNECTED:
+      return "DISCONNECTED";
+    case PAUSED:
+      return "PAUSED";
+    case QUARANTINED:
+      return "QUARANTINED";
+    default:
+      return "<?>";
+    }
+  }
+};
+
+
+namespace indi_device_watchdog_status {
+  const char Magic[8] = { 'I', 'D', 'W', 'S', 'T', 'A', 'T', '1' };
+  const uint32_t Version = 1;
+  const uint32_t MaxDevices = 64;
+  const size_t MaxNameLength = 64;
+
+  static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<int64_t>::is_always_lock_free,
+		"The status table requires lock-free atomics");
+
+  /**
+   * The names are written once before the table is published. All other
+   * fields are only accessed through the sequence lock.
+   */
+  struct alignas(64) DeviceSlotT {
+    std::atomic<uint32_t> seq;
+    char indiDeviceName[MaxNameLength];
+    char indiDriverName[MaxNameLength];
+    std::atomic<uint32_t> state;
+    std::atomic<uint32_t> driverRestartCount;
+    std::atomic<int64_t> lastChangeTimeMs;      // Wall clock (ms since the epoch) of the last state change
+    std::atomic<int64_t> connectLatencyUs;      // Duration of the last successful connect request (-1 = unknown)
+  };
+
+  struct alignas(64) HeaderT {
+    char magic[8];                              // Written last - the table is valid once it matches
+    uint32_t version;
+    uint32_t deviceCount;
+    int32_t writerPid;
+    std::atomic<uint32_t> indiServerConnected;
+    std::atomic<int64_t> heartbeatTimeMs;       // Wall clock (ms since the epoch) of the last update
+  };
+
+  struct TableT {
+    HeaderT header;
+    DeviceSlotT slots[MaxDevices];
+  };
+}
+
+
+/**
+ * Consistent copy of a device slot.
+ */
+struct IndiDeviceWatchdogStatusRecordT {
+  std::string indiDeviceName;
+  std::string indiDriverName;
+  IndiDeviceWatchdogDeviceStateT::TypeE state;
+  uint32_t driverRestartCount;
+  int64_t lastChangeTimeMs;
+  int64_t connectLatencyUs;
+
+  IndiDeviceWatchdogStatusRecordT() : state(IndiDeviceWatchdogDeviceStateT::UNKNOWN), driverRestartCount(0), lastChangeTimeMs(0), connectLatencyUs(-1) {}
+};
+
+
+class IndiDeviceWatchdogStatusReaderT {
+ private:
+  const indi_device_watchdog_status::TableT * table_;
+
+  // We do not want copies
+  IndiDeviceWatchdogStatusReaderT(const IndiDeviceWatchdogStatusReaderT &);
+  IndiDeviceWatchdogStatusReaderT &operator=(const IndiDeviceWatchdogStatusReaderT &);
+
+ public:
+  IndiDeviceWatchdogStatusReaderT() : table_(nullptr) {}
+  ~IndiDeviceWatchdogStatusReaderT() { close(); }
+
+  /**
+   * Maps the status table. Returns false if the watchdog does not run or
+   * the table has an incompatible version.
+   */
+  bool open(const std::string & name = INDI_DEVICE_WATCHDOG_STATUS_DEFAULT_NAME) {
+    close();
+
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+
+    if (fd < 0) {
+      return false;
+    }
+
+    struct stat fileStat;
+    void * mapping = MAP_FAILED;
+
+    if (fstat(fd, & fileStat) == 0 && static_cast<size_t>(fileStat.st_size) >= sizeof(indi_device_watchdog_status::TableT)) {
+      mapping = mmap(nullptr, sizeof(indi_device_watchdog_status::TableT), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+
+    if (mapping == MAP_FAILED) {
+      return false;
+    }
+
+    table_ = static_cast<const indi_device_watchdog_status::TableT *>(mapping);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    
+    if (memcmp(table_->header.magic, indi_device_watchdog_status::Magic, sizeof(indi_device_watchdog_status::Magic)) != 0
+	|| table_->header.version != indi_device_watchdog_status::Version) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+    if (table_ != nullptr) {
+      munmap(const_cast<indi_device_watchdog_status::TableT *>(table_), sizeof(indi_device_watchdog_status::TableT));
+      table_ = nullptr;
+    }
+  }
+
+  bool isOpen() const { return table_ != nullptr; }
+
+  uint32_t getDeviceCount() const { return (table_ != nullptr ? table_->header.deviceCount : 0); }
+
+  bool isIndiServerConnected() const {
+    return (table_ != nullptr && table_->header.indiServerConnected.load(std::memory_order_relaxed) != 0);
+  }
+
+  /**
+   * A heartbeat which does not advance means that the watchdog hangs or
+   * was killed.
+   */
+  int64_t getHeartbeatTimeMs() const {
+    return (table_ != nullptr ? table_->header.heartbeatTimeMs.load(std::memory_order_relaxed) : 0);
+  }
+
+  /**
+   * Returns false if the slot does not exist or if no consistent copy
+   * could be made (the writer kept updating it).
+   */
+  bool readDevice(uint32_t idx, IndiDeviceWatchdogStatusRecordT & record) const {
+    if (idx >= getDeviceCount()) {
+      return false;
+    }
+
+    const indi_device_watchdog_status::DeviceSlotT & slot = table_->slots[idx];
+
+    for (int attempt = 0; attempt < 100; ++attempt) {
+      uint32_t seqBefore = slot.seq.load(std::memory_order_acquire);
+
+      if (seqBefore & 1) {
+	continue;
+      }
+
+      uint32_t state = slot.state.load(std::memory_order_relaxed);
+      uint32_t driverRestartCount = slot.driverRestartCount.load(std::memory_order_relaxed);
+      int64_t lastChangeTimeMs = slot.lastChangeTimeMs.load(std::memory_order_relaxed);
+      int64_t connectLatencyUs = slot.connectLatencyUs.load(std::memory_order_relaxed);
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+
+      if (slot.seq.load(std::memory_order_relaxed) == seqBefore) {
+	record.indiDeviceName.assign(slot.indiDeviceName, strnlen(slot.indiDeviceName, indi_device_watchdog_status::MaxNameLength));
+	record.indiDriverName.assign(slot.indiDriverName, strnlen(slot.indiDriverName, indi_device_watchdog_status::MaxNameLength));
+	record.state = (state < IndiDeviceWatchdogDeviceStateT::_Count ? static_cast<IndiDeviceWatchdogDeviceStateT::TypeE>(state) : IndiDeviceWatchdogDeviceStateT::UNKNOWN);
+	record.driverRestartCount = driverRestartCount;
+	record.lastChangeTimeMs = lastChangeTimeMs;
+	record.connectLatencyUs = connectLatencyUs;
+	return true;
+      }
+    }
+    return false;
+  }
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_STATUS_H_ */
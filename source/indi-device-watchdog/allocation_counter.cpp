@@ -0,0 +1,74 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include <atomic>
+
+#include "allocation_counter.h"
+
+
+static std::atomic<bool> enabled(false);
+static std::atomic<uint64_t> allocationCount(0);
+static std::atomic<uint64_t> allocatedBytes(0);
+
+// Plain integers - a thread_local with a constructor could allocate itself
+static thread_local uint64_t threadAllocationCount = 0;
+static thread_local uint64_t threadAllocatedBytes = 0;
+
+
+namespace allocation_counter {
+  bool isEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+  }
+
+  void enable() {
+    enabled.store(true, std::memory_order_relaxed);
+  }
+
+  void count(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    threadAllocationCount++;
+    threadAllocatedBytes += size;
+  }
+
+  uint64_t getAllocationCount() {
+    return allocationCount.load(std::memory_order_relaxed);
+  }
+
+  uint64_t getAllocatedBytes() {
+    return allocatedBytes.load(std::memory_order_relaxed);
+  }
+
+  uint64_t getThreadAllocationCount() {
+    return threadAllocationCount;
+  }
+
+  uint64_t getThreadAllocatedBytes() {
+    return threadAllocatedBytes;
+  }
+}
@@ -0,0 +1,61 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_ALLOCATION_COUNTER_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_ALLOCATION_COUNTER_H_ SOURCE_INDI_DEVICE_WATCHDOG_ALLOCATION_COUNTER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Counts the heap allocations made through operator new - for the whole
+ * process and for the calling thread. Allocations by C libraries calling
+ * malloc() directly are not counted.
+ *
+ * Only counts if the counting operator new (counting_operator_new.cpp)
+ * is linked - by the allocation test and with OPTION_COUNT_ALLOCATIONS.
+ * Otherwise all counters stay 0.
+ *
+ * Used to check that an iteration of the decision loop does not allocate
+ * once all per-device state has been set up. The thread counters are not
+ * disturbed by the INDI client and the other threads of the watchdog.
+ */
+namespace allocation_counter {
+  bool isEnabled();
+  void enable();
+  void count(std::size_t size);
+
+  uint64_t getAllocationCount();
+  uint64_t getAllocatedBytes();
+
+  uint64_t getThreadAllocationCount();
+  uint64_t getThreadAllocatedBytes();
+}
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_ALLOCATION_COUNTER_H_ */
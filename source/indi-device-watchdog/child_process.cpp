@@ -0,0 +1,161 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#include <spawn.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <cerrno>
+#include <cstring>
+
+#include "logging.h"
+#include "child_process.h"
+
+extern char **environ;
+
+
+static const std::string & describeCommand(const std::vector<std::string> & argStrs) {
+  // For "/bin/sh -c <command> ..." the command is the interesting part
+  return (argStrs.size() >= 3 && argStrs.at(1) == "-c" ? argStrs.at(2) : argStrs.at(0));
+}
+
+
+ChildProcessT::ChildProcessT() : pid_(-1), exitCode_(-1), state_(ChildProcessStateT::NOT_STARTED), ownProcessGroup_(false) {
+}
+
+
+ChildProcessT::~ChildProcessT() {
+  // Never leave a zombie behind
+  kill();
+}
+
+
+bool ChildProcessT::startShellCommand(const std::string & command, const std::vector<std::string> & args, bool ownProcessGroup) {
+
+  std::vector<std::string> argStrs = { "/bin/sh", "-c", command, "sh" };
+  argStrs.insert(argStrs.end(), args.begin(), args.end());
+
+  return start(argStrs, ownProcessGroup);
+}
+
+
+bool ChildProcessT::start(const std::vector<std::string> & argStrs, bool ownProcessGroup) {
+
+  if (poll() == ChildProcessStateT::RUNNING) {
+    LOG(warning) << "Child process " << pid_ << " is still running - not starting '" << describeCommand(argStrs) << "'." << std::endl;
+    return false;
+  }
+
+  std::vector<char *> argv;
+  argv.reserve(argStrs.size() + 1);
+
+  for (auto & arg : argStrs) {
+    argv.push_back(const_cast<char *>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(& attr);
+
+  if (ownProcessGroup) {
+    // Process group 0 = a new one with the pid of the child
+    posix_spawnattr_setflags(& attr, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(& attr, 0);
+  }
+  
+  int rc = posix_spawn(& pid_, argv.at(0), nullptr, & attr, argv.data(), environ);
+  posix_spawnattr_destroy(& attr);
+
+  if (rc != 0) {
+    LOG(error) << "ERROR: Cannot start '" << describeCommand(argStrs) << "': " << strerror(rc) << std::endl;
+    pid_ = -1;
+    state_ = ChildProcessStateT::NOT_STARTED;
+    return false;
+  }
+
+  LOG(debug) << "Started '" << describeCommand(argStrs) << "' as process " << pid_ << "." << std::endl;
+
+  exitCode_ = -1;
+  state_ = ChildProcessStateT::RUNNING;
+  ownProcessGroup_ = ownProcessGroup;
+
+  return true;
+}
+
+
+ChildProcessStateT::TypeE ChildProcessT::poll() {
+
+  if (state_ != ChildProcessStateT::RUNNING) {
+    return state_;
+  }
+
+  int status = 0;
+  pid_t rc = waitpid(pid_, & status, WNOHANG);
+
+  if (rc == pid_) {
+    exitCode_ = (WIFEXITED(status) ? WEXITSTATUS(status) : 128 + (WIFSIGNALED(status) ? WTERMSIG(status) : 0));
+    state_ = ChildProcessStateT::EXITED;
+  }
+  else if (rc < 0 && errno == ECHILD) {
+    // Somebody else reaped the child
+    state_ = ChildProcessStateT::EXITED;
+  }
+
+  return state_;
+}
+
+
+void ChildProcessT::kill() {
+
+  if (poll() != ChildProcessStateT::RUNNING) {
+    return;
+  }
+
+  LOG(debug) << "Killing process " << pid_ << "..." << std::endl;
+
+  ::kill(ownProcessGroup_ ? -pid_ : pid_, SIGKILL);
+  
+  int status = 0;
+  waitpid(pid_, & status, 0);
+
+  exitCode_ = 128 + SIGKILL;
+  state_ = ChildProcessStateT::EXITED;
+}
+
+
+bool ChildProcessT::sendSignal(int signal) {
+  return (poll() == ChildProcessStateT::RUNNING && ::kill(pid_, signal) == 0);
+}
+
+
+pid_t ChildProcessT::getPid() const {
+  return pid_;
+}
+
+
+int ChildProcessT::getExitCode() const {
+  return exitCode_;
+}
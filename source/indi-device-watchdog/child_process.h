@@ -0,0 +1,105 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_CHILD_PROCESS_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_CHILD_PROCESS_H_ SOURCE_INDI_DEVICE_WATCHDOG_CHILD_PROCESS_H_
+
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+struct ChildProcessStateT {
+  typedef enum {
+    NOT_STARTED,
+    RUNNING,
+    EXITED,
+    _Count
+  } TypeE;
+
+  static const char *asStr(const TypeE &inType) {
+    switch (inType) {
+    case NOT_STARTED:
+      return "NOT_STARTED";
+    case RUNNING:
+      return "RUNNING";
+    case EXITED:
+      return "EXITED";
+    default:
+      return "<?>";
+    }
+  }
+};
+
+
+/**
+ * Small wrapper around a child process which is started via posix_spawn()
+ * and which is polled without blocking (waitpid() with WNOHANG). This way
+ * the watchdog loop is never blocked by a slow external command.
+ */
+class ChildProcessT {
+ private:
+  pid_t pid_;
+  int exitCode_;
+  ChildProcessStateT::TypeE state_;
+  bool ownProcessGroup_;
+
+  // We do not want copies - the child would be reaped twice
+  ChildProcessT(const ChildProcessT &);
+  ChildProcessT &operator=(const ChildProcessT &);
+
+ public:
+  ChildProcessT();
+  ~ChildProcessT();
+
+  /**
+   * Runs the given command via "/bin/sh -c". The additional arguments
+   * are available as $1, $2, ... within the command.
+   */
+  bool startShellCommand(const std::string & command, const std::vector<std::string> & args = std::vector<std::string>(), bool ownProcessGroup = false);
+
+  /**
+   * Runs the given executable (argv[0] is the path) without a shell. In
+   * its own process group the child and all processes it starts are
+   * killed together.
+   */
+  bool start(const std::vector<std::string> & argv, bool ownProcessGroup = false);
+
+  ChildProcessStateT::TypeE poll();
+
+  /**
+   * Kills the child - and its whole process group if it has its own -
+   * unless it already exited.
+   */
+  void kill();
+  bool sendSignal(int signal);
+
+  pid_t getPid() const;
+  int getExitCode() const;
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_CHILD_PROCESS_H_ */
@@ -0,0 +1,559 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#include "logging.h"
+#include "control_server.h"
+
+// Protect the server thread against misbehaving clients
+static const size_t MaxClientCount = 32;
+static const size_t MaxRequestSize = 64 * 1024;
+static const size_t MaxPendingResponseSize = 1024 * 1024;
+
+
+std::string ControlServerT::escapeJson(const std::string & str) {
+  std::string escaped;
+  escaped.reserve(str.size());
+
+  for (char c : str) {
+    switch (c) {
+    case '"': escaped += "\\\""; break;
+    case '\\': escaped += "\\\\"; break;
+    case '\n': escaped += "\\n"; break;
+    case '\r': escaped += "\\r"; break;
+    case '\t': escaped += "\\t"; break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+	char buffer[8];
+	snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+	escaped += buffer;
+      }
+      else {
+	escaped += c;
+      }
+    }
+  }
+  return escaped;
+}
+
+
+static const char * asJsonBool(bool value) {
+  return (value ? "true" : "false");
+}
+
+
+ControlServerT::ControlServerT(const std::string & socketPath, StatusProviderT statusProvider, CommandHandlerT commandHandler) : socketPath_(socketPath), statusProvider_(statusProvider), commandHandler_(commandHandler), listenFd_(-1), epollFd_(-1), stopEventFd_(-1), requestCount_(0), failedRequestCount_(0) {
+}
+
+
+ControlServerT::~ControlServerT() {
+  stop();
+}
+
+
+bool ControlServerT::start() {
+  if (serverThread_.joinable()) {
+    return true;
+  }
+  
+  if (! openSocket()) {
+    closeSocket();
+    return false;
+  }
+
+  serverThread_ = std::thread(&ControlServerT::run, this);
+
+  LOG(info) << "Control socket listening on '" << socketPath_ << "'." << std::endl;
+  
+  return true;
+}
+
+
+void ControlServerT::stop() {
+  if (stopEventFd_ >= 0) {
+    uint64_t value = 1;
+    
+    if (write(stopEventFd_, & value, sizeof(value)) < 0) {
+      LOG(error) << "Cannot stop control server: " << strerror(errno) << std::endl;
+    }
+  }
+
+  if (serverThread_.joinable()) {
+    serverThread_.join();
+  }
+
+  for (auto & clientEntry : clients_) {
+    close(clientEntry.first);
+  }
+  clients_.clear();
+  
+  closeSocket();
+}
+
+
+bool ControlServerT::openSocket() {
+  sockaddr_un addr;
+  memset(& addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+
+  if (socketPath_.size() >= sizeof(addr.sun_path)) {
+    LOG(error) << "Control socket path '" << socketPath_ << "' is too long." << std::endl;
+    return false;
+  }
+  strncpy(addr.sun_path, socketPath_.c_str(), sizeof(addr.sun_path) - 1);
+
+  // Remove a stale socket of a previous run - but nothing else
+  struct stat fileStat;
+  
+  if (lstat(socketPath_.c_str(), & fileStat) == 0) {
+    if (! S_ISSOCK(fileStat.st_mode)) {
+      LOG(error) << "Control socket path '" << socketPath_ << "' exists and is not a socket." << std::endl;
+      return false;
+    }
+    unlink(socketPath_.c_str());
+  }
+  
+  listenFd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+  if (listenFd_ < 0 || bind(listenFd_, reinterpret_cast<sockaddr *>(& addr), sizeof(addr)) != 0 || listen(listenFd_, 8) != 0) {
+    LOG(error) << "Cannot create control socket '" << socketPath_ << "': " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  chmod(socketPath_.c_str(), 0660);
+  
+  epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+  stopEventFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if (epollFd_ < 0 || stopEventFd_ < 0) {
+    LOG(error) << "Cannot create control server event loop: " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  epoll_event event;
+  memset(& event, 0, sizeof(event));
+  
+  event.events = EPOLLIN;
+  event.data.fd = listenFd_;
+  epoll_ctl(epollFd_, EPOLL_CTL_ADD, listenFd_, & event);
+
+  event.data.fd = stopEventFd_;
+  epoll_ctl(epollFd_, EPOLL_CTL_ADD, stopEventFd_, & event);
+
+  return true;
+}
+
+
+void ControlServerT::closeSocket() {
+  if (listenFd_ >= 0) {
+    close(listenFd_);
+    listenFd_ = -1;
+    unlink(socketPath_.c_str());
+  }
+
+  if (epollFd_ >= 0) {
+    close(epollFd_);
+    epollFd_ = -1;
+  }
+
+  if (stopEventFd_ >= 0) {
+    close(stopEventFd_);
+    stopEventFd_ = -1;
+  }
+}
+
+
+void ControlServerT::run() {
+  epoll_event events[16];
+
+  while (true) {
+    int eventCount = epoll_wait(epollFd_, events, sizeof(events) / sizeof(events[0]), -1);
+
+    if (eventCount < 0) {
+      if (errno == EINTR) {
+	continue;
+      }
+      LOG(error) << "Control server event loop failed: " << strerror(errno) << std::endl;
+      return;
+    }
+
+    for (int eventIdx = 0; eventIdx < eventCount; ++eventIdx) {
+      int fd = events[eventIdx].data.fd;
+      uint32_t flags = events[eventIdx].events;
+      
+      if (fd == stopEventFd_) {
+	return;
+      }
+
+      if (fd == listenFd_) {
+	acceptClients();
+	continue;
+      }
+
+      auto clientIt = clients_.find(fd);
+
+      if (clientIt == clients_.end()) {
+	continue;
+      }
+
+      bool keepOpen = true;
+
+      if (! clientIt->second.readClosed && (flags & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+	keepOpen = readFromClient(clientIt->second);
+      }
+      else if (flags & (EPOLLHUP | EPOLLERR)) {
+	// The pending output cannot be delivered anymore
+	keepOpen = false;
+      }
+
+      if (keepOpen && (flags & EPOLLOUT)) {
+	keepOpen = writeToClient(clientIt->second);
+      }
+
+      if (! keepOpen) {
+	closeClient(fd);
+      }
+    }
+  }
+}
+
+
+void ControlServerT::acceptClients() {
+  while (true) {
+    int fd = accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+	LOG(error) << "Cannot accept control client: " << strerror(errno) << std::endl;
+      }
+      return;
+    }
+
+    if (clients_.size() >= MaxClientCount) {
+      LOG(warning) << "Too many control clients - rejecting connection." << std::endl;
+      close(fd);
+      continue;
+    }
+
+    epoll_event event;
+    memset(& event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, & event) != 0) {
+      close(fd);
+      continue;
+    }
+
+    clients_[fd].fd = fd;
+    clients_[fd].events = event.events;
+  }
+}
+
+
+/**
+ * Returns false if the client should be closed.
+ */
+bool ControlServerT::readFromClient(ClientT & client) {
+  char buffer[4096];
+
+  while (true) {
+    ssize_t n = read(client.fd, buffer, sizeof(buffer));
+
+    if (n > 0) {
+      client.inBuffer.append(buffer, n);
+
+      // Per chunk - otherwise a fast client is buffered beyond the limits
+      if (! handleRequests(client)) {
+	return false;
+      }
+      continue;
+    }
+    if (n == 0) {
+      // Only the pending output is written from now on
+      client.readClosed = true;
+      break;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      break;
+    }
+    if (errno != EINTR) {
+      return false;
+    }
+  }
+
+  return writeToClient(client) && ! (client.readClosed && client.outBuffer.empty());
+}
+
+
+/**
+ * Handles the complete requests of the input buffer. Returns false if
+ * the client exceeded the buffer limits.
+ */
+bool ControlServerT::handleRequests(ClientT & client) {
+  size_t lineEnd;
+  
+  while ((lineEnd = client.inBuffer.find('\n')) != std::string::npos) {
+    std::string request = client.inBuffer.substr(0, lineEnd);
+    client.inBuffer.erase(0, lineEnd + 1);
+
+    if (request.find_first_not_of(" \t\r") == std::string::npos) {
+      continue;
+    }
+
+    client.outBuffer += handleRequest(request);
+    client.outBuffer += '\n';
+  }
+
+  if (client.inBuffer.size() > MaxRequestSize || client.outBuffer.size() > MaxPendingResponseSize) {
+    LOG(warning) << "Control client exceeded the buffer limits - closing connection." << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+
+/**
+ * Returns false if the client should be closed.
+ */
+bool ControlServerT::writeToClient(ClientT & client) {
+  while (! client.outBuffer.empty()) {
+    ssize_t n = send(client.fd, client.outBuffer.data(), client.outBuffer.size(), MSG_NOSIGNAL);
+
+    if (n > 0) {
+      client.outBuffer.erase(0, n);
+      continue;
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    return false;
+  }
+
+  // Only wait for the socket to become writable while output is pending.
+  // Once the client closed its side, EPOLLIN would report the end of the
+  // stream again and again.
+  uint32_t events = 0;
+
+  if (! client.readClosed) {
+    events |= EPOLLIN;
+  }
+  if (! client.outBuffer.empty()) {
+    events |= EPOLLOUT;
+  }
+
+  if (events != client.events) {
+    epoll_event event;
+    memset(& event, 0, sizeof(event));
+    event.events = events;
+    event.data.fd = client.fd;
+
+    epoll_ctl(epollFd_, EPOLL_CTL_MOD, client.fd, & event);
+    client.events = events;
+  }
+  
+  return true;
+}
+
+
+void ControlServerT::closeClient(int fd) {
+  epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+  close(fd);
+  clients_.erase(fd);
+}
+
+
+std::string ControlServerT::handleRequest(const std::string & request) {
+  requestCount_++;
+  
+  boost::property_tree::ptree requestTree;
+  std::istringstream requestStream(request);
+
+  try {
+    boost::property_tree::read_json(requestStream, requestTree);
+  } catch (boost::property_tree::json_parser::json_parser_error & exc) {
+    failedRequestCount_++;
+    return renderError(std::string("Invalid JSON: ") + exc.message());
+  }
+
+  std::string commandName = requestTree.get<std::string>("command", "");
+  ControlCommandT command;
+
+  if (commandName == "health") {
+    return renderHealth(statusProvider_().get());
+  }
+  else if (commandName == "status") {
+    return renderStatus(statusProvider_().get());
+  }
+  else if (commandName == "restart") {
+    command.type = ControlCommandT::TypeT::RESTART_DRIVER;
+  }
+  else if (commandName == "pause") {
+    command.type = ControlCommandT::TypeT::PAUSE;
+  }
+  else if (commandName == "resume") {
+    command.type = ControlCommandT::TypeT::RESUME;
+  }
+  else if (commandName == "resetCounters") {
+    command.type = ControlCommandT::TypeT::RESET_COUNTERS;
+  }
+  else {
+    failedRequestCount_++;
+    return renderError("Unknown command '" + commandName + "'.");
+  }
+
+  command.indiDeviceName = requestTree.get<std::string>("device", "");
+  command.indiDriverName = requestTree.get<std::string>("driver", "");
+  
+  std::string errorMsg = commandHandler_(command);
+
+  if (! errorMsg.empty()) {
+    failedRequestCount_++;
+    return renderError(errorMsg);
+  }
+  
+  return "{\"ok\":true}";
+}
+
+
+std::string ControlServerT::renderHealth(const WatchdogStatusT * status) {
+  std::ostringstream ss;
+
+  if (status == nullptr) {
+    return "{\"ok\":true,\"healthy\":false,\"connected\":false,\"cycle\":0,\"ageMs\":-1}";
+  }
+
+  auto age = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - status->time);
+  
+  ss << "{\"ok\":true,\"healthy\":" << asJsonBool(status->healthy)
+     << ",\"connected\":" << asJsonBool(status->indiServerConnected)
+     << ",\"cycle\":" << status->cycleCount
+     << ",\"ageMs\":" << age.count() << "}";
+
+  return ss.str();
+}
+
+
+std::string ControlServerT::renderStatus(const WatchdogStatusT * status) {
+  std::string health = renderHealth(status);
+  std::ostringstream ss;
+
+  // Extend the health object by the details
+  ss << health.substr(0, health.size() - 1);
+
+  if (status != nullptr) {
+    const HookExecutorStatsT & hookStats = status->hookStats;
+    
+    ss << ",\"reconnects\":" << status->reconnectCount
+       << ",\"driverReplayFailures\":" << status->driverReplayFailureCount
+       << ",\"hooks\":{\"queueDepth\":" << hookStats.queueDepth
+       << ",\"maxQueueDepth\":" << hookStats.maxQueueDepth
+       << ",\"executed\":" << hookStats.executedCount
+       << ",\"failed\":" << hookStats.failedCount
+       << ",\"coalesced\":" << hookStats.coalescedCount
+       << ",\"dropped\":" << hookStats.droppedCount
+       << ",\"latencyP50Us\":" << hookStats.latencyP50.count()
+       << ",\"latencyP99Us\":" << hookStats.latencyP99.count() << "}"
+       << ",\"self\":{\"rssKb\":" << status->selfStats.rssKb
+       << ",\"heapInUseKb\":" << status->selfStats.heapInUseKb
+       << ",\"threads\":" << status->selfStats.threadCount
+       << ",\"fds\":" << status->selfStats.fdCount << "}"
+       << ",\"devices\":[";
+
+    for (size_t idx = 0; idx < status->devices.size(); ++idx) {
+      const DeviceStatusT & device = status->devices[idx];
+      
+      ss << (idx > 0 ? "," : "")
+	 << "{\"device\":\"" << escapeJson(device.indiDeviceName) << "\""
+	 << ",\"driver\":\"" << escapeJson(device.indiDriverName) << "\""
+	 << ",\"linuxDeviceExists\":" << asJsonBool(device.linuxDeviceExists)
+	 << ",\"indiDeviceExists\":" << asJsonBool(device.indiDeviceExists)
+	 << ",\"indiDeviceConnected\":" << asJsonBool(device.indiDeviceConnected)
+	 << ",\"healthy\":" << asJsonBool(device.healthy)
+	 << ",\"paused\":" << asJsonBool(device.paused)
+	 << ",\"quarantined\":" << asJsonBool(device.quarantined)
+	 << ",\"presenceChanges\":" << device.presenceChangeCount
+	 << ",\"driverRestarts\":" << device.driverRestartCount
+	 << ",\"breakerOpen\":" << asJsonBool(device.breakerOpen)
+	 << ",\"connectLatencyUs\":" << device.connectLatencyUs
+	 << ",\"sloViolations\":" << device.sloViolationCount
+	 << ",\"plugInToConnectedP50Ms\":" << device.plugInToConnectedP50Ms
+	 << ",\"plugInToConnectedP99Ms\":" << device.plugInToConnectedP99Ms
+	 << ",\"busy\":" << asJsonBool(device.busy)
+	 << ",\"actionDeferred\":" << asJsonBool(device.actionDeferred)
+	 << ",\"deferredActions\":" << device.deferredActionCount
+	 << ",\"framesSaved\":" << device.framesSaved
+	 << ",\"staleProperty\":\"" << escapeJson(device.staleProperty) << "\""
+	 << ",\"driverPid\":" << device.driverProcess.pid
+	 << ",\"driverState\":\"" << escapeJson(std::string(1, device.driverProcess.state)) << "\""
+	 << ",\"driverCpuPercent\":" << device.driverProcess.cpuPercent
+	 << ",\"driverRssKb\":" << device.driverProcess.rssKb
+	 << ",\"driverFds\":" << device.driverProcess.fdCount
+	 << ",\"driverThreads\":" << device.driverProcess.threadCount
+	 << ",\"preemptiveRestarts\":" << device.preemptiveRestartCount
+	 << ",\"failedMessagePattern\":\"" << escapeJson(device.failedMessagePattern) << "\""
+	 << ",\"failureMessages\":" << device.failureMessageCount << "}";
+    }
+    ss << "]";
+  }
+  
+  ss << "}";
+  
+  return ss.str();
+}
+
+
+std::string ControlServerT::renderError(const std::string & errorMsg) {
+  return "{\"ok\":false,\"error\":\"" + escapeJson(errorMsg) + "\"}";
+}
+
+
+unsigned long ControlServerT::getRequestCount() const {
+  return requestCount_;
+}
+
+
+unsigned long ControlServerT::getFailedRequestCount() const {
+  return failedRequestCount_;
+}
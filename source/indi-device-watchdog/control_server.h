@@ -0,0 +1,121 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_CONTROL_SERVER_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_CONTROL_SERVER_H_ SOURCE_INDI_DEVICE_WATCHDOG_CONTROL_SERVER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "watchdog_status.h"
+
+/**
+ * Local control and status API on a Unix domain socket. Requests and
+ * responses are newline delimited JSON objects, e.g.
+ *
+ *   {"command": "health"}
+ *   {"command": "status"}
+ *   {"command": "restart", "driver": "indi_asi_ccd"}   (or "device": ...)
+ *   {"command": "pause", "device": "ZWO CCD ASI1600MM Pro"}  (no device = all)
+ *   {"command": "resume", "device": "ZWO CCD ASI1600MM Pro"}
+ *   {"command": "resetCounters"}
+ *
+ * All clients are served by a single thread with a non-blocking epoll
+ * loop. Status requests are answered from the last published status
+ * snapshot - they never wait for the decision loop. Commands are only
+ * validated and queued by the command handler.
+ */
+class ControlServerT {
+ public:
+  typedef std::function<std::shared_ptr<const WatchdogStatusT>()> StatusProviderT;
+  typedef std::function<std::string(const ControlCommandT & command)> CommandHandlerT; // Returns an error message (empty = accepted)
+
+ private:
+  struct ClientT {
+    int fd;
+    std::string inBuffer;
+    std::string outBuffer;
+    uint32_t events; // Registered with epoll
+    bool readClosed; // The client shut down its side of the connection
+
+    ClientT() : fd(-1), events(0), readClosed(false) {}
+  };
+
+  std::string socketPath_;
+  StatusProviderT statusProvider_;
+  CommandHandlerT commandHandler_;
+
+  int listenFd_;
+  int epollFd_;
+  int stopEventFd_;
+  std::map<int /*fd*/, ClientT> clients_; // Only accessed by the server thread
+  std::thread serverThread_;
+
+  std::atomic<unsigned long> requestCount_;
+  std::atomic<unsigned long> failedRequestCount_;
+  
+  bool openSocket();
+  void closeSocket();
+  void run();
+  void acceptClients();
+  bool readFromClient(ClientT & client);
+  bool handleRequests(ClientT & client);
+  bool writeToClient(ClientT & client);
+  void closeClient(int fd);
+  std::string handleRequest(const std::string & request);
+
+  static std::string renderHealth(const WatchdogStatusT * status);
+  static std::string renderStatus(const WatchdogStatusT * status);
+  static std::string renderError(const std::string & errorMsg);
+
+  // We do not want copies
+  ControlServerT(const ControlServerT &);
+  ControlServerT &operator=(const ControlServerT &);
+  
+ public:
+  ControlServerT(const std::string & socketPath, StatusProviderT statusProvider, CommandHandlerT commandHandler);
+  ~ControlServerT();
+
+  /**
+   * Returns false if the socket cannot be created.
+   */
+  bool start();
+  void stop();
+
+  unsigned long getRequestCount() const;
+  unsigned long getFailedRequestCount() const;
+
+  static std::string escapeJson(const std::string & str);
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_CONTROL_SERVER_H_ */
@@ -0,0 +1,98 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#include <cstdlib>
+#include <new>
+
+#include "allocation_counter.h"
+
+
+/**
+ * Replaces the global operator new and delete to feed the allocation
+ * counter. Not part of the core library - only linked into the
+ * allocation test and, with OPTION_COUNT_ALLOCATIONS, into the watchdog.
+ */
+struct EnableAllocationCounterT {
+  EnableAllocationCounterT() {
+    allocation_counter::enable();
+  }
+};
+
+static EnableAllocationCounterT enableAllocationCounter;
+
+
+static void * countedAllocate(std::size_t size) {
+  allocation_counter::count(size);
+
+  void * ptr = std::malloc(size > 0 ? size : 1);
+
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+
+void * operator new(std::size_t size) {
+  return countedAllocate(size);
+}
+
+void * operator new[](std::size_t size) {
+  return countedAllocate(size);
+}
+
+void * operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  try {
+    return countedAllocate(size);
+  } catch (std::bad_alloc &) {
+    return nullptr;
+  }
+}
+
+void * operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  try {
+    return countedAllocate(size);
+  } catch (std::bad_alloc &) {
+    return nullptr;
+  }
+}
+
+void operator delete(void * ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void * ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void * ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void * ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
@@ -0,0 +1,72 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+
+#include "cycle_latency_stats.h"
+
+
+CycleLatencyStatsT::CycleLatencyStatsT(size_t capacity) : nextSample_(0), sampleCount_(0) {
+  samples_.reserve(std::max<size_t>(capacity, 1));
+  sortedSamples_.reserve(samples_.capacity());
+}
+
+
+void CycleLatencyStatsT::record(std::chrono::microseconds latency) {
+  if (samples_.size() < samples_.capacity()) {
+    samples_.push_back(latency);
+  }
+  else {
+    samples_[nextSample_] = latency;
+    nextSample_ = (nextSample_ + 1) % samples_.size();
+  }
+  
+  sampleCount_++;
+}
+
+
+std::chrono::microseconds CycleLatencyStatsT::getPercentile(double percentile) const {
+  if (samples_.empty()) {
+    return std::chrono::microseconds(0);
+  }
+
+  std::vector<std::chrono::microseconds> & sortedSamples = sortedSamples_;
+  sortedSamples.assign(samples_.begin(), samples_.end());
+  double clampedPercentile = std::min(std::max(percentile, 0.0), 100.0);
+  size_t idx = static_cast<size_t>(std::ceil(clampedPercentile / 100.0 * sortedSamples.size()));
+  idx = (idx > 0 ? idx - 1 : 0);
+  
+  std::nth_element(sortedSamples.begin(), sortedSamples.begin() + idx, sortedSamples.end());
+
+  return sortedSamples[idx];
+}
+
+
+unsigned long CycleLatencyStatsT::getSampleCount() const {
+  return sampleCount_;
+}
@@ -0,0 +1,60 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_CYCLE_LATENCY_STATS_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_CYCLE_LATENCY_STATS_H_ SOURCE_INDI_DEVICE_WATCHDOG_CYCLE_LATENCY_STATS_H_
+
+#include <chrono>
+#include <vector>
+
+/**
+ * Keeps the latencies of the most recent watchdog cycles (fixed size
+ * ring buffer) and calculates percentiles from them.
+ */
+class CycleLatencyStatsT {
+ private:
+  std::vector<std::chrono::microseconds> samples_;
+  mutable std::vector<std::chrono::microseconds> sortedSamples_; // Scratch buffer of getPercentile()
+  size_t nextSample_;
+  unsigned long sampleCount_;
+
+ public:
+  explicit CycleLatencyStatsT(size_t capacity = 1024);
+
+  void record(std::chrono::microseconds latency);
+
+  /**
+   * Returns the given percentile (0..100) of the recorded latencies.
+   * Does not allocate - but must not be called by several threads at
+   * once.
+   */
+  std::chrono::microseconds getPercentile(double percentile) const;
+
+  unsigned long getSampleCount() const;
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_CYCLE_LATENCY_STATS_H_ */
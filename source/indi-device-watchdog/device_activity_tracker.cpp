@@ -0,0 +1,140 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include <cstring>
+
+#include "device_activity_tracker.h"
+
+
+struct ActivityPropertyT {
+  const char * name;
+  bool exposure; // Counts frames
+};
+
+// Standard INDI properties which are busy while the device is working
+static const ActivityPropertyT activityProperties[] = {
+  { "CCD_EXPOSURE", true },
+  { "GUIDER_EXPOSURE", false },
+  { "CCD_VIDEO_STREAM", false },
+  { "EQUATORIAL_EOD_COORD", false },
+  { "HORIZONTAL_COORD", false },
+  { "TELESCOPE_MOTION_NS", false },
+  { "TELESCOPE_MOTION_WE", false },
+  { "TELESCOPE_PARK", false },
+  { "ABS_FOCUS_POSITION", false },
+  { "REL_FOCUS_POSITION", false },
+  { "FOCUS_TIMER", false },
+  { "ABS_ROTATOR_ANGLE", false },
+  { "FILTER_SLOT", false },
+  { "ABS_DOME_POSITION", false },
+  { "DOME_MOTION", false },
+  { "DOME_SHUTTER", false }
+};
+
+static const int activityPropertyCount = sizeof(activityProperties) / sizeof(activityProperties[0]);
+
+
+int DeviceActivityTrackerT::getActivityPropertyIdx(const char * propertyName) {
+  for (int idx = 0; idx < activityPropertyCount; ++idx) {
+    if (strcmp(activityProperties[idx].name, propertyName) == 0) {
+      return idx;
+    }
+  }
+  return -1;
+}
+
+
+bool DeviceActivityTrackerT::isActivityProperty(const char * propertyName) {
+  return (propertyName != nullptr && getActivityPropertyIdx(propertyName) >= 0);
+}
+
+
+void DeviceActivityTrackerT::update(const std::string & indiDeviceName, const char * propertyName, IPState propertyState, std::chrono::steady_clock::time_point now) {
+  int idx = getActivityPropertyIdx(propertyName);
+
+  if (idx < 0) {
+    return;
+  }
+
+  bool busy = (propertyState == IPS_BUSY);
+  uint32_t propertyBit = (1U << idx);
+  std::lock_guard<std::mutex> guard(mutex_);
+  ActivityStateT & state = devices_[indiDeviceName];
+  bool wasBusy = ((state.busyProperties & propertyBit) != 0);
+
+  if (busy && state.busyProperties == 0) {
+    state.busySince = now;
+  }
+  
+  if (busy) {
+    state.busyProperties |= propertyBit;
+  }
+  else {
+    state.busyProperties &= ~propertyBit;
+
+    // An aborted or failed exposure ends with alert
+    if (wasBusy && propertyState == IPS_OK && activityProperties[idx].exposure) {
+      state.completedExposureCount++;
+    }
+  }
+}
+
+
+void DeviceActivityTrackerT::reset(const std::string & indiDeviceName) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto stateIt = devices_.find(indiDeviceName);
+
+  if (stateIt != devices_.end()) {
+    stateIt->second.busyProperties = 0;
+  }
+}
+
+
+bool DeviceActivityTrackerT::getActivity(const std::string & indiDeviceName, DeviceActivityT & activity) const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto stateIt = devices_.find(indiDeviceName);
+
+  if (stateIt == devices_.end()) {
+    return false;
+  }
+
+  const ActivityStateT & state = stateIt->second;
+  
+  activity.busy = (state.busyProperties != 0);
+  activity.busyPropertyName = nullptr;
+  activity.busySince = state.busySince;
+  activity.completedExposureCount = state.completedExposureCount;
+
+  for (int idx = 0; idx < activityPropertyCount && activity.busy; ++idx) {
+    if ((state.busyProperties & (1U << idx)) != 0) {
+      activity.busyPropertyName = activityProperties[idx].name;
+      break;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,95 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_DEVICE_ACTIVITY_TRACKER_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_DEVICE_ACTIVITY_TRACKER_H_ SOURCE_INDI_DEVICE_WATCHDOG_DEVICE_ACTIVITY_TRACKER_H_
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "indiapi.h"
+
+
+struct DeviceActivityT {
+  bool busy;
+  const char * busyPropertyName; // The first busy activity property (nullptr if idle)
+  std::chrono::steady_clock::time_point busySince;
+  unsigned long completedExposureCount; // CCD_EXPOSURE went from busy to ok
+
+  DeviceActivityT() : busy(false), busyPropertyName(nullptr), completedExposureCount(0) {}
+};
+
+
+/**
+ * Tracks whether an INDI device is in the middle of something which a
+ * driver restart or a CONNECTION toggle would throw away - an exposure, a
+ * slew, a focuser or filter wheel move. A device is busy as long as one
+ * of its activity properties (e.g. CCD_EXPOSURE) has the state busy.
+ *
+ * Updated by the INDI client thread, read by the decision loop.
+ */
+class DeviceActivityTrackerT {
+ private:
+  struct ActivityStateT {
+    uint32_t busyProperties; // Bit per index into the activity property table
+    std::chrono::steady_clock::time_point busySince;
+    unsigned long completedExposureCount;
+
+    ActivityStateT() : busyProperties(0), completedExposureCount(0) {}
+  };
+
+  std::map<std::string /*INDI device name*/, ActivityStateT> devices_;
+  mutable std::mutex mutex_;
+
+  static int getActivityPropertyIdx(const char * propertyName);
+
+ public:
+  static bool isActivityProperty(const char * propertyName);
+  
+  /**
+   * Called with each update of an activity property.
+   */
+  void update(const std::string & indiDeviceName, const char * propertyName, IPState propertyState, std::chrono::steady_clock::time_point now);
+
+  /**
+   * The device was disconnected or went away - its activity is over. The
+   * completed exposures are kept.
+   */
+  void reset(const std::string & indiDeviceName);
+
+  /**
+   * Returns false if nothing is known about the device.
+   */
+  bool getActivity(const std::string & indiDeviceName, DeviceActivityT & activity) const;
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_DEVICE_ACTIVITY_TRACKER_H_ */
@@ -28,18 +28,18 @@
 
 #include "device_data.h"
 
-DeviceDataT::DeviceDataT() {
+DeviceDataT::DeviceDataT() : recoveryStepConfigs_(RecoveryLadderT::getDefaultStepConfigs()), recoveryLadder_(std::make_shared<RecoveryLadderT>()), recoverySlo_(30000), maxActionDeferral_(600000) {
   
 }
 
-DeviceDataT::DeviceDataT(const std::string & indiDeviceName, const std::string & linuxDeviceName, const std::string & indiDeviceDriverName, bool enableAutoConnect) {
+DeviceDataT::DeviceDataT(const std::string & indiDeviceName, const std::string & linuxDeviceName, const std::string & indiDeviceDriverName, bool enableAutoConnect) : recoveryStepConfigs_(RecoveryLadderT::getDefaultStepConfigs()), recoveryLadder_(std::make_shared<RecoveryLadderT>()), recoverySlo_(30000), maxActionDeferral_(600000) {
   indiDeviceName_ = indiDeviceName;
   linuxDeviceName_ = linuxDeviceName;
   indiDeviceDriverName_ = indiDeviceDriverName;
   enableAutoConnect_ = enableAutoConnect;
 }
 
-std::string DeviceDataT::getLinuxDeviceName() const {
+const std::string & DeviceDataT::getLinuxDeviceName() const {
   return linuxDeviceName_; 
 }
 
@@ -47,7 +47,7 @@ void DeviceDataT::setLinuxDeviceName(const std::string linuxDeviceName) {
   linuxDeviceName_ = linuxDeviceName;
 }
 
-std::string DeviceDataT::getIndiDeviceName() const {
+const std::string & DeviceDataT::getIndiDeviceName() const {
   return indiDeviceName_;
 }
 
@@ -55,7 +55,7 @@ void DeviceDataT::setIndiDeviceName(std::string indiDeviceName) {
   indiDeviceName_ = indiDeviceName;
 }
 
-std::string DeviceDataT::getIndiDeviceDriverName() const {
+const std::string & DeviceDataT::getIndiDeviceDriverName() const {
   return indiDeviceDriverName_;
 }
 
@@ -78,6 +78,62 @@ void DeviceDataT::setEnableAutoConnect(bool enableAutoConnect) {
   enableAutoConnect_ = enableAutoConnect;
 }
 
+const std::vector<RecoveryStepConfigT> & DeviceDataT::getRecoveryStepConfigs() const {
+  return recoveryStepConfigs_;
+}
+
+void DeviceDataT::setRecoveryStepConfigs(const std::vector<RecoveryStepConfigT> & recoveryStepConfigs) {
+  recoveryStepConfigs_ = recoveryStepConfigs;
+}
+
+const std::vector<std::string> & DeviceDataT::getDependsOn() const {
+  return dependsOn_;
+}
+
+void DeviceDataT::setDependsOn(const std::vector<std::string> & dependsOn) {
+  dependsOn_ = dependsOn;
+}
+
+std::chrono::milliseconds DeviceDataT::getRecoverySlo() const {
+  return recoverySlo_;
+}
+
+void DeviceDataT::setRecoverySlo(std::chrono::milliseconds recoverySlo) {
+  recoverySlo_ = recoverySlo;
+}
+
+const std::vector<std::string> & DeviceDataT::getCoupledTo() const {
+  return coupledTo_;
+}
+
+void DeviceDataT::setCoupledTo(const std::vector<std::string> & coupledTo) {
+  coupledTo_ = coupledTo;
+}
+
+std::chrono::milliseconds DeviceDataT::getMaxActionDeferral() const {
+  return maxActionDeferral_;
+}
+
+void DeviceDataT::setMaxActionDeferral(std::chrono::milliseconds maxActionDeferral) {
+  maxActionDeferral_ = maxActionDeferral;
+}
+
+const std::vector<LivenessPropertyConfigT> & DeviceDataT::getLivenessProperties() const {
+  return livenessProperties_;
+}
+
+void DeviceDataT::setLivenessProperties(const std::vector<LivenessPropertyConfigT> & livenessProperties) {
+  livenessProperties_ = livenessProperties;
+}
+
+RecoveryLadderT & DeviceDataT::getRecoveryLadder() {
+  return *recoveryLadder_;
+}
+
+void DeviceDataT::setRecoveryLadder(std::shared_ptr<RecoveryLadderT> recoveryLadder) {
+  recoveryLadder_ = recoveryLadder;
+}
+
 std::ostream &
 DeviceDataT::print(std::ostream &os) const {
 
@@ -89,6 +145,32 @@ DeviceDataT::print(std::ostream &os) const {
      << ", INDI driver: " << indiDeviceDriverName_
      << ", INDI device: " << (indiDeviceName != nullptr ? indiDeviceName : "NOT SET");
 
+  if (! dependsOn_.empty()) {
+    os << ", depends on: ";
+    
+    for (size_t idx = 0; idx < dependsOn_.size(); ++idx) {
+      os << (idx > 0 ? ", " : "") << dependsOn_[idx];
+    }
+  }
+  
+  if (! coupledTo_.empty()) {
+    os << ", coupled to: ";
+    
+    for (size_t idx = 0; idx < coupledTo_.size(); ++idx) {
+      os << (idx > 0 ? ", " : "") << coupledTo_[idx];
+    }
+  }
+  
+  if (! livenessProperties_.empty()) {
+    os << ", liveness properties: ";
+    
+    for (size_t idx = 0; idx < livenessProperties_.size(); ++idx) {
+      os << (idx > 0 ? ", " : "") << livenessProperties_[idx].propertyName;
+    }
+  }
+  
+  os << ", recovery step: " << (recoveryLadder_->isActive() ? RecoveryActionTypeT::asStr(recoveryLadder_->getCurrentAction()->getType()) : "none");
+
   return os;
 }
 
@@ -28,11 +28,17 @@
 #ifndef SOURCE_INDI_AUTO_CONNECTOR_DEVICE_DATA_H_
 #define SOURCE_INDI_AUTO_CONNECTOR_DEVICE_DATA_H_ SOURCE_INDI_AUTO_CONNECTOR_DEVICE_DATA_H_
 
+#include <chrono>
 #include <string>
 #include <memory>
+#include <vector>
 
 #include "basedevice.h"
 
+#include "recovery_action.h"
+#include "recovery_ladder.h"
+#include "property_liveness_monitor.h"
+
 class DeviceDataT {
  private:
   std::string indiDeviceName_;
@@ -40,18 +46,25 @@ class DeviceDataT {
   std::string indiDeviceDriverName_;
   INDI::BaseDevice indiBaseDevice_;
   bool enableAutoConnect_;
+  std::vector<RecoveryStepConfigT> recoveryStepConfigs_;
+  std::shared_ptr<RecoveryLadderT> recoveryLadder_;
+  std::vector<std::string> dependsOn_; // INDI device names which have to be connected first
+  std::chrono::milliseconds recoverySlo_; // Max. time from plug-in to CONNECTION=ON (0 = no SLO)
+  std::vector<std::string> coupledTo_; // INDI device names whose exposures or moves a recovery of this device would disturb
+  std::chrono::milliseconds maxActionDeferral_; // Max. time a recovery waits for busy coupled devices
+  std::vector<LivenessPropertyConfigT> livenessProperties_; // Properties a healthy driver keeps updating
   
  public:
   DeviceDataT();
   DeviceDataT(const std::string & indiDeviceName, const std::string & linuxDeviceName, const std::string & indiDeviceDriverName, bool enableAutoConnect);
 
-  std::string getIndiDeviceName() const;
+  const std::string & getIndiDeviceName() const;
   void setIndiDeviceName(std::string indiDeviceName);
 
-  std::string getLinuxDeviceName() const;
+  const std::string & getLinuxDeviceName() const;
   void setLinuxDeviceName(const std::string linuxDeviceName);
 
-  std::string getIndiDeviceDriverName() const;
+  const std::string & getIndiDeviceDriverName() const;
   void setIndiDeviceDriverName(const std::string indiDeviceDriverName);
 
   INDI::BaseDevice getIndiBaseDevice() const;
@@ -60,6 +73,27 @@ class DeviceDataT {
   bool getEnableAutoConnect() const;
   void setEnableAutoConnect(bool enableAutoConnect);
 
+  const std::vector<RecoveryStepConfigT> & getRecoveryStepConfigs() const;
+  void setRecoveryStepConfigs(const std::vector<RecoveryStepConfigT> & recoveryStepConfigs);
+
+  const std::vector<std::string> & getDependsOn() const;
+  void setDependsOn(const std::vector<std::string> & dependsOn);
+
+  std::chrono::milliseconds getRecoverySlo() const;
+  void setRecoverySlo(std::chrono::milliseconds recoverySlo);
+
+  const std::vector<std::string> & getCoupledTo() const;
+  void setCoupledTo(const std::vector<std::string> & coupledTo);
+
+  std::chrono::milliseconds getMaxActionDeferral() const;
+  void setMaxActionDeferral(std::chrono::milliseconds maxActionDeferral);
+
+  const std::vector<LivenessPropertyConfigT> & getLivenessProperties() const;
+  void setLivenessProperties(const std::vector<LivenessPropertyConfigT> & livenessProperties);
+
+  RecoveryLadderT & getRecoveryLadder();
+  void setRecoveryLadder(std::shared_ptr<RecoveryLadderT> recoveryLadder);
+
   std::ostream &print(std::ostream &os) const;
 
   friend std::ostream &operator<<(std::ostream &os, const DeviceDataT &deviceData);
@@ -25,16 +25,124 @@
  *
  ****************************************************************************/
 
+#include <algorithm>
 #include <filesystem>
 #include <vector>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
 
 #include "device_data.h"
+#include "device_dependency_graph.h"
 #include "device_data_persistance.h"
 
 namespace device_data_persistance {
 
+  /**
+   * Reads the optional "recoveryLadder" list of a device entry. Each step
+   * has an "action" and an optional "timeoutMs". All other keys are passed
+   * to the action as parameters (e.g. "usbPort" or "command").
+   */
+  static std::vector<RecoveryStepConfigT> loadRecoverySteps(const boost::property_tree::ptree & deviceDataPt, const std::filesystem::path & configFilePath) {
+
+    auto recoveryLadderPt = deviceDataPt.get_child_optional("recoveryLadder");
+
+    if (! recoveryLadderPt) {
+      return RecoveryLadderT::getDefaultStepConfigs();
+    }
+
+    std::vector<RecoveryStepConfigT> stepConfigs;
+    
+    for (const boost::property_tree::ptree::value_type & stepNode : *recoveryLadderPt) {
+      const boost::property_tree::ptree & stepPt = stepNode.second;
+
+      std::string actionName = stepPt.get<std::string>("action");
+      RecoveryActionTypeT::TypeE actionType = RecoveryActionTypeT::asType(actionName.c_str());
+
+      if (actionType == RecoveryActionTypeT::_Count) {
+	throw boost::property_tree::json_parser::json_parser_error("Unknown recovery action '" + actionName + "'", configFilePath.string(), 0);
+      }
+
+      RecoveryStepConfigT stepConfig(actionType, std::chrono::milliseconds(stepPt.get<long>("timeoutMs", RecoveryStepConfigT::getDefaultTimeout(actionType).count())));
+
+      for (const boost::property_tree::ptree::value_type & parameterNode : stepPt) {
+	if (parameterNode.first == "action" || parameterNode.first == "timeoutMs") {
+	  continue;
+	}
+
+	// Durations (e.g. "settleMs") are interpreted by the action
+	if (parameterNode.first.size() > 2 && parameterNode.first.compare(parameterNode.first.size() - 2, 2, "Ms") == 0 && ! parameterNode.second.get_value_optional<long>()) {
+	  throw boost::property_tree::json_parser::json_parser_error("Recovery step parameter '" + parameterNode.first + "' is not a number", configFilePath.string(), 0);
+	}
+	stepConfig.parameters[parameterNode.first] = parameterNode.second.get_value<std::string>();
+      }
+      
+      stepConfigs.push_back(stepConfig);
+    }
+    
+    return stepConfigs;
+  }
+
+  
+  /**
+   * Reads an optional list of INDI device names of a device entry - e.g.
+   * "dependsOn" (devices which have to be connected before this device)
+   * or "coupledTo".
+   */
+  static std::vector<std::string> loadDeviceNames(const boost::property_tree::ptree & deviceDataPt, const std::string & key) {
+    std::vector<std::string> deviceNames;
+    auto deviceNamesPt = deviceDataPt.get_child_optional(key);
+
+    if (deviceNamesPt) {
+      for (const boost::property_tree::ptree::value_type & deviceNameNode : *deviceNamesPt) {
+	deviceNames.push_back(deviceNameNode.second.get_value<std::string>());
+      }
+    }
+    return deviceNames;
+  }
+
+
+  /**
+   * Reads the optional "livenessProperties" list of a device entry. Each
+   * entry has a "property" and at least one of "maxUpdateIntervalMs"
+   * (max. time between two updates) and "maxBusyMs" (max. time in state
+   * busy).
+   */
+  static std::vector<LivenessPropertyConfigT> loadLivenessProperties(const boost::property_tree::ptree & deviceDataPt, const std::filesystem::path & configFilePath) {
+    std::vector<LivenessPropertyConfigT> livenessProperties;
+    auto livenessPt = deviceDataPt.get_child_optional("livenessProperties");
+
+    if (! livenessPt) {
+      return livenessProperties;
+    }
+    
+    for (const boost::property_tree::ptree::value_type & propertyNode : *livenessPt) {
+      const boost::property_tree::ptree & propertyPt = propertyNode.second;
+
+      LivenessPropertyConfigT livenessProperty(propertyPt.get<std::string>("property"),
+					       std::chrono::milliseconds(propertyPt.get<long>("maxUpdateIntervalMs", 0)),
+					       std::chrono::milliseconds(propertyPt.get<long>("maxBusyMs", 0)));
+
+      if (livenessProperty.maxUpdateInterval.count() <= 0 && livenessProperty.maxBusyTime.count() <= 0) {
+	throw boost::property_tree::json_parser::json_parser_error("Liveness property '" + livenessProperty.propertyName + "' needs 'maxUpdateIntervalMs' or 'maxBusyMs'", configFilePath.string(), 0);
+      }
+      
+      livenessProperties.push_back(livenessProperty);
+    }
+    
+    return livenessProperties;
+  }
+
+
+  static std::string joinNames(const std::vector<std::string> & names) {
+    std::string joinedNames;
+
+    for (const std::string & name : names) {
+      joinedNames += (joinedNames.empty() ? "'" : ", '") + name + "'";
+    }
+    return joinedNames;
+  }
+
+  
   /**
    * Load devices to monitor from a JSON file to a vector of DeviceDataT objects.
    */
@@ -55,13 +163,114 @@ namespace device_data_persistance {
 			     deviceDataPt.get<std::string>("indiDeviceDriverName"),
 			     deviceDataPt.get<bool>("enableAutoConnect")
 			     );
+
+      deviceData.setRecoveryStepConfigs(loadRecoverySteps(deviceDataPt, configFilePath));
+      deviceData.setDependsOn(loadDeviceNames(deviceDataPt, "dependsOn"));
+      deviceData.setRecoverySlo(std::chrono::milliseconds(deviceDataPt.get<long>("recoverySloMs", deviceData.getRecoverySlo().count())));
+      deviceData.setCoupledTo(loadDeviceNames(deviceDataPt, "coupledTo"));
+      deviceData.setMaxActionDeferral(std::chrono::milliseconds(deviceDataPt.get<long>("maxActionDeferralMs", deviceData.getMaxActionDeferral().count())));
+      deviceData.setLivenessProperties(loadLivenessProperties(deviceDataPt, configFilePath));
 	
 	deviceDataVec.push_back(deviceData);
     }
+
+    DeviceDependencyGraphT dependencyGraph(deviceDataVec);
+
+    if (! dependencyGraph.getUnknownDependencies().empty()) {
+      throw boost::property_tree::json_parser::json_parser_error("Unknown device(s) in 'dependsOn': " + joinNames(dependencyGraph.getUnknownDependencies()), configFilePath.string(), 0);
+    }
+
+    if (! dependencyGraph.getCycleDevices().empty()) {
+      throw boost::property_tree::json_parser::json_parser_error("Cyclic 'dependsOn' between device(s): " + joinNames(dependencyGraph.getCycleDevices()), configFilePath.string(), 0);
+    }
+
+    std::vector<std::string> unknownCoupledDevices;
+    
+    for (const DeviceDataT & deviceData : deviceDataVec) {
+      for (const std::string & coupledDevice : deviceData.getCoupledTo()) {
+	if (std::none_of(deviceDataVec.begin(), deviceDataVec.end(), [& coupledDevice](const DeviceDataT & other) { return other.getIndiDeviceName() == coupledDevice; })) {
+	  unknownCoupledDevices.push_back(coupledDevice);
+	}
+      }
+    }
+
+    if (! unknownCoupledDevices.empty()) {
+      throw boost::property_tree::json_parser::json_parser_error("Unknown device(s) in 'coupledTo': " + joinNames(unknownCoupledDevices), configFilePath.string(), 0);
+    }
     
     return deviceDataVec;
   }
 
+
+
+  /**
+   * Load the optional top-level "hooks" list. Each hook has an "event"
+   * (deviceLost, driverRestarted, breakerOpened, serverLost), a "type"
+   * (command, fifo, http), a "target" and an optional "timeoutMs".
+   */
+  std::vector<HookConfigT> loadHooks(const std::filesystem::path & configFilePath) {
+    boost::property_tree::ptree rootPt;
+    boost::property_tree::json_parser::read_json(configFilePath.string(), rootPt);
+    std::vector<HookConfigT> hooks;
+
+    auto hooksPt = rootPt.get_child_optional("hooks");
+
+    if (! hooksPt) {
+      return hooks;
+    }
+    
+    for (const boost::property_tree::ptree::value_type & hookNode : *hooksPt) {
+      const boost::property_tree::ptree & hookPt = hookNode.second;
+
+      std::string eventName = hookPt.get<std::string>("event");
+      std::string typeName = hookPt.get<std::string>("type");
+      HookEventT::TypeE event = HookEventT::asType(eventName.c_str());
+      HookTypeT::TypeE type = HookTypeT::asType(typeName.c_str());
+
+      if (event == HookEventT::_Count) {
+	throw boost::property_tree::json_parser::json_parser_error("Unknown hook event '" + eventName + "'", configFilePath.string(), 0);
+      }
+      
+      if (type == HookTypeT::_Count) {
+	throw boost::property_tree::json_parser::json_parser_error("Unknown hook type '" + typeName + "'", configFilePath.string(), 0);
+      }
+
+      hooks.push_back(HookConfigT(event, type, hookPt.get<std::string>("target"), std::chrono::milliseconds(hookPt.get<long>("timeoutMs", 5000))));
+    }
+
+    return hooks;
+  }
+
+
+  std::vector<MessagePatternConfigT> loadMessagePatterns(const std::filesystem::path & configFilePath) {
+    boost::property_tree::ptree rootPt;
+    boost::property_tree::json_parser::read_json(configFilePath.string(), rootPt);
+    std::vector<MessagePatternConfigT> messagePatterns;
+
+    auto messagePatternsPt = rootPt.get_child_optional("messagePatterns");
+
+    if (! messagePatternsPt) {
+      return messagePatterns;
+    }
+
+    // No driver name = the patterns apply to all INDI drivers
+    for (const boost::property_tree::ptree::value_type & messagePatternNode : *messagePatternsPt) {
+      const boost::property_tree::ptree & messagePatternPt = messagePatternNode.second;
+      std::string indiDriverName = messagePatternPt.get<std::string>("indiDeviceDriverName", "");
+
+      for (const boost::property_tree::ptree::value_type & patternNode : messagePatternPt.get_child("patterns")) {
+	std::string pattern = patternNode.second.get_value<std::string>();
+
+	if (pattern.empty()) {
+	  throw boost::property_tree::json_parser::json_parser_error("Empty message pattern", configFilePath.string(), 0);
+	}
+	messagePatterns.push_back(MessagePatternConfigT(indiDriverName, pattern));
+      }
+    }
+
+    return messagePatterns;
+  }
+
   
   /**
    * NOTE: So far only used to write the initial data structure to JSON.
@@ -34,11 +34,15 @@
 #include <filesystem>
 
 #include "device_data.h"
+#include "hook_executor.h"
+#include "message_pattern_matcher.h"
 
 namespace device_data_persistance {
 
   std::vector<DeviceDataT> load(const std::filesystem::path & configFilePath);
   void save(const std::vector<DeviceDataT> & deviceDataVec, const std::filesystem::path & configFilePath);
+  std::vector<HookConfigT> loadHooks(const std::filesystem::path & configFilePath);
+  std::vector<MessagePatternConfigT> loadMessagePatterns(const std::filesystem::path & configFilePath);
 
 }
 
@@ -0,0 +1,130 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#include <algorithm>
+
+#include "device_dependency_graph.h"
+
+
+DeviceDependencyGraphT::DeviceDependencyGraphT() {
+}
+
+DeviceDependencyGraphT::DeviceDependencyGraphT(const std::vector<DeviceDataT> & devices) {
+
+  for (const DeviceDataT & deviceData : devices) {
+    dependencies_[deviceData.getIndiDeviceName()];
+  }
+  
+  for (const DeviceDataT & deviceData : devices) {
+    for (const std::string & dependency : deviceData.getDependsOn()) {
+      if (dependencies_.find(dependency) == dependencies_.end()) {
+	unknownDependencies_.push_back(dependency);
+	continue;
+      }
+      
+      dependencies_[deviceData.getIndiDeviceName()].push_back(dependency);
+      dependents_[dependency].push_back(deviceData.getIndiDeviceName());
+    }
+  }
+
+  computeWaves();
+}
+
+
+void DeviceDependencyGraphT::computeWaves() {
+  std::map<std::string, size_t> openDependencyCounts;
+  std::vector<std::string> wave;
+  
+  for (const auto & dependencyEntry : dependencies_) {
+    openDependencyCounts[dependencyEntry.first] = dependencyEntry.second.size();
+
+    if (dependencyEntry.second.empty()) {
+      wave.push_back(dependencyEntry.first);
+    }
+  }
+
+  size_t orderedDeviceCount = 0;
+  
+  while (! wave.empty()) {
+    std::vector<std::string> nextWave;
+
+    for (const std::string & indiDeviceName : wave) {
+      auto dependentsIt = dependents_.find(indiDeviceName);
+
+      if (dependentsIt == dependents_.end()) {
+	continue;
+      }
+      
+      for (const std::string & dependent : dependentsIt->second) {
+	if (--openDependencyCounts[dependent] == 0) {
+	  nextWave.push_back(dependent);
+	}
+      }
+    }
+
+    orderedDeviceCount += wave.size();
+    waves_.push_back(wave);
+    wave.swap(nextWave);
+  }
+
+  // All devices which never got ready are part of (or depend on) a cycle
+  if (orderedDeviceCount != dependencies_.size()) {
+    for (const auto & openDependencyCount : openDependencyCounts) {
+      if (openDependencyCount.second > 0) {
+	cycleDevices_.push_back(openDependencyCount.first);
+      }
+    }
+  }
+}
+
+
+bool DeviceDependencyGraphT::isValid() const {
+  return cycleDevices_.empty() && unknownDependencies_.empty();
+}
+
+const std::vector<std::string> & DeviceDependencyGraphT::getCycleDevices() const {
+  return cycleDevices_;
+}
+
+const std::vector<std::string> & DeviceDependencyGraphT::getUnknownDependencies() const {
+  return unknownDependencies_;
+}
+
+const std::vector<std::vector<std::string> > & DeviceDependencyGraphT::getWaves() const {
+  return waves_;
+}
+
+const std::vector<std::string> & DeviceDependencyGraphT::getDependencies(const std::string & indiDeviceName) const {
+  static const std::vector<std::string> sNoDependencies;
+  
+  auto dependenciesIt = dependencies_.find(indiDeviceName);
+  return (dependenciesIt != dependencies_.end() ? dependenciesIt->second : sNoDependencies);
+}
+
+bool DeviceDependencyGraphT::hasDependents(const std::string & indiDeviceName) const {
+  return dependents_.find(indiDeviceName) != dependents_.end();
+}
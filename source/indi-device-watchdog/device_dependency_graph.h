@@ -0,0 +1,72 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_DEVICE_DEPENDENCY_GRAPH_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_DEVICE_DEPENDENCY_GRAPH_H_ SOURCE_INDI_DEVICE_WATCHDOG_DEVICE_DEPENDENCY_GRAPH_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "device_data.h"
+
+/**
+ * DAG of the "dependsOn" relations between the monitored devices (e.g. a
+ * filter wheel which is attached through the CCD). The devices are
+ * ordered in waves (Kahn's algorithm): wave 0 contains the devices
+ * without dependencies, wave n the devices whose dependencies are all in
+ * the waves before.
+ */
+class DeviceDependencyGraphT {
+ private:
+  std::map<std::string, std::vector<std::string> > dependencies_;
+  std::map<std::string, std::vector<std::string> > dependents_;
+  std::vector<std::vector<std::string> > waves_;
+  std::vector<std::string> cycleDevices_;
+  std::vector<std::string> unknownDependencies_;
+  
+  void computeWaves();
+
+ public:
+  DeviceDependencyGraphT();
+  explicit DeviceDependencyGraphT(const std::vector<DeviceDataT> & devices);
+
+  /**
+   * Returns false if a dependency refers to an unknown device or if the
+   * dependencies contain a cycle.
+   */
+  bool isValid() const;
+  const std::vector<std::string> & getCycleDevices() const;
+  const std::vector<std::string> & getUnknownDependencies() const;
+  
+  const std::vector<std::vector<std::string> > & getWaves() const;
+  const std::vector<std::string> & getDependencies(const std::string & indiDeviceName) const;
+  bool hasDependents(const std::string & indiDeviceName) const;
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_DEVICE_DEPENDENCY_GRAPH_H_ */
@@ -0,0 +1,156 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include <filesystem>
+#include <algorithm>
+
+#include "logging.h"
+#include "device_presence_monitor.h"
+
+
+DevicePresenceMonitorT::DevicePresenceMonitorT(const std::vector<std::string> & linuxDeviceNames, std::chrono::milliseconds sampleInterval, const FlapPolicyT & flapPolicy, PresenceChangedCallbackT presenceChangedCallback, PresenceProbeT presenceProbe) : sampleInterval_(sampleInterval), flapPolicy_(flapPolicy), presenceChangedCallback_(presenceChangedCallback), presenceProbe_(presenceProbe), stop_(false) {
+
+  if (flapPolicy_.threshold > FlapDetectorT::MaxTransitions) {
+    LOG(warning) << "Flap threshold " << flapPolicy_.threshold << " exceeds the maximum of " << FlapDetectorT::MaxTransitions << " - using the maximum." << std::endl;
+    flapPolicy_.threshold = FlapDetectorT::MaxTransitions;
+  }
+
+  for (const std::string & linuxDeviceName : linuxDeviceNames) {
+    flapDetectors_[linuxDeviceName];
+  }
+
+  // Initial presence - without debouncing
+  sampleDevices();
+}
+
+
+DevicePresenceMonitorT::~DevicePresenceMonitorT() {
+  stop();
+}
+
+
+void DevicePresenceMonitorT::start() {
+  std::lock_guard<std::mutex> guard(monitorMutex_);
+
+  if (! monitorThread_.joinable()) {
+    stop_ = false;
+    monitorThread_ = std::thread(&DevicePresenceMonitorT::run, this);
+  }
+}
+
+
+void DevicePresenceMonitorT::stop() {
+  {
+    std::lock_guard<std::mutex> guard(monitorMutex_);
+    stop_ = true;
+  }
+  monitorCv_.notify_all();
+
+  if (monitorThread_.joinable()) {
+    monitorThread_.join();
+  }
+}
+
+
+void DevicePresenceMonitorT::sampleDevices() {
+  std::vector<std::string> changedDevices;
+  
+  {
+    std::lock_guard<std::mutex> guard(flapDetectorsMutex_);
+
+    for (auto & flapDetectorEntry : flapDetectors_) {
+      std::error_code ec;
+      bool present = (presenceProbe_ != nullptr ? presenceProbe_(flapDetectorEntry.first) : std::filesystem::exists(flapDetectorEntry.first, ec));
+      FlapDetectorT & flapDetector = flapDetectorEntry.second;
+      bool wasQuarantined = flapDetector.isQuarantined();
+      
+      if (flapDetector.sample(present, std::chrono::steady_clock::now(), flapPolicy_)) {
+	changedDevices.push_back(flapDetectorEntry.first);
+
+	if (flapDetector.isQuarantined() && ! wasQuarantined) {
+	  LOG(warning) << "Linux device '" << flapDetectorEntry.first << "' is flapping (" << flapDetector.getFlapCount()
+		       << " presence changes) - quarantined." << std::endl;
+	}
+	else if (! flapDetector.isQuarantined() && wasQuarantined) {
+	  LOG(info) << "Linux device '" << flapDetectorEntry.first << "' is stable again - quarantine ended." << std::endl;
+	}
+      }
+    }
+  }
+
+  // Outside of the lock - the callback may query the presence
+  for (const std::string & linuxDeviceName : changedDevices) {
+    presenceChangedCallback_(linuxDeviceName);
+  }
+}
+
+
+void DevicePresenceMonitorT::run() {
+  std::unique_lock<std::mutex> lock(monitorMutex_);
+
+  while (! monitorCv_.wait_for(lock, sampleInterval_, [this]() { return stop_; })) {
+    lock.unlock();
+    sampleDevices();
+    lock.lock();
+  }
+}
+
+
+bool DevicePresenceMonitorT::getPresence(const std::string & linuxDeviceName, DevicePresenceT & presence) const {
+  std::lock_guard<std::mutex> guard(flapDetectorsMutex_);
+
+  auto flapDetectorIt = flapDetectors_.find(linuxDeviceName);
+
+  if (flapDetectorIt == flapDetectors_.end()) {
+    return false;
+  }
+
+  const FlapDetectorT & flapDetector = flapDetectorIt->second;
+  auto now = std::chrono::steady_clock::now();
+
+  // Both at the same time - sample() may not have run since the debounce
+  // time passed
+  presence.present = flapDetector.isPresent(now, flapPolicy_);
+  presence.settled = flapDetector.isSettled(now, flapPolicy_);
+  presence.remainingQuarantine = flapDetector.getRemainingQuarantine(now);
+  presence.quarantined = (presence.remainingQuarantine.count() > 0);
+  presence.flapCount = flapDetector.getFlapCount();
+  presence.quarantineCount = flapDetector.getQuarantineCount();
+  presence.lastTransitionTime = flapDetector.getLastTransitionTime();
+
+  return true;
+}
+
+
+void DevicePresenceMonitorT::resetCounters() {
+  std::lock_guard<std::mutex> guard(flapDetectorsMutex_);
+
+  for (auto & flapDetectorEntry : flapDetectors_) {
+    flapDetectorEntry.second.resetCounters();
+  }
+}
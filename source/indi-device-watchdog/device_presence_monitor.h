@@ -0,0 +1,109 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_DEVICE_PRESENCE_MONITOR_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_DEVICE_PRESENCE_MONITOR_H_ SOURCE_INDI_DEVICE_WATCHDOG_DEVICE_PRESENCE_MONITOR_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "flap_detector.h"
+
+/**
+ * The debounced presence of a Linux device as seen by the monitor.
+ */
+struct DevicePresenceT {
+  bool present;
+  bool settled;
+  bool quarantined;
+  std::chrono::milliseconds remainingQuarantine;
+  unsigned long flapCount;
+  unsigned long quarantineCount;
+  std::chrono::steady_clock::time_point lastTransitionTime;
+
+  DevicePresenceT() : present(false), settled(true), quarantined(false), remainingQuarantine(0), flapCount(0), quarantineCount(0) {}
+};
+
+
+/**
+ * Samples the presence of the Linux devices much more often than the
+ * watchdog cycle runs - a device which bounces several times a second
+ * would otherwise be caught in a random state. Each sample is fed into
+ * the flap detector of the device. Whenever the debounced presence or
+ * the quarantine state of a device changes, the "changed" callback is
+ * called from the monitor thread. By default the presence is sampled
+ * from the local filesystem, a probe may take it from elsewhere.
+ */
+class DevicePresenceMonitorT {
+ public:
+  typedef std::function<void(const std::string & linuxDeviceName)> PresenceChangedCallbackT;
+  typedef std::function<bool(const std::string & linuxDeviceName)> PresenceProbeT;
+
+ private:
+  std::chrono::milliseconds sampleInterval_;
+  FlapPolicyT flapPolicy_;
+  PresenceChangedCallbackT presenceChangedCallback_;
+  PresenceProbeT presenceProbe_;
+  
+  std::map<std::string /*Linux device name*/, FlapDetectorT> flapDetectors_;
+  mutable std::mutex flapDetectorsMutex_;
+  
+  std::thread monitorThread_;
+  std::mutex monitorMutex_;
+  std::condition_variable monitorCv_;
+  bool stop_;
+
+  void sampleDevices();
+  void run();
+
+  // We do not want copies
+  DevicePresenceMonitorT(const DevicePresenceMonitorT &);
+  DevicePresenceMonitorT &operator=(const DevicePresenceMonitorT &);
+  
+ public:
+  DevicePresenceMonitorT(const std::vector<std::string> & linuxDeviceNames, std::chrono::milliseconds sampleInterval, const FlapPolicyT & flapPolicy, PresenceChangedCallbackT presenceChangedCallback, PresenceProbeT presenceProbe = nullptr);
+  ~DevicePresenceMonitorT();
+
+  void start();
+  void stop();
+
+  /**
+   * Returns false if the given Linux device is not monitored.
+   */
+  bool getPresence(const std::string & linuxDeviceName, DevicePresenceT & presence) const;
+
+  void resetCounters();
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_DEVICE_PRESENCE_MONITOR_H_ */
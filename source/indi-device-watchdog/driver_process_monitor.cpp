@@ -0,0 +1,335 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+#include "logging.h"
+#include "process_table.h"
+#include "driver_process_monitor.h"
+
+
+std::ostream &
+DriverProcessStatsT::print(std::ostream &os) const {
+  os << "PID: " << pid << ", state: " << state << ", CPU: " << cpuPercent << " %, RSS: " << rssKb << " kB, open fds: " << fdCount << ", threads: " << threadCount;
+
+  if (uninterruptibleTime.count() > 0) {
+    os << ", uninterruptible for " << uninterruptibleTime.count() << " ms";
+  }
+  return os;
+}
+
+std::ostream &operator<<(std::ostream &os, const DriverProcessStatsT &stats) {
+    return stats.print(os);
+}
+
+
+
+DriverProcessMonitorT::DriverProcessT::DriverProcessT() : pid(-1), statFd(-1), startTime(0), cpuTicks(0), exceededSampleCounts() {
+}
+
+
+DriverProcessMonitorT::DriverProcessMonitorT(const std::vector<std::string> & indiDriverNames, std::chrono::milliseconds sampleInterval, const DriverProcessLimitsT & limits, IndiServerPidProviderT indiServerPidProvider) : sampleInterval_(sampleInterval), limits_(limits), indiServerPidProvider_(indiServerPidProvider), indiServerPid_(-1), pageSizeKb_(sysconf(_SC_PAGESIZE) / 1024), clockTicksPerSec_(sysconf(_SC_CLK_TCK)), stop_(true) {
+
+  for (const std::string & indiDriverName : indiDriverNames) {
+    drivers_[indiDriverName] = DriverProcessT();
+    stats_[indiDriverName] = DriverProcessStatsT();
+  }
+}
+
+
+DriverProcessMonitorT::~DriverProcessMonitorT() {
+  stop();
+
+  for (auto & driverEntry : drivers_) {
+    closeDriver(driverEntry.second);
+  }
+}
+
+
+void DriverProcessMonitorT::start() {
+  std::lock_guard<std::mutex> guard(monitorMutex_);
+
+  if (! monitorThread_.joinable()) {
+    stop_ = false;
+    monitorThread_ = std::thread(&DriverProcessMonitorT::run, this);
+  }
+}
+
+
+void DriverProcessMonitorT::stop() {
+  {
+    std::lock_guard<std::mutex> guard(monitorMutex_);
+    stop_ = true;
+  }
+  monitorCv_.notify_all();
+
+  if (monitorThread_.joinable()) {
+    monitorThread_.join();
+  }
+}
+
+
+void DriverProcessMonitorT::closeDriver(DriverProcessT & driver) {
+  if (driver.statFd >= 0) {
+    close(driver.statFd);
+  }
+  
+  driver = DriverProcessT();
+}
+
+
+/**
+ * Looks up the PIDs of the drivers which are not known. The INDI server
+ * PID is only looked up again once the last one is gone.
+ */
+void DriverProcessMonitorT::discoverDrivers() {
+  if (indiServerPid_ <= 0 || (kill(indiServerPid_, 0) != 0 && errno == ESRCH)) {
+    indiServerPid_ = indiServerPidProvider_();
+
+    if (indiServerPid_ <= 0) {
+      LOG_DEDUP(warning, "driverProcesses", "INDI server process not found - the INDI driver processes are not monitored.");
+      return;
+    }
+    
+    LOG_DEDUP(info, "driverProcesses", "Monitoring the INDI driver processes of the INDI server (PID " << indiServerPid_ << ").");
+  }
+  
+  std::map<std::string, pid_t> childProcesses = process_table::getChildProcesses(indiServerPid_);
+
+  for (auto & driverEntry : drivers_) {
+    DriverProcessT & driver = driverEntry.second;
+    auto childProcessIt = childProcesses.find(std::filesystem::path(driverEntry.first).filename().string());
+
+    if (driver.pid > 0 || childProcessIt == childProcesses.end()) {
+      continue;
+    }
+
+    std::string procDir = "/proc/" + std::to_string(childProcessIt->second);
+    
+    driver.statFd = open((procDir + "/stat").c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (driver.statFd < 0) {
+      continue;
+    }
+
+    driver.pid = childProcessIt->second;
+    driver.fdDirPath = procDir + "/fd";
+
+    LOG(debug) << "Monitoring INDI driver '" << driverEntry.first << "' (PID " << driver.pid << ")." << std::endl;
+  }
+}
+
+
+/**
+ * Returns false if the process is gone.
+ */
+bool DriverProcessMonitorT::sampleDriver(DriverProcessT & driver, std::chrono::steady_clock::time_point now) {
+  char stat[1024];
+  ssize_t statSize = pread(driver.statFd, stat, sizeof(stat) - 1, 0);
+
+  if (statSize <= 0) {
+    return false;
+  }
+
+  stat[statSize] = '\0';
+
+  // The process name (field 2) may contain spaces - parse behind it
+  const char * fields = strrchr(stat, ')');
+
+  if (fields == nullptr || fields[1] == '\0' || fields[2] == '\0') {
+    return false;
+  }
+
+  char state = fields[2];
+  char * fieldPos = const_cast<char *>(fields + 3);
+  unsigned long long cpuTicks = 0;
+  unsigned long long startTime = 0;
+  long threadCount = 0;
+  long rssPages = 0;
+
+  // Field 3 is the state, fields 14/15 are utime/stime, field 20 is the
+  // number of threads, field 22 the start time and field 24 the RSS.
+  for (int fieldIdx = 4; fieldIdx <= 24; ++fieldIdx) {
+    long long value = strtoll(fieldPos, & fieldPos, 10);
+
+    if (fieldIdx == 14 || fieldIdx == 15) {
+      cpuTicks += static_cast<unsigned long long>(value);
+    }
+    else if (fieldIdx == 20) {
+      threadCount = static_cast<long>(value);
+    }
+    else if (fieldIdx == 22) {
+      startTime = static_cast<unsigned long long>(value);
+    }
+    else if (fieldIdx == 24) {
+      rssPages = static_cast<long>(value);
+    }
+  }
+
+  if (driver.startTime != 0 && startTime != driver.startTime) {
+    // The PID was reused
+    return false;
+  }
+
+  DriverProcessStatsT & stats = driver.stats;
+
+  if (driver.startTime != 0) {
+    double elapsedSec = std::chrono::duration<double>(now - driver.lastSampleTime).count();
+
+    stats.cpuPercent = (elapsedSec > 0 ? 100.0 * static_cast<double>(cpuTicks - driver.cpuTicks) / clockTicksPerSec_ / elapsedSec : 0);
+  }
+  
+  driver.startTime = startTime;
+  driver.cpuTicks = cpuTicks;
+  driver.lastSampleTime = now;
+
+  stats.pid = driver.pid;
+  stats.state = state;
+  stats.rssKb = rssPages * pageSizeKb_;
+  stats.threadCount = static_cast<unsigned int>(threadCount);
+  stats.fdCount = 0;
+
+  // Only readable by the owner of the driver process (or root)
+  DIR * fdDir = opendir(driver.fdDirPath.c_str());
+
+  if (fdDir != nullptr) {
+    while (struct dirent * entry = readdir(fdDir)) {
+      if (entry->d_name[0] != '.') {
+	stats.fdCount++;
+      }
+    }
+    closedir(fdDir);
+  }
+
+  if (state == 'D') {
+    if (driver.uninterruptibleSince == std::chrono::steady_clock::time_point()) {
+      driver.uninterruptibleSince = now;
+    }
+    stats.uninterruptibleTime = std::chrono::duration_cast<std::chrono::milliseconds>(now - driver.uninterruptibleSince);
+  }
+  else {
+    driver.uninterruptibleSince = std::chrono::steady_clock::time_point();
+    stats.uninterruptibleTime = std::chrono::milliseconds(0);
+  }
+
+  checkLimits(driver);
+
+  return true;
+}
+
+
+void DriverProcessMonitorT::checkLimits(DriverProcessT & driver) {
+  DriverProcessStatsT & stats = driver.stats;
+  bool exceeded[DriverProcessLimitT::_Count] = {
+    limits_.maxRssKb > 0 && stats.rssKb > limits_.maxRssKb,
+    limits_.maxFdCount > 0 && stats.fdCount > limits_.maxFdCount,
+    limits_.maxThreadCount > 0 && stats.threadCount > limits_.maxThreadCount,
+    limits_.maxCpuPercent > 0 && stats.cpuPercent > limits_.maxCpuPercent,
+    limits_.maxUninterruptibleTime.count() > 0 && stats.uninterruptibleTime >= limits_.maxUninterruptibleTime
+  };
+
+  stats.exceededLimit = DriverProcessLimitT::_Count;
+  
+  for (int limitIdx = 0; limitIdx < DriverProcessLimitT::_Count; ++limitIdx) {
+    driver.exceededSampleCounts[limitIdx] = (exceeded[limitIdx] ? driver.exceededSampleCounts[limitIdx] + 1 : 0);
+
+    // The uninterruptible time already is a duration
+    bool sustained = (limitIdx == DriverProcessLimitT::UNINTERRUPTIBLE || driver.exceededSampleCounts[limitIdx] >= limits_.sustainedSampleCount);
+    
+    if (exceeded[limitIdx] && sustained && stats.exceededLimit == DriverProcessLimitT::_Count) {
+      stats.exceededLimit = static_cast<DriverProcessLimitT::TypeE>(limitIdx);
+    }
+  }
+}
+
+
+void DriverProcessMonitorT::sampleDrivers() {
+  auto now = std::chrono::steady_clock::now();
+  bool driverMissing = false;
+
+  for (auto & driverEntry : drivers_) {
+    DriverProcessT & driver = driverEntry.second;
+    
+    if (driver.pid > 0 && ! sampleDriver(driver, now)) {
+      LOG(debug) << "INDI driver '" << driverEntry.first << "' (PID " << driver.pid << ") is gone." << std::endl;
+      closeDriver(driver);
+    }
+    driverMissing = driverMissing || (driver.pid <= 0);
+  }
+
+  if (driverMissing) {
+    discoverDrivers();
+
+    // Newly found drivers get their first sample right away
+    for (auto & driverEntry : drivers_) {
+      DriverProcessT & driver = driverEntry.second;
+
+      if (driver.pid > 0 && driver.startTime == 0 && ! sampleDriver(driver, now)) {
+	closeDriver(driver);
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(statsMutex_);
+
+  for (auto & driverEntry : drivers_) {
+    stats_.at(driverEntry.first) = driverEntry.second.stats;
+  }
+}
+
+
+void DriverProcessMonitorT::run() {
+  std::unique_lock<std::mutex> lock(monitorMutex_);
+
+  do {
+    lock.unlock();
+    sampleDrivers();
+    lock.lock();
+  } while (! monitorCv_.wait_for(lock, sampleInterval_, [this]() { return stop_; }));
+}
+
+
+bool DriverProcessMonitorT::getStats(const std::string & indiDriverName, DriverProcessStatsT & stats) const {
+  std::lock_guard<std::mutex> guard(statsMutex_);
+
+  auto statsIt = stats_.find(indiDriverName);
+
+  if (statsIt == stats_.end()) {
+    return false;
+  }
+
+  stats = statsIt->second;
+  return true;
+}
@@ -0,0 +1,174 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_DRIVER_PROCESS_MONITOR_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_DRIVER_PROCESS_MONITOR_H_ SOURCE_INDI_DEVICE_WATCHDOG_DRIVER_PROCESS_MONITOR_H_
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct DriverProcessLimitT {
+  typedef enum {
+    RSS,
+    FD_COUNT,
+    THREAD_COUNT,
+    CPU,
+    UNINTERRUPTIBLE,
+    _Count
+  } TypeE;
+
+  static const char *asStr(const TypeE &inType) {
+    switch (inType) {
+    case RSS:
+      return "RSS";
+    case FD_COUNT:
+      return "open fds";
+    case THREAD_COUNT:
+      return "threads";
+    case CPU:
+      return "CPU";
+    case UNINTERRUPTIBLE:
+      return "uninterruptible sleep";
+    default:
+      return "<?>";
+    }
+  }
+};
+
+
+/**
+ * Resource limits of an INDI driver process (0 = no limit). Except for
+ * the time in uninterruptible sleep, a limit only counts once it was
+ * exceeded by sustainedSampleCount consecutive samples.
+ */
+struct DriverProcessLimitsT {
+  long maxRssKb;
+  unsigned int maxFdCount;
+  unsigned int maxThreadCount;
+  double maxCpuPercent;
+  std::chrono::milliseconds maxUninterruptibleTime; // Continuously in state D (e.g. stuck in USB I/O)
+  unsigned int sustainedSampleCount;
+
+  DriverProcessLimitsT() : maxRssKb(0), maxFdCount(0), maxThreadCount(0), maxCpuPercent(0), maxUninterruptibleTime(0), sustainedSampleCount(3) {}
+};
+
+
+struct DriverProcessStatsT {
+  pid_t pid; // -1 if the driver process was not found
+  char state; // As in /proc/<pid>/stat - R, S, D, Z, ...
+  double cpuPercent; // Since the previous sample
+  long rssKb;
+  unsigned int fdCount;
+  unsigned int threadCount;
+  std::chrono::milliseconds uninterruptibleTime;
+  DriverProcessLimitT::TypeE exceededLimit; // _Count if within all limits
+
+  DriverProcessStatsT() : pid(-1), state('?'), cpuPercent(0), rssKb(0), fdCount(0), threadCount(0), uninterruptibleTime(0), exceededLimit(DriverProcessLimitT::_Count) {}
+
+  std::ostream &print(std::ostream &os) const;
+  friend std::ostream &operator<<(std::ostream &os, const DriverProcessStatsT &stats);
+};
+
+
+/**
+ * Samples the resource usage of the INDI driver processes - the children
+ * of the INDI server - in the given interval. The driver PIDs are only
+ * looked up in /proc when a driver process is not known (yet). Each
+ * sample then is a pread() of the kept open /proc/<pid>/stat plus a walk
+ * of /proc/<pid>/fd. A changed start time reveals a reused PID.
+ */
+class DriverProcessMonitorT {
+ public:
+  typedef std::function<pid_t()> IndiServerPidProviderT;
+
+ private:
+  struct DriverProcessT {
+    pid_t pid;
+    int statFd;
+    std::string fdDirPath;
+    unsigned long long startTime;
+    unsigned long long cpuTicks;
+    std::chrono::steady_clock::time_point lastSampleTime;
+    std::chrono::steady_clock::time_point uninterruptibleSince;
+    unsigned int exceededSampleCounts[DriverProcessLimitT::_Count];
+    DriverProcessStatsT stats;
+
+    DriverProcessT();
+  };
+
+  std::chrono::milliseconds sampleInterval_;
+  DriverProcessLimitsT limits_;
+  IndiServerPidProviderT indiServerPidProvider_;
+  pid_t indiServerPid_;
+  long pageSizeKb_;
+  long clockTicksPerSec_;
+
+  std::map<std::string /*driver name*/, DriverProcessT> drivers_; // Only accessed by the monitor thread
+  std::map<std::string /*driver name*/, DriverProcessStatsT> stats_;
+  mutable std::mutex statsMutex_;
+  
+  std::thread monitorThread_;
+  std::mutex monitorMutex_;
+  std::condition_variable monitorCv_;
+  bool stop_;
+
+  void discoverDrivers();
+  bool sampleDriver(DriverProcessT & driver, std::chrono::steady_clock::time_point now);
+  void checkLimits(DriverProcessT & driver);
+  static void closeDriver(DriverProcessT & driver);
+  void sampleDrivers();
+  void run();
+
+  // We do not want copies
+  DriverProcessMonitorT(const DriverProcessMonitorT &);
+  DriverProcessMonitorT &operator=(const DriverProcessMonitorT &);
+  
+ public:
+  DriverProcessMonitorT(const std::vector<std::string> & indiDriverNames, std::chrono::milliseconds sampleInterval, const DriverProcessLimitsT & limits, IndiServerPidProviderT indiServerPidProvider);
+  ~DriverProcessMonitorT();
+
+  void start();
+  void stop();
+
+  /**
+   * Returns false if the given driver is not monitored.
+   */
+  bool getStats(const std::string & indiDriverName, DriverProcessStatsT & stats) const;
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_DRIVER_PROCESS_MONITOR_H_ */
@@ -0,0 +1,115 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include <algorithm>
+
+#include "flap_detector.h"
+
+
+FlapDetectorT::FlapDetectorT() : nextTransition_(0), transitionCount_(0), initialized_(false), rawPresent_(false), stablePresent_(false), quarantined_(false), flapCount_(0), quarantineCount_(0) {
+}
+
+
+size_t FlapDetectorT::countTransitionsSince(TimePointT since) const {
+  size_t count = 0;
+
+  for (size_t idx = 0; idx < transitionCount_; ++idx) {
+    if (transitionTimes_[idx] >= since) {
+      count++;
+    }
+  }
+  return count;
+}
+
+
+bool FlapDetectorT::sample(bool present, TimePointT now, const FlapPolicyT & policy) {
+  // The first sample is taken as it is - there is nothing to debounce yet
+  if (! initialized_) {
+    initialized_ = true;
+    rawPresent_ = present;
+    stablePresent_ = present;
+    return false;
+  }
+
+  bool previousStablePresent = stablePresent_;
+  bool previousQuarantined = quarantined_;
+  
+  if (present != rawPresent_) {
+    rawPresent_ = present;
+    lastTransitionTime_ = now;
+    flapCount_++;
+
+    transitionTimes_[nextTransition_] = now;
+    nextTransition_ = (nextTransition_ + 1) % MaxTransitions;
+    transitionCount_ = std::min(transitionCount_ + 1, MaxTransitions);
+
+    // Each further flap extends the quarantine
+    if (quarantined_ || countTransitionsSince(now - policy.window) >= policy.threshold) {
+      quarantineEndTime_ = now + policy.quarantine;
+
+      if (! quarantined_) {
+	quarantined_ = true;
+	quarantineCount_++;
+      }
+    }
+  }
+
+  if (quarantined_ && now >= quarantineEndTime_) {
+    quarantined_ = false;
+  }
+  
+  if (isSettled(now, policy)) {
+    stablePresent_ = rawPresent_;
+  }
+
+  return (stablePresent_ != previousStablePresent || quarantined_ != previousQuarantined);
+}
+
+
+bool FlapDetectorT::isPresent(TimePointT now, const FlapPolicyT & policy) const {
+  return (isSettled(now, policy) ? rawPresent_ : stablePresent_);
+}
+
+
+bool FlapDetectorT::isSettled(TimePointT now, const FlapPolicyT & policy) const {
+  return (transitionCount_ == 0 || now - lastTransitionTime_ >= policy.debounce);
+}
+
+
+std::chrono::milliseconds FlapDetectorT::getRemainingQuarantine(TimePointT now) const {
+  if (! quarantined_ || now >= quarantineEndTime_) {
+    return std::chrono::milliseconds(0);
+  }
+  return std::chrono::duration_cast<std::chrono::milliseconds>(quarantineEndTime_ - now);
+}
+
+
+void FlapDetectorT::resetCounters() {
+  flapCount_ = 0;
+  quarantineCount_ = 0;
+}
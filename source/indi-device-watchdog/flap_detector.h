@@ -0,0 +1,102 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_FLAP_DETECTOR_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_FLAP_DETECTOR_H_ SOURCE_INDI_DEVICE_WATCHDOG_FLAP_DETECTOR_H_
+
+#include <array>
+#include <chrono>
+
+/**
+ * Parameters of the flap detection. A presence change is only acted on
+ * once the new state was stable for the debounce time. A device which
+ * changes its presence at least "threshold" times within the window is
+ * quarantined until it was quiet for the quarantine time.
+ */
+struct FlapPolicyT {
+  std::chrono::milliseconds debounce;
+  std::chrono::milliseconds window;
+  unsigned int threshold;
+  std::chrono::milliseconds quarantine;
+
+  FlapPolicyT() : debounce(1000), window(10000), threshold(6), quarantine(60000) {}
+  FlapPolicyT(std::chrono::milliseconds debounce, std::chrono::milliseconds window, unsigned int threshold, std::chrono::milliseconds quarantine) : debounce(debounce), window(window), threshold(threshold), quarantine(quarantine) {}
+};
+
+
+/**
+ * Debounces the presence samples of a single device and detects flapping.
+ * The most recent presence transitions are kept in a fixed size ring
+ * buffer - hence the state of a device has a constant size.
+ */
+class FlapDetectorT {
+ public:
+  typedef std::chrono::steady_clock::time_point TimePointT;
+  
+  static constexpr size_t MaxTransitions = 16;
+
+ private:
+  std::array<TimePointT, MaxTransitions> transitionTimes_;
+  size_t nextTransition_;
+  size_t transitionCount_;
+  
+  bool initialized_;
+  bool rawPresent_;
+  bool stablePresent_;
+  bool quarantined_;
+  TimePointT lastTransitionTime_;
+  TimePointT quarantineEndTime_;
+
+  unsigned long flapCount_;
+  unsigned long quarantineCount_;
+
+  size_t countTransitionsSince(TimePointT since) const;
+  
+ public:
+  FlapDetectorT();
+
+  /**
+   * Returns true if the debounced presence or the quarantine state changed.
+   */
+  bool sample(bool present, TimePointT now, const FlapPolicyT & policy);
+
+  /**
+   * The debounced presence at the given time - a raw state which became
+   * stable after the last sample already counts.
+   */
+  bool isPresent(TimePointT now, const FlapPolicyT & policy) const;
+  bool isSettled(TimePointT now, const FlapPolicyT & policy) const;
+  bool isQuarantined() const { return quarantined_; }
+  TimePointT getLastTransitionTime() const { return lastTransitionTime_; }
+  std::chrono::milliseconds getRemainingQuarantine(TimePointT now) const;
+  unsigned long getFlapCount() const { return flapCount_; }
+  unsigned long getQuarantineCount() const { return quarantineCount_; }
+  void resetCounters();
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_FLAP_DETECTOR_H_ */
@@ -0,0 +1,396 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <sstream>
+
+#include "logging.h"
+#include "child_process.h"
+#include "hook_executor.h"
+
+
+static std::string escapeJson(const std::string & str) {
+  std::string escaped;
+  escaped.reserve(str.size());
+
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+    }
+    escaped += (static_cast<unsigned char>(c) < 0x20 ? ' ' : c);
+  }
+  return escaped;
+}
+
+
+static int getRemainingMs(std::chrono::steady_clock::time_point deadline) {
+  auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+  return static_cast<int>(std::max<long>(remaining.count(), 0));
+}
+
+
+HookExecutorT::HookExecutorT(const std::vector<HookConfigT> & hooks, unsigned int numThreads, size_t capacity) : hooks_(hooks), capacity_(std::max<size_t>(capacity, 1)), stop_(false), latencyStats_(256) {
+  for (unsigned int idx = 0; idx < std::max(numThreads, 1U) && ! hooks_.empty(); ++idx) {
+    workers_.emplace_back(&HookExecutorT::runWorker, this);
+  }
+}
+
+
+HookExecutorT::~HookExecutorT() {
+  stop();
+}
+
+
+void HookExecutorT::stop() {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stop_ = true;
+  }
+  workAvailableCv_.notify_all();
+
+  for (std::thread & worker : workers_) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+}
+
+
+void HookExecutorT::fire(HookEventT::TypeE event, const std::string & subject) {
+  bool queued = false;
+  
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    for (size_t hookIdx = 0; hookIdx < hooks_.size(); ++hookIdx) {
+      if (hooks_[hookIdx].event != event) {
+	continue;
+      }
+
+      // The same hook is still waiting for the same subject - one run
+      // reports both events.
+      auto pendingIt = std::find_if(queue_.begin(), queue_.end(), [hookIdx, & subject](const PendingHookT & pendingHook) {
+	return pendingHook.hookIdx == hookIdx && pendingHook.subject == subject;
+      });
+
+      if (pendingIt != queue_.end()) {
+	pendingIt->coalescedCount++;
+	stats_.coalescedCount++;
+	continue;
+      }
+      
+      if (queue_.size() >= capacity_) {
+	stats_.droppedCount++;
+	LOG(warning) << "Hook queue is full - dropping " << HookTypeT::asStr(hooks_[hookIdx].type) << " hook of event '" << HookEventT::asStr(event) << "' for '" << subject << "'." << std::endl;
+	continue;
+      }
+
+      queue_.push_back(PendingHookT { hookIdx, subject, std::chrono::steady_clock::now(), 0 });
+      stats_.maxQueueDepth = std::max(stats_.maxQueueDepth, queue_.size());
+      queued = true;
+    }
+  }
+
+  if (queued) {
+    workAvailableCv_.notify_all();
+  }
+}
+
+
+void HookExecutorT::runWorker() {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (true) {
+    workAvailableCv_.wait(lock, [this]() { return stop_ || ! queue_.empty(); });
+
+    if (stop_) {
+      return;
+    }
+
+    PendingHookT pendingHook = queue_.front();
+    queue_.pop_front();
+
+    lock.unlock();
+    
+    const HookConfigT & hook = hooks_[pendingHook.hookIdx];
+    bool successful = execute(hook, pendingHook.subject, pendingHook.coalescedCount);
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - pendingHook.firedTime);
+
+    LOG(debug) << "Hook " << HookTypeT::asStr(hook.type) << " '" << hook.target << "' of event '" << HookEventT::asStr(hook.event)
+	       << "' for '" << pendingHook.subject << "' " << (successful ? "finished" : "failed") << " after " << latency.count() << " us." << std::endl;
+    
+    lock.lock();
+
+    stats_.executedCount++;
+    
+    if (! successful) {
+      stats_.failedCount++;
+    }
+    latencyStats_.record(latency);
+  }
+}
+
+
+std::string HookExecutorT::composePayload(const HookConfigT & hook, const std::string & subject, unsigned int coalescedCount) {
+  std::ostringstream ss;
+
+  ss << "{\"event\":\"" << HookEventT::asStr(hook.event) << "\""
+     << ",\"subject\":\"" << escapeJson(subject) << "\""
+     << ",\"time\":" << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count()
+     << ",\"coalesced\":" << coalescedCount << "}";
+
+  return ss.str();
+}
+
+
+bool HookExecutorT::execute(const HookConfigT & hook, const std::string & subject, unsigned int coalescedCount) {
+  switch (hook.type) {
+  case HookTypeT::COMMAND:
+    return runCommand(hook, subject);
+
+  case HookTypeT::FIFO:
+    return writeToFifo(hook, composePayload(hook, subject, coalescedCount) + "\n");
+
+  case HookTypeT::HTTP:
+    return postHttp(hook, composePayload(hook, subject, coalescedCount));
+
+  default:
+    return false;
+  }
+}
+
+
+/**
+ * The event name and the subject are passed as $1 and $2. The command
+ * runs in its own process group - on timeout the processes started by
+ * it are killed as well.
+ */
+bool HookExecutorT::runCommand(const HookConfigT & hook, const std::string & subject) {
+  ChildProcessT childProcess;
+
+  if (! childProcess.startShellCommand(hook.target, { HookEventT::asStr(hook.event), subject }, true /*own process group*/)) {
+    return false;
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + hook.timeout;
+  
+  while (childProcess.poll() == ChildProcessStateT::RUNNING) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      LOG(warning) << "Hook command '" << hook.target << "' timed out." << std::endl;
+      childProcess.kill();
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  
+  return (childProcess.getExitCode() == 0);
+}
+
+
+/**
+ * Does not wait for a reader to open the pipe - without reader the event
+ * is lost.
+ */
+bool HookExecutorT::writeToFifo(const HookConfigT & hook, const std::string & payload) {
+  int fd = open(hook.target.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+
+  if (fd < 0) {
+    LOG(debug) << "Cannot open hook pipe '" << hook.target << "': " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + hook.timeout;
+  size_t written = 0;
+
+  while (written < payload.size()) {
+    ssize_t n = write(fd, payload.data() + written, payload.size() - written);
+
+    if (n > 0) {
+      written += n;
+      continue;
+    }
+    
+    if (n < 0 && errno != EAGAIN && errno != EINTR) {
+      break;
+    }
+
+    pollfd pfd = { fd, POLLOUT, 0 };
+    
+    if (poll(& pfd, 1, getRemainingMs(deadline)) <= 0) {
+      break;
+    }
+  }
+  
+  close(fd);
+  
+  return (written == payload.size());
+}
+
+
+/**
+ * Minimal HTTP/1.0 client for local endpoints ("http://host[:port]/path").
+ * Succeeds if the endpoint answers with a 2xx status.
+ */
+bool HookExecutorT::postHttp(const HookConfigT & hook, const std::string & payload) {
+  const std::string scheme = "http://";
+
+  if (hook.target.compare(0, scheme.size(), scheme) != 0) {
+    return false;
+  }
+
+  std::string hostPort = hook.target.substr(scheme.size());
+  std::string path = "/";
+  size_t pathPos = hostPort.find('/');
+
+  if (pathPos != std::string::npos) {
+    path = hostPort.substr(pathPos);
+    hostPort = hostPort.substr(0, pathPos);
+  }
+
+  std::string host = hostPort;
+  std::string port = "80";
+  size_t portPos = hostPort.rfind(':');
+
+  if (portPos != std::string::npos) {
+    host = hostPort.substr(0, portPos);
+    port = hostPort.substr(portPos + 1);
+  }
+
+  // NOTE: The name lookup is not covered by the timeout - use local endpoints
+  addrinfo hints;
+  memset(& hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  addrinfo * addrInfos = nullptr;
+  
+  if (getaddrinfo(host.c_str(), port.c_str(), & hints, & addrInfos) != 0 || addrInfos == nullptr) {
+    return false;
+  }
+
+  int fd = socket(addrInfos->ai_family, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+
+  if (fd < 0) {
+    freeaddrinfo(addrInfos);
+    return false;
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + hook.timeout;
+  int rc = connect(fd, addrInfos->ai_addr, addrInfos->ai_addrlen);
+  freeaddrinfo(addrInfos);
+
+  if (rc != 0 && errno == EINPROGRESS) {
+    pollfd pfd = { fd, POLLOUT, 0 };
+    int socketError = 0;
+    socklen_t socketErrorLen = sizeof(socketError);
+
+    rc = (poll(& pfd, 1, getRemainingMs(deadline)) == 1
+	  && getsockopt(fd, SOL_SOCKET, SO_ERROR, & socketError, & socketErrorLen) == 0
+	  && socketError == 0) ? 0 : -1;
+  }
+
+  std::ostringstream request;
+  request << "POST " << path << " HTTP/1.0\r\n"
+	  << "Host: " << hostPort << "\r\n"
+	  << "Content-Type: application/json\r\n"
+	  << "Content-Length: " << payload.size() << "\r\n"
+	  << "Connection: close\r\n\r\n"
+	  << payload;
+
+  std::string requestStr = request.str();
+  size_t sent = 0;
+
+  while (rc == 0 && sent < requestStr.size()) {
+    ssize_t n = send(fd, requestStr.data() + sent, requestStr.size() - sent, MSG_NOSIGNAL);
+
+    if (n > 0) {
+      sent += n;
+      continue;
+    }
+
+    pollfd pfd = { fd, POLLOUT, 0 };
+    
+    if ((n < 0 && errno != EAGAIN && errno != EINTR) || poll(& pfd, 1, getRemainingMs(deadline)) <= 0) {
+      rc = -1;
+    }
+  }
+
+  // Only the status line is of interest
+  std::string response;
+
+  while (rc == 0 && response.find("\r\n") == std::string::npos) {
+    char buffer[512];
+    pollfd pfd = { fd, POLLIN, 0 };
+
+    if (poll(& pfd, 1, getRemainingMs(deadline)) <= 0) {
+      rc = -1;
+      break;
+    }
+
+    ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+
+    if (n > 0) {
+      response.append(buffer, n);
+    }
+    else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+      break;
+    }
+  }
+
+  close(fd);
+
+  if (rc != 0) {
+    LOG(debug) << "HTTP hook '" << hook.target << "' failed or timed out." << std::endl;
+    return false;
+  }
+  
+  // "HTTP/1.x 2yy ..."
+  size_t statusPos = response.find(' ');
+  
+  return (statusPos != std::string::npos && statusPos + 1 < response.size() && response[statusPos + 1] == '2');
+}
+
+
+HookExecutorStatsT HookExecutorT::getStats() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+
+  HookExecutorStatsT stats = stats_;
+  stats.queueDepth = queue_.size();
+  stats.latencyP50 = latencyStats_.getPercentile(50);
+  stats.latencyP99 = latencyStats_.getPercentile(99);
+
+  return stats;
+}
@@ -0,0 +1,184 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_HOOK_EXECUTOR_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_HOOK_EXECUTOR_H_ SOURCE_INDI_DEVICE_WATCHDOG_HOOK_EXECUTOR_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "enum_helper.h"
+#include "cycle_latency_stats.h"
+
+struct HookEventT {
+  typedef enum {
+    DEVICE_LOST,
+    DRIVER_RESTARTED,
+    BREAKER_OPENED,
+    SERVER_LOST,
+    _Count
+  } TypeE;
+
+  static const char *asStr(const TypeE &inType) {
+    switch (inType) {
+    case DEVICE_LOST:
+      return "deviceLost";
+    case DRIVER_RESTARTED:
+      return "driverRestarted";
+    case BREAKER_OPENED:
+      return "breakerOpened";
+    case SERVER_LOST:
+      return "serverLost";
+    default:
+      return "<?>";
+    }
+  }
+
+  MAC_AS_TYPE(Type, E, _Count);
+};
+
+
+struct HookTypeT {
+  typedef enum {
+    COMMAND,
+    FIFO,
+    HTTP,
+    _Count
+  } TypeE;
+
+  static const char *asStr(const TypeE &inType) {
+    switch (inType) {
+    case COMMAND:
+      return "command";
+    case FIFO:
+      return "fifo";
+    case HTTP:
+      return "http";
+    default:
+      return "<?>";
+    }
+  }
+
+  MAC_AS_TYPE(Type, E, _Count);
+};
+
+
+/**
+ * A hook as configured in the "hooks" list of the device config. The
+ * target is the command (command), the path of the named pipe (fifo) or
+ * the URL (http, e.g. http://localhost:8080/events).
+ */
+struct HookConfigT {
+  HookEventT::TypeE event;
+  HookTypeT::TypeE type;
+  std::string target;
+  std::chrono::milliseconds timeout;
+
+  HookConfigT() : event(HookEventT::_Count), type(HookTypeT::_Count), timeout(5000) {}
+  HookConfigT(HookEventT::TypeE event, HookTypeT::TypeE type, const std::string & target, std::chrono::milliseconds timeout) : event(event), type(type), target(target), timeout(timeout) {}
+};
+
+
+struct HookExecutorStatsT {
+  size_t queueDepth;
+  size_t maxQueueDepth;
+  unsigned long executedCount;
+  unsigned long failedCount;
+  unsigned long coalescedCount;
+  unsigned long droppedCount;
+  std::chrono::microseconds latencyP50;
+  std::chrono::microseconds latencyP99;
+
+  HookExecutorStatsT() : queueDepth(0), maxQueueDepth(0), executedCount(0), failedCount(0), coalescedCount(0), droppedCount(0), latencyP50(0), latencyP99(0) {}
+};
+
+
+/**
+ * Runs the hooks of an event on a small set of worker threads. fire()
+ * only queues the hooks - it never waits for a hook. The queue is bounded:
+ * a hook which is still queued for the same subject (e.g. the same
+ * device) absorbs further events (coalescing), and if the queue is full
+ * new events are dropped. Each hook is aborted after its timeout.
+ *
+ * The latency of a hook is measured from firing the event until the
+ * hook finished.
+ */
+class HookExecutorT {
+ private:
+  struct PendingHookT {
+    size_t hookIdx;
+    std::string subject;
+    std::chrono::steady_clock::time_point firedTime;
+    unsigned int coalescedCount;
+  };
+
+  std::vector<HookConfigT> hooks_;
+  size_t capacity_;
+
+  std::deque<PendingHookT> queue_;
+  std::vector<std::thread> workers_;
+  mutable std::mutex mutex_;
+  std::condition_variable workAvailableCv_;
+  bool stop_;
+
+  // Guarded by mutex_
+  HookExecutorStatsT stats_;
+  CycleLatencyStatsT latencyStats_;
+  
+  void runWorker();
+  bool execute(const HookConfigT & hook, const std::string & subject, unsigned int coalescedCount);
+  static std::string composePayload(const HookConfigT & hook, const std::string & subject, unsigned int coalescedCount);
+  static bool runCommand(const HookConfigT & hook, const std::string & subject);
+  static bool writeToFifo(const HookConfigT & hook, const std::string & payload);
+  static bool postHttp(const HookConfigT & hook, const std::string & payload);
+
+  // We do not want copies
+  HookExecutorT(const HookExecutorT &);
+  HookExecutorT &operator=(const HookExecutorT &);
+
+ public:
+  HookExecutorT(const std::vector<HookConfigT> & hooks, unsigned int numThreads = 2, size_t capacity = 64);
+  ~HookExecutorT();
+
+  /**
+   * Queues all hooks of the given event. The subject is the device, the
+   * driver or the server the event refers to.
+   */
+  void fire(HookEventT::TypeE event, const std::string & subject);
+
+  void stop();
+
+  HookExecutorStatsT getStats() const;
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_HOOK_EXECUTOR_H_ */
@@ -0,0 +1,92 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_INDI_AWAITABLE_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_INDI_AWAITABLE_H_ SOURCE_INDI_DEVICE_WATCHDOG_INDI_AWAITABLE_H_
+
+#include "indi_pending_operation.h"
+
+// The awaitable API requires C++20 coroutines. Everything else in the
+// project only requires C++17.
+#if defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <exception>
+
+#define INDI_DEVICE_WATCHDOG_HAVE_COROUTINES 1
+
+class IndiClientT;
+
+/**
+ * Result of IndiClientT::setSwitch(). Suspends the awaiting coroutine
+ * until the INDI driver confirmed (IPS_OK) or rejected (IPS_ALERT) the
+ * new switch state or until the timeout expired:
+ *
+ *   IndiOperationResultT::TypeE result = co_await client.setSwitch(dev, "CONNECTION", "CONNECT", 5000ms);
+ *
+ * The state lives in the coroutine frame. The coroutine is resumed on
+ * the thread which resolved the operation (usually the INDI client
+ * listener thread).
+ */
+class SetSwitchAwaitableT : public IndiPendingOperationT {
+ private:
+  IndiClientT & client_;
+  std::coroutine_handle<> handle_;
+
+ protected:
+  void complete(IndiOperationResultT::TypeE /*result*/) override {
+    handle_.resume();
+  }
+
+ public:
+  SetSwitchAwaitableT(IndiClientT & client, const std::string & deviceName, const std::string & propertyName, const std::string & elementName, std::chrono::milliseconds timeout)
+    : IndiPendingOperationT(deviceName, propertyName, elementName, timeout), client_(client) {}
+
+  bool await_ready() const noexcept { return false; }
+  bool await_suspend(std::coroutine_handle<> handle);
+  IndiOperationResultT::TypeE await_resume() const noexcept { return getResult(); }
+};
+
+
+/**
+ * Return type of fire-and-forget coroutines (e.g. recovery sequences)
+ * which co_await INDI operations. The coroutine starts right away and
+ * its frame is freed when it finishes.
+ */
+struct DetachedIndiTaskT {
+  struct promise_type {
+    DetachedIndiTaskT get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+};
+
+#endif /* __cpp_impl_coroutine */
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_INDI_AWAITABLE_H_ */
@@ -26,16 +26,60 @@
  ****************************************************************************/
 
 #include <thread>
+#include <vector>
 
 #include "indi_client.h"
 #include "indiproperty.h"
 #include "basedevice.h"
 
 
-IndiClientT::IndiClientT() = default;
+std::atomic<int> IndiClientT::sActiveConnectionThreadCount(0);
+
+
+/**
+ * Pending operation with a completion handler (see IndiClientT::setSwitch()).
+ * It deletes itself once completed.
+ */
+class CallbackOperationT : public IndiPendingOperationT {
+ private:
+  IndiClientT::OperationCompletionHandlerT completionHandler_;
+
+ protected:
+  void complete(IndiOperationResultT::TypeE result) override {
+    if (completionHandler_) {
+      completionHandler_(result);
+    }
+    delete this;
+  }
+
+ public:
+  CallbackOperationT(const std::string & deviceName, const std::string & propertyName, const std::string & elementName, std::chrono::milliseconds timeout, IndiClientT::OperationCompletionHandlerT completionHandler)
+    : IndiPendingOperationT(deviceName, propertyName, elementName, timeout), completionHandler_(std::move(completionHandler)) {}
+
+  void completeNow() {
+    complete(getResult());
+  }
+};
+
+
+#ifdef INDI_DEVICE_WATCHDOG_HAVE_COROUTINES
+bool SetSwitchAwaitableT::await_suspend(std::coroutine_handle<> handle) {
+  handle_ = handle;
+
+  // NOTE: Once the operation is pending it may be resumed by another
+  //       thread right away. Hence no member must be touched afterwards.
+  return client_.startOperation(*this);
+}
+#endif
+
+
+IndiClientT::IndiClientT() : mConnectionWanted(false), mStopConnectionManager(false), mConnectionAttemptCount(0), mConnectionThreadStartCount(0), mPendingOperations(nullptr), mPendingOperationCount(0) {
+}
 
 IndiClientT::~IndiClientT() {
+  stopConnectionManager();
   disconnect();
+  cancelPendingOperations();
 }
 
 
@@ -140,37 +184,134 @@ void IndiClientT::newMessage(INDI::BaseDevice dp, int messageID) {
 
 void IndiClientT::serverConnected() {
     notifyServerConnectionStateChanged(IndiServerConnectionStateT::CONNECTED);
+
+    notifyConnectionStateWaiters();
 }
 
 void IndiClientT::serverDisconnected(int /*exit_code*/) {
     notifyServerConnectionStateChanged(IndiServerConnectionStateT::DISCONNECTED);
+
+    // No answer will arrive for operations sent over the lost connection
+    cancelPendingOperations();
+
+    // Wake up the connection manager so that it reconnects right away
+    // (the backoff starts over once a connection was established).
+    mConnectionManagerCv.notify_all();
+    notifyConnectionStateWaiters();
 }
 
 void IndiClientT::connectToIndiServerBlocking() {
   
-  // This function is blocking and therefore needs to be in a separate thread
+  // This function is blocking and therefore runs in the connection manager thread
+  mConnectionAttemptCount++;
+  
   bool connectIndiServerResult = this->connectServer();
 
   if (!connectIndiServerResult) {
     // Emit a failure signal...
     notifyServerConnectionFailed();
+    notifyConnectionStateWaiters();
   } else {
     // NOTE: Do not emit a success signal since this will already
     // happen from within the INDI server...
   }
 }
 
+void IndiClientT::runConnectionManager() {
+
+  sActiveConnectionThreadCount++;
+
+  std::unique_lock<std::mutex> lock(mConnectionManagerMutex);
+
+  while (!mStopConnectionManager) {
+
+    // A wake-up (e.g. connect() or a new pending operation) is no
+    // permission to retry before the backoff delay passed.
+    if (mConnectionWanted && !this->isServerConnected() && std::chrono::steady_clock::now() >= mNextConnectionAttemptTime) {
+      lock.unlock();
+      
+      notifyServerConnectionStateChanged(IndiServerConnectionStateT::CONNECTING);
+      connectToIndiServerBlocking();
+
+      lock.lock();
+
+      if (mStopConnectionManager) {
+        break;
+      }
+
+      if (this->isServerConnected()) {
+        // A lost connection is retried right away
+        mReconnectPolicy.reset();
+        mNextConnectionAttemptTime = std::chrono::steady_clock::time_point();
+      }
+      else {
+        mNextConnectionAttemptTime = std::chrono::steady_clock::now() + mReconnectPolicy.nextDelay();
+      }
+    }
+
+    // Sleep until the next retry or the next deadline of a pending
+    // operation - or until connect() / disconnect() / the destructor, a
+    // new pending operation or a lost connection wakes us up.
+    auto now = std::chrono::steady_clock::now();
+    auto nextOperationDeadline = getNextOperationDeadline();
+    std::chrono::milliseconds waitTime = mReconnectPolicy.getMaxDelay();
+
+    if (mConnectionWanted && !this->isServerConnected() && mNextConnectionAttemptTime < now + waitTime) {
+      waitTime = std::chrono::duration_cast<std::chrono::milliseconds>(mNextConnectionAttemptTime - now) + std::chrono::milliseconds(1);
+    }
+
+    if (nextOperationDeadline < now + waitTime) {
+      waitTime = std::chrono::duration_cast<std::chrono::milliseconds>(nextOperationDeadline - now) + std::chrono::milliseconds(1);
+    }
+    
+    mConnectionManagerCv.wait_for(lock, waitTime);
+
+    lock.unlock();
+    expirePendingOperations();
+    lock.lock();
+  }
+
+  sActiveConnectionThreadCount--;
+}
+
+void IndiClientT::stopConnectionManager() {
+    {
+        std::lock_guard<std::mutex> guard(mConnectionManagerMutex);
+        mStopConnectionManager = true;
+        mConnectionWanted = false;
+    }
+
+    mConnectionManagerCv.notify_all();
+
+    if (mConnectionManagerThread.joinable()) {
+        mConnectionManagerThread.join();
+    }
+}
+
 void IndiClientT::connect() {
+    {
+        std::lock_guard<std::mutex> guard(mConnectionManagerMutex);
 
-    if (!this->isServerConnected()) {
-        notifyServerConnectionStateChanged(IndiServerConnectionStateT::CONNECTING);
+        if (mStopConnectionManager) {
+            return;
+        }
 
-        mIndiConnectServerThread = std::thread(&IndiClientT::connectToIndiServerBlocking, this);
-        mIndiConnectServerThread.detach();
+        mConnectionWanted = true;
+
+        if (!mConnectionManagerThread.joinable()) {
+            mConnectionThreadStartCount++;
+            mConnectionManagerThread = std::thread(&IndiClientT::runConnectionManager, this);
+        }
     }
+
+    mConnectionManagerCv.notify_all();
 }
 
 void IndiClientT::disconnect() {
+    {
+        std::lock_guard<std::mutex> guard(mConnectionManagerMutex);
+        mConnectionWanted = false;
+    }
 
     if (this->isServerConnected()) {
       notifyServerConnectionStateChanged(IndiServerConnectionStateT::DISCONNECTING);
@@ -180,6 +321,364 @@ void IndiClientT::disconnect() {
 
 }
 
+void IndiClientT::notifyConnectionStateWaiters() {
+    {
+        // Avoid a lost wake-up between the predicate check and the wait
+        std::lock_guard<std::mutex> guard(mConnectionManagerMutex);
+    }
+    mConnectionStateCv.notify_all();
+}
+
+bool IndiClientT::waitForConnection(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mConnectionManagerMutex);
+
+    return mConnectionStateCv.wait_for(lock, timeout, [this]() {
+        return this->isServerConnected();
+    });
+}
+
+void IndiClientT::setReconnectPolicy(const ReconnectPolicyT & reconnectPolicy) {
+    std::lock_guard<std::mutex> guard(mConnectionManagerMutex);
+    mReconnectPolicy = reconnectPolicy;
+}
+
+unsigned long IndiClientT::getConnectionAttemptCount() const {
+    return mConnectionAttemptCount;
+}
+
+unsigned long IndiClientT::getConnectionThreadStartCount() const {
+    return mConnectionThreadStartCount;
+}
+
+int IndiClientT::getActiveConnectionThreadCount() {
+    return sActiveConnectionThreadCount;
+}
+
+void IndiClientT::wakeUpConnectionManager() {
+    {
+        // Avoid a lost wake-up between the deadline check and the wait
+        std::lock_guard<std::mutex> guard(mConnectionManagerMutex);
+    }
+    mConnectionManagerCv.notify_all();
+}
+
+void IndiClientT::linkPendingOperation(IndiPendingOperationT & operation) {
+    operation.prev_ = nullptr;
+    operation.next_ = mPendingOperations;
+
+    if (mPendingOperations != nullptr) {
+        mPendingOperations->prev_ = & operation;
+    }
+    mPendingOperations = & operation;
+    mPendingOperationCount++;
+}
+
+void IndiClientT::unlinkPendingOperation(IndiPendingOperationT & operation) {
+    if (operation.prev_ != nullptr) {
+        operation.prev_->next_ = operation.next_;
+    }
+    else {
+        mPendingOperations = operation.next_;
+    }
+
+    if (operation.next_ != nullptr) {
+        operation.next_->prev_ = operation.prev_;
+    }
+    
+    operation.prev_ = nullptr;
+    operation.next_ = nullptr;
+    mPendingOperationCount--;
+}
+
+bool IndiClientT::sendSwitch(const std::string & deviceName, const std::string & propertyName, const std::string & elementName) {
+    if (! this->isServerConnected()) {
+        return false;
+    }
+    
+#if INDI_MAJOR_VERSION < 2
+    INDI::BaseDevice * baseDevice = this->getDevice(deviceName.c_str());
+
+    if (baseDevice == nullptr) {
+        return false;
+    }
+    
+    ISwitchVectorProperty * switchVec = baseDevice->getSwitch(propertyName.c_str());
+
+    if (switchVec == nullptr || IUFindSwitch(switchVec, elementName.c_str()) == nullptr) {
+        return false;
+    }
+
+    if (switchVec->r == ISR_1OFMANY) {
+        IUResetSwitch(switchVec);
+    }
+    IUFindSwitch(switchVec, elementName.c_str())->s = ISS_ON;
+
+    this->sendNewSwitch(switchVec);
+#else
+    INDI::BaseDevice baseDevice = this->getDevice(deviceName.c_str());
+
+    if (! baseDevice.isValid()) {
+        return false;
+    }
+    
+    INDI::PropertySwitch switchProperty = baseDevice.getSwitch(propertyName.c_str());
+
+    if (! switchProperty.isValid() || switchProperty.findWidgetByName(elementName.c_str()) == nullptr) {
+        return false;
+    }
+
+    if (switchProperty.getRule() == ISR_1OFMANY) {
+        switchProperty.reset();
+    }
+    switchProperty.findWidgetByName(elementName.c_str())->setState(ISS_ON);
+
+    this->sendNewSwitch(switchProperty);
+#endif
+
+    return true;
+}
+
+bool IndiClientT::getSwitchState(const std::string & deviceName, const std::string & propertyName, const std::string & elementName,
+                                 bool & elementOn, IPState & propertyState) {
+#if INDI_MAJOR_VERSION < 2
+    INDI::BaseDevice * baseDevice = this->getDevice(deviceName.c_str());
+    ISwitchVectorProperty * switchVec = (baseDevice != nullptr ? baseDevice->getSwitch(propertyName.c_str()) : nullptr);
+    ISwitch * element = (switchVec != nullptr ? IUFindSwitch(switchVec, elementName.c_str()) : nullptr);
+
+    if (element == nullptr) {
+        return false;
+    }
+    elementOn = (element->s == ISS_ON);
+    propertyState = switchVec->s;
+#else
+    INDI::BaseDevice baseDevice = this->getDevice(deviceName.c_str());
+    INDI::PropertySwitch switchProperty = (baseDevice.isValid() ? baseDevice.getSwitch(propertyName.c_str()) : INDI::PropertySwitch());
+    auto * element = (switchProperty.isValid() ? switchProperty.findWidgetByName(elementName.c_str()) : nullptr);
+
+    if (element == nullptr) {
+        return false;
+    }
+    elementOn = (element->getState() == ISS_ON);
+    propertyState = switchProperty.getState();
+#endif
+    return true;
+}
+
+bool IndiClientT::startOperation(IndiPendingOperationT & operation) {
+    bool elementOn = false;
+    IPState propertyState = IPS_IDLE;
+
+    if (getSwitchState(operation.deviceName_, operation.propertyName_, operation.elementName_, elementOn, propertyState)
+        && elementOn && propertyState != IPS_BUSY && propertyState != IPS_ALERT) {
+        // Nothing to wait for - the next update of the property (e.g. a
+        // driver repeating its state) would be taken for the answer.
+        operation.result_ = IndiOperationResultT::ALREADY_SET;
+        operation.resolved_ = true;
+        return false;
+    }
+    
+    {
+        // Register before sending - the answer may arrive before sendSwitch() returns
+        std::lock_guard<std::mutex> guard(mPendingOperationsMutex);
+        operation.armed_ = false;
+        operation.resolved_ = false;
+        operation.transitionSeen_ = ! elementOn;
+        linkPendingOperation(operation);
+    }
+
+    bool sent = sendSwitch(operation.deviceName_, operation.propertyName_, operation.elementName_);
+
+    {
+        std::lock_guard<std::mutex> guard(mPendingOperationsMutex);
+
+        if (operation.resolved_) {
+            // Already answered (or expired) while sending
+            return false;
+        }
+
+        if (! sent) {
+            unlinkPendingOperation(operation);
+            operation.result_ = IndiOperationResultT::NOT_SENT;
+            operation.resolved_ = true;
+            return false;
+        }
+
+        operation.armed_ = true;
+    }
+
+    // The deadline of the new operation may be earlier than the one the
+    // connection manager currently waits for.
+    wakeUpConnectionManager();
+    
+    return true;
+}
+
+bool IndiClientT::setSwitch(const std::string & deviceName, const std::string & propertyName, const std::string & elementName,
+                            std::chrono::milliseconds timeout, OperationCompletionHandlerT completionHandler) {
+    auto * operation = new CallbackOperationT(deviceName, propertyName, elementName, timeout, std::move(completionHandler));
+
+    if (! startOperation(*operation)) {
+        if (operation->getResult() == IndiOperationResultT::NOT_SENT) {
+            delete operation;
+            return false;
+        }
+        operation->completeNow();
+    }
+    return true;
+}
+
+#ifdef INDI_DEVICE_WATCHDOG_HAVE_COROUTINES
+SetSwitchAwaitableT IndiClientT::setSwitch(const std::string & deviceName, const std::string & propertyName, const std::string & elementName,
+                                           std::chrono::milliseconds timeout) {
+    return SetSwitchAwaitableT(*this, deviceName, propertyName, elementName, timeout);
+}
+#endif
+
+/**
+ * Called for each property update (from the INDI client listener thread).
+ * A switch operation succeeds once the driver reports the requested
+ * element as ON with a state other than IPS_BUSY - after a transition:
+ * the element was off when the request was sent, or the driver reported
+ * IPS_BUSY since. IPS_ALERT means the driver rejected or failed the
+ * change.
+ *
+ * Does not allocate - the resolved operations are chained via their
+ * (no longer used) list pointers.
+ */
+void IndiClientT::resolvePendingOperations(INDI::Property property) {
+    IndiPendingOperationT * completedOperations = nullptr;
+    IndiPendingOperationT ** completedOperationsEnd = & completedOperations;
+    auto now = std::chrono::steady_clock::now();
+    
+    {
+        std::lock_guard<std::mutex> guard(mPendingOperationsMutex);
+
+        if (mPendingOperations == nullptr) {
+            return;
+        }
+        
+        const char * deviceName = property.getDeviceName();
+        const char * propertyName = property.getName();
+        IPState propertyState = property.getState();
+        
+        IndiPendingOperationT * operation = mPendingOperations;
+
+        while (operation != nullptr) {
+            IndiPendingOperationT * next = operation->next_;
+            bool resolved = false;
+
+            if (operation->deviceName_ == deviceName && operation->propertyName_ == propertyName) {
+                if (propertyState == IPS_ALERT) {
+                    operation->result_ = IndiOperationResultT::FAILED;
+                    resolved = true;
+                }
+                else if (propertyState == IPS_BUSY) {
+                    operation->transitionSeen_ = true;
+                }
+                else if (operation->transitionSeen_) {
+#if INDI_MAJOR_VERSION < 2
+                    ISwitchVectorProperty * switchVec = property.getSwitch();
+                    ISwitch * element = (switchVec != nullptr ? IUFindSwitch(switchVec, operation->elementName_.c_str()) : nullptr);
+                    bool elementOn = (element != nullptr && element->s == ISS_ON);
+#else
+                    INDI::PropertySwitch switchProperty(property);
+                    auto * element = switchProperty.findWidgetByName(operation->elementName_.c_str());
+                    bool elementOn = (element != nullptr && element->getState() == ISS_ON);
+#endif
+                    if (elementOn) {
+                        operation->result_ = IndiOperationResultT::SUCCEEDED;
+                        resolved = true;
+                    }
+                }
+            }
+
+            if (! resolved && operation->deadline_ <= now) {
+                operation->result_ = IndiOperationResultT::TIMEOUT;
+                resolved = true;
+            }
+
+            if (resolved) {
+                unlinkPendingOperation(*operation);
+                operation->resolved_ = true;
+
+                if (operation->armed_) {
+                    *completedOperationsEnd = operation;
+                    completedOperationsEnd = & operation->next_;
+                }
+            }
+            operation = next;
+        }
+    }
+
+    // Complete outside of the lock - a completion may start new operations
+    completeOperations(completedOperations);
+}
+
+void IndiClientT::completePendingOperations(IndiOperationResultT::TypeE result, bool expiredOnly) {
+    IndiPendingOperationT * completedOperations = nullptr;
+    IndiPendingOperationT ** completedOperationsEnd = & completedOperations;
+    auto now = std::chrono::steady_clock::now();
+
+    {
+        std::lock_guard<std::mutex> guard(mPendingOperationsMutex);
+
+        IndiPendingOperationT * operation = mPendingOperations;
+
+        while (operation != nullptr) {
+            IndiPendingOperationT * next = operation->next_;
+            
+            if (! expiredOnly || operation->deadline_ <= now) {
+                unlinkPendingOperation(*operation);
+                operation->result_ = result;
+                operation->resolved_ = true;
+
+                if (operation->armed_) {
+                    *completedOperationsEnd = operation;
+                    completedOperationsEnd = & operation->next_;
+                }
+            }
+            operation = next;
+        }
+    }
+
+    completeOperations(completedOperations);
+}
+
+void IndiClientT::completeOperations(IndiPendingOperationT * completedOperations) {
+    while (completedOperations != nullptr) {
+        // complete() may free the operation or start it again
+        IndiPendingOperationT * operation = completedOperations;
+        completedOperations = operation->next_;
+        operation->next_ = nullptr;
+        
+        operation->complete(operation->result_);
+    }
+}
+
+void IndiClientT::expirePendingOperations() {
+    completePendingOperations(IndiOperationResultT::TIMEOUT, true /*expired only*/);
+}
+
+void IndiClientT::cancelPendingOperations() {
+    completePendingOperations(IndiOperationResultT::CANCELLED, false /*all*/);
+}
+
+std::chrono::steady_clock::time_point IndiClientT::getNextOperationDeadline() {
+    std::lock_guard<std::mutex> guard(mPendingOperationsMutex);
+
+    auto nextDeadline = std::chrono::steady_clock::time_point::max();
+
+    for (IndiPendingOperationT * operation = mPendingOperations; operation != nullptr; operation = operation->next_) {
+        nextDeadline = std::min(nextDeadline, operation->deadline_);
+    }
+    return nextDeadline;
+}
+
+size_t IndiClientT::getPendingOperationCount() {
+    std::lock_guard<std::mutex> guard(mPendingOperationsMutex);
+    return mPendingOperationCount;
+}
+
 bool IndiClientT::isConnected() const {
     return this->isServerConnected();
 }
@@ -33,8 +33,18 @@
 #include "basedevice.h"
 
 #include "indi_server_connection_state.h"
+#include "indi_operation_result.h"
+#include "indi_pending_operation.h"
+#include "indi_awaitable.h"
+#include "reconnect_policy.h"
 
 #include <boost/signals2.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
 #include <thread>
 
 class IndiClientT : public INDI::BaseClient {
@@ -67,8 +77,42 @@ private:
 
 
     void connectToIndiServerBlocking();
-
-    std::thread mIndiConnectServerThread;
+    void runConnectionManager();
+    void stopConnectionManager();
+    void notifyConnectionStateWaiters();
+
+    // One long-lived thread per client owns the complete connect/reconnect
+    // lifecycle. It is stopped and joined in the destructor so that no
+    // thread can outlive the client.
+    std::thread mConnectionManagerThread;
+    std::mutex mConnectionManagerMutex;
+    std::condition_variable mConnectionManagerCv;
+    std::condition_variable mConnectionStateCv;
+    bool mConnectionWanted;
+    bool mStopConnectionManager;
+    ReconnectPolicyT mReconnectPolicy;
+    std::chrono::steady_clock::time_point mNextConnectionAttemptTime; // Wake-ups before do not retry
+
+    std::atomic<unsigned long> mConnectionAttemptCount;
+    std::atomic<unsigned long> mConnectionThreadStartCount;
+
+    static std::atomic<int> sActiveConnectionThreadCount;
+
+    // Intrusive list of operations waiting for the answer of a driver
+    std::mutex mPendingOperationsMutex;
+    IndiPendingOperationT * mPendingOperations;
+    size_t mPendingOperationCount;
+
+    void linkPendingOperation(IndiPendingOperationT & operation);
+    void unlinkPendingOperation(IndiPendingOperationT & operation);
+    bool sendSwitch(const std::string & deviceName, const std::string & propertyName, const std::string & elementName);
+    bool getSwitchState(const std::string & deviceName, const std::string & propertyName, const std::string & elementName,
+                        bool & elementOn, IPState & propertyState);
+    void resolvePendingOperations(INDI::Property property);
+    void completePendingOperations(IndiOperationResultT::TypeE result, bool expiredOnly);
+    static void completeOperations(IndiPendingOperationT * completedOperations);
+    std::chrono::steady_clock::time_point getNextOperationDeadline();
+    void wakeUpConnectionManager();
 
     // We do not want device copies
     IndiClientT(const IndiClientT &);
@@ -159,12 +203,76 @@ public:
     }
 
 
+    /**
+     * Asks the connection manager thread to connect to the INDI server and
+     * to keep reconnecting while the connection is lost. Does not block.
+     */
     void connect();
 
     void disconnect();
 
     [[nodiscard]] bool isConnected() const;
 
+    /**
+     * Blocks until the client is connected to the INDI server or the
+     * timeout expired. Returns true if connected.
+     */
+    bool waitForConnection(std::chrono::milliseconds timeout);
+
+    void setReconnectPolicy(const ReconnectPolicyT & reconnectPolicy);
+
+    [[nodiscard]] unsigned long getConnectionAttemptCount() const;
+
+    /**
+     * Number of connection manager threads started by this client (at most 1).
+     */
+    [[nodiscard]] unsigned long getConnectionThreadStartCount() const;
+
+    /**
+     * Number of connection manager threads currently alive in the process
+     * (over all client instances).
+     */
+    [[nodiscard]] static int getActiveConnectionThreadCount();
+
+    typedef std::function<void(IndiOperationResultT::TypeE result)> OperationCompletionHandlerT;
+
+    /**
+     * Sends the operation to the INDI server and keeps it pending until
+     * it is resolved. Returns false if the operation was resolved right
+     * away (e.g. with NOT_SENT or - if the element already is on - with
+     * ALREADY_SET) - complete() is then not called and the result is
+     * available from the operation.
+     */
+    bool startOperation(IndiPendingOperationT & operation);
+
+    /**
+     * Turns on the given switch element (in case of a one-of-many switch
+     * all others are turned off) and calls the handler once the driver
+     * confirmed or rejected the change or the timeout expired - or right
+     * away with ALREADY_SET if the element already is on. Returns false
+     * (without calling the handler) if it could not be sent.
+     */
+    bool setSwitch(const std::string & deviceName, const std::string & propertyName, const std::string & elementName,
+                   std::chrono::milliseconds timeout, OperationCompletionHandlerT completionHandler);
+
+  #ifdef INDI_DEVICE_WATCHDOG_HAVE_COROUTINES
+    /**
+     * Awaitable variant of setSwitch(). See SetSwitchAwaitableT.
+     */
+    SetSwitchAwaitableT setSwitch(const std::string & deviceName, const std::string & propertyName, const std::string & elementName,
+                                  std::chrono::milliseconds timeout);
+  #endif
+
+    /**
+     * Timeouts are handled by the connection manager thread. This can be
+     * called in addition to expire operations right away.
+     */
+    void expirePendingOperations();
+
+    void cancelPendingOperations();
+
+    [[nodiscard]] size_t getPendingOperationCount();
+
   //    [[nodiscard]] INDI::BaseDevice getDevice(const std::string &deviceName);
 
 protected:
@@ -174,7 +282,10 @@ protected:
 
     void notifyNewProperty(INDI::Property property) { mNewPropertyListeners(property); }
 
-    void notifyUpdateProperty(INDI::Property property) { mUpdatePropertyListeners(property); }
+    void notifyUpdateProperty(INDI::Property property) {
+        resolvePendingOperations(property);
+        mUpdatePropertyListeners(property);
+    }
 
     void notifyRemoveProperty(INDI::Property property) { mRemovePropertyListeners(property); }
 
@@ -0,0 +1,53 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_INDI_CONNECTION_CYCLE_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_INDI_CONNECTION_CYCLE_H_ SOURCE_INDI_DEVICE_WATCHDOG_INDI_CONNECTION_CYCLE_H_
+
+#include <chrono>
+#include <string>
+
+#include "indi_client.h"
+
+#ifdef INDI_DEVICE_WATCHDOG_HAVE_COROUTINES
+
+/**
+ * Disconnects the INDI device and connects it again - one linear
+ * sequence: the connect request is only sent once the driver confirmed
+ * the disconnect. The handler is called with the result of the step
+ * which did not succeed or with the one of the connect request. The
+ * coroutine runs on the INDI client listener thread once started.
+ *
+ * The arguments are taken by value - they live in the coroutine frame.
+ */
+DetachedIndiTaskT cycleIndiDeviceConnection(IndiClientT & client, std::string indiDeviceName, std::chrono::milliseconds timeout,
+					    IndiClientT::OperationCompletionHandlerT completionHandler);
+
+#endif /* INDI_DEVICE_WATCHDOG_HAVE_COROUTINES */
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_INDI_CONNECTION_CYCLE_H_ */
@@ -31,44 +31,154 @@
 #include <iostream>
 #include <vector>
 #include <filesystem>
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <fstream>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "logging.h"
-#include "wait_for.h"
 
 #include "indi_device_watchdog.h"
+#include "allocation_counter.h"
+#include "indi_connection_cycle.h"
+#include "process_table.h"
+#include "realtime.h"
 
-IndiDeviceWatchdogT::IndiDeviceWatchdogT(const std::string & hostname, int port, int timeoutSec, const std::vector<DeviceDataT> & devicesToMonitor, const std::string & indiBinPath, const std::string & indiServerPipePath) : hostname_(hostname), port_(port), timeoutSec_(timeoutSec), indiDriverRestartManager_(3, indiBinPath, indiServerPipePath) {
+IndiDeviceWatchdogT::IndiDeviceWatchdogT(const std::string & hostname, int port, int timeoutSec, const std::vector<DeviceDataT> & devicesToMonitor, const std::string & indiBinPath, const std::string & indiServerPipePath, const RecoveryActionFactoryT & recoveryActionFactory, const ReconnectPolicyT & reconnectPolicy, std::chrono::milliseconds livenessInterval, std::chrono::milliseconds livenessTimeout, unsigned int evaluationThreadCount, std::shared_ptr<IndiServerSupervisorT> indiServerSupervisor) : hostname_(hostname), port_(port), timeoutSec_(timeoutSec), reconnectPolicy_(reconnectPolicy), connected_(false), serverLost_(false), indiServerSupervisor_(indiServerSupervisor), warmStarting_(false), startupReported_(false), cycleWakeUpRequested_(false), connectionLost_(false), reconnectCount_(0), lastTimeToReconnect_(0), maxTimeToReconnect_(0), totalTimeToReconnect_(0), indiDriverRestartManager_(3, indiBinPath, indiServerPipePath), indiDriverRestartExecutor_(indiDriverRestartManager_, IndiDriverTopologyT(devicesToMonitor)), evaluationPool_(evaluationThreadCount), lastDecisionAllocationCount_(0), maxDecisionAllocationCount_(0), evaluationAllocationCount_(0), cycleCount_(0), selfStatsInterval_(0) {
   using namespace std::chrono_literals;
 
+  indiDriverRestartManager_.setIndiServerSupervisor(indiServerSupervisor_);
+
+  // Fired where the driver is actually started again - in supervisor mode
+  // by the supervisor thread.
+  indiDriverRestartManager_.setDriverRestartedCallback([this](const std::string & indiDriverName) {
+    fireHooks(HookEventT::DRIVER_RESTARTED, indiDriverName);
+  });
+
   resetIndiClient();
   
   // Process config entries to deviceConnections_
   for (auto it = devicesToMonitor.begin(); it != devicesToMonitor.end(); ++it) {
-    deviceConnections_.insert( std::pair<std::string, DeviceDataT>(it->getIndiDeviceName(), *it) );
+    DeviceDataT deviceData = *it;
+    deviceData.setRecoveryLadder(std::make_shared<RecoveryLadderT>(deviceData.getRecoveryStepConfigs(), recoveryActionFactory));
+    
+    deviceConnections_.insert( std::pair<std::string, DeviceDataT>(it->getIndiDeviceName(), deviceData) );
+    indiDriverNames_[it->getIndiDeviceName()] = it->getIndiDeviceDriverName();
+    connectLatenciesUs_[it->getIndiDeviceName()] = -1;
+    messageFailures_[it->getIndiDeviceName()].patternOwner = -1;
+    recoveryTimelines_.emplace(std::piecewise_construct, std::forward_as_tuple(it->getIndiDeviceName()), std::forward_as_tuple(it->getRecoverySlo()));
+  }
+
+  dependencyGraph_ = DeviceDependencyGraphT(devicesToMonitor);
+  cyclePlan_.reserve(deviceConnections_.size());
+
+  const auto & waves = dependencyGraph_.getWaves();
+  
+  for (size_t waveIdx = 0; waveIdx < waves.size() && waves.size() > 1; ++waveIdx) {
+    std::stringstream ss;
+    
+    for (const std::string & indiDeviceName : waves[waveIdx]) {
+      ss << " '" << indiDeviceName << "'";
+    }
+    LOG(info) << "Connection wave " << waveIdx << ":" << ss.str() << std::endl;
+  }
+
+  const IndiDriverTopologyT & driverTopology = indiDriverRestartExecutor_.getTopology();
+  
+  for (const std::string & indiDriverName : driverTopology.getSharedIndiDrivers()) {
+    std::stringstream ss;
+    
+    for (const std::string & indiDeviceName : driverTopology.getIndiDevices(indiDriverName)) {
+      ss << " '" << indiDeviceName << "'";
+    }
+    LOG(info) << "INDI driver '" << indiDriverName << "' serves:" << ss.str() << std::endl;
+  }
+
+  for (const DeviceDataT & deviceData : devicesToMonitor) {
+    std::vector<std::string> & coupledDevices = coupledDevices_[deviceData.getIndiDeviceName()];
+    
+    coupledDevices = driverTopology.getIndiDevices(deviceData.getIndiDeviceDriverName());
+
+    for (const DeviceDataT & otherDeviceData : devicesToMonitor) {
+      const std::vector<std::string> & otherCoupledTo = otherDeviceData.getCoupledTo();
+      
+      if (std::find(deviceData.getCoupledTo().begin(), deviceData.getCoupledTo().end(), otherDeviceData.getIndiDeviceName()) != deviceData.getCoupledTo().end()
+	  || std::find(otherCoupledTo.begin(), otherCoupledTo.end(), deviceData.getIndiDeviceName()) != otherCoupledTo.end()) {
+	coupledDevices.push_back(otherDeviceData.getIndiDeviceName());
+      }
+    }
+    
+    std::sort(coupledDevices.begin(), coupledDevices.end());
+    coupledDevices.erase(std::unique(coupledDevices.begin(), coupledDevices.end()), coupledDevices.end());
+
+    actionDeferrals_[deviceData.getIndiDeviceName()] = ActionDeferralT();
+    livenessMonitor_.addDevice(deviceData.getIndiDeviceName(), deviceData.getLivenessProperties());
+    preemptiveRestarts_[deviceData.getIndiDeviceDriverName()] = PreemptiveRestartT();
+  }
+
+  if (livenessInterval.count() > 0) {
+    livenessProbe_ = std::make_unique<IndiServerLivenessProbeT>(hostname_, port_, livenessInterval, livenessTimeout,
+								[this]() { return getKnownIndiDevices(); },
+								[this](const std::string & reason) { indiServerLost(reason); });
   }
 }
 
 IndiDeviceWatchdogT::~IndiDeviceWatchdogT() {
 
+  if (controlServer_ != nullptr) {
+    controlServer_->stop();
+  }
+
+  if (hookExecutor_ != nullptr) {
+    hookExecutor_->stop();
+  }
+
+  if (livenessProbe_ != nullptr) {
+    livenessProbe_->stop();
+  }
+
+  if (indiServerSupervisor_ != nullptr) {
+    indiServerSupervisor_->stop();
+  }
+
+  if (presenceMonitor_ != nullptr) {
+    presenceMonitor_->stop();
+  }
+
+  if (driverProcessMonitor_ != nullptr) {
+    driverProcessMonitor_->stop();
+  }
+
+  if (remotePresenceClient_ != nullptr) {
+    remotePresenceClient_->stop();
+  }
+  
   serverConnectionFailedListenerConnection_.disconnect();
+  serverConnectionStateChangedListenerConnection_.disconnect();
   newDeviceListenerConnection_.disconnect();
   removeDeviceListenerConnection_.disconnect();
   newPropertyListenerConnection_.disconnect();
   removePropertyListenerConnection_.disconnect();
   updatePropertyListenerConnection_.disconnect();
+  newMessageListenerConnection_.disconnect();
   
   client_->disconnect();
+  client_->cancelPendingOperations();
 }
 
 
 void IndiDeviceWatchdogT::resetIndiClient() {
 
   serverConnectionFailedListenerConnection_.disconnect();
+  serverConnectionStateChangedListenerConnection_.disconnect();
   newDeviceListenerConnection_.disconnect();
   removeDeviceListenerConnection_.disconnect();
   newPropertyListenerConnection_.disconnect();
   removePropertyListenerConnection_.disconnect();
   updatePropertyListenerConnection_.disconnect();
+  newMessageListenerConnection_.disconnect();
 
 
   if (client_ != nullptr) {
@@ -78,17 +188,34 @@ void IndiDeviceWatchdogT::resetIndiClient() {
   LOG(debug) <<"Resetting INDI client..." << std::endl;
 
   connected_ = false;
+
+  {
+    std::lock_guard<std::mutex> guard(knownIndiDevicesMutex_);
+    knownIndiDevices_.clear();
+    devicesWithConnectionProperty_.clear();
+  }
   
   client_ = std::make_shared<IndiClientT>(); // Create a new client
   
   client_->setServer(hostname_.c_str(), port_);
   client_->setConnectionTimeout(timeoutSec_, 0);
+  client_->setReconnectPolicy(reconnectPolicy_);
     
   serverConnectionFailedListenerConnection_ = client_->registerServerConnectionFailedListener([&]() {
     LOG(error) << "Connection to INDI server failed." << std::endl;
     connected_ = false;
   });
 
+  serverConnectionStateChangedListenerConnection_ = client_->registerServerConnectionStateChangedListener([&](IndiServerConnectionStateT::TypeE state) {
+    LOG(debug) << "INDI server connection state: " << IndiServerConnectionStateT::asStr(state) << std::endl;
+
+    if (state == IndiServerConnectionStateT::DISCONNECTED && connected_) {
+      LOG(warning) << "INDI server disconnected." << std::endl;
+      connected_ = false;
+      wakeUp();
+    }
+  });
+
   newDeviceListenerConnection_ = client_->registerNewDeviceListener([&](INDI::BaseDevice device) {
     addIndiDevice(device);
   });
@@ -98,7 +225,7 @@ void IndiDeviceWatchdogT::resetIndiClient() {
   });
 
   newPropertyListenerConnection_ = client_->registerNewPropertyListener([&](INDI::Property property) {
-    propertyUpdated(property);
+    propertyDefined(property);
   });
 
   removePropertyListenerConnection_ = client_->registerRemovePropertyListener([&](INDI::Property property) {
@@ -108,6 +235,10 @@ void IndiDeviceWatchdogT::resetIndiClient() {
   updatePropertyListenerConnection_ = client_->registerUpdatePropertyListener([&](INDI::Property property) {
     propertyUpdated(property);
   });
+
+  newMessageListenerConnection_ = client_->registerNewMessageListener([&](INDI::BaseDevice indiBaseDevice, int messageId) {
+    messageReceived(indiBaseDevice, messageId);
+  });
 }
 
 INDI::BaseDevice IndiDeviceWatchdogT::getBaseDeviceFromProperty(INDI::Property property) {
@@ -131,9 +262,13 @@ void IndiDeviceWatchdogT::addIndiDevice(INDI::BaseDevice indiBaseDevice) {
   if (indiDeviceDataIt != deviceConnections_.end()) {
     indiDeviceDataIt->second.setIndiDeviceName(indiDeviceName);
     indiDeviceDataIt->second.setIndiBaseDevice(indiBaseDevice);
+
+    std::lock_guard<std::mutex> knownIndiDevicesGuard(knownIndiDevicesMutex_);
+    knownIndiDevices_.insert(indiDeviceName);
+    lastPropertyActivity_ = std::chrono::steady_clock::now();
   }
   else {
-    LOG(error) << "NOTE: Not handling INDI device '" << indiDeviceName << "' since it is not on the device list." << std::endl;
+    LOG_DEDUP(error, "unmonitored:" + indiDeviceName, "NOTE: Not handling INDI device '" << indiDeviceName << "' since it is not on the device list.");
   }
 }
 
@@ -150,9 +285,14 @@ void IndiDeviceWatchdogT::removeIndiDevice(INDI::BaseDevice indiBaseDevice) {
 
   if (indiDeviceDataIt != deviceConnections_.end()) {
     indiDeviceDataIt->second.setIndiBaseDevice(INDI::BaseDevice());
+    recoveryTimelines_.at(indiDeviceName).reportLost(std::chrono::steady_clock::now());
+    activityTracker_.reset(indiDeviceName);
+
+    std::lock_guard<std::mutex> knownIndiDevicesGuard(knownIndiDevicesMutex_);
+    knownIndiDevices_.erase(indiDeviceName);
   }
   else {
-    LOG(info) << "NOTE: Not handling INDI device '" << indiDeviceName << "' since it is not on the device list." << std::endl;
+    LOG_DEDUP(info, "unmonitored:" + indiDeviceName, "NOTE: Not handling INDI device '" << indiDeviceName << "' since it is not on the device list.");
   }
 }
 
@@ -162,19 +302,92 @@ void IndiDeviceWatchdogT::propertyRemoved(INDI::Property property) {
 }
 
 
+void IndiDeviceWatchdogT::propertyDefined(INDI::Property property) {
+  {
+    std::lock_guard<std::mutex> guard(knownIndiDevicesMutex_);
+    lastPropertyActivity_ = std::chrono::steady_clock::now();
+
+    if (std::string(property.getName()) == "CONNECTION") {
+      devicesWithConnectionProperty_.insert(property.getDeviceName());
+    }
+  }
+
+  if (warmStarting_) {
+    {
+      // Avoid a lost wake-up of waitForInitialProperties()
+      std::lock_guard<std::mutex> guard(cycleMutex_);
+    }
+    cycleCv_.notify_all();
+  }
+
+  propertyUpdated(property);
+}
+
+
 void IndiDeviceWatchdogT::propertyUpdated(INDI::Property property) {
-  LOG(debug) << "Updated property '" << property.getName() << "'." << std::endl;
+  // Some drivers update e.g. exposure progress several times a second
+  LOG_RATE_LIMITED(debug, 10.0, 50) << "Updated property '" << property.getName() << "'." << std::endl;
+
+  if (std::string(property.getName()) == "CONNECTION") {
+    auto recoveryTimelineIt = recoveryTimelines_.find(property.getDeviceName());
+
+    if (recoveryTimelineIt != recoveryTimelines_.end()) {
+      auto now = std::chrono::steady_clock::now();
+      
+      if (isIndiDeviceConnected(getBaseDeviceFromProperty(property))) {
+	recoveryTimelineIt->second.reportConnected(now);
+	livenessMonitor_.reset(property.getDeviceName(), now);
+	messageFailures_.at(property.getDeviceName()).patternId = -1;
+      }
+      else {
+	recoveryTimelineIt->second.reportLost(now);
+	activityTracker_.reset(property.getDeviceName());
+      }
+    }
+  }
+  else {
+    auto now = std::chrono::steady_clock::now();
+
+    livenessMonitor_.update(property.getDeviceName(), property.getName(), property.getState(), now);
+    
+    if (DeviceActivityTrackerT::isActivityProperty(property.getName()) && coupledDevices_.count(property.getDeviceName()) > 0) {
+      activityTracker_.update(property.getDeviceName(), property.getName(), property.getState(), now);
+    }
+  }
+  
+  // Devices which depend on this one may be connected now
+  if (std::string(property.getName()) == "CONNECTION" && dependencyGraph_.hasDependents(property.getDeviceName())) {
+    wakeUp();
+  }
 }
 
 
-bool IndiDeviceWatchdogT::requestIndiDriverRestart(DeviceDataT & deviceData) {
+DriverRestartResultT::TypeE IndiDeviceWatchdogT::requestIndiDriverRestart(DeviceDataT & deviceData) {
   std::string driverName = deviceData.getIndiDeviceDriverName();
+  bool breakerWasOpen = indiDriverRestartManager_.isBreakerOpen(driverName);
   
-  bool restarted = indiDriverRestartManager_.requestRestart(driverName);
+  DriverRestartResultT::TypeE result = indiDriverRestartExecutor_.request(deviceData.getIndiDeviceName(), std::chrono::steady_clock::now());
+  bool restarted = (result == DriverRestartResultT::RESTARTED);
   
   deviceData.setIndiBaseDevice(INDI::BaseDevice());
 
-  return restarted;
+  if (restarted) {
+    // The other devices of the driver go away and come back with it
+    for (const std::string & indiDeviceName : indiDriverRestartExecutor_.getTopology().getIndiDevices(driverName)) {
+      if (indiDeviceName != deviceData.getIndiDeviceName()) {
+	DeviceDataT & otherDeviceData = deviceConnections_.at(indiDeviceName);
+	
+	otherDeviceData.setIndiBaseDevice(INDI::BaseDevice());
+	otherDeviceData.getRecoveryLadder().reset();
+      }
+    }
+  }
+
+  if (! breakerWasOpen && indiDriverRestartManager_.isBreakerOpen(driverName)) {
+    fireHooks(HookEventT::BREAKER_OPENED, driverName);
+  }
+
+  return result;
 }
 
 
@@ -188,9 +401,9 @@ bool IndiDeviceWatchdogT::isDeviceValid(INDI::BaseDevice indiBaseDevice) {
 
 
 /**
- * NOTE: Just sening this successfully, does not yet mean that it was successfully connected!
- *      --> Actually an updated from the INDI server will be sent once the property has
- *          changed successfully. Only then the connect was successful.
+ * NOTE: Just sending this successfully, does not yet mean that it was successfully connected!
+ *      --> The INDI client resolves the request once the driver updated the property.
+ *          Then the decision loop is woken up to evaluate the device right away.
  */
 bool IndiDeviceWatchdogT::requestConnectionStateChange(INDI::BaseDevice indiBaseDevice, bool connect) {
 
@@ -200,114 +413,353 @@ bool IndiDeviceWatchdogT::requestConnectionStateChange(INDI::BaseDevice indiBase
     return false;
   }
 
+  std::string indiDeviceName = indiBaseDevice.getDeviceName();
+  auto requestTime = std::chrono::steady_clock::now();
+  
+  return client_->setSwitch(indiDeviceName, "CONNECTION", (connect ? "CONNECT" : "DISCONNECT"), std::chrono::seconds(timeoutSec_),
+			    [this, indiDeviceName, connect, requestTime](IndiOperationResultT::TypeE result) {
+			      auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - requestTime);
+			      
+			      LOG(debug) << "INDI device '" << (connect ? "connect" : "disconnect") << "' request for device '" << indiDeviceName
+					 << "' finished after " << latency.count() << " us: " << IndiOperationResultT::asStr(result) << std::endl;
+
+			      auto connectLatencyIt = connectLatenciesUs_.find(indiDeviceName);
+			      
+			      if (connect && result == IndiOperationResultT::SUCCEEDED && connectLatencyIt != connectLatenciesUs_.end()) {
+				connectLatencyIt->second = latency.count();
+			      }
+
+			      if (result != IndiOperationResultT::CANCELLED) {
+				wakeUp();
+			      }
+			    });
+}
 
-#if INDI_MAJOR_VERSION < 2
-    ISwitchVectorProperty* connectionSwitchVec = indiBaseDevice.getSwitch("CONNECTION");
 
-    if (connectionSwitchVec == nullptr) {
-      return false;
-    }
-    
-    // TODO: Better get via propery name "CONNECT" / "DISCONNECT"? -> ISwitch * p = IUFindSwitch(vec, "CONNECT");
-    // TODO: Check switch state - IPS_ALERT / IPS_OK...?
-    // TODO: Check connectionSwitchVec->sp...
-    // connectionSwitchVec->sp[0].s = (connect ? ISS_ON : ISS_OFF);
-    // connectionSwitchVec->sp[1].s = (connect ? ISS_OFF : ISS_ON);
+bool IndiDeviceWatchdogT::fileExists(const std::string & pathToFile) const {
+  // NOTE: std::filesystem::exists() would allocate a path each cycle
+  struct stat st;
+  return (stat(pathToFile.c_str(), & st) == 0);
+}
 
-    
-    ISwitch * connectSwitch = IUFindSwitch(connectionSwitchVec, "CONNECT");
 
-    if (connectSwitch != nullptr) {
-      connectSwitch->s = (connect ? ISS_ON : ISS_OFF);
-    }
+bool IndiDeviceWatchdogT::isIndiDeviceConnected(INDI::BaseDevice indiBaseDevice) {
+
+#if INDI_MAJOR_VERSION < 2
+  ISwitchVectorProperty* connectionSwitchVec = indiBaseDevice.getSwitch("CONNECTION");
+  return (connectionSwitchVec != nullptr ? (connectionSwitchVec->sp != nullptr ? connectionSwitchVec->sp[0].s == ISS_ON : false) : false);  
+#else    
+  INDI::PropertySwitch connectionSwitch = indiBaseDevice.getSwitch("CONNECTION");
+  return (connectionSwitch.isValid() ? (connectionSwitch[0].getState() == ISS_ON ? true : false) : false);
+#endif
+}
 
-    ISwitch * disconnectSwitch = IUFindSwitch(connectionSwitchVec, "DISCONNECT");
 
-    if (disconnectSwitch != nullptr) {
-      disconnectSwitch->s = (connect ? ISS_OFF : ISS_ON);
-    }
+void IndiDeviceWatchdogT::messageReceived(INDI::BaseDevice indiBaseDevice, int messageId) {
+  if (messagePatternMatcher_.empty()) {
+    return;
+  }
 
-    
-    client_->sendNewSwitch(connectionSwitchVec);
+  auto messageFailureIt = messageFailures_.find(indiBaseDevice.getDeviceName());
 
-#else    
-  INDI::PropertySwitch connectionSwitch = indiBaseDevice.getSwitch("CONNECTION");
+  if (messageFailureIt == messageFailures_.end()) {
+    return;
+  }
 
-  if (! connectionSwitch.isValid()) {
-    return false;
+  MessageFailureT & messageFailure = messageFailureIt->second;
+  std::string message = indiBaseDevice.messageQueue(messageId);
+  int patternId = messagePatternMatcher_.match(message.data(), message.size(), messageFailure.patternOwner);
+
+  if (patternId < 0) {
+    return;
   }
 
-  // TODO: Better get via property name "CONNECT" / "DISCONNECT"? 
-  connectionSwitch[0].setState(connect ? ISS_ON : ISS_OFF);
-  connectionSwitch[1].setState(connect ? ISS_OFF : ISS_ON);
+  messageFailure.patternId = patternId;
+  ++messageFailure.matchCount;
 
-  client_->sendNewSwitch(connectionSwitch);
-#endif
+  // A failing driver may repeat its message several times a second
+  LOG_RATE_LIMITED(warning, 1.0, 10) << "INDI device '" << messageFailureIt->first << "' reported a failure ('" << messagePatternMatcher_.getPattern(patternId)
+				     << "'): " << message << std::endl;
+  wakeUp();
+}
+
+
+/**
+ * A connected INDI device must keep updating its liveness properties and
+ * must not report a failure message.
+ */
+bool IndiDeviceWatchdogT::isIndiDeviceResponsive(const DeviceObservationT & observation) {
+  return (observation.staleProperty.propertyName == nullptr && observation.failedMessagePattern < 0);
+}
+
+
+/**
+ * The device is fine if the Linux and the INDI device exist and - if auto
+ * connect is enabled - the INDI device is connected. A connected device
+ * must be responsive.
+ */
+bool IndiDeviceWatchdogT::isDeviceHealthy(const DeviceDataT & deviceData, const DeviceObservationT & observation) {
+  return (observation.linuxDeviceExists && observation.indiDeviceExists && ! observation.linuxDevicePresence.quarantined
+	  && (observation.indiDeviceConnected ? isIndiDeviceResponsive(observation) : ! deviceData.getEnableAutoConnect()));
+}
+
+
+bool IndiDeviceWatchdogT::sendConnectionRequest(DeviceDataT & deviceData, bool connect) {
+  return requestConnectionStateChange(deviceData.getIndiBaseDevice(), connect);
+}
+
+
+bool IndiDeviceWatchdogT::cycleConnection(DeviceDataT & deviceData, ConnectionCycleHandlerT handler) {
+#ifdef INDI_DEVICE_WATCHDOG_HAVE_COROUTINES
+  std::string indiDeviceName = deviceData.getIndiDeviceName();
+
+  LOG(info) << "Disconnecting and connecting INDI device '" << indiDeviceName << "'..." << std::endl;
   
+  cycleIndiDeviceConnection(*client_, indiDeviceName, std::chrono::seconds(timeoutSec_), [this, indiDeviceName, handler](IndiOperationResultT::TypeE result) {
+    LOG(debug) << "Connection cycle of INDI device '" << indiDeviceName << "' finished: " << IndiOperationResultT::asStr(result) << std::endl;
+
+    handler(result == IndiOperationResultT::SUCCEEDED || result == IndiOperationResultT::ALREADY_SET);
+    
+    if (result != IndiOperationResultT::CANCELLED) {
+      wakeUp();
+    }
+  });
   return true;
+#else
+  return false;
+#endif
 }
 
 
-bool IndiDeviceWatchdogT::fileExists(const std::string & pathToFile) const {
-  return std::filesystem::exists(pathToFile);
+DriverRestartResultT::TypeE IndiDeviceWatchdogT::restartIndiDriver(DeviceDataT & deviceData) {
+  return requestIndiDriverRestart(deviceData);
 }
 
 
-bool IndiDeviceWatchdogT::isIndiDeviceConnected(INDI::BaseDevice indiBaseDevice) {
+bool IndiDeviceWatchdogT::linuxDeviceExists(const std::string & linuxDeviceName) const {
+  return (remotePresenceClient_ != nullptr ? remotePresenceClient_->isPresent(linuxDeviceName) : fileExists(linuxDeviceName));
+}
 
-#if INDI_MAJOR_VERSION < 2
-  ISwitchVectorProperty* connectionSwitchVec = indiBaseDevice.getSwitch("CONNECTION");
-  return (connectionSwitchVec != nullptr ? (connectionSwitchVec->sp != nullptr ? connectionSwitchVec->sp[0].s == ISS_ON : false) : false);  
-#else    
-  INDI::PropertySwitch connectionSwitch = indiBaseDevice.getSwitch("CONNECTION");
-  return (connectionSwitch.isValid() ? (connectionSwitch[0].getState() == ISS_ON ? true : false) : false);
-#endif
+
+bool IndiDeviceWatchdogT::hasLinuxDevice(const DeviceDataT & deviceData) const {
+  return linuxDeviceExists(deviceData.getLinuxDeviceName());
 }
 
 
-bool IndiDeviceWatchdogT::handleDeviceConnection(DeviceDataT & deviceData) {
-  std::string indiDeviceName = deviceData.getIndiDeviceName();
+bool IndiDeviceWatchdogT::hasIndiDevice(const DeviceDataT & deviceData) const {
+  return isDeviceValid(deviceData.getIndiBaseDevice());
+}
+
+
+bool IndiDeviceWatchdogT::hasConnectedIndiDevice(const DeviceDataT & deviceData) const {
+  return isIndiDeviceConnected(deviceData.getIndiBaseDevice());
+}
+
+
+DeviceObservationT IndiDeviceWatchdogT::observeDevice(const std::string & indiDeviceName, const std::string & linuxDeviceName, INDI::BaseDevice indiBaseDevice) const {
+  DeviceObservationT observation;
+
+  observation.indiDeviceConnected = isIndiDeviceConnected(indiBaseDevice);
+  observation.indiDeviceExists = isDeviceValid(indiBaseDevice);
+
+  if (observation.indiDeviceConnected) {
+    observation.staleProperty = livenessMonitor_.check(indiDeviceName, std::chrono::steady_clock::now());
+    observation.failedMessagePattern = messageFailures_.at(indiDeviceName).patternId;
+  }
+
+  // The sampled presence is debounced - a single snapshot may be caught
+  // in the middle of a bouncing device.
+  if (presenceMonitor_ != nullptr && presenceMonitor_->getPresence(linuxDeviceName, observation.linuxDevicePresence)) {
+    observation.linuxDeviceExists = observation.linuxDevicePresence.present;
+  }
+  else if (remotePresenceClient_ != nullptr) {
+    remotePresenceClient_->getPresence(linuxDeviceName, observation.linuxDeviceExists, observation.linuxDevicePresence.lastTransitionTime);
+  }
+  else {
+    observation.linuxDeviceExists = fileExists(linuxDeviceName);
+  }
+
+  if (remotePresenceClient_ != nullptr && ! remotePresenceClient_->isSynced()) {
+    // Do not act on a presence which may be outdated
+    observation.linuxDevicePresence.settled = false;
+  }
+
+  return observation;
+}
+
+
+/**
+ * Observes all devices in parallel. Each task only gets copies of the
+ * data it needs and writes to its own slot of the result. The result is
+ * the plan which is then executed serially by handleDeviceConnection().
+ *
+ * NOTE: deviceConnectionsMutex_ must be held by the caller.
+ */
+const std::vector<std::pair<DeviceDataT *, DeviceObservationT> > & IndiDeviceWatchdogT::evaluateDevices() {
+  std::vector<std::pair<DeviceDataT *, DeviceObservationT> > & plan = cyclePlan_;
+  plan.clear(); // Keeps the capacity
+
+  // Dependencies first (wave by wave)
+  for (const auto & wave : dependencyGraph_.getWaves()) {
+    for (const std::string & indiDeviceName : wave) {
+      auto deviceDataIt = deviceConnections_.find(indiDeviceName);
+
+      if (deviceDataIt != deviceConnections_.end()) {
+	plan.emplace_back(& deviceDataIt->second, DeviceObservationT());
+      }
+    }
+  }
+
+  // Devices on a dependency cycle are not part of any wave
+  for (auto it = deviceConnections_.begin(); it != deviceConnections_.end() && plan.size() < deviceConnections_.size(); ++it) {
+    if (std::find_if(plan.begin(), plan.end(), [& it](const auto & planEntry) { return planEntry.first == & it->second; }) == plan.end()) {
+      plan.emplace_back(& it->second, DeviceObservationT());
+    }
+  }
+
+  for (size_t idx = 0; idx < plan.size(); ++idx) {
+    // The device data is not modified before waitIdle() returns. A
+    // small capture is stored in place by std::function.
+    std::pair<DeviceDataT *, DeviceObservationT> * planEntry = & plan[idx];
+
+    evaluationPool_.submit([this, planEntry]() {
+      uint64_t allocationCountBefore = allocation_counter::getThreadAllocationCount();
+      
+      planEntry->second = observeDevice(planEntry->first->getIndiDeviceName(), planEntry->first->getLinuxDeviceName(), planEntry->first->getIndiBaseDevice());
+
+      evaluationAllocationCount_.fetch_add(allocation_counter::getThreadAllocationCount() - allocationCountBefore, std::memory_order_relaxed);
+    });
+  }
+
+  evaluationPool_.waitIdle();
+
+  return plan;
+}
+
+
+bool IndiDeviceWatchdogT::areDependenciesConnected(const DeviceDataT & deviceData, const std::vector<std::pair<DeviceDataT *, DeviceObservationT> > & plan) const {
+  for (const std::string & dependency : dependencyGraph_.getDependencies(deviceData.getIndiDeviceName())) {
+    auto planEntryIt = std::find_if(plan.begin(), plan.end(), [& dependency](const auto & planEntry) { return planEntry.first->getIndiDeviceName() == dependency; });
+
+    if (planEntryIt == plan.end() || ! planEntryIt->second.indiDeviceConnected) {
+      return false;
+    }
+  }
+  return true;
+}
+
 
-  bool indiDeviceConnected = isIndiDeviceConnected(deviceData.getIndiBaseDevice());
-  bool linuxDeviceExists = fileExists(deviceData.getLinuxDeviceName());
-  bool indiDeviceExists = isDeviceValid(deviceData.getIndiBaseDevice());
+/**
+ * Returns true if the INDI client needs to be reset (e.g. because
+ * an INDI driver was restarted).
+ */
+bool IndiDeviceWatchdogT::handleDeviceConnection(DeviceDataT & deviceData, const DeviceObservationT & observation, bool dependenciesConnected) {
+  const std::string & indiDeviceName = deviceData.getIndiDeviceName();
+
+  bool indiDeviceConnected = observation.indiDeviceConnected;
+  bool linuxDeviceExists = observation.linuxDeviceExists;
+  bool indiDeviceExists = observation.indiDeviceExists;
+  const DevicePresenceT & linuxDevicePresence = observation.linuxDevicePresence;
+  const PropertyStalenessT & staleProperty = observation.staleProperty;
   
-  LOG(info) << "Processing '" << indiDeviceName << "' -> Linux device exists? " << linuxDeviceExists << ", INDI device exists? " << indiDeviceExists << ", INDI device connected? " << indiDeviceConnected;
-  LOG(debug) << " (details: " << deviceData << ")" << std::endl;
+  // Evaluated every cycle - only log what changed.
+  LOG_DEDUP(info, "processing:" + indiDeviceName, "Processing '" << indiDeviceName << "' -> Linux device exists? " << linuxDeviceExists << ", INDI device exists? " << indiDeviceExists
+	    << ", INDI device connected? " << indiDeviceConnected << ", Linux device presence changes: " << linuxDevicePresence.flapCount);
+  LOG_DEDUP(debug, "details:" + indiDeviceName, "Details of '" << indiDeviceName << "': " << deviceData);
+
+  RecoveryLadderT & recoveryLadder = deviceData.getRecoveryLadder();
+
+  if (pausedDevices_.count(indiDeviceName) > 0) {
+    LOG_DEDUP(info, "waiting:" + indiDeviceName, "Monitoring of '" << indiDeviceName << "' is paused.");
+    recoveryLadder.reset();
+    return false;
+  }
+
+  if (linuxDevicePresence.quarantined) {
+    // Connecting, disconnecting or restarting the INDI driver of a
+    // bouncing device only causes churn.
+    LOG_RATE_LIMITED(warning, 0.2, 3) << "Linux device of '" << indiDeviceName << "' is flapping - quarantined for another " << linuxDevicePresence.remainingQuarantine.count()
+		 << " ms (presence changes: " << linuxDevicePresence.flapCount << ", quarantines: " << linuxDevicePresence.quarantineCount << ")." << std::endl;
+    recoveryLadder.reset();
+    return false;
+  }
+
+  if (! linuxDevicePresence.settled) {
+    LOG_DEDUP(info, "waiting:" + indiDeviceName, "Waiting for the presence of the Linux device of '" << indiDeviceName << "' to settle.");
+    return false;
+  }
   
   if (linuxDeviceExists) {
-    // Linux device already existed before
-    if (! indiDeviceExists) {
-      // Linux device is there but corresponding INDI base
-      // device does not exist -> Restart INDI driver
-      return requestIndiDriverRestart(deviceData);
+    // Linux device is there. The INDI device is fine if it exists
+    // and - if auto connect is enabled - is connected. A connected
+    // device must not hang.
+    bool indiDeviceHealthy = indiDeviceExists && (indiDeviceConnected ? isIndiDeviceResponsive(observation) : ! deviceData.getEnableAutoConnect());
+
+    if (indiDeviceHealthy) {
+      recoveryLadder.reset();
+      finishActionDeferral(indiDeviceName);
+      indiDriverRestartManager_.reportHealthy(deviceData.getIndiDeviceDriverName());
+      indiDriverRestartExecutor_.reportRecovered(indiDeviceName);
+      return false;
     }
-    else {
-      // Linux device is there and corresponding INDI base
-      // device exists -> connect if auto connect is enabled
-      // and INDI device is not connected
-      if (! indiDeviceConnected && deviceData.getEnableAutoConnect()) {
-	// Try to connect INDI device
-	bool successful = requestConnectionStateChange(deviceData.getIndiBaseDevice(), true);
-
-	if (! successful) {
-	  // If connection fails, restart INDI driver
-	  return requestIndiDriverRestart(deviceData);
-	}
+
+    if (staleProperty.propertyName != nullptr) {
+      if (staleProperty.busy) {
+	LOG_DEDUP(warning, "stale:" + indiDeviceName, "INDI device '" << indiDeviceName << "' is connected, but property '" << staleProperty.propertyName
+		  << "' is busy for more than " << staleProperty.limit.count() << " ms - the INDI driver seems to hang.");
       }
+      else {
+	LOG_DEDUP(warning, "stale:" + indiDeviceName, "INDI device '" << indiDeviceName << "' is connected, but property '" << staleProperty.propertyName
+		  << "' was not updated for more than " << staleProperty.limit.count() << " ms - the INDI driver seems to hang.");
+      }
+    }
+
+    if (observation.failedMessagePattern >= 0) {
+      LOG_DEDUP(warning, "message:" + indiDeviceName, "INDI device '" << indiDeviceName << "' is connected, but reported a failure ('"
+		<< messagePatternMatcher_.getPattern(observation.failedMessagePattern) << "').");
+    }
+    
+    if (indiDriverRestartExecutor_.isRecoveryPending(indiDeviceName, std::chrono::steady_clock::now())) {
+      // The shared INDI driver was restarted for another device
+      LOG_DEDUP(info, "waiting:" + indiDeviceName, "Waiting for '" << indiDeviceName << "' to come back with the restarted INDI driver '" << deviceData.getIndiDeviceDriverName() << "'.");
+      return false;
+    }
+
+    if (! dependenciesConnected) {
+      // Do not waste attempts while e.g. the hub or the CCD this
+      // device is attached to is not connected.
+      LOG_DEDUP(info, "waiting:" + indiDeviceName, "Waiting for the dependencies of '" << indiDeviceName << "' to be connected.");
+      recoveryLadder.reset();
+      return false;
+    }
+
+    // Do not throw away e.g. an exposure of a coupled device. The
+    // activity of a hanging or failed device itself is meaningless.
+    if (deferDisruptiveAction(deviceData, ! isIndiDeviceResponsive(observation), std::chrono::steady_clock::now())) {
+      return false;
     }
+    
+    // Otherwise walk up the recovery ladder - starting with the
+    // cheapest remedy. If the INDI device does not exist, the
+    // connect steps are skipped and the INDI driver is restarted.
+    recoveryTimelines_.at(indiDeviceName).recordAction(std::chrono::steady_clock::now());
+    return recoveryLadder.process(*this, deviceData);
   }
   else {
-    // Linux device does not exist
-    if (indiDeviceConnected) {
+    // Linux device does not exist. A running recovery step (e.g. a USB
+    // re-authorization) may cause this temporarily.
+    recoveryLadder.settle(*this, deviceData);
+
+    if (indiDeviceConnected && ! recoveryLadder.isActive()) {
       // Disconnect INDI device
+      recoveryTimelines_.at(indiDeviceName).recordAction(std::chrono::steady_clock::now());
       bool successful = requestConnectionStateChange(deviceData.getIndiBaseDevice(), false);
 
       deviceData.setIndiBaseDevice(INDI::BaseDevice());
       
       if (! successful) {
 	// If disconnect fails, restart INDI driver
-	return requestIndiDriverRestart(deviceData);
+	return (requestIndiDriverRestart(deviceData) == DriverRestartResultT::RESTARTED);
       }
     }
   }
@@ -316,51 +768,1142 @@ bool IndiDeviceWatchdogT::handleDeviceConnection(DeviceDataT & deviceData) {
 }
 
 
-void IndiDeviceWatchdogT::run() {
-  using namespace std::chrono_literals;
-
-
-  // Try to connect to the INDI server forever
-  while(true) {
-    LOG(info) << "Trying to connect to INDI server...";
+void IndiDeviceWatchdogT::recordReconnect() {
+  if (! connectionLost_) {
+    return;
+  }
+  
+  connectionLost_ = false;
 
-    // Try to (re-) connect to the INDI server
-    client_->connect();
+  auto timeToReconnect = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - connectionLostTime_);
 
-    auto isClientConnected = [&]() -> bool {
-      return client_->isConnected();
-    };
+  reconnectCount_++;
+  lastTimeToReconnect_ = timeToReconnect;
+  maxTimeToReconnect_ = std::max(maxTimeToReconnect_, timeToReconnect);
+  totalTimeToReconnect_ += timeToReconnect;
   
-    try {
-      wait_for(isClientConnected, 5000ms);
-      connected_ = true;
-    } catch (std::runtime_error & exc) {
-      LOG(info) << "Timeout!" << std::endl;
-      connected_ = false;
-      continue;
-    }
-
-    LOG(info) << "Connected!" << std::endl;
+  LOG(info) << "Reconnected to INDI server after " << timeToReconnect.count() << " ms (reconnects: " << reconnectCount_
+	    << ", avg: " << (totalTimeToReconnect_.count() / reconnectCount_) << " ms"
+	    << ", max: " << maxTimeToReconnect_.count() << " ms"
+	    << ", connection attempts: " << client_->getConnectionAttemptCount() << ")." << std::endl;
+}
 
-    while(connected_) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(5000ms));
 
-      std::lock_guard<std::mutex> guard(deviceConnectionsMutex_);
-      
-      for (auto it = deviceConnections_.begin(); it != deviceConnections_.end(); ++it) {
-	bool restarted = handleDeviceConnection(it->second);
+std::vector<std::string> IndiDeviceWatchdogT::getKnownIndiDevices() {
+  std::lock_guard<std::mutex> guard(knownIndiDevicesMutex_);
+  return std::vector<std::string>(knownIndiDevices_.begin(), knownIndiDevices_.end());
+}
 
-	if (restarted) {
-	  resetIndiClient();
-	  
-	  break;
-	}
-      }
-      
-      LOG(info) << std::endl << std::endl;
-    }
 
-    LOG(info) << "Lost connection to INDI server." << std::endl;
+/**
+ * Called by the liveness probe (from its own thread).
+ */
+void IndiDeviceWatchdogT::indiServerLost(const std::string & reason) {
+  if (! connected_) {
+    return;
   }
 
+  LOG(warning) << "INDI server liveness check failed: " << reason << std::endl;
+
+  serverLost_ = true;
+  connected_ = false;
+  wakeUp();
+}
+
+
+void IndiDeviceWatchdogT::wakeUp() {
+  {
+    std::lock_guard<std::mutex> guard(cycleMutex_);
+    cycleWakeUpRequested_ = true;
+  }
+  cycleCv_.notify_all();
+}
+
+
+void IndiDeviceWatchdogT::waitForNextCycle(std::chrono::milliseconds cycleTime) {
+  std::unique_lock<std::mutex> lock(cycleMutex_);
+  cycleCv_.wait_for(lock, cycleTime, [this]() { return cycleWakeUpRequested_; });
+  cycleWakeUpRequested_ = false;
+}
+
+
+/**
+ * Time since the start of this process (based on /proc, resolution of
+ * one clock tick). Returns a negative value if it cannot be determined.
+ */
+static std::chrono::milliseconds getProcessAge() {
+  std::ifstream statFile("/proc/self/stat");
+  std::ifstream uptimeFile("/proc/uptime");
+  std::string stat;
+  double uptimeSec = 0;
+
+  if (! std::getline(statFile, stat) || ! (uptimeFile >> uptimeSec)) {
+    return std::chrono::milliseconds(-1);
+  }
+
+  // The process name (field 2) may contain spaces - skip behind it
+  size_t fieldsPos = stat.rfind(')');
+
+  if (fieldsPos == std::string::npos) {
+    return std::chrono::milliseconds(-1);
+  }
+  
+  std::istringstream fields(stat.substr(fieldsPos + 2));
+  std::string field;
+  unsigned long long startTimeTicks = 0;
+
+  // Field 22 is the start time - field 3 is the first one after the name
+  for (int fieldIdx = 3; fieldIdx <= 22 && fields >> field; ++fieldIdx) {
+    if (fieldIdx == 22) {
+      startTimeTicks = std::stoull(field);
+    }
+  }
+
+  double ageSec = uptimeSec - static_cast<double>(startTimeTicks) / sysconf(_SC_CLK_TCK);
+
+  return std::chrono::milliseconds(static_cast<long>(ageSec * 1000.0));
+}
+
+
+void IndiDeviceWatchdogT::setRestartStateFilePath(const std::string & restartStateFilePath) {
+  indiDriverRestartManager_.openRestartStateFile(restartStateFilePath);
+}
+
+
+void IndiDeviceWatchdogT::setDriverRestartCoalesceWindow(std::chrono::milliseconds coalesceWindow) {
+  indiDriverRestartExecutor_.setCoalesceWindow(coalesceWindow);
+}
+
+
+void IndiDeviceWatchdogT::enableFlapDetection(std::chrono::milliseconds sampleInterval, const FlapPolicyT & flapPolicy) {
+  std::vector<std::string> linuxDeviceNames;
+  
+  {
+    std::lock_guard<std::mutex> guard(deviceConnectionsMutex_);
+
+    for (const auto & deviceConnection : deviceConnections_) {
+      linuxDeviceNames.push_back(deviceConnection.second.getLinuxDeviceName());
+    }
+  }
+
+  presenceMonitor_ = std::make_unique<DevicePresenceMonitorT>(linuxDeviceNames, sampleInterval, flapPolicy, [this](const std::string & linuxDeviceName) {
+    LOG(debug) << "Presence of Linux device '" << linuxDeviceName << "' changed." << std::endl;
+    wakeUp();
+  }, [this](const std::string & linuxDeviceName) {
+    return linuxDeviceExists(linuxDeviceName);
+  });
+}
+
+
+void IndiDeviceWatchdogT::enableRemotePresence(const std::string & hostname, int port, const std::string & token) {
+  std::vector<std::string> linuxDeviceNames;
+  
+  {
+    std::lock_guard<std::mutex> guard(deviceConnectionsMutex_);
+
+    for (const auto & deviceConnection : deviceConnections_) {
+      const std::string & linuxDeviceName = deviceConnection.second.getLinuxDeviceName();
+      
+      if (std::find(linuxDeviceNames.begin(), linuxDeviceNames.end(), linuxDeviceName) == linuxDeviceNames.end()) {
+	linuxDeviceNames.push_back(linuxDeviceName);
+      }
+    }
+  }
+
+  remotePresenceClient_ = std::make_unique<RemotePresenceClientT>(hostname, port, token, linuxDeviceNames, reconnectPolicy_);
+  remotePresenceClient_->start();
+}
+
+
+void IndiDeviceWatchdogT::setStateSnapshotPath(const std::string & stateSnapshotPath) {
+  stateSnapshotPath_ = stateSnapshotPath;
+
+  if (! stateSnapshotPath_.empty()) {
+    stateSnapshot_ = state_snapshot::load(stateSnapshotPath_);
+
+    LOG(debug) << "Loaded state snapshot of " << stateSnapshot_.size() << " devices from '" << stateSnapshotPath_ << "'." << std::endl;
+  }
+}
+
+
+void IndiDeviceWatchdogT::saveStateSnapshot(const std::vector<std::pair<DeviceDataT *, DeviceObservationT> > & plan) {
+  if (stateSnapshotPath_.empty()) {
+    return;
+  }
+
+  // Only write if something changed - the snapshot may live on an SD card.
+  // Compared in place, a new map is only built if it is written.
+  bool changed = (stateSnapshot_.size() != plan.size());
+
+  for (auto planEntryIt = plan.begin(); planEntryIt != plan.end() && ! changed; ++planEntryIt) {
+    auto deviceStateIt = stateSnapshot_.find(planEntryIt->first->getIndiDeviceName());
+
+    changed = (deviceStateIt == stateSnapshot_.end()
+	       || deviceStateIt->second.linuxDeviceExists != planEntryIt->second.linuxDeviceExists
+	       || deviceStateIt->second.indiDeviceExists != planEntryIt->second.indiDeviceExists
+	       || deviceStateIt->second.indiDeviceConnected != planEntryIt->second.indiDeviceConnected);
+  }
+
+  if (! changed) {
+    return;
+  }
+  
+  state_snapshot::DeviceStateMapT deviceStates;
+
+  for (const auto & planEntry : plan) {
+    DeviceStateSnapshotT & deviceState = deviceStates[planEntry.first->getIndiDeviceName()];
+
+    deviceState.linuxDeviceExists = planEntry.second.linuxDeviceExists;
+    deviceState.indiDeviceExists = planEntry.second.indiDeviceExists;
+    deviceState.indiDeviceConnected = planEntry.second.indiDeviceConnected;
+  }
+
+  state_snapshot::save(deviceStates, stateSnapshotPath_);
+  stateSnapshot_ = deviceStates;
+}
+
+
+/**
+ * The INDI devices which are expected to show up after connecting to the
+ * INDI server: the ones which existed at the end of the last run - or if
+ * there is no snapshot - the ones whose Linux device exists.
+ */
+std::set<std::string> IndiDeviceWatchdogT::getExpectedIndiDevices() {
+  std::set<std::string> expectedIndiDevices;
+  std::lock_guard<std::mutex> guard(deviceConnectionsMutex_);
+
+  for (const auto & deviceConnection : deviceConnections_) {
+    auto snapshotIt = stateSnapshot_.find(deviceConnection.first);
+    bool expected = (snapshotIt != stateSnapshot_.end() ? snapshotIt->second.indiDeviceExists : linuxDeviceExists(deviceConnection.second.getLinuxDeviceName()));
+
+    if (expected) {
+      expectedIndiDevices.insert(deviceConnection.first);
+    }
+  }
+  return expectedIndiDevices;
+}
+
+
+/**
+ * After connecting, the INDI server sends the properties of all devices.
+ * Wait until the CONNECTION property of all expected devices arrived (or
+ * no property arrived for a short quiet period) so that the first cycle
+ * can reconcile all devices at once.
+ */
+void IndiDeviceWatchdogT::waitForInitialProperties() {
+  using namespace std::chrono_literals;
+
+  const std::chrono::milliseconds quietPeriod = 500ms;
+  
+  std::set<std::string> expectedIndiDevices = getExpectedIndiDevices();
+  auto startTime = std::chrono::steady_clock::now();
+  auto deadline = startTime + std::chrono::seconds(timeoutSec_);
+  size_t reportedDeviceCount = 0;
+  const char * reason = "timeout";
+  
+  warmStarting_ = true;
+  
+  std::unique_lock<std::mutex> lock(cycleMutex_);
+
+  while (connected_) {
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point lastPropertyActivity;
+    
+    {
+      std::lock_guard<std::mutex> guard(knownIndiDevicesMutex_);
+      lastPropertyActivity = std::max(lastPropertyActivity_, startTime);
+      reportedDeviceCount = std::count_if(expectedIndiDevices.begin(), expectedIndiDevices.end(), [this](const std::string & indiDeviceName) {
+	return devicesWithConnectionProperty_.count(indiDeviceName) > 0;
+      });
+    }
+
+    if (reportedDeviceCount == expectedIndiDevices.size()) {
+      reason = "all expected devices reported";
+      break;
+    }
+
+    if (now - lastPropertyActivity >= quietPeriod) {
+      reason = "quiet period";
+      break;
+    }
+
+    if (now >= deadline) {
+      break;
+    }
+    
+    cycleCv_.wait_until(lock, std::min(deadline, lastPropertyActivity + quietPeriod));
+  }
+
+  warmStarting_ = false;
+  
+  LOG(info) << "Initial INDI property burst complete after "
+	    << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count() << " ms ("
+	    << reason << ", " << reportedDeviceCount << "/" << expectedIndiDevices.size() << " expected devices reported)." << std::endl;
+}
+
+
+void IndiDeviceWatchdogT::enableDriverProcessMonitoring(std::chrono::milliseconds sampleInterval, const DriverProcessLimitsT & limits) {
+  std::vector<std::string> indiDriverNames;
+
+  for (const auto & preemptiveRestartEntry : preemptiveRestarts_) {
+    indiDriverNames.push_back(preemptiveRestartEntry.first);
+  }
+
+  // In supervisor mode the INDI server is a child of the watchdog
+  std::shared_ptr<IndiServerSupervisorT> indiServerSupervisor = indiServerSupervisor_;
+
+  driverProcessMonitor_ = std::make_unique<DriverProcessMonitorT>(indiDriverNames, sampleInterval, limits, [indiServerSupervisor]() {
+    return (indiServerSupervisor != nullptr ? indiServerSupervisor->getIndiServerPid() : process_table::findProcess("indiserver"));
+  });
+}
+
+
+void IndiDeviceWatchdogT::enableControlServer(const std::string & socketPath) {
+  controlServer_ = std::make_unique<ControlServerT>(socketPath,
+						    [this]() { return getStatus(); },
+						    [this](const ControlCommandT & command) { return queueControlCommand(command); });
+}
+
+
+void IndiDeviceWatchdogT::setHooks(const std::vector<HookConfigT> & hooks) {
+  if (! hooks.empty()) {
+    hookExecutor_ = std::make_unique<HookExecutorT>(hooks);
+  }
+}
+
+
+void IndiDeviceWatchdogT::setMessagePatterns(const std::vector<MessagePatternConfigT> & messagePatterns) {
+  std::vector<std::string> indiDriverNames;
+  
+  for (const auto & indiDriverNameEntry : indiDriverNames_) {
+    indiDriverNames.push_back(indiDriverNameEntry.second);
+  }
+
+  messagePatternMatcher_ = MessagePatternMatcherT();
+  messagePatternMatcher_.setOwnerNames(indiDriverNames);
+  
+  for (const MessagePatternConfigT & messagePattern : messagePatterns) {
+    int patternOwner = -1;
+    
+    if (! messagePattern.indiDriverName.empty()) {
+      patternOwner = messagePatternMatcher_.getOwner(messagePattern.indiDriverName);
+
+      if (patternOwner < 0) {
+	LOG(warning) << "Message pattern '" << messagePattern.pattern << "' refers to INDI driver '" << messagePattern.indiDriverName << "' which is not monitored - ignoring it." << std::endl;
+	continue;
+      }
+    }
+    messagePatternMatcher_.addPattern(messagePattern.pattern, patternOwner);
+  }
+  messagePatternMatcher_.compile();
+
+  for (const auto & indiDriverNameEntry : indiDriverNames_) {
+    messageFailures_.at(indiDriverNameEntry.first).patternOwner = messagePatternMatcher_.getOwner(indiDriverNameEntry.second);
+  }
+}
+
+
+void IndiDeviceWatchdogT::fireHooks(HookEventT::TypeE event, const std::string & subject) {
+  if (hookExecutor_ != nullptr) {
+    hookExecutor_->fire(event, subject);
+  }
+}
+
+
+void IndiDeviceWatchdogT::setSelfStatsInterval(std::chrono::seconds selfStatsInterval) {
+  selfStatsInterval_ = selfStatsInterval;
+}
+
+
+void IndiDeviceWatchdogT::reportSelfStats() {
+  auto now = std::chrono::steady_clock::now();
+  
+  if (selfStatsInterval_.count() <= 0 || (cycleCount_ > 0 && now - lastSelfStatsTime_ < selfStatsInterval_)) {
+    return;
+  }
+
+  lastSelfStatsTime_ = now;
+  selfStats_ = SelfStatsT::sample();
+
+  if (allocation_counter::isEnabled()) {
+    LOG(info) << "Self stats: " << selfStats_ << ", INDI connection threads: " << IndiClientT::getActiveConnectionThreadCount()
+	      << ", heap allocations: " << allocation_counter::getAllocationCount() << " (decision loop: " << lastDecisionAllocationCount_ << " last, "
+	      << maxDecisionAllocationCount_ << " max per cycle)" << std::endl;
+  }
+  else {
+    LOG(info) << "Self stats: " << selfStats_ << ", INDI connection threads: " << IndiClientT::getActiveConnectionThreadCount() << std::endl;
+  }
+
+  if (driverProcessMonitor_ != nullptr) {
+    for (const auto & preemptiveRestartEntry : preemptiveRestarts_) {
+      DriverProcessStatsT stats;
+
+      if (driverProcessMonitor_->getStats(preemptiveRestartEntry.first, stats) && stats.pid > 0) {
+	LOG(info) << "INDI driver '" << preemptiveRestartEntry.first << "': " << stats << " (preemptive restarts: " << preemptiveRestartEntry.second.restartCount << ")" << std::endl;
+      }
+    }
+  }
+  
+  reportRecoveryStats();
+}
+
+
+void IndiDeviceWatchdogT::setRecoveryStatsFilePath(const std::string & recoveryStatsFilePath) {
+  recoveryStatsFilePath_ = recoveryStatsFilePath;
+}
+
+
+bool IndiDeviceWatchdogT::setRealtimeScheduling(const std::string & policy, int priority) {
+  // The decision thread waits for the evaluation threads in each cycle
+  if (! realtime::setSchedulingPolicy(pthread_self(), policy, priority) || ! evaluationPool_.setSchedulingPolicy(policy, priority)) {
+    return false;
+  }
+
+  LOG(info) << "Decision loop and " << evaluationPool_.getNumThreads() << " evaluation threads run with real-time scheduling policy '" << policy
+	    << "', priority " << priority << "." << std::endl;
+
+  return true;
+}
+
+
+void IndiDeviceWatchdogT::observeRecoveries(const std::vector<std::pair<DeviceDataT *, DeviceObservationT> > & plan, std::chrono::steady_clock::time_point now) {
+  for (const auto & planEntry : plan) {
+    const DeviceDataT & deviceData = *planEntry.first;
+    const DeviceObservationT & observation = planEntry.second;
+    DeviceRecoveryTimelineT & recoveryTimeline = recoveryTimelines_.at(deviceData.getIndiDeviceName());
+
+    // Without flap detection or presence agent the plug-in time is only known to the cycle
+    auto linuxDeviceChangeTime = (presenceMonitor_ != nullptr || remotePresenceClient_ != nullptr ? observation.linuxDevicePresence.lastTransitionTime : now);
+    
+    if (recoveryTimeline.observe(isDeviceHealthy(deviceData, observation), observation.linuxDeviceExists, linuxDeviceChangeTime, observation.indiDeviceConnected, now)) {
+      LOG(warning) << "Recovery SLO violated: '" << deviceData.getIndiDeviceName() << "' was connected " << recoveryTimeline.getLastPlugInToConnected().count()
+		   << " ms after plug-in (SLO: " << recoveryTimeline.getRecoverySlo().count() << " ms, violations: " << recoveryTimeline.getSloViolationCount() << ")." << std::endl;
+    }
+  }
+}
+
+
+/**
+ * Returns the number of exposures completed by the coupled devices so
+ * far. busyDeviceName is the first busy coupled device (nullptr if all
+ * are idle).
+ */
+unsigned long IndiDeviceWatchdogT::getCoupledActivity(const std::string & indiDeviceName, bool ignoreOwnActivity, const std::string * & busyDeviceName, const char * & busyPropertyName) const {
+  unsigned long completedExposureCount = 0;
+
+  busyDeviceName = nullptr;
+  busyPropertyName = nullptr;
+  
+  for (const std::string & coupledDevice : coupledDevices_.at(indiDeviceName)) {
+    DeviceActivityT activity;
+
+    if (! activityTracker_.getActivity(coupledDevice, activity)) {
+      continue;
+    }
+    
+    completedExposureCount += activity.completedExposureCount;
+    
+    if (activity.busy && busyDeviceName == nullptr && ! (ignoreOwnActivity && coupledDevice == indiDeviceName)) {
+      busyDeviceName = & coupledDevice;
+      busyPropertyName = activity.busyPropertyName;
+    }
+  }
+  return completedExposureCount;
+}
+
+
+/**
+ * Returns true if the recovery of the device shall wait since a coupled
+ * device is busy - until the max. action deferral of the device passed.
+ */
+bool IndiDeviceWatchdogT::deferDisruptiveAction(const DeviceDataT & deviceData, bool ignoreOwnActivity, std::chrono::steady_clock::time_point now) {
+  const std::string & indiDeviceName = deviceData.getIndiDeviceName();
+  ActionDeferralT & deferral = actionDeferrals_.at(indiDeviceName);
+  const std::string * busyDeviceName;
+  const char * busyPropertyName;
+  unsigned long completedExposureCount = getCoupledActivity(indiDeviceName, ignoreOwnActivity, busyDeviceName, busyPropertyName);
+
+  if (busyDeviceName == nullptr || deferral.expired) {
+    if (busyDeviceName == nullptr) {
+      finishActionDeferral(indiDeviceName);
+    }
+    return false;
+  }
+
+  if (! deferral.active) {
+    deferral.active = true;
+    deferral.since = now;
+    deferral.completedExposureCountAtStart = completedExposureCount;
+    deferral.deferredActionCount++;
+  }
+
+  auto deferredFor = std::chrono::duration_cast<std::chrono::milliseconds>(now - deferral.since);
+  
+  if (deferredFor >= deviceData.getMaxActionDeferral()) {
+    LOG(warning) << "Recovery of '" << indiDeviceName << "' was deferred for " << deferredFor.count() << " ms - '" << *busyDeviceName
+		 << "' is still busy (" << busyPropertyName << "). Recovering anyway." << std::endl;
+
+    deferral.framesSaved += completedExposureCount - deferral.completedExposureCountAtStart;
+    deferral.active = false;
+    deferral.expired = true;
+    deferral.expiredCount++;
+    return false;
+  }
+
+  LOG_DEDUP(info, "waiting:" + indiDeviceName, "Deferring recovery of '" << indiDeviceName << "' - '" << *busyDeviceName << "' is busy (" << busyPropertyName << ").");
+  
+  return true;
+}
+
+
+void IndiDeviceWatchdogT::finishActionDeferral(const std::string & indiDeviceName) {
+  ActionDeferralT & deferral = actionDeferrals_.at(indiDeviceName);
+
+  if (deferral.active) {
+    const std::string * busyDeviceName;
+    const char * busyPropertyName;
+    unsigned long framesSaved = getCoupledActivity(indiDeviceName, false, busyDeviceName, busyPropertyName) - deferral.completedExposureCountAtStart;
+
+    deferral.framesSaved += framesSaved;
+
+    LOG(info) << "Recovery of '" << indiDeviceName << "' is no longer deferred after " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - deferral.since).count()
+	      << " ms (frames saved: " << framesSaved << ")." << std::endl;
+  }
+  
+  deferral.active = false;
+  deferral.expired = false;
+}
+
+
+/**
+ * Restarts the first INDI driver which exceeds a resource limit. The
+ * restart waits while a coupled device of the driver is busy - at most
+ * for the shortest max. action deferral of its devices. Returns true if
+ * the INDI client needs to be reset.
+ */
+bool IndiDeviceWatchdogT::restartExhaustedDrivers(std::chrono::steady_clock::time_point now) {
+  if (driverProcessMonitor_ == nullptr) {
+    return false;
+  }
+
+  const IndiDriverTopologyT & driverTopology = indiDriverRestartExecutor_.getTopology();
+  
+  for (auto & preemptiveRestartEntry : preemptiveRestarts_) {
+    const std::string & indiDriverName = preemptiveRestartEntry.first;
+    PreemptiveRestartT & preemptiveRestart = preemptiveRestartEntry.second;
+    const std::vector<std::string> & indiDeviceNames = driverTopology.getIndiDevices(indiDriverName);
+    DriverProcessStatsT stats;
+
+    if (! driverProcessMonitor_->getStats(indiDriverName, stats) || stats.exceededLimit == DriverProcessLimitT::_Count || stats.pid == preemptiveRestart.restartedPid || indiDeviceNames.empty()) {
+      preemptiveRestart.pending = false;
+      continue;
+    }
+
+    if (! preemptiveRestart.pending) {
+      preemptiveRestart.pending = true;
+      preemptiveRestart.since = now;
+    }
+
+    const std::string * busyDeviceName = nullptr;
+    const char * busyPropertyName = nullptr;
+    std::chrono::milliseconds maxDeferral = std::chrono::milliseconds::max();
+
+    // The own activity of a driver stuck in I/O is meaningless
+    bool ignoreOwnActivity = (stats.exceededLimit == DriverProcessLimitT::UNINTERRUPTIBLE);
+    
+    for (const std::string & indiDeviceName : indiDeviceNames) {
+      maxDeferral = std::min(maxDeferral, deviceConnections_.at(indiDeviceName).getMaxActionDeferral());
+
+      if (busyDeviceName == nullptr) {
+	getCoupledActivity(indiDeviceName, ignoreOwnActivity, busyDeviceName, busyPropertyName);
+      }
+    }
+
+    if (busyDeviceName != nullptr && now - preemptiveRestart.since < maxDeferral) {
+      LOG_DEDUP(info, "preemptiveRestart:" + indiDriverName, "INDI driver '" << indiDriverName << "' exceeds its " << DriverProcessLimitT::asStr(stats.exceededLimit)
+		<< " limit - deferring its restart, '" << *busyDeviceName << "' is busy (" << busyPropertyName << ").");
+      continue;
+    }
+
+    std::chrono::milliseconds timeSinceRestart = indiDriverRestartExecutor_.getTimeSinceRestart(indiDriverName, now);
+
+    if (timeSinceRestart.count() >= 0 && timeSinceRestart < indiDriverRestartExecutor_.getCoalesceWindow()) {
+      // Restarted for one of its devices anyway - the new process is not sampled yet
+      continue;
+    }
+
+    // Repeated while the restart manager backs off
+    LOG_DEDUP(warning, "preemptiveRestart:" + indiDriverName, "INDI driver '" << indiDriverName << "' exceeds its " << DriverProcessLimitT::asStr(stats.exceededLimit)
+	      << " limit - restarting it preemptively.");
+
+    preemptiveRestart.pending = false;
+
+    if (requestIndiDriverRestart(deviceConnections_.at(indiDeviceNames.front())) == DriverRestartResultT::RESTARTED) {
+      LOG(info) << "Restarted INDI driver '" << indiDriverName << "' preemptively (" << stats << ")." << std::endl;
+      
+      preemptiveRestart.restartedPid = stats.pid;
+      preemptiveRestart.restartCount++;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+void IndiDeviceWatchdogT::reportRecoveryStats() {
+  for (const auto & recoveryTimelineEntry : recoveryTimelines_) {
+    const DeviceRecoveryTimelineT & recoveryTimeline = recoveryTimelineEntry.second;
+    const LatencyHistogramT & plugInToConnected = recoveryTimeline.getPlugInToConnected();
+
+    if (plugInToConnected.getCount() == 0 && recoveryTimeline.getLossToDetection().getCount() == 0) {
+      continue;
+    }
+    
+    LOG(info) << "Recovery of '" << recoveryTimelineEntry.first << "' - plug-in to connected p50: " << plugInToConnected.getPercentile(50).count()
+	      << " ms, p99: " << plugInToConnected.getPercentile(99).count() << " ms, max: " << plugInToConnected.getMax().count()
+	      << " ms (" << plugInToConnected.getCount() << " recoveries, SLO violations: " << recoveryTimeline.getSloViolationCount()
+	      << "), loss to detection p99: " << recoveryTimeline.getLossToDetection().getPercentile(99).count()
+	      << " ms, detection to action p99: " << recoveryTimeline.getDetectionToAction().getPercentile(99).count() << " ms" << std::endl;
+  }
+
+  if (recoveryStatsFilePath_.empty()) {
+    return;
+  }
+
+  std::string tmpFilePath = recoveryStatsFilePath_ + ".tmp";
+  std::ofstream ofs(tmpFilePath, std::ios::trunc);
+  bool first = true;
+
+  ofs << "{\"devices\":{";
+  
+  for (const auto & recoveryTimelineEntry : recoveryTimelines_) {
+    ofs << (first ? "" : ",") << "\"" << ControlServerT::escapeJson(recoveryTimelineEntry.first) << "\":";
+    recoveryTimelineEntry.second.printJson(ofs);
+    first = false;
+  }
+  ofs << "}}" << std::endl;
+  ofs.close();
+  
+  if (! ofs || std::rename(tmpFilePath.c_str(), recoveryStatsFilePath_.c_str()) != 0) {
+    LOG(warning) << "Cannot write recovery stats to '" << recoveryStatsFilePath_ << "'." << std::endl;
+  }
+}
+
+
+void IndiDeviceWatchdogT::enableStatusTable(const std::string & name) {
+  statusTablePublisher_ = std::make_unique<StatusTablePublisherT>(name, indiDriverNames_);
+}
+
+
+std::shared_ptr<const WatchdogStatusT> IndiDeviceWatchdogT::getStatus() const {
+  std::lock_guard<std::mutex> guard(statusMutex_);
+  return status_;
+}
+
+
+/**
+ * Called by the control server thread. Only the immutable device list
+ * is used to validate the command - the command itself is executed by
+ * the decision loop.
+ */
+std::string IndiDeviceWatchdogT::queueControlCommand(const ControlCommandT & command) {
+  ControlCommandT queuedCommand = command;
+
+  if (! command.indiDeviceName.empty() && indiDriverNames_.count(command.indiDeviceName) == 0) {
+    return "Unknown device '" + command.indiDeviceName + "'.";
+  }
+  
+  if (command.type == ControlCommandT::TypeT::RESTART_DRIVER) {
+    if (queuedCommand.indiDriverName.empty() && ! command.indiDeviceName.empty()) {
+      queuedCommand.indiDriverName = indiDriverNames_.at(command.indiDeviceName);
+    }
+
+    bool knownDriver = std::any_of(indiDriverNames_.begin(), indiDriverNames_.end(), [& queuedCommand](const auto & entry) {
+      return entry.second == queuedCommand.indiDriverName;
+    });
+    
+    if (! knownDriver) {
+      return "Unknown driver '" + queuedCommand.indiDriverName + "'.";
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(pendingControlCommandsMutex_);
+    pendingControlCommands_.push_back(queuedCommand);
+  }
+  
+  wakeUp();
+
+  return "";
+}
+
+
+/**
+ * Returns true if an INDI driver was restarted.
+ *
+ * NOTE: deviceConnectionsMutex_ must be held by the caller.
+ */
+bool IndiDeviceWatchdogT::executeControlCommands() {
+  std::vector<ControlCommandT> commands;
+  bool restarted = false;
+
+  {
+    std::lock_guard<std::mutex> guard(pendingControlCommandsMutex_);
+    commands.swap(pendingControlCommands_);
+  }
+
+  for (const ControlCommandT & command : commands) {
+    LOG(info) << "Executing control command " << ControlCommandT::TypeT::asStr(command.type)
+	      << (command.indiDeviceName.empty() ? "" : " for device '" + command.indiDeviceName + "'")
+	      << (command.indiDriverName.empty() ? "" : " for driver '" + command.indiDriverName + "'") << "." << std::endl;
+    
+    switch (command.type) {
+    case ControlCommandT::TypeT::RESTART_DRIVER:
+      indiDriverRestartExecutor_.requestImmediate(command.indiDriverName, std::chrono::steady_clock::now());
+
+      for (const std::string & indiDeviceName : indiDriverRestartExecutor_.getTopology().getIndiDevices(command.indiDriverName)) {
+	DeviceDataT & deviceData = deviceConnections_.at(indiDeviceName);
+	
+	deviceData.setIndiBaseDevice(INDI::BaseDevice());
+	deviceData.getRecoveryLadder().reset();
+      }
+      restarted = true;
+      break;
+
+    case ControlCommandT::TypeT::PAUSE:
+    case ControlCommandT::TypeT::RESUME:
+      for (const auto & deviceConnection : deviceConnections_) {
+	if (command.indiDeviceName.empty() || command.indiDeviceName == deviceConnection.first) {
+	  if (command.type == ControlCommandT::TypeT::PAUSE) {
+	    pausedDevices_.insert(deviceConnection.first);
+	  }
+	  else {
+	    pausedDevices_.erase(deviceConnection.first);
+	  }
+	}
+      }
+      break;
+      
+    case ControlCommandT::TypeT::RESET_COUNTERS:
+      resetCounters();
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  return restarted;
+}
+
+
+void IndiDeviceWatchdogT::resetCounters() {
+  reconnectCount_ = 0;
+  lastTimeToReconnect_ = std::chrono::milliseconds(0);
+  maxTimeToReconnect_ = std::chrono::milliseconds(0);
+  totalTimeToReconnect_ = std::chrono::milliseconds(0);
+  
+  if (presenceMonitor_ != nullptr) {
+    presenceMonitor_->resetCounters();
+  }
+
+  for (auto & recoveryTimelineEntry : recoveryTimelines_) {
+    recoveryTimelineEntry.second.resetCounters();
+  }
+
+  for (auto & preemptiveRestartEntry : preemptiveRestarts_) {
+    preemptiveRestartEntry.second.restartCount = 0;
+  }
+
+  for (auto & messageFailureEntry : messageFailures_) {
+    messageFailureEntry.second.matchCount = 0;
+  }
+
+  for (auto & actionDeferralEntry : actionDeferrals_) {
+    ActionDeferralT & deferral = actionDeferralEntry.second;
+    deferral.deferredActionCount = 0;
+    deferral.expiredCount = 0;
+    deferral.framesSaved = 0;
+  }
+}
+
+
+/**
+ * Returns the status buffer which is neither published nor held by a
+ * reader - a reader can only get hold of the published one. If a reader
+ * still holds the other one, it is replaced.
+ */
+std::shared_ptr<WatchdogStatusT> IndiDeviceWatchdogT::acquireStatusBuffer() {
+  for (const auto & statusBuffer : statusBuffers_) {
+    if (statusBuffer != nullptr && statusBuffer.use_count() == 1) {
+      return statusBuffer;
+    }
+  }
+
+  std::shared_ptr<WatchdogStatusT> & statusBuffer = (statusBuffers_[0] != status_ ? statusBuffers_[0] : statusBuffers_[1]);
+  statusBuffer = std::make_shared<WatchdogStatusT>();
+
+  return statusBuffer;
+}
+
+
+/**
+ * Fills the unpublished status buffer in place - the strings and the
+ * device list keep their capacity, so that this does not allocate once
+ * both buffers have been filled.
+ */
+void IndiDeviceWatchdogT::publishStatus(const std::vector<std::pair<DeviceDataT *, DeviceObservationT> > & plan) {
+  std::shared_ptr<WatchdogStatusT> status = acquireStatusBuffer();
+
+  status->time = std::chrono::steady_clock::now();
+  status->cycleCount = cycleCount_;
+  status->indiServerConnected = connected_;
+  status->reconnectCount = reconnectCount_;
+  status->driverReplayFailureCount = (indiServerSupervisor_ != nullptr ? indiServerSupervisor_->getReplayFailureCount() : 0);
+  status->healthy = connected_;
+  status->hookStats = (hookExecutor_ != nullptr ? hookExecutor_->getStats() : HookExecutorStatsT());
+  status->selfStats = selfStats_;
+  status->devices.resize(plan.size());
+
+  // Only written by the decision loop - no need to lock
+  const std::shared_ptr<const WatchdogStatusT> & lastStatus = status_;
+  
+  for (size_t planIdx = 0; planIdx < plan.size(); ++planIdx) {
+    const DeviceDataT & deviceData = *plan[planIdx].first;
+    const DeviceObservationT & observation = plan[planIdx].second;
+    DriverRestartStateT restartState = indiDriverRestartManager_.getRestartState(deviceData.getIndiDeviceDriverName());
+    DeviceStatusT & deviceStatus = status->devices[planIdx];
+    
+    deviceStatus.indiDeviceName = deviceData.getIndiDeviceName();
+    deviceStatus.indiDriverName = deviceData.getIndiDeviceDriverName();
+    deviceStatus.linuxDeviceExists = observation.linuxDeviceExists;
+    deviceStatus.indiDeviceExists = observation.indiDeviceExists;
+    deviceStatus.indiDeviceConnected = observation.indiDeviceConnected;
+    deviceStatus.paused = (pausedDevices_.count(deviceStatus.indiDeviceName) > 0);
+    deviceStatus.quarantined = observation.linuxDevicePresence.quarantined;
+    deviceStatus.presenceChangeCount = observation.linuxDevicePresence.flapCount;
+    deviceStatus.driverRestartCount = restartState.totalRestartCount;
+    deviceStatus.breakerOpen = (restartState.breakerOpen != 0);
+    deviceStatus.connectLatencyUs = connectLatenciesUs_.at(deviceStatus.indiDeviceName);
+    deviceStatus.healthy = isDeviceHealthy(deviceData, observation);
+
+    const DeviceRecoveryTimelineT & recoveryTimeline = recoveryTimelines_.at(deviceStatus.indiDeviceName);
+    deviceStatus.sloViolationCount = recoveryTimeline.getSloViolationCount();
+    deviceStatus.plugInToConnectedP50Ms = recoveryTimeline.getPlugInToConnected().getPercentile(50).count();
+    deviceStatus.plugInToConnectedP99Ms = recoveryTimeline.getPlugInToConnected().getPercentile(99).count();
+
+    DeviceActivityT activity;
+    const ActionDeferralT & deferral = actionDeferrals_.at(deviceStatus.indiDeviceName);
+    deviceStatus.busy = (activityTracker_.getActivity(deviceStatus.indiDeviceName, activity) && activity.busy);
+    deviceStatus.actionDeferred = deferral.active;
+    deviceStatus.deferredActionCount = deferral.deferredActionCount;
+    deviceStatus.framesSaved = deferral.framesSaved;
+    deviceStatus.staleProperty = (observation.staleProperty.propertyName != nullptr ? observation.staleProperty.propertyName : "");
+    deviceStatus.preemptiveRestartCount = preemptiveRestarts_.at(deviceStatus.indiDriverName).restartCount;
+
+    if (observation.failedMessagePattern >= 0) {
+      deviceStatus.failedMessagePattern = messagePatternMatcher_.getPattern(observation.failedMessagePattern);
+    }
+    else {
+      deviceStatus.failedMessagePattern.clear();
+    }
+    deviceStatus.failureMessageCount = messageFailures_.at(deviceStatus.indiDeviceName).matchCount;
+
+    deviceStatus.driverProcess = DriverProcessStatsT();
+    
+    if (driverProcessMonitor_ != nullptr) {
+      driverProcessMonitor_->getStats(deviceStatus.indiDriverName, deviceStatus.driverProcess);
+    }
+
+    if (! deviceStatus.healthy && ! deviceStatus.paused) {
+      status->healthy = false;
+
+      // A device which was healthy in the last cycle was lost
+      bool wasHealthy = (lastStatus != nullptr && std::any_of(lastStatus->devices.begin(), lastStatus->devices.end(), [& deviceStatus](const DeviceStatusT & lastDeviceStatus) {
+	return lastDeviceStatus.indiDeviceName == deviceStatus.indiDeviceName && lastDeviceStatus.healthy;
+      }));
+
+      if (wasHealthy) {
+	fireHooks(HookEventT::DEVICE_LOST, deviceStatus.indiDeviceName);
+      }
+    }
+  }
+
+  if (statusTablePublisher_ != nullptr) {
+    statusTablePublisher_->publish(*status);
+  }
+
+  std::lock_guard<std::mutex> guard(statusMutex_);
+  status_ = status;
+}
+
+
+void IndiDeviceWatchdogT::publishDisconnected() {
+  std::shared_ptr<WatchdogStatusT> status = acquireStatusBuffer();
+
+  if (status_ != nullptr) {
+    *status = *status_;
+  }
+
+  status->time = std::chrono::steady_clock::now();
+  status->indiServerConnected = false;
+  status->healthy = false;
+
+  if (statusTablePublisher_ != nullptr) {
+    statusTablePublisher_->publish(*status);
+  }
+
+  std::lock_guard<std::mutex> guard(statusMutex_);
+  status_ = status;
+}
+
+
+void IndiDeviceWatchdogT::runCycle() {
+  auto cycleStartTime = std::chrono::steady_clock::now();
+
+  // The whole iteration - but only the decision thread and the evaluation
+  // tasks. The INDI client thread and the other threads of the watchdog
+  // do not count.
+  uint64_t allocationCountBefore = allocation_counter::getThreadAllocationCount();
+  evaluationAllocationCount_ = 0;
+  
+  // NOTE: Resetting the INDI client joins its listener thread - whose
+  //       callbacks take deviceConnectionsMutex_. Hence the lock is
+  //       released for the reset.
+  std::unique_lock<std::mutex> lock(deviceConnectionsMutex_);
+
+  if (executeControlCommands()) {
+    // An INDI driver was restarted on request
+    lock.unlock();
+    resetIndiClient();
+    return;
+  }
+  
+  const auto & plan = evaluateDevices();
+
+  observeRecoveries(plan, std::chrono::steady_clock::now());
+
+  bool restarted = false;
+  
+  for (auto & planEntry : plan) {
+    restarted = handleDeviceConnection(*planEntry.first, planEntry.second, areDependenciesConnected(*planEntry.first, plan));
+
+    if (restarted) {
+      break;
+    }
+  }
+
+  if (! restarted) {
+    restarted = restartExhaustedDrivers(std::chrono::steady_clock::now());
+  }
+
+  if (restarted) {
+    lock.unlock();
+    resetIndiClient();
+    lock.lock();
+  }
+
+  saveStateSnapshot(plan);
+  reportSelfStats();
+
+  cycleCount_++;
+  publishStatus(plan);
+
+  cycleLatencyStats_.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - cycleStartTime));
+
+  LOG(trace) << "Cycle latency p50: " << cycleLatencyStats_.getPercentile(50).count() << " us, p99: " << cycleLatencyStats_.getPercentile(99).count()
+	     << " us (" << plan.size() << " devices, " << evaluationPool_.getNumThreads() << " evaluation threads, "
+	     << evaluationPool_.getStolenTaskCount() << " tasks stolen)" << std::endl;
+
+  if (hookExecutor_ != nullptr) {
+    HookExecutorStatsT hookStats = hookExecutor_->getStats();
+    
+    LOG(trace) << "Hook queue depth: " << hookStats.queueDepth << " (max: " << hookStats.maxQueueDepth << "), latency p50: " << hookStats.latencyP50.count()
+	       << " us, p99: " << hookStats.latencyP99.count() << " us (executed: " << hookStats.executedCount << ", failed: " << hookStats.failedCount
+	       << ", coalesced: " << hookStats.coalescedCount << ", dropped: " << hookStats.droppedCount << ")" << std::endl;
+  }
+
+  lastDecisionAllocationCount_ = allocation_counter::getThreadAllocationCount() - allocationCountBefore;
+
+  if (evaluationPool_.getNumThreads() > 0) {
+    // Otherwise the tasks ran on the decision thread
+    lastDecisionAllocationCount_ += evaluationAllocationCount_;
+  }
+
+  if (! restarted) {
+    // Restarts allocate (new INDI client)
+    maxDecisionAllocationCount_ = std::max(maxDecisionAllocationCount_, lastDecisionAllocationCount_);
+  }
+
+  if (allocation_counter::isEnabled()) {
+    LOG(trace) << "Heap allocations in the last cycle: " << lastDecisionAllocationCount_ << std::endl;
+  }
+}
+
+
+void IndiDeviceWatchdogT::run() {
+  using namespace std::chrono_literals;
+
+  // In supervisor mode the watchdog owns the INDI server process
+  if (indiServerSupervisor_ != nullptr) {
+    indiServerSupervisor_->start();
+  }
+
+  if (presenceMonitor_ != nullptr) {
+    presenceMonitor_->start();
+  }
+
+  if (driverProcessMonitor_ != nullptr) {
+    driverProcessMonitor_->start();
+  }
+
+  if (controlServer_ != nullptr) {
+    controlServer_->start();
+  }
+
+  // Try to connect to the INDI server forever
+  while(true) {
+    LOG(info) << "Trying to connect to INDI server...";
+
+    // Let the connection manager thread of the client (re-) connect to the
+    // INDI server. Calling this repeatedly does not start further threads.
+    // It retries with a jittered exponential backoff.
+    client_->connect();
+
+    if (! client_->waitForConnection(std::chrono::seconds(timeoutSec_))) {
+      LOG(info) << "Timeout!" << std::endl;
+      LOG(debug) << "Connection attempts: " << client_->getConnectionAttemptCount()
+		 << ", active connection threads: " << IndiClientT::getActiveConnectionThreadCount() << std::endl;
+      connected_ = false;
+      continue;
+    }
+
+    connected_ = true;
+
+    LOG(info) << "Connected!" << std::endl;
+
+    recordReconnect();
+
+    if (livenessProbe_ != nullptr) {
+      livenessProbe_->start();
+    }
+
+    // Warm start: reconcile all devices right after the initial
+    // property burst instead of waiting for the first regular cycle.
+    waitForInitialProperties();
+    
+    while(connected_) {
+      runCycle();
+
+      if (! startupReported_) {
+	startupReported_ = true;
+	LOG(info) << "All devices reconciled " << getProcessAge().count() << " ms after process start." << std::endl;
+      }
+      
+      waitForNextCycle(5000ms);
+    }
+
+    LOG(info) << "Lost connection to INDI server." << std::endl;
+
+    publishDisconnected();
+    fireHooks(HookEventT::SERVER_LOST, hostname_ + ":" + std::to_string(port_));
+
+    if (serverLost_) {
+      // libindi may still consider a half-open connection as connected
+      serverLost_ = false;
+      resetIndiClient();
+    }
+
+    connectionLost_ = true;
+    connectionLostTime_ = std::chrono::steady_clock::now();
+  }
+
+}
+
+
+bool IndiDeviceWatchdogT::runSoakTest(unsigned int cycleCount, double maxGrowthPercent) {
+  // One-time allocations (e.g. of libindi) happen during the warm-up
+  unsigned int reportInterval = std::max(cycleCount / 10, 1U);
+  SelfStatsT baseline = SelfStatsT::sample();
+  unsigned long failedConnectionCount = 0;
+
+  LOG(warning) << "Soak test: running " << cycleCount << " reset / reconnect cycles against " << hostname_ << ":" << port_ << "..." << std::endl;
+  
+  for (unsigned int cycle = 1; cycle <= cycleCount; ++cycle) {
+    resetIndiClient();
+    client_->connect();
+
+    if (client_->waitForConnection(std::chrono::seconds(timeoutSec_))) {
+      connected_ = true;
+      runCycle();
+    }
+    else {
+      failedConnectionCount++;
+    }
+
+    if (cycle == reportInterval) {
+      baseline = SelfStatsT::sample();
+    }
+
+    if (cycle % reportInterval == 0) {
+      LOG(warning) << "Soak test: cycle " << cycle << "/" << cycleCount << " - " << SelfStatsT::sample()
+		   << ", INDI connection threads: " << IndiClientT::getActiveConnectionThreadCount()
+		   << ", failed connections: " << failedConnectionCount << std::endl;
+    }
+  }
+
+  // The connection manager thread of a client is joined by its destructor
+  // - the new client is not connected and has none yet.
+  resetIndiClient();
+
+  int connectionThreadCount = IndiClientT::getActiveConnectionThreadCount();
+  SelfStatsT finalStats = SelfStatsT::sample();
+  double rssGrowthPercent = 100.0 * (finalStats.rssKb - baseline.rssKb) / std::max(baseline.rssKb, 1L);
+  double heapGrowthPercent = 100.0 * (finalStats.heapInUseKb - baseline.heapInUseKb) / std::max(baseline.heapInUseKb, 1L);
+
+  // A few threads and fds may legitimately come and go (e.g. the client
+  // which was just reset).
+  const unsigned int tolerance = 2;
+  bool passed = (rssGrowthPercent <= maxGrowthPercent && heapGrowthPercent <= maxGrowthPercent && connectionThreadCount == 0
+		 && finalStats.threadCount <= baseline.threadCount + tolerance && finalStats.fdCount <= baseline.fdCount + tolerance);
+
+  LOG(warning) << "Soak test " << (passed ? "passed" : "FAILED") << " after " << cycleCount << " cycles - baseline: " << baseline << " / final: " << finalStats
+	       << ", INDI connection threads: " << connectionThreadCount << " (RSS growth: " << rssGrowthPercent << " %, heap growth: " << heapGrowthPercent << " %, max. allowed: " << maxGrowthPercent << " %)." << std::endl;
+
+  return passed;
+}
+
+
+bool IndiDeviceWatchdogT::runCycles(unsigned int cycleCount) {
+  if (! connected_) {
+    client_->connect();
+
+    if (! client_->waitForConnection(std::chrono::seconds(timeoutSec_))) {
+      return false;
+    }
+
+    connected_ = true;
+    recordReconnect();
+    waitForInitialProperties();
+  }
+
+  for (unsigned int cycle = 0; cycle < cycleCount && connected_; ++cycle) {
+    runCycle();
+  }
+  return connected_;
+}
+
+
+const CycleLatencyStatsT & IndiDeviceWatchdogT::getCycleLatencyStats() const {
+  return cycleLatencyStats_;
+}
+
+
+uint64_t IndiDeviceWatchdogT::getLastCycleAllocationCount() const {
+  return lastDecisionAllocationCount_;
+}
+
+
+uint64_t IndiDeviceWatchdogT::getMaxCycleAllocationCount() const {
+  return maxDecisionAllocationCount_;
 }
@@ -29,61 +29,387 @@
 #define SOURCE_INDI_AUTO_CONNECTOR_H_ SOURCE_INDI_AUTO_CONNECTOR_H_
 
 #include <boost/signals2.hpp>
+#include <atomic>
+#include <condition_variable>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <set>
 
 #include "indi_client.h"
 #include "device_data.h"
 #include "indi_driver_restart_manager.h"
+#include "indi_driver_restart_executor.h"
+#include "recovery_action.h"
+#include "reconnect_policy.h"
+#include "indi_server_liveness_probe.h"
+#include "indi_server_supervisor.h"
+#include "work_stealing_pool.h"
+#include "cycle_latency_stats.h"
+#include "device_dependency_graph.h"
+#include "state_snapshot.h"
+#include "device_presence_monitor.h"
+#include "watchdog_status.h"
+#include "control_server.h"
+#include "status_table_publisher.h"
+#include "hook_executor.h"
+#include "recovery_timeline.h"
+#include "remote_presence_client.h"
+#include "device_activity_tracker.h"
+#include "property_liveness_monitor.h"
+#include "driver_process_monitor.h"
+#include "message_pattern_matcher.h"
+
+/**
+ * What was observed about a device at the beginning of a cycle. The
+ * observations are made in parallel, one task per device.
+ */
+struct DeviceObservationT {
+  bool linuxDeviceExists;
+  bool indiDeviceExists;
+  bool indiDeviceConnected;
+  DevicePresenceT linuxDevicePresence; // Only filled if flap detection is enabled
+  PropertyStalenessT staleProperty; // Only checked while the INDI device is connected
+  int failedMessagePattern; // Failure message reported since the INDI device was connected (-1 = none)
+
+  DeviceObservationT() : linuxDeviceExists(false), indiDeviceExists(false), indiDeviceConnected(false), failedMessagePattern(-1) {}
+};
+
+
+/**
+ * A recovery which waits for busy coupled devices (e.g. an exposure of
+ * the CCD) - at most until the max. action deferral of the device.
+ */
+struct ActionDeferralT {
+  bool active;
+  bool expired; // Deadline passed - not deferred again until the coupled devices are idle
+  std::chrono::steady_clock::time_point since;
+  unsigned long completedExposureCountAtStart;
+  unsigned long deferredActionCount;
+  unsigned long expiredCount;
+  unsigned long framesSaved; // Exposures of coupled devices completed while deferred
+
+  ActionDeferralT() : active(false), expired(false), completedExposureCountAtStart(0), deferredActionCount(0), expiredCount(0), framesSaved(0) {}
+};
+
+
+/**
+ * Failure messages of an INDI device - written by the INDI client thread.
+ */
+struct MessageFailureT {
+  int patternOwner; // Index of the INDI driver in the message pattern matcher
+  std::atomic<int> patternId; // Last matched pattern since the INDI device was connected (-1 = none)
+  std::atomic<unsigned long> matchCount;
+
+  MessageFailureT() : patternOwner(-1), patternId(-1), matchCount(0) {}
+};
+
+
+/**
+ * An INDI driver process which exceeds a resource limit is restarted
+ * before it takes the host down - once its devices are idle.
+ */
+struct PreemptiveRestartT {
+  bool pending;
+  std::chrono::steady_clock::time_point since;
+  pid_t restartedPid; // The stats of the old process may still be reported
+  unsigned long restartCount;
+
+  PreemptiveRestartT() : pending(false), restartedPid(-1), restartCount(0) {}
+};
+
 
 /**
  *
  */
-class IndiDeviceWatchdogT {
+class IndiDeviceWatchdogT : public RecoveryActionContextT {
  private:
   std::string hostname_;
   int port_;
   int timeoutSec_;
+  ReconnectPolicyT reconnectPolicy_;
   std::shared_ptr<IndiClientT> client_;
-  bool connected_;
+  std::atomic<bool> connected_;
+  std::atomic<bool> serverLost_;
+
+  std::unique_ptr<IndiServerLivenessProbeT> livenessProbe_;
+  std::shared_ptr<IndiServerSupervisorT> indiServerSupervisor_;
+  std::set<std::string> knownIndiDevices_;
+  std::mutex knownIndiDevicesMutex_;
+
+  // Warm start: wait for the initial property burst of the INDI server
+  std::set<std::string> devicesWithConnectionProperty_; // guarded by knownIndiDevicesMutex_
+  std::chrono::steady_clock::time_point lastPropertyActivity_; // guarded by knownIndiDevicesMutex_
+  std::atomic<bool> warmStarting_;
+  bool startupReported_;
+  std::string stateSnapshotPath_;
+  state_snapshot::DeviceStateMapT stateSnapshot_;
+
+  // Allows to wake up the decision loop before the next regular cycle
+  std::mutex cycleMutex_;
+  std::condition_variable cycleCv_;
+  bool cycleWakeUpRequested_;
+
+  // Time-to-reconnect metrics
+  bool connectionLost_;
+  std::chrono::steady_clock::time_point connectionLostTime_;
+  unsigned long reconnectCount_;
+  std::chrono::milliseconds lastTimeToReconnect_;
+  std::chrono::milliseconds maxTimeToReconnect_;
+  std::chrono::milliseconds totalTimeToReconnect_;
   boost::signals2::connection serverConnectionFailedListenerConnection_;
+  boost::signals2::connection serverConnectionStateChangedListenerConnection_;
   boost::signals2::connection newDeviceListenerConnection_;
   boost::signals2::connection removeDeviceListenerConnection_;
   boost::signals2::connection newPropertyListenerConnection_;
   boost::signals2::connection removePropertyListenerConnection_;
   boost::signals2::connection updatePropertyListenerConnection_;
+  boost::signals2::connection newMessageListenerConnection_;
 
   typedef std::map<std::string /*device name*/, DeviceDataT> DeviceConnStateMapT;
   DeviceConnStateMapT deviceConnections_; 
 
   std::mutex deviceConnectionsMutex_;
 
+  // Devices are processed in topological order of their "dependsOn" relations
+  DeviceDependencyGraphT dependencyGraph_;
+
   IndiDriverRestartManagerT indiDriverRestartManager_;
+  IndiDriverRestartExecutorT indiDriverRestartExecutor_; // Coalesces the restarts of shared drivers
+
+  WorkStealingPoolT evaluationPool_;
+  CycleLatencyStatsT cycleLatencyStats_;
+
+  // Reused by every cycle - the decision loop shall not allocate once
+  // it reached its steady state. Counted for the whole iteration - the
+  // decision thread and the evaluation tasks.
+  std::vector<std::pair<DeviceDataT *, DeviceObservationT> > cyclePlan_;
+  uint64_t lastDecisionAllocationCount_;
+  uint64_t maxDecisionAllocationCount_;
+  std::atomic<uint64_t> evaluationAllocationCount_; // Made by the evaluation tasks
+
+  std::unique_ptr<DevicePresenceMonitorT> presenceMonitor_;
+  std::unique_ptr<RemotePresenceClientT> remotePresenceClient_; // Linux devices on another host
+
+  // Control socket: commands are queued and executed by the decision
+  // loop, status readers only take the last published status.
+  std::unique_ptr<ControlServerT> controlServer_;
+  std::map<std::string /*device name*/, std::string /*driver name*/> indiDriverNames_; // immutable
+  std::vector<ControlCommandT> pendingControlCommands_;
+  std::mutex pendingControlCommandsMutex_;
+  std::set<std::string> pausedDevices_; // Only accessed by the decision loop
+  unsigned long cycleCount_;
+  std::shared_ptr<const WatchdogStatusT> status_;
+  mutable std::mutex statusMutex_;
+  std::shared_ptr<WatchdogStatusT> statusBuffers_[2]; // Double buffer of status_ - only accessed by the decision loop
+
+  // Written by the INDI client thread when a connect request succeeded
+  std::map<std::string /*device name*/, std::atomic<int64_t> /*us*/> connectLatenciesUs_;
+  std::unique_ptr<StatusTablePublisherT> statusTablePublisher_;
+  std::unique_ptr<HookExecutorT> hookExecutor_;
+
+  std::chrono::seconds selfStatsInterval_;
+  std::chrono::steady_clock::time_point lastSelfStatsTime_;
+  SelfStatsT selfStats_;
+
+  // Disruptive actions wait for coupled devices which are busy. A device
+  // is coupled to itself, the devices of its INDI driver and the devices
+  // of its "coupledTo" list (both directions).
+  DeviceActivityTrackerT activityTracker_;
+  std::map<std::string /*device name*/, std::vector<std::string> /*device names*/> coupledDevices_; // immutable
+  std::map<std::string /*device name*/, ActionDeferralT> actionDeferrals_; // Only accessed by the decision loop
+
+  // A driver may hang while its CONNECTION switch still is on
+  PropertyLivenessMonitorT livenessMonitor_;
+
+  // Some drivers only report a failure by a message (e.g. "Error reading
+  // from port"). Immutable once the patterns are set.
+  MessagePatternMatcherT messagePatternMatcher_;
+  std::map<std::string /*device name*/, MessageFailureT> messageFailures_;
+
+  std::unique_ptr<DriverProcessMonitorT> driverProcessMonitor_;
+  std::map<std::string /*driver name*/, PreemptiveRestartT> preemptiveRestarts_; // Only accessed by the decision loop
+
+  // The loss and connect events are reported by the INDI client thread
+  std::map<std::string /*device name*/, DeviceRecoveryTimelineT> recoveryTimelines_;
+  std::string recoveryStatsFilePath_;
 
   static bool isDeviceValid(INDI::BaseDevice indiBaseDevice);
   static INDI::BaseDevice getBaseDeviceFromProperty(INDI::Property property);
   void resetIndiClient();
+  void recordReconnect();
+  void wakeUp();
+  void waitForNextCycle(std::chrono::milliseconds cycleTime);
+  void indiServerLost(const std::string & reason);
+  std::vector<std::string> getKnownIndiDevices();
   
   void addIndiDevice(INDI::BaseDevice device);
   void removeIndiDevice(INDI::BaseDevice device);
+  void propertyDefined(INDI::Property property);
   void propertyUpdated(INDI::Property property);
   void propertyRemoved(INDI::Property property);
+  void messageReceived(INDI::BaseDevice indiBaseDevice, int messageId);
 
 
-  bool requestIndiDriverRestart(DeviceDataT & deviceData);
+  DriverRestartResultT::TypeE requestIndiDriverRestart(DeviceDataT & deviceData);
   bool requestConnectionStateChange(INDI::BaseDevice indiBaseDevice, bool connect);
   bool sendIndiDeviceDisconnectRequest(INDI::BaseDevice indiBaseDevice);
   bool fileExists(const std::string & pathToFile) const;
+  bool linuxDeviceExists(const std::string & linuxDeviceName) const;
   static bool isIndiDeviceConnected(INDI::BaseDevice indiBaseDevice);
-  bool handleDeviceConnection(DeviceDataT & deviceData);
+  static bool isIndiDeviceResponsive(const DeviceObservationT & observation);
+  static bool isDeviceHealthy(const DeviceDataT & deviceData, const DeviceObservationT & observation);
+  DeviceObservationT observeDevice(const std::string & indiDeviceName, const std::string & linuxDeviceName, INDI::BaseDevice indiBaseDevice) const;
+  const std::vector<std::pair<DeviceDataT *, DeviceObservationT> > & evaluateDevices();
+  bool areDependenciesConnected(const DeviceDataT & deviceData, const std::vector<std::pair<DeviceDataT *, DeviceObservationT> > & plan) const;
+  bool handleDeviceConnection(DeviceDataT & deviceData, const DeviceObservationT & observation, bool dependenciesConnected);
+  void runCycle();
+  std::set<std::string> getExpectedIndiDevices();
+  void waitForInitialProperties();
+  void saveStateSnapshot(const std::vector<std::pair<DeviceDataT *, DeviceObservationT> > & plan);
+  std::string queueControlCommand(const ControlCommandT & command);
+  bool executeControlCommands();
+  void resetCounters();
+  std::shared_ptr<WatchdogStatusT> acquireStatusBuffer();
+  void publishStatus(const std::vector<std::pair<DeviceDataT *, DeviceObservationT> > & plan);
+  void publishDisconnected();
+  void fireHooks(HookEventT::TypeE event, const std::string & subject);
+  void reportSelfStats();
+  void observeRecoveries(const std::vector<std::pair<DeviceDataT *, DeviceObservationT> > & plan, std::chrono::steady_clock::time_point now);
+  unsigned long getCoupledActivity(const std::string & indiDeviceName, bool ignoreOwnActivity, const std::string * & busyDeviceName, const char * & busyPropertyName) const;
+  bool deferDisruptiveAction(const DeviceDataT & deviceData, bool ignoreOwnActivity, std::chrono::steady_clock::time_point now);
+  void finishActionDeferral(const std::string & indiDeviceName);
+  bool restartExhaustedDrivers(std::chrono::steady_clock::time_point now);
+  void reportRecoveryStats();
 
   
  public:
-  IndiDeviceWatchdogT(const std::string & hostname, int port, int timeoutSec, const std::vector<DeviceDataT> & devicesToMonitor, const std::string & indiBinPath, const std::string & indiServerPipePath);
-  ~IndiDeviceWatchdogT();
+  IndiDeviceWatchdogT(const std::string & hostname, int port, int timeoutSec, const std::vector<DeviceDataT> & devicesToMonitor, const std::string & indiBinPath, const std::string & indiServerPipePath, const RecoveryActionFactoryT & recoveryActionFactory, const ReconnectPolicyT & reconnectPolicy, std::chrono::milliseconds livenessInterval, std::chrono::milliseconds livenessTimeout, unsigned int evaluationThreadCount, std::shared_ptr<IndiServerSupervisorT> indiServerSupervisor = nullptr);
+  ~IndiDeviceWatchdogT() override;
+
+  /**
+   * Enables persisting the device states after each cycle. The snapshot
+   * of the last run (if any) tells the warm start which devices to expect.
+   */
+  void setStateSnapshotPath(const std::string & stateSnapshotPath);
+
+  /**
+   * Persists the INDI driver restart history (empty = in memory only).
+   */
+  void setRestartStateFilePath(const std::string & restartStateFilePath);
+
+  /**
+   * Restart requests for a driver within the given time after its last
+   * restart are absorbed. The other devices of the driver wait that long
+   * for the driver to come back before starting their own recovery.
+   */
+  void setDriverRestartCoalesceWindow(std::chrono::milliseconds coalesceWindow);
+
+  /**
+   * Samples the presence of the Linux devices in the given interval and
+   * only acts on debounced presence changes. Flapping devices are
+   * quarantined.
+   */
+  void enableFlapDetection(std::chrono::milliseconds sampleInterval, const FlapPolicyT & flapPolicy);
+
+  /**
+   * Takes the presence of the Linux devices from the presence agent on
+   * the given host instead of the local filesystem. The token has to
+   * match the one of the agent. Must be called before
+   * enableFlapDetection().
+   */
+  void enableRemotePresence(const std::string & hostname, int port, const std::string & token);
+
+  /**
+   * Samples CPU time, RSS, open fds, threads and scheduler state of the
+   * INDI driver processes in the given interval. A driver which exceeds
+   * one of the limits is restarted.
+   */
+  void enableDriverProcessMonitoring(std::chrono::milliseconds sampleInterval, const DriverProcessLimitsT & limits);
+
+  /**
+   * Serves the control and status API on the given Unix domain socket.
+   */
+  void enableControlServer(const std::string & socketPath);
+
+  /**
+   * The status published at the end of the last cycle (nullptr before
+   * the first cycle). Never blocks on the decision loop.
+   */
+  std::shared_ptr<const WatchdogStatusT> getStatus() const;
+
+  /**
+   * Publishes the device states in a shared memory status table.
+   */
+  void enableStatusTable(const std::string & name);
+
+  /**
+   * Hooks which run on state transitions (device lost, driver restarted,
+   * breaker opened, server lost).
+   */
+  void setHooks(const std::vector<HookConfigT> & hooks);
+
+  /**
+   * A connected INDI device which reports a message containing one of
+   * the patterns of its INDI driver is recovered. Must be called before
+   * run().
+   */
+  void setMessagePatterns(const std::vector<MessagePatternConfigT> & messagePatterns);
+
+  /**
+   * Logs the resource usage of the watchdog in the given interval
+   * (0 = disabled).
+   */
+  void setSelfStatsInterval(std::chrono::seconds selfStatsInterval);
+
+  /**
+   * Writes the recovery latency histograms of all devices as JSON to the
+   * given file whenever the self stats are reported (empty = disabled).
+   */
+  void setRecoveryStatsFilePath(const std::string & recoveryStatsFilePath);
+
+  /**
+   * Runs the calling thread - which must be the one calling run() - and
+   * the evaluation threads with the given real-time scheduling policy.
+   * All other threads of the watchdog keep normal scheduling.
+   */
+  bool setRealtimeScheduling(const std::string & policy, int priority);
+
+  // RecoveryActionContextT
+  bool sendConnectionRequest(DeviceDataT & deviceData, bool connect) override;
+  bool cycleConnection(DeviceDataT & deviceData, ConnectionCycleHandlerT handler) override;
+  DriverRestartResultT::TypeE restartIndiDriver(DeviceDataT & deviceData) override;
+  bool hasLinuxDevice(const DeviceDataT & deviceData) const override;
+  bool hasIndiDevice(const DeviceDataT & deviceData) const override;
+  bool hasConnectedIndiDevice(const DeviceDataT & deviceData) const override;
   
   void run();
+
+  /**
+   * Instead of run(): resets the INDI client, reconnects to the INDI
+   * server and runs a cycle - cycleCount times. Returns false if RSS or
+   * heap grew by more than maxGrowthPercent, if threads or file
+   * descriptors leaked or if an INDI connection thread is still alive.
+   */
+  bool runSoakTest(unsigned int cycleCount, double maxGrowthPercent);
+
+  /**
+   * Instead of run(): connects to the INDI server (unless connected) and
+   * runs the given number of cycles back to back - used by the tests and
+   * benchmarks. Returns false if the INDI server cannot be reached or the
+   * connection was lost.
+   */
+  bool runCycles(unsigned int cycleCount);
+
+  const CycleLatencyStatsT & getCycleLatencyStats() const;
+
+  /**
+   * Heap allocations of the decision thread and the evaluation tasks in
+   * the last cycle and the maximum of all cycles which did not restart a
+   * driver.
+   */
+  uint64_t getLastCycleAllocationCount() const;
+  uint64_t getMaxCycleAllocationCount() const;
 };
 
 #endif /*SOURCE_INDI_AUTO_CONNECTOR_H_*/
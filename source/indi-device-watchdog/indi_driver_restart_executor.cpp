@@ -0,0 +1,118 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include "logging.h"
+#include "indi_driver_restart_executor.h"
+
+
+IndiDriverRestartExecutorT::IndiDriverRestartExecutorT(IndiDriverRestartManagerT & restartManager, const IndiDriverTopologyT & topology) : restartManager_(restartManager), topology_(topology), coalesceWindow_(30000), restartCount_(0), coalescedCount_(0) {
+}
+
+
+void IndiDriverRestartExecutorT::setCoalesceWindow(std::chrono::milliseconds coalesceWindow) {
+  coalesceWindow_ = coalesceWindow;
+}
+
+
+std::chrono::milliseconds IndiDriverRestartExecutorT::getCoalesceWindow() const {
+  return coalesceWindow_;
+}
+
+
+void IndiDriverRestartExecutorT::markRecoveryPending(const std::string & indiDriverName, const std::string & exceptIndiDeviceName, TimePointT now) {
+  lastRestartTimes_[indiDriverName] = now;
+  restartCount_++;
+  
+  for (const std::string & indiDeviceName : topology_.getIndiDevices(indiDriverName)) {
+    if (indiDeviceName != exceptIndiDeviceName) {
+      pendingRecoveries_[indiDeviceName] = now + coalesceWindow_;
+    }
+  }
+}
+
+
+DriverRestartResultT::TypeE IndiDriverRestartExecutorT::request(const std::string & indiDeviceName, TimePointT now) {
+  std::string indiDriverName = topology_.getIndiDriverName(indiDeviceName);
+  std::chrono::milliseconds timeSinceRestart = getTimeSinceRestart(indiDriverName, now);
+  
+  if (timeSinceRestart.count() >= 0 && timeSinceRestart < coalesceWindow_) {
+    LOG(info) << "INDI driver '" << indiDriverName << "' was restarted " << timeSinceRestart.count() << " ms ago - not restarting it again for '" << indiDeviceName << "'." << std::endl;
+    coalescedCount_++;
+    return DriverRestartResultT::COALESCED;
+  }
+
+  if (! restartManager_.requestRestart(indiDriverName)) {
+    return DriverRestartResultT::REJECTED;
+  }
+
+  markRecoveryPending(indiDriverName, indiDeviceName, now);
+  
+  return DriverRestartResultT::RESTARTED;
+}
+
+
+void IndiDriverRestartExecutorT::requestImmediate(const std::string & indiDriverName, TimePointT now) {
+  restartManager_.requestImmediateRestart(indiDriverName);
+  markRecoveryPending(indiDriverName, "", now);
+}
+
+
+std::chrono::milliseconds IndiDriverRestartExecutorT::getTimeSinceRestart(const std::string & indiDriverName, TimePointT now) const {
+  auto lastRestartTimeIt = lastRestartTimes_.find(indiDriverName);
+
+  if (lastRestartTimeIt == lastRestartTimes_.end()) {
+    return std::chrono::milliseconds(-1);
+  }
+  return std::chrono::duration_cast<std::chrono::milliseconds>(now - lastRestartTimeIt->second);
+}
+
+
+bool IndiDriverRestartExecutorT::isRecoveryPending(const std::string & indiDeviceName, TimePointT now) const {
+  auto pendingRecoveryIt = pendingRecoveries_.find(indiDeviceName);
+  return (pendingRecoveryIt != pendingRecoveries_.end() && now < pendingRecoveryIt->second);
+}
+
+
+void IndiDriverRestartExecutorT::reportRecovered(const std::string & indiDeviceName) {
+  pendingRecoveries_.erase(indiDeviceName);
+}
+
+
+const IndiDriverTopologyT & IndiDriverRestartExecutorT::getTopology() const {
+  return topology_;
+}
+
+
+unsigned long IndiDriverRestartExecutorT::getRestartCount() const {
+  return restartCount_;
+}
+
+
+unsigned long IndiDriverRestartExecutorT::getCoalescedCount() const {
+  return coalescedCount_;
+}
@@ -0,0 +1,95 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_INDI_DRIVER_RESTART_EXECUTOR_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_INDI_DRIVER_RESTART_EXECUTOR_H_ SOURCE_INDI_DEVICE_WATCHDOG_INDI_DRIVER_RESTART_EXECUTOR_H_
+
+#include <chrono>
+#include <map>
+#include <string>
+
+#include "indi_driver_restart_manager.h"
+#include "indi_driver_topology.h"
+
+/**
+ * Deduplicates the restart requests of the devices which share an INDI
+ * driver. The first request restarts the driver (subject to backoff and
+ * breaker of the restart manager), further requests for the same driver
+ * within the coalesce window are absorbed. All other devices of a
+ * restarted driver are marked as pending recovery for the window - they
+ * disappear and come back with the driver and shall not escalate their
+ * own recovery meanwhile.
+ *
+ * Only used by the decision loop.
+ */
+class IndiDriverRestartExecutorT {
+ public:
+  typedef std::chrono::steady_clock::time_point TimePointT;
+
+ private:
+  IndiDriverRestartManagerT & restartManager_;
+  IndiDriverTopologyT topology_;
+  std::chrono::milliseconds coalesceWindow_;
+
+  std::map<std::string /*driver name*/, TimePointT> lastRestartTimes_;
+  std::map<std::string /*device name*/, TimePointT /*until*/> pendingRecoveries_;
+  unsigned long restartCount_;
+  unsigned long coalescedCount_;
+
+  void markRecoveryPending(const std::string & indiDriverName, const std::string & exceptIndiDeviceName, TimePointT now);
+  
+ public:
+  IndiDriverRestartExecutorT(IndiDriverRestartManagerT & restartManager, const IndiDriverTopologyT & topology);
+
+  void setCoalesceWindow(std::chrono::milliseconds coalesceWindow);
+  std::chrono::milliseconds getCoalesceWindow() const;
+
+  /**
+   * Restart request of the driver of the given device.
+   */
+  DriverRestartResultT::TypeE request(const std::string & indiDeviceName, TimePointT now);
+
+  /**
+   * Restarts the driver regardless of window, backoff and breaker.
+   */
+  void requestImmediate(const std::string & indiDriverName, TimePointT now);
+
+  /**
+   * Time since the last restart of the given driver (negative if never).
+   */
+  std::chrono::milliseconds getTimeSinceRestart(const std::string & indiDriverName, TimePointT now) const;
+  
+  bool isRecoveryPending(const std::string & indiDeviceName, TimePointT now) const;
+  void reportRecovered(const std::string & indiDeviceName);
+
+  const IndiDriverTopologyT & getTopology() const;
+  unsigned long getRestartCount() const;
+  unsigned long getCoalescedCount() const;
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_INDI_DRIVER_RESTART_EXECUTOR_H_ */
@@ -28,75 +28,219 @@
 #include <filesystem>
 #include <iostream>
 #include <fstream>
+#include <chrono>
+#include <algorithm>
 
 #include "logging.h"
 #include "indi_driver_restart_manager.h"
 
 
-IndiDriverRestartManagerT::IndiDriverRestartManagerT() : restartTriggerLimit_(3), indiBinPath_("/usr/bin"), indiServerPipe_("/tmp/indiserverFIFO") {
+IndiDriverRestartManagerT::IndiDriverRestartManagerT() : IndiDriverRestartManagerT(3, "/usr/bin", "/tmp/indiserverFIFO") {
 }
 
 
-IndiDriverRestartManagerT::IndiDriverRestartManagerT(int restartTriggerLimit, const std::string & indiBinPath, const std::string & indiServerPipe) : restartTriggerLimit_(restartTriggerLimit), indiBinPath_(indiBinPath), indiServerPipe_(indiServerPipe) {
+IndiDriverRestartManagerT::IndiDriverRestartManagerT(int restartTriggerLimit, const std::string & indiBinPath, const std::string & indiServerPipe) : restartTriggerLimit_(restartTriggerLimit), indiBinPath_(indiBinPath), indiServerPipe_(indiServerPipe), restartStateFile_(std::make_unique<RestartStateFileT>("")), minRestartBackoff_(10000), maxRestartBackoff_(600000), breakerThreshold_(5), breakerCooldown_(1800000) {
 
 }
 
 
+void IndiDriverRestartManagerT::openRestartStateFile(const std::string & restartStateFilePath) {
+  auto startTime = std::chrono::steady_clock::now();
+  
+  restartStateFile_ = std::make_unique<RestartStateFileT>(restartStateFilePath);
+
+  LOG(debug) << "Opened restart state file '" << restartStateFilePath << "' in "
+	     << std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count() << " us." << std::endl;
+}
+
+
 void IndiDriverRestartManagerT::reset() {
-  driverRestartMap_.clear();
+  restartStateFile_->clear();
 }
 
 
-void IndiDriverRestartManagerT::restart(const std::string & indiDriverName) {
-  std::ofstream indiServerPipe(indiServerPipe_);
+int64_t IndiDriverRestartManagerT::getWallClockTimeMs() {
+  // NOTE: The steady clock does not survive a reboot
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+
+std::chrono::milliseconds IndiDriverRestartManagerT::getRestartBackoff(unsigned int consecutiveRestartCount) const {
+  std::chrono::milliseconds backoff = minRestartBackoff_;
+
+  for (unsigned int i = 1; i < consecutiveRestartCount && backoff < maxRestartBackoff_; ++i) {
+    backoff *= 2;
+  }
+  return std::min(backoff, maxRestartBackoff_);
+}
+
+
+DriverRestartStateT IndiDriverRestartManagerT::loadState(const std::string & indiDriverName) const {
+  DriverRestartStateT state;
+  restartStateFile_->load(indiDriverName, state);
+
+  // Guard against wall clock jumps (e.g. no RTC and no NTP yet)
+  int64_t nowMs = getWallClockTimeMs();
+
+  if (state.nextAllowedRestartTimeMs - nowMs > breakerCooldown_.count()) {
+    state.nextAllowedRestartTimeMs = nowMs;
+  }
   
-  if (indiServerPipe.is_open()) {
-    std::filesystem::path indiDriverPath = indiBinPath_ / std::filesystem::path(indiDriverName);
-    LOG(info) << "Restarting INDi driver '" << indiDriverPath.string() << "'..." << std::endl;
-    
-    indiServerPipe << "stop " << indiDriverPath.string() << std::endl;
-    indiServerPipe << "start " << indiDriverPath.string() << std::endl;
+  return state;
+}
+
 
-    indiServerPipe.close();
+void IndiDriverRestartManagerT::storeState(const std::string & indiDriverName, const DriverRestartStateT & state) {
+  if (! restartStateFile_->store(indiDriverName, state)) {
+    LOG(warning) << "Cannot store restart state of INDI driver '" << indiDriverName << "'." << std::endl;
   }
-  else {
+}
+
+
+DriverRestartStateT IndiDriverRestartManagerT::getRestartState(const std::string & indiDriverName) const {
+  return loadState(indiDriverName);
+}
+
+
+bool IndiDriverRestartManagerT::isBreakerOpen(const std::string & indiDriverName) const {
+  return loadState(indiDriverName).breakerOpen != 0;
+}
+
+
+void IndiDriverRestartManagerT::setIndiServerSupervisor(std::shared_ptr<IndiServerSupervisorT> indiServerSupervisor) {
+  indiServerSupervisor_ = indiServerSupervisor;
+
+  if (indiServerSupervisor_ != nullptr) {
+    indiServerSupervisor_->setDriverRestartedCallback(driverRestartedCallback_);
+  }
+}
+
+
+void IndiDriverRestartManagerT::setDriverRestartedCallback(DriverRestartedCallbackT driverRestartedCallback) {
+  driverRestartedCallback_ = driverRestartedCallback;
+
+  if (indiServerSupervisor_ != nullptr) {
+    indiServerSupervisor_->setDriverRestartedCallback(driverRestartedCallback_);
+  }
+}
+
+
+bool IndiDriverRestartManagerT::writeIndiServerCommand(const std::string & command, const std::string & indiDriverName) {
+  std::ofstream indiServerPipe(indiServerPipe_);
+  
+  if (! indiServerPipe.is_open()) {
     LOG(error) << "ERROR: Cannot open INDI server pipe '" <<  indiServerPipe_ << "'." << std::endl;
+    return false;
+  }
+
+  std::filesystem::path indiDriverPath = indiBinPath_ / std::filesystem::path(indiDriverName);
+  indiServerPipe << command << " " << indiDriverPath.string() << std::endl;
+
+  return true;
+}
+
+
+/**
+ * In supervisor mode the supervisor thread restarts the driver - waiting
+ * for a driver which does not terminate would stall the decision loop.
+ */
+void IndiDriverRestartManagerT::restart(const std::string & indiDriverName) {
+  LOG(info) << "Restarting INDi driver '" << indiDriverName << "'..." << std::endl;
+
+  if (indiServerSupervisor_ != nullptr) {
+    indiServerSupervisor_->requestDriverRestart(indiDriverName);
+    return;
+  }
+  
+  if (! writeIndiServerCommand("stop", indiDriverName)) {
+    return;
+  }
+
+  if (writeIndiServerCommand("start", indiDriverName) && driverRestartedCallback_ != nullptr) {
+    driverRestartedCallback_(indiDriverName);
   }
 }
 
 
 bool IndiDriverRestartManagerT::requestRestart(const std::string & indiDriverName) {
-  auto it = driverRestartMap_.find(indiDriverName);
-  bool restarted = false;
-
-  if (it != driverRestartMap_.end()) {
-    // Already known..
-    bool isRestartConditionReached = (it->second >= restartTriggerLimit_ - 1);
-    
-    if (isRestartConditionReached) {
-      restart(indiDriverName);
-      restarted = true;
-
-      // Reset the counter
-      it->second = 0;
-    }
-    else {
-      it->second++;
+  DriverRestartStateT state = loadState(indiDriverName);
+  int64_t nowMs = getWallClockTimeMs();
+
+  state.pendingRequestCount++;
+
+  if (nowMs < state.nextAllowedRestartTimeMs) {
+    LOG(debug) << "Not restarting INDI driver '" << indiDriverName << "' - " << (state.breakerOpen ? "breaker open" : "backoff") << " for another "
+	       << (state.nextAllowedRestartTimeMs - nowMs) << " ms." << std::endl;
+    storeState(indiDriverName, state);
+    return false;
+  }
+
+  if (state.breakerOpen) {
+    LOG(warning) << "Cooldown of INDI driver '" << indiDriverName << "' expired - trying one more restart." << std::endl;
+  }
+
+  // A driver which was healthy since its last restart is restarted at
+  // once, otherwise only every restartTriggerLimit_ requests.
+  bool isRestartConditionReached = (state.consecutiveRestartCount == 0 || state.breakerOpen || static_cast<int>(state.pendingRequestCount) >= restartTriggerLimit_);
+  
+  if (! isRestartConditionReached) {
+    storeState(indiDriverName, state);
+    return false;
+  }
+  
+  restart(indiDriverName);
+
+  state.pendingRequestCount = 0;
+  state.totalRestartCount++;
+  state.consecutiveRestartCount++;
+  state.lastRestartTimeMs = nowMs;
+
+  if (state.consecutiveRestartCount >= breakerThreshold_) {
+    if (! state.breakerOpen) {
+      LOG(error) << "INDI driver '" << indiDriverName << "' was restarted " << state.consecutiveRestartCount
+		 << " times without recovering - blocking further restarts for " << breakerCooldown_.count() / 1000 << " s." << std::endl;
     }
+    state.breakerOpen = 1;
+    state.nextAllowedRestartTimeMs = nowMs + breakerCooldown_.count();
   }
   else {
-    // New entry
-    // First request -> directly restart
-    restart(indiDriverName);
-    restarted = true;
-    
-    driverRestartMap_.insert(std::pair<std::string, int> (indiDriverName, 0));
+    state.nextAllowedRestartTimeMs = nowMs + getRestartBackoff(state.consecutiveRestartCount).count();
+  }
+
+  storeState(indiDriverName, state);
+  
+  return true;
+}
+
+
+void IndiDriverRestartManagerT::reportHealthy(const std::string & indiDriverName) {
+  DriverRestartStateT state = loadState(indiDriverName);
+
+  if (state.consecutiveRestartCount == 0 && ! state.breakerOpen && state.pendingRequestCount == 0) {
+    return;
+  }
+
+  if (state.breakerOpen) {
+    LOG(info) << "INDI driver '" << indiDriverName << "' recovered - closing breaker." << std::endl;
   }
+  
+  state.consecutiveRestartCount = 0;
+  state.pendingRequestCount = 0;
+  state.breakerOpen = 0;
+  
+  // Still keep the minimum distance between two restarts
+  state.nextAllowedRestartTimeMs = std::min(state.nextAllowedRestartTimeMs, state.lastRestartTimeMs + minRestartBackoff_.count());
 
-  return restarted;
+  storeState(indiDriverName, state);
 }
 
 
 void IndiDriverRestartManagerT::requestImmediateRestart(const std::string & indiDriverName) {
+  DriverRestartStateT state = loadState(indiDriverName);
+  
   restart(indiDriverName);
+
+  state.totalRestartCount++;
+  state.lastRestartTimeMs = getWallClockTimeMs();
+  storeState(indiDriverName, state);
 }
@@ -28,24 +28,112 @@
 #ifndef SOURCE_INDI_DRIVER_RESTART_MANAGER_H_
 #define SOURCE_INDI_DRIVER_RESTART_MANAGER_H_ SOURCE_INDI_DRIVER_RESTART_MANAGER_H_
 
-#include <map>
+#include <chrono>
+#include <memory>
+#include <string>
 
+#include "indi_server_supervisor.h"
+#include "restart_state_file.h"
+
+struct DriverRestartResultT {
+  typedef enum {
+    RESTARTED,
+    COALESCED,
+    REJECTED,
+    _Count
+  } TypeE;
+
+  static const char *asStr(const TypeE &inType) {
+    switch (inType) {
+    case RESTARTED:
+      return "RESTARTED";
+    case COALESCED:
+      return "COALESCED";
+    case REJECTED:
+      return "REJECTED";
+    default:
+      return "<?>";
+    }
+  }
+};
+
+
+/**
+ * Restarts INDI drivers via the INDI server pipe. The first restart
+ * request of a healthy driver restarts it right away, further requests
+ * only every restartTriggerLimit requests. After each restart further
+ * restarts are blocked for an exponentially growing backoff time. After
+ * too many restarts without the driver becoming healthy in between, the
+ * breaker opens and blocks restarts for a long cooldown time.
+ *
+ * The restart history is kept in a memory mapped state file, so that a
+ * restart of the watchdog does not restart all drivers again.
+ */
 class IndiDriverRestartManagerT {
+ public:
+  typedef IndiServerSupervisorT::DriverRestartedCallbackT DriverRestartedCallbackT;
+
  private:
   int restartTriggerLimit_;
-  std::map<std::string, int> driverRestartMap_;
   std::string indiBinPath_;
   std::string indiServerPipe_;
+  std::shared_ptr<IndiServerSupervisorT> indiServerSupervisor_;
+  std::unique_ptr<RestartStateFileT> restartStateFile_;
+  DriverRestartedCallbackT driverRestartedCallback_;
+
+  std::chrono::milliseconds minRestartBackoff_;
+  std::chrono::milliseconds maxRestartBackoff_;
+  unsigned int breakerThreshold_;
+  std::chrono::milliseconds breakerCooldown_;
+
+  static int64_t getWallClockTimeMs();
+  std::chrono::milliseconds getRestartBackoff(unsigned int consecutiveRestartCount) const;
+  DriverRestartStateT loadState(const std::string & indiDriverName) const;
+  void storeState(const std::string & indiDriverName, const DriverRestartStateT & state);
   
   void restart(const std::string & indiDriverName);
+  bool writeIndiServerCommand(const std::string & command, const std::string & indiDriverName);
   
  public:
   IndiDriverRestartManagerT();
   IndiDriverRestartManagerT(int restartTriggerLimit, const std::string & indiBinPath, const std::string & indiServerPipe);
   
+  /**
+   * Persist the restart history in the given file (empty = in memory only).
+   */
+  void openRestartStateFile(const std::string & restartStateFilePath);
+  
   bool requestRestart(const std::string & indiDriverName);
+
+  /**
+   * Restarts the driver regardless of backoff and breaker (the restart
+   * is recorded though).
+   */
   void requestImmediateRestart(const std::string & indiDriverName);
+
+  /**
+   * Tells the manager that the devices of the driver work again. This
+   * resets the backoff and closes the breaker.
+   */
+  void reportHealthy(const std::string & indiDriverName);
+
+  bool isBreakerOpen(const std::string & indiDriverName) const;
+  DriverRestartStateT getRestartState(const std::string & indiDriverName) const;
+  
   void reset();
+
+  /**
+   * In supervisor mode the restarts are executed asynchronously by the
+   * supervisor. It knows the exact driver PIDs and kills a driver which
+   * does not terminate on "stop" before it is started again.
+   */
+  void setIndiServerSupervisor(std::shared_ptr<IndiServerSupervisorT> indiServerSupervisor);
+
+  /**
+   * Called once the "start" of a restarted driver was written to the
+   * INDI server pipe - in supervisor mode by the supervisor thread.
+   */
+  void setDriverRestartedCallback(DriverRestartedCallbackT driverRestartedCallback);
 };
 
 #endif /* SOURCE_INDI_DRIVER_RESTART_MANAGER_H_ */
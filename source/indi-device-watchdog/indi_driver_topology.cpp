@@ -0,0 +1,67 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include "indi_driver_topology.h"
+
+
+IndiDriverTopologyT::IndiDriverTopologyT() {
+}
+
+
+IndiDriverTopologyT::IndiDriverTopologyT(const std::vector<DeviceDataT> & devices) {
+  for (const DeviceDataT & deviceData : devices) {
+    driverDevices_[deviceData.getIndiDeviceDriverName()].push_back(deviceData.getIndiDeviceName());
+    deviceDrivers_[deviceData.getIndiDeviceName()] = deviceData.getIndiDeviceDriverName();
+  }
+}
+
+
+const std::vector<std::string> & IndiDriverTopologyT::getIndiDevices(const std::string & indiDriverName) const {
+  static const std::vector<std::string> noDevices;
+  
+  auto driverDevicesIt = driverDevices_.find(indiDriverName);
+  return (driverDevicesIt != driverDevices_.end() ? driverDevicesIt->second : noDevices);
+}
+
+
+std::string IndiDriverTopologyT::getIndiDriverName(const std::string & indiDeviceName) const {
+  auto deviceDriverIt = deviceDrivers_.find(indiDeviceName);
+  return (deviceDriverIt != deviceDrivers_.end() ? deviceDriverIt->second : "");
+}
+
+
+std::vector<std::string> IndiDriverTopologyT::getSharedIndiDrivers() const {
+  std::vector<std::string> sharedIndiDrivers;
+
+  for (const auto & driverDevicesEntry : driverDevices_) {
+    if (driverDevicesEntry.second.size() > 1) {
+      sharedIndiDrivers.push_back(driverDevicesEntry.first);
+    }
+  }
+  return sharedIndiDrivers;
+}
@@ -0,0 +1,69 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_INDI_DRIVER_TOPOLOGY_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_INDI_DRIVER_TOPOLOGY_H_ SOURCE_INDI_DEVICE_WATCHDOG_INDI_DRIVER_TOPOLOGY_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "device_data.h"
+
+/**
+ * Index of which INDI devices are served by which INDI driver. One
+ * driver may serve several devices (e.g. two cameras of the same vendor
+ * or a mount and its auxiliary devices) - restarting it affects all of
+ * them. Built once from the device config.
+ */
+class IndiDriverTopologyT {
+ private:
+  std::map<std::string /*driver name*/, std::vector<std::string> /*device names*/> driverDevices_;
+  std::map<std::string /*device name*/, std::string /*driver name*/> deviceDrivers_;
+  
+ public:
+  IndiDriverTopologyT();
+  explicit IndiDriverTopologyT(const std::vector<DeviceDataT> & devices);
+
+  /**
+   * The devices served by the given driver (empty if unknown).
+   */
+  const std::vector<std::string> & getIndiDevices(const std::string & indiDriverName) const;
+
+  /**
+   * The driver of the given device (empty if unknown).
+   */
+  std::string getIndiDriverName(const std::string & indiDeviceName) const;
+
+  /**
+   * Drivers which serve more than one device.
+   */
+  std::vector<std::string> getSharedIndiDrivers() const;
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_INDI_DRIVER_TOPOLOGY_H_ */
@@ -0,0 +1,63 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_INDI_OPERATION_RESULT_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_INDI_OPERATION_RESULT_H_ SOURCE_INDI_DEVICE_WATCHDOG_INDI_OPERATION_RESULT_H_
+
+struct IndiOperationResultT {
+    typedef enum {
+        SUCCEEDED,
+        ALREADY_SET, // The switch element was already on - nothing was sent
+        NOT_SENT,
+        FAILED,
+        TIMEOUT,
+        CANCELLED,
+        _Count
+    } TypeE;
+
+    static const char *asStr(const TypeE &inType) {
+        switch (inType) {
+            case SUCCEEDED:
+                return "SUCCEEDED";
+            case ALREADY_SET:
+                return "ALREADY_SET";
+            case NOT_SENT:
+                return "NOT_SENT";
+            case FAILED:
+                return "FAILED";
+            case TIMEOUT:
+                return "TIMEOUT";
+            case CANCELLED:
+                return "CANCELLED";
+            default:
+                return "<?>";
+        }
+    }
+};
+
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_INDI_OPERATION_RESULT_H_ */
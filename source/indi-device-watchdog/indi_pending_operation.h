@@ -0,0 +1,88 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_INDI_PENDING_OPERATION_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_INDI_PENDING_OPERATION_H_ SOURCE_INDI_DEVICE_WATCHDOG_INDI_PENDING_OPERATION_H_
+
+#include <chrono>
+#include <string>
+
+#include "indi_operation_result.h"
+
+class IndiClientT;
+
+/**
+ * An INDI operation (e.g. setting a switch) which waits for the answer of
+ * the INDI driver. Pending operations are linked into an intrusive list
+ * of the IndiClientT, so the client itself does not allocate anything to
+ * track or to resolve them. The operation - including its names - is
+ * owned by the caller: the coroutine frame for SetSwitchAwaitableT, a
+ * heap object with the completion handler for the callback variant of
+ * IndiClientT::setSwitch(). They are resolved from the property update
+ * callbacks or when their deadline expired.
+ *
+ * complete() is called exactly once - from the thread which resolved the
+ * operation (usually the INDI client listener thread).
+ */
+class IndiPendingOperationT {
+  friend class IndiClientT;
+
+ private:
+  std::string deviceName_;
+  std::string propertyName_;
+  std::string elementName_;
+  std::chrono::steady_clock::time_point deadline_;
+
+  // Managed by IndiClientT under its pending operations mutex
+  bool armed_;
+  bool resolved_;
+  bool transitionSeen_; // The element was off when sent or the driver reported busy since
+  IndiOperationResultT::TypeE result_;
+  IndiPendingOperationT * prev_;
+  IndiPendingOperationT * next_;
+
+ protected:
+  virtual void complete(IndiOperationResultT::TypeE result) = 0;
+
+ public:
+  IndiPendingOperationT(const std::string & deviceName, const std::string & propertyName, const std::string & elementName, std::chrono::milliseconds timeout)
+    : deviceName_(deviceName), propertyName_(propertyName), elementName_(elementName),
+      deadline_(std::chrono::steady_clock::now() + timeout), armed_(false), resolved_(false), transitionSeen_(false),
+      result_(IndiOperationResultT::FAILED), prev_(nullptr), next_(nullptr) {}
+
+  virtual ~IndiPendingOperationT() = default;
+
+  IndiPendingOperationT(const IndiPendingOperationT &) = delete;
+  IndiPendingOperationT & operator=(const IndiPendingOperationT &) = delete;
+
+  const std::string & getDeviceName() const { return deviceName_; }
+  const std::string & getPropertyName() const { return propertyName_; }
+  const std::string & getElementName() const { return elementName_; }
+  IndiOperationResultT::TypeE getResult() const { return result_; }
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_INDI_PENDING_OPERATION_H_ */
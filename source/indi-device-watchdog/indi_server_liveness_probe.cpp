@@ -0,0 +1,295 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+#include "logging.h"
+#include "indi_server_liveness_probe.h"
+
+
+static std::string escapeXml(const std::string & str) {
+  std::string escaped;
+  escaped.reserve(str.size());
+
+  for (char c : str) {
+    switch (c) {
+    case '&': escaped += "&amp;"; break;
+    case '<': escaped += "&lt;"; break;
+    case '>': escaped += "&gt;"; break;
+    case '"': escaped += "&quot;"; break;
+    case '\'': escaped += "&apos;"; break;
+    default: escaped += c;
+    }
+  }
+  return escaped;
+}
+
+
+IndiServerLivenessProbeT::IndiServerLivenessProbeT(const std::string & hostname, int port, std::chrono::milliseconds interval, std::chrono::milliseconds timeout, ProbeDeviceSelectorT probeDeviceSelector, ServerLostCallbackT serverLostCallback) : hostname_(hostname), port_(port), interval_(interval), timeout_(timeout), probeDeviceSelector_(probeDeviceSelector), serverLostCallback_(serverLostCallback), stop_(false), socketFd_(-1), nextProbeDeviceIdx_(0), lastRoundTripTimeUs_(0), maxRoundTripTimeUs_(0), probeCount_(0), failureCount_(0) {
+}
+
+
+IndiServerLivenessProbeT::~IndiServerLivenessProbeT() {
+  stop();
+}
+
+
+void IndiServerLivenessProbeT::start() {
+  std::lock_guard<std::mutex> guard(probeMutex_);
+
+  if (! probeThread_.joinable()) {
+    stop_ = false;
+    probeThread_ = std::thread(&IndiServerLivenessProbeT::run, this);
+  }
+}
+
+
+void IndiServerLivenessProbeT::stop() {
+  {
+    std::lock_guard<std::mutex> guard(probeMutex_);
+    stop_ = true;
+  }
+  probeCv_.notify_all();
+
+  if (probeThread_.joinable()) {
+    probeThread_.join();
+  }
+  closeSocket();
+}
+
+
+/**
+ * Returns false if the probe was stopped while sleeping.
+ */
+bool IndiServerLivenessProbeT::sleepFor(std::chrono::milliseconds duration) {
+  std::unique_lock<std::mutex> lock(probeMutex_);
+  return ! probeCv_.wait_for(lock, duration, [this]() { return stop_; });
+}
+
+
+bool IndiServerLivenessProbeT::openSocket() {
+  addrinfo hints;
+  memset(& hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  addrinfo * addrInfos = nullptr;
+  
+  if (getaddrinfo(hostname_.c_str(), std::to_string(port_).c_str(), & hints, & addrInfos) != 0 || addrInfos == nullptr) {
+    return false;
+  }
+
+  int fd = socket(addrInfos->ai_family, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+
+  if (fd < 0) {
+    freeaddrinfo(addrInfos);
+    return false;
+  }
+
+  // Detect a half-open connection (e.g. a dropped Wi-Fi link) within the
+  // timeout - even if no data is pending.
+  int enable = 1;
+  int keepAliveSec = 1;
+  int keepAliveCount = std::max(1, static_cast<int>(timeout_.count() / 1000));
+  unsigned int userTimeoutMs = static_cast<unsigned int>(timeout_.count());
+
+  setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, & enable, sizeof(enable));
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, & keepAliveSec, sizeof(keepAliveSec));
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, & keepAliveSec, sizeof(keepAliveSec));
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, & keepAliveCount, sizeof(keepAliveCount));
+  setsockopt(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, & userTimeoutMs, sizeof(userTimeoutMs));
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, & enable, sizeof(enable));
+  
+  int rc = connect(fd, addrInfos->ai_addr, addrInfos->ai_addrlen);
+  freeaddrinfo(addrInfos);
+
+  if (rc != 0 && errno == EINPROGRESS) {
+    pollfd pfd = { fd, POLLOUT, 0 };
+    int socketError = 0;
+    socklen_t socketErrorLen = sizeof(socketError);
+
+    rc = (poll(& pfd, 1, static_cast<int>(timeout_.count())) == 1
+	  && getsockopt(fd, SOL_SOCKET, SO_ERROR, & socketError, & socketErrorLen) == 0
+	  && socketError == 0) ? 0 : -1;
+  }
+
+  if (rc != 0) {
+    close(fd);
+    return false;
+  }
+
+  std::lock_guard<std::mutex> guard(probeMutex_);
+  socketFd_ = fd;
+  
+  return true;
+}
+
+
+void IndiServerLivenessProbeT::closeSocket() {
+  std::lock_guard<std::mutex> guard(probeMutex_);
+
+  if (socketFd_ >= 0) {
+    close(socketFd_);
+    socketFd_ = -1;
+  }
+}
+
+
+bool IndiServerLivenessProbeT::probe(std::string & failureReason) {
+  char buffer[4096];
+
+  // Drop whatever arrived since the last probe and check for EOF / errors
+  while (true) {
+    ssize_t n = recv(socketFd_, buffer, sizeof(buffer), 0);
+
+    if (n > 0) {
+      continue;
+    }
+    if (n == 0) {
+      failureReason = "INDI server closed the connection";
+      return false;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      break;
+    }
+    if (errno != EINTR) {
+      failureReason = std::string("Socket error: ") + strerror(errno);
+      return false;
+    }
+  }
+
+  probeCount_++;
+  
+  std::vector<std::string> probeDevices = probeDeviceSelector_();
+
+  if (probeDevices.empty()) {
+    // Nothing which would answer - rely on keepalive / TCP_USER_TIMEOUT
+    return true;
+  }
+
+  // A second device only if the first one did not answer
+  size_t attemptCount = std::min<size_t>(2, probeDevices.size());
+
+  for (size_t attempt = 0; attempt < attemptCount; ++attempt) {
+    const std::string & probeDevice = probeDevices[nextProbeDeviceIdx_++ % probeDevices.size()];
+    std::string request = "<getProperties version='1.7' device='" + escapeXml(probeDevice) + "' name='CONNECTION'/>\n";
+    auto startTime = std::chrono::steady_clock::now();
+
+    if (send(socketFd_, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size())) {
+      failureReason = std::string("Cannot send probe: ") + strerror(errno);
+      return false;
+    }
+
+    pollfd pfd = { socketFd_, POLLIN, 0 };
+    int rc;
+  
+    do {
+      auto remaining = timeout_ - std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime);
+      rc = poll(& pfd, 1, std::max(0, static_cast<int>(remaining.count())));
+    } while (rc < 0 && errno == EINTR);
+
+    if (rc == 0) {
+      LOG(debug) << "INDI device '" << probeDevice << "' did not answer the liveness probe within " << timeout_.count() << " ms." << std::endl;
+      continue;
+    }
+
+    ssize_t n = recv(socketFd_, buffer, sizeof(buffer), 0);
+
+    if (n <= 0) {
+      failureReason = (n == 0 ? std::string("INDI server closed the connection") : std::string("Socket error: ") + strerror(errno));
+      return false;
+    }
+  
+    long roundTripTimeUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+    lastRoundTripTimeUs_ = roundTripTimeUs;
+    maxRoundTripTimeUs_ = std::max(maxRoundTripTimeUs_.load(), roundTripTimeUs);
+
+    LOG(trace) << "INDI server liveness probe RTT (" << probeDevice << "): " << roundTripTimeUs << " us." << std::endl;
+  
+    return true;
+  }
+
+  failureReason = "INDI server did not answer within " + std::to_string(timeout_.count()) + " ms";
+  return false;
+}
+
+
+void IndiServerLivenessProbeT::run() {
+
+  do {
+    bool hasSocket;
+    {
+      std::lock_guard<std::mutex> guard(probeMutex_);
+      hasSocket = (socketFd_ >= 0);
+    }
+
+    std::string failureReason;
+    
+    if (! hasSocket && ! openSocket()) {
+      failureReason = "Cannot connect to INDI server";
+    }
+    else if (! probe(failureReason)) {
+      closeSocket();
+    }
+    
+    if (! failureReason.empty()) {
+      failureCount_++;
+      serverLostCallback_(failureReason);
+    }
+  } while (sleepFor(interval_));
+}
+
+
+std::chrono::microseconds IndiServerLivenessProbeT::getLastRoundTripTime() const {
+  return std::chrono::microseconds(lastRoundTripTimeUs_);
+}
+
+
+std::chrono::microseconds IndiServerLivenessProbeT::getMaxRoundTripTime() const {
+  return std::chrono::microseconds(maxRoundTripTimeUs_);
+}
+
+
+unsigned long IndiServerLivenessProbeT::getProbeCount() const {
+  return probeCount_;
+}
+
+
+unsigned long IndiServerLivenessProbeT::getFailureCount() const {
+  return failureCount_;
+}
@@ -0,0 +1,103 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_INDI_SERVER_LIVENESS_PROBE_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_INDI_SERVER_LIVENESS_PROBE_H_ SOURCE_INDI_DEVICE_WATCHDOG_INDI_SERVER_LIVENESS_PROBE_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Actively checks that the INDI server is alive. The libindi client owns
+ * its socket, so the probe uses a separate, lightweight TCP connection
+ * with keepalive and TCP_USER_TIMEOUT enabled. Periodically it asks for
+ * the CONNECTION property of one known INDI device (getProperties) and
+ * measures the round trip time until the answer arrives. The server
+ * forwards the request to the driver, which sends the property to all
+ * its clients again - hence only one device per probe, in turn. If it
+ * does not answer (e.g. a hung driver), another device is asked before
+ * the server counts as dead. Without known devices only the TCP level
+ * checks apply.
+ *
+ * If the server does not answer within the timeout (or the socket dies)
+ * the "lost" callback is called from the probe thread.
+ */
+class IndiServerLivenessProbeT {
+ public:
+  typedef std::function<std::vector<std::string>()> ProbeDeviceSelectorT;
+  typedef std::function<void(const std::string & reason)> ServerLostCallbackT;
+
+ private:
+  std::string hostname_;
+  int port_;
+  std::chrono::milliseconds interval_;
+  std::chrono::milliseconds timeout_;
+  ProbeDeviceSelectorT probeDeviceSelector_;
+  ServerLostCallbackT serverLostCallback_;
+  
+  std::thread probeThread_;
+  std::mutex probeMutex_;
+  std::condition_variable probeCv_;
+  bool stop_;
+  int socketFd_;
+  size_t nextProbeDeviceIdx_; // Only accessed by the probe thread
+
+  std::atomic<long> lastRoundTripTimeUs_;
+  std::atomic<long> maxRoundTripTimeUs_;
+  std::atomic<unsigned long> probeCount_;
+  std::atomic<unsigned long> failureCount_;
+
+  bool openSocket();
+  void closeSocket();
+  bool probe(std::string & failureReason);
+  void run();
+  bool sleepFor(std::chrono::milliseconds duration);
+
+  // We do not want copies
+  IndiServerLivenessProbeT(const IndiServerLivenessProbeT &);
+  IndiServerLivenessProbeT &operator=(const IndiServerLivenessProbeT &);
+  
+ public:
+  IndiServerLivenessProbeT(const std::string & hostname, int port, std::chrono::milliseconds interval, std::chrono::milliseconds timeout, ProbeDeviceSelectorT probeDeviceSelector, ServerLostCallbackT serverLostCallback);
+  ~IndiServerLivenessProbeT();
+
+  void start();
+  void stop();
+
+  std::chrono::microseconds getLastRoundTripTime() const;
+  std::chrono::microseconds getMaxRoundTripTime() const;
+  unsigned long getProbeCount() const;
+  unsigned long getFailureCount() const;
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_INDI_SERVER_LIVENESS_PROBE_H_ */
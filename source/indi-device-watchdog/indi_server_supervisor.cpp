@@ -0,0 +1,415 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+
+#include "logging.h"
+#include "indi_server_supervisor.h"
+#include "process_table.h"
+
+
+/**
+ * pidfd_open() has no glibc wrapper on older systems (e.g. Ubuntu 20.04).
+ */
+static int openPidFd(pid_t pid) {
+#ifdef SYS_pidfd_open
+  return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+  (void) pid;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+
+IndiServerSupervisorT::IndiServerSupervisorT(const std::string & indiServerBinary, int port, const std::string & indiServerPipePath, const std::string & indiBinPath, const std::vector<std::string> & driverNames) : indiServerBinary_(indiServerBinary), port_(port), indiServerPipePath_(indiServerPipePath), indiBinPath_(indiBinPath), driverNames_(driverNames), indiServerPidFd_(-1), wakeUpFd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)), stop_(false), restartRequested_(false), replayPending_(false), running_(false), indiServerPid_(-1), generation_(0), unexpectedExitCount_(0), replayFailureCount_(0) {
+}
+
+
+IndiServerSupervisorT::~IndiServerSupervisorT() {
+  stop();
+
+  if (wakeUpFd_ >= 0) {
+    close(wakeUpFd_);
+  }
+}
+
+
+void IndiServerSupervisorT::start() {
+  std::lock_guard<std::mutex> guard(supervisorMutex_);
+
+  if (! supervisorThread_.joinable()) {
+    stop_ = false;
+    supervisorThread_ = std::thread(&IndiServerSupervisorT::run, this);
+  }
+}
+
+
+void IndiServerSupervisorT::wakeUp() {
+  uint64_t one = 1;
+  (void) ! write(wakeUpFd_, & one, sizeof(one));
+}
+
+
+void IndiServerSupervisorT::stop() {
+  {
+    std::lock_guard<std::mutex> guard(supervisorMutex_);
+    stop_ = true;
+  }
+
+  wakeUp();
+
+  if (supervisorThread_.joinable()) {
+    supervisorThread_.join();
+  }
+}
+
+
+void IndiServerSupervisorT::requestRestart() {
+  {
+    std::lock_guard<std::mutex> guard(supervisorMutex_);
+    restartRequested_ = true;
+  }
+
+  wakeUp();
+}
+
+
+void IndiServerSupervisorT::requestDriverRestart(const std::string & driverName) {
+  {
+    std::lock_guard<std::mutex> guard(supervisorMutex_);
+
+    if (std::find(pendingDriverRestarts_.begin(), pendingDriverRestarts_.end(), driverName) == pendingDriverRestarts_.end()) {
+      pendingDriverRestarts_.push_back(driverName);
+    }
+  }
+
+  wakeUp();
+}
+
+
+void IndiServerSupervisorT::setDriverRestartedCallback(DriverRestartedCallbackT driverRestartedCallback) {
+  driverRestartedCallback_ = driverRestartedCallback;
+}
+
+
+bool IndiServerSupervisorT::createPipe() {
+  struct stat pipeStat;
+
+  if (stat(indiServerPipePath_.c_str(), & pipeStat) == 0) {
+    if (S_ISFIFO(pipeStat.st_mode)) {
+      return true;
+    }
+    LOG(error) << "ERROR: '" << indiServerPipePath_ << "' exists but is not a FIFO." << std::endl;
+    return false;
+  }
+
+  if (mkfifo(indiServerPipePath_.c_str(), 0664) != 0) {
+    LOG(error) << "ERROR: Cannot create FIFO '" << indiServerPipePath_ << "': " << strerror(errno) << std::endl;
+    return false;
+  }
+  
+  return true;
+}
+
+
+bool IndiServerSupervisorT::spawnIndiServer() {
+
+  if (! createPipe()) {
+    return false;
+  }
+  
+  LOG(info) << "Starting INDI server '" << indiServerBinary_ << "' on port " << port_ << " with FIFO '" << indiServerPipePath_ << "'..." << std::endl;
+  
+  if (! indiServerProcess_.start({ indiServerBinary_, "-p", std::to_string(port_), "-f", indiServerPipePath_ })) {
+    return false;
+  }
+
+  indiServerPidFd_ = openPidFd(indiServerProcess_.getPid());
+
+  if (indiServerPidFd_ < 0) {
+    LOG(debug) << "pidfd not available (" << strerror(errno) << ") - polling INDI server process instead." << std::endl;
+  }
+  
+  indiServerPid_ = indiServerProcess_.getPid();
+  running_ = true;
+  generation_++;
+  replayPending_ = true;
+
+  return true;
+}
+
+
+/**
+ * The INDI server opens the FIFO shortly after its start. Until then
+ * opening the FIFO for writing without blocking fails with ENXIO.
+ */
+bool IndiServerSupervisorT::writeIndiServerCommands(const std::string & commands) {
+  using namespace std::chrono_literals;
+
+  auto startTime = std::chrono::steady_clock::now();
+  int fd = -1;
+
+  while ((fd = open(indiServerPipePath_.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC)) < 0) {
+    if (errno != ENXIO || std::chrono::steady_clock::now() - startTime > 5s || indiServerProcess_.poll() != ChildProcessStateT::RUNNING) {
+      LOG(error) << "ERROR: Cannot open INDI server FIFO '" << indiServerPipePath_ << "': " << strerror(errno) << std::endl;
+      return false;
+    }
+    std::this_thread::sleep_for(50ms);
+  }
+
+  // Blocking writes from here on
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+  bool successful = (write(fd, commands.data(), commands.size()) == static_cast<ssize_t>(commands.size()));
+  close(fd);
+
+  return successful;
+}
+
+
+bool IndiServerSupervisorT::replayDriverStarts() {
+  std::stringstream commands;
+  
+  for (const auto & driverName : driverNames_) {
+    std::filesystem::path indiDriverPath = indiBinPath_ / std::filesystem::path(driverName);
+    LOG(info) << "Starting INDI driver '" << indiDriverPath.string() << "'..." << std::endl;
+
+    commands << "start " << indiDriverPath.string() << std::endl;
+  }
+
+  if (! writeIndiServerCommands(commands.str())) {
+    replayFailureCount_++;
+    LOG(error) << "Replaying the INDI driver starts failed (" << replayFailureCount_ << " times) - retrying." << std::endl;
+    return false;
+  }
+  return true;
+}
+
+
+/**
+ * Waits up to 1 s for the driver to exit after "stop" - via a pidfd if
+ * available. The INDI server reaps its drivers, so a PID which is gone
+ * or belongs to another process means the driver exited.
+ */
+void IndiServerSupervisorT::waitForDriverExit(const std::string & driverName, pid_t driverPid) {
+  using namespace std::chrono_literals;
+
+  int driverPidFd = openPidFd(driverPid);
+
+  if (driverPidFd >= 0) {
+    pollfd pfd = { driverPidFd, POLLIN, 0 };
+    int result = poll(& pfd, 1, 1000);
+    close(driverPidFd);
+
+    if (result != 0) {
+      return;
+    }
+  }
+  else {
+    auto startTime = std::chrono::steady_clock::now();
+
+    while (std::chrono::steady_clock::now() - startTime < 1s) {
+      if (kill(driverPid, 0) != 0 || getDriverPid(driverName) != driverPid) {
+	return;
+      }
+      std::this_thread::sleep_for(50ms);
+    }
+  }
+
+  if (getDriverPid(driverName) == driverPid) {
+    LOG(warning) << "INDI driver '" << driverName << "' (PID " << driverPid << ") did not terminate - killing it." << std::endl;
+    kill(driverPid, SIGKILL);
+  }
+}
+
+
+void IndiServerSupervisorT::restartDriver(const std::string & driverName) {
+  std::string indiDriverPath = (indiBinPath_ / std::filesystem::path(driverName)).string();
+  pid_t driverPid = getDriverPid(driverName);
+  
+  if (! writeIndiServerCommands("stop " + indiDriverPath + "\n")) {
+    return;
+  }
+
+  if (driverPid > 0) {
+    waitForDriverExit(driverName, driverPid);
+  }
+
+  if (writeIndiServerCommands("start " + indiDriverPath + "\n") && driverRestartedCallback_ != nullptr) {
+    driverRestartedCallback_(driverName);
+  }
+}
+
+
+void IndiServerSupervisorT::waitForExitOrWakeUp(std::chrono::milliseconds timeout) {
+  pollfd pfds[2] = {
+    { wakeUpFd_, POLLIN, 0 },
+    { indiServerPidFd_, POLLIN, 0 }
+  };
+
+  // A negative fd is ignored by poll()
+  poll(pfds, 2, static_cast<int>(timeout.count()));
+
+  uint64_t value;
+  (void) ! read(wakeUpFd_, & value, sizeof(value));
+}
+
+
+void IndiServerSupervisorT::stopIndiServer() {
+  using namespace std::chrono_literals;
+
+  if (indiServerProcess_.poll() == ChildProcessStateT::RUNNING) {
+    LOG(info) << "Stopping INDI server (PID " << indiServerProcess_.getPid() << ")..." << std::endl;
+
+    indiServerProcess_.sendSignal(SIGTERM);
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    while (indiServerProcess_.poll() == ChildProcessStateT::RUNNING && std::chrono::steady_clock::now() - startTime < 3s) {
+      std::this_thread::sleep_for(50ms);
+    }
+
+    // Does nothing if it already exited
+    indiServerProcess_.kill();
+  }
+
+  if (indiServerPidFd_ >= 0) {
+    close(indiServerPidFd_);
+    indiServerPidFd_ = -1;
+  }
+  
+  running_ = false;
+  indiServerPid_ = -1;
+}
+
+
+void IndiServerSupervisorT::run() {
+  using namespace std::chrono_literals;
+
+  while (true) {
+    bool restartRequested;
+    std::vector<std::string> pendingDriverRestarts;
+    {
+      std::lock_guard<std::mutex> guard(supervisorMutex_);
+
+      if (stop_) {
+	break;
+      }
+      restartRequested = restartRequested_;
+      restartRequested_ = false;
+      pendingDriverRestarts.swap(pendingDriverRestarts_);
+    }
+
+    if (restartRequested) {
+      stopIndiServer();
+    }
+    
+    if (! running_ && ! spawnIndiServer()) {
+      // Do not spin if the binary cannot be started at all
+      waitForExitOrWakeUp(1000ms);
+      continue;
+    }
+
+    if (replayPending_) {
+      replayPending_ = ! replayDriverStarts();
+    }
+    else {
+      // A restarted INDI server starts all drivers anyway
+      for (const std::string & driverName : pendingDriverRestarts) {
+	restartDriver(driverName);
+      }
+    }
+
+    waitForExitOrWakeUp(1000ms);
+
+    if (running_ && indiServerProcess_.poll() == ChildProcessStateT::EXITED) {
+      LOG(error) << "INDI server (PID " << indiServerPid_ << ") exited unexpectedly with code " << indiServerProcess_.getExitCode() << "." << std::endl;
+
+      unexpectedExitCount_++;
+      stopIndiServer();
+
+      // Avoid a restart storm if the INDI server dies right away
+      waitForExitOrWakeUp(1000ms);
+    }
+  }
+
+  stopIndiServer();
+}
+
+
+bool IndiServerSupervisorT::isRunning() const {
+  return running_;
+}
+
+
+pid_t IndiServerSupervisorT::getIndiServerPid() const {
+  return indiServerPid_;
+}
+
+
+unsigned long IndiServerSupervisorT::getGeneration() const {
+  return generation_;
+}
+
+
+unsigned long IndiServerSupervisorT::getUnexpectedExitCount() const {
+  return unexpectedExitCount_;
+}
+
+
+unsigned long IndiServerSupervisorT::getReplayFailureCount() const {
+  return replayFailureCount_;
+}
+
+
+/**
+ * The INDI drivers are the children of the INDI server.
+ */
+std::map<std::string, pid_t> IndiServerSupervisorT::getDriverPids() const {
+  return process_table::getChildProcesses(indiServerPid_);
+}
+
+
+pid_t IndiServerSupervisorT::getDriverPid(const std::string & driverName) const {
+  std::map<std::string, pid_t> driverPids = getDriverPids();
+  auto it = driverPids.find(std::filesystem::path(driverName).filename().string());
+  
+  return (it != driverPids.end() ? it->second : -1);
+}
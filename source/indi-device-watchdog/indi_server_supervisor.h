@@ -0,0 +1,142 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_INDI_SERVER_SUPERVISOR_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_INDI_SERVER_SUPERVISOR_H_ SOURCE_INDI_DEVICE_WATCHDOG_INDI_SERVER_SUPERVISOR_H_
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "child_process.h"
+
+/**
+ * Supervisor mode: the watchdog starts the INDI server itself, owns the
+ * command FIFO and reaps the INDI server process (via a pidfd, falling
+ * back to polling on kernels without pidfd support). After each start
+ * the "start" commands of all configured drivers are replayed through
+ * the FIFO - a failed replay is retried. If the INDI server dies
+ * unexpectedly it is started again.
+ *
+ * Since the INDI server is a child of the watchdog, the PIDs of the
+ * drivers (the children of the INDI server) are known exactly. Driver
+ * restarts are executed by the supervisor thread: a driver which does not
+ * terminate on "stop" is killed before it is started again.
+ */
+class IndiServerSupervisorT {
+ public:
+  typedef std::function<void(const std::string & driverName)> DriverRestartedCallbackT;
+
+ private:
+  std::string indiServerBinary_;
+  int port_;
+  std::string indiServerPipePath_;
+  std::string indiBinPath_;
+  std::vector<std::string> driverNames_;
+  
+  ChildProcessT indiServerProcess_;
+  int indiServerPidFd_;
+  std::thread supervisorThread_;
+  std::mutex supervisorMutex_;
+  int wakeUpFd_;
+  bool stop_;
+  bool restartRequested_;
+  std::vector<std::string> pendingDriverRestarts_;
+  bool replayPending_; // Only accessed by the supervisor thread
+  DriverRestartedCallbackT driverRestartedCallback_;
+
+  std::atomic<bool> running_;
+  std::atomic<pid_t> indiServerPid_;
+  std::atomic<unsigned long> generation_;
+  std::atomic<unsigned long> unexpectedExitCount_;
+  std::atomic<unsigned long> replayFailureCount_;
+
+  bool createPipe();
+  bool spawnIndiServer();
+  void stopIndiServer();
+  bool writeIndiServerCommands(const std::string & commands);
+  bool replayDriverStarts();
+  void restartDriver(const std::string & driverName);
+  void waitForDriverExit(const std::string & driverName, pid_t driverPid);
+  void waitForExitOrWakeUp(std::chrono::milliseconds timeout);
+  void wakeUp();
+  void run();
+
+  // We do not want copies
+  IndiServerSupervisorT(const IndiServerSupervisorT &);
+  IndiServerSupervisorT &operator=(const IndiServerSupervisorT &);
+  
+ public:
+  IndiServerSupervisorT(const std::string & indiServerBinary, int port, const std::string & indiServerPipePath, const std::string & indiBinPath, const std::vector<std::string> & driverNames);
+  ~IndiServerSupervisorT();
+
+  void start();
+  void stop();
+
+  /**
+   * Asynchronously stops and starts the INDI server. Completion can be
+   * detected by a changed getGeneration() while isRunning() is true.
+   */
+  void requestRestart();
+
+  /**
+   * Asynchronously stops and starts the given INDI driver.
+   */
+  void requestDriverRestart(const std::string & driverName);
+
+  /**
+   * Called by the supervisor thread once the "start" of a restarted
+   * driver was written to the FIFO. Must be set before start().
+   */
+  void setDriverRestartedCallback(DriverRestartedCallbackT driverRestartedCallback);
+  
+  bool isRunning() const;
+  pid_t getIndiServerPid() const;
+
+  /**
+   * Incremented by each start of the INDI server - independent of the
+   * replay of the driver starts.
+   */
+  unsigned long getGeneration() const;
+  unsigned long getUnexpectedExitCount() const;
+  unsigned long getReplayFailureCount() const;
+
+  /**
+   * PIDs of the running INDI drivers - driver name -> PID.
+   */
+  std::map<std::string, pid_t> getDriverPids() const;
+  pid_t getDriverPid(const std::string & driverName) const;
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_INDI_SERVER_SUPERVISOR_H_ */
@@ -0,0 +1,169 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include <algorithm>
+#include <cmath>
+
+#include "latency_histogram.h"
+
+
+LatencyHistogramT::LatencyHistogramT() {
+  reset();
+}
+
+
+size_t LatencyHistogramT::getBucketIndex(uint64_t valueMs) {
+  if (valueMs < SubBucketCount) {
+    return static_cast<size_t>(valueMs);
+  }
+
+  unsigned int magnitude = 63 - __builtin_clzll(valueMs);
+
+  if (magnitude >= MaxMagnitude) {
+    return BucketCount - 1;
+  }
+  
+  unsigned int shift = magnitude - SubBucketBits;
+  uint64_t subBucket = (valueMs >> shift) - SubBucketCount;
+
+  return static_cast<size_t>(SubBucketCount + shift * SubBucketCount + subBucket);
+}
+
+
+uint64_t LatencyHistogramT::getBucketLowerBound(size_t bucketIdx) {
+  if (bucketIdx < SubBucketCount) {
+    return bucketIdx;
+  }
+
+  uint64_t shift = (bucketIdx - SubBucketCount) / SubBucketCount;
+  uint64_t subBucket = (bucketIdx - SubBucketCount) % SubBucketCount;
+
+  return (SubBucketCount + subBucket) << shift;
+}
+
+
+/**
+ * The middle of the bucket.
+ */
+uint64_t LatencyHistogramT::getBucketValue(size_t bucketIdx) {
+  if (bucketIdx < SubBucketCount) {
+    return bucketIdx;
+  }
+  
+  uint64_t shift = (bucketIdx - SubBucketCount) / SubBucketCount;
+
+  return getBucketLowerBound(bucketIdx) + ((1ULL << shift) >> 1);
+}
+
+
+void LatencyHistogramT::record(std::chrono::milliseconds latency) {
+  uint64_t valueMs = static_cast<uint64_t>(std::max<int64_t>(latency.count(), 0));
+  
+  buckets_[getBucketIndex(valueMs)]++;
+  
+  minMs_ = (count_ == 0 ? valueMs : std::min(minMs_, valueMs));
+  maxMs_ = std::max(maxMs_, valueMs);
+  sumMs_ += valueMs;
+  count_++;
+}
+
+
+void LatencyHistogramT::reset() {
+  buckets_.fill(0);
+  count_ = 0;
+  sumMs_ = 0;
+  minMs_ = 0;
+  maxMs_ = 0;
+}
+
+
+uint64_t LatencyHistogramT::getCount() const {
+  return count_;
+}
+
+
+std::chrono::milliseconds LatencyHistogramT::getMin() const {
+  return std::chrono::milliseconds(minMs_);
+}
+
+
+std::chrono::milliseconds LatencyHistogramT::getMax() const {
+  return std::chrono::milliseconds(maxMs_);
+}
+
+
+std::chrono::milliseconds LatencyHistogramT::getMean() const {
+  return std::chrono::milliseconds(count_ > 0 ? sumMs_ / count_ : 0);
+}
+
+
+std::chrono::milliseconds LatencyHistogramT::getPercentile(double percentile) const {
+  if (count_ == 0) {
+    return std::chrono::milliseconds(0);
+  }
+
+  double clampedPercentile = std::min(std::max(percentile, 0.0), 100.0);
+  uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(clampedPercentile / 100.0 * count_)), 1);
+  uint64_t seen = 0;
+
+  for (size_t bucketIdx = 0; bucketIdx < BucketCount; ++bucketIdx) {
+    seen += buckets_[bucketIdx];
+
+    if (seen >= rank) {
+      // Do not report more than was actually seen
+      return std::chrono::milliseconds(std::min(std::max(getBucketValue(bucketIdx), minMs_), maxMs_));
+    }
+  }
+  return getMax();
+}
+
+
+std::ostream &
+LatencyHistogramT::printJson(std::ostream &os) const {
+  os << "{\"count\":" << count_
+     << ",\"minMs\":" << getMin().count()
+     << ",\"maxMs\":" << getMax().count()
+     << ",\"meanMs\":" << getMean().count()
+     << ",\"p50Ms\":" << getPercentile(50).count()
+     << ",\"p90Ms\":" << getPercentile(90).count()
+     << ",\"p99Ms\":" << getPercentile(99).count()
+     << ",\"buckets\":[";
+
+  bool first = true;
+  
+  for (size_t bucketIdx = 0; bucketIdx < BucketCount; ++bucketIdx) {
+    if (buckets_[bucketIdx] > 0) {
+      os << (first ? "" : ",") << "[" << getBucketLowerBound(bucketIdx) << "," << buckets_[bucketIdx] << "]";
+      first = false;
+    }
+  }
+  
+  os << "]}";
+
+  return os;
+}
@@ -0,0 +1,85 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_LATENCY_HISTOGRAM_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_LATENCY_HISTOGRAM_H_ SOURCE_INDI_DEVICE_WATCHDOG_LATENCY_HISTOGRAM_H_
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+/**
+ * Fixed memory latency histogram with logarithmic buckets (similar to an
+ * HDR histogram). Values up to 15 ms are counted exactly, above each power
+ * of two is split into 16 sub-buckets - hence the relative error is below
+ * 1/32. Values above ~74 h are counted in the last bucket. Recording a
+ * value never allocates.
+ */
+class LatencyHistogramT {
+ public:
+  static constexpr unsigned int SubBucketBits = 4;
+  static constexpr uint64_t SubBucketCount = (1U << SubBucketBits);
+  static constexpr unsigned int MaxMagnitude = 28;
+  static constexpr size_t BucketCount = SubBucketCount + (MaxMagnitude - SubBucketBits) * SubBucketCount;
+
+ private:
+  std::array<uint32_t, BucketCount> buckets_;
+  uint64_t count_;
+  uint64_t sumMs_;
+  uint64_t minMs_;
+  uint64_t maxMs_;
+
+  static size_t getBucketIndex(uint64_t valueMs);
+  static uint64_t getBucketLowerBound(size_t bucketIdx);
+  static uint64_t getBucketValue(size_t bucketIdx);
+  
+ public:
+  LatencyHistogramT();
+
+  void record(std::chrono::milliseconds latency);
+  void reset();
+
+  uint64_t getCount() const;
+  std::chrono::milliseconds getMin() const;
+  std::chrono::milliseconds getMax() const;
+  std::chrono::milliseconds getMean() const;
+
+  /**
+   * Returns the given percentile (0..100) - the value of the bucket
+   * which contains it.
+   */
+  std::chrono::milliseconds getPercentile(double percentile) const;
+
+  /**
+   * Writes the histogram as JSON object (summary and non-empty buckets).
+   */
+  std::ostream &printJson(std::ostream &os) const;
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_LATENCY_HISTOGRAM_H_ */
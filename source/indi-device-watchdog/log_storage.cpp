@@ -0,0 +1,528 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+#include <boost/log/utility/setup/formatter_parser.hpp>
+
+#include "logging.h"
+#include "log_storage.h"
+
+namespace fs = std::filesystem;
+
+
+const char * LogStorageBackendT::ActiveFileName = "indi_device_watchdog.log";
+const char * LogStorageBackendT::RotatedFilePrefix = "indi_device_watchdog_";
+
+
+static bool writeAll(int fd, const char * data, size_t size) {
+  while (size > 0) {
+    ssize_t written = ::write(fd, data, size);
+
+    if (written < 0) {
+      if (errno == EINTR) {
+	continue;
+      }
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+
+LogStorageBackendT::LogStorageBackendT(const LogStorageConfigT & config, const std::function<void(const std::string &)> & rotatedHandler) :
+  config_(config), rotatedHandler_(rotatedHandler), activeFd_(-1), stagingFd_(-1), activeFileSize_(0), activeFileDay_(getCurrentDay()), rotationSeq_(0),
+  loggedBytes_(0), writtenBytes_(0), writeCount_(0), droppedBytes_(0) {
+
+  std::error_code ec;
+  fs::create_directories(config_.logDir, ec);
+
+  buffer_.reserve(SpillSize + BlockSize);
+  
+  openActiveFile();
+
+  if (! config_.stagingDir.empty()) {
+    fs::create_directories(config_.stagingDir, ec);
+    openStagingFile();
+  }
+}
+
+
+LogStorageBackendT::~LogStorageBackendT() {
+  spill(true);
+
+  if (activeFd_ >= 0) {
+    close(activeFd_);
+  }
+  if (stagingFd_ >= 0) {
+    close(stagingFd_);
+  }
+}
+
+
+int LogStorageBackendT::getCurrentDay() {
+  std::time_t now = std::time(nullptr);
+  std::tm localTime;
+  localtime_r(&now, &localTime);
+  return localTime.tm_yday;
+}
+
+
+void LogStorageBackendT::openActiveFile() {
+  std::string path = (fs::path(config_.logDir) / ActiveFileName).string();
+  
+  activeFd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+  if (activeFd_ < 0) {
+    std::cerr << "Cannot open log file '" << path << "': " << strerror(errno) << std::endl;
+    return;
+  }
+
+  struct stat st;
+  activeFileSize_ = (fstat(activeFd_, &st) == 0 ? st.st_size : 0);
+}
+
+
+void LogStorageBackendT::openStagingFile() {
+  std::string path = (fs::path(config_.stagingDir) / (std::string(ActiveFileName) + ".staging")).string();
+
+  stagingFd_ = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+  if (stagingFd_ < 0) {
+    std::cerr << "Cannot open log staging file '" << path << "': " << strerror(errno) << std::endl;
+    return;
+  }
+
+  // Records of a previous run which were not written to the log
+  // directory (e.g. after a crash). The staging file keeps them until
+  // the next spill.
+  char chunk[BlockSize];
+  ssize_t bytesRead;
+
+  while ((bytesRead = pread(stagingFd_, chunk, sizeof(chunk), buffer_.size())) > 0) {
+    buffer_.append(chunk, bytesRead);
+  }
+}
+
+
+void LogStorageBackendT::spill(bool all) {
+  size_t size = buffer_.size();
+  
+  if (! all) {
+    // Only write up to the last block boundary of the file
+    uintmax_t alignedEnd = ((activeFileSize_ + buffer_.size()) / BlockSize) * BlockSize;
+    size = (alignedEnd > activeFileSize_ ? alignedEnd - activeFileSize_ : 0);
+  }
+
+  if (size == 0 || activeFd_ < 0) {
+    if (buffer_.size() > MaxBufferSize) {
+      // The log directory is not writable - do not grow without bounds
+      droppedBytes_ += buffer_.size();
+      buffer_.clear();
+      size = 0;
+    }
+    else {
+      return;
+    }
+  }
+  else if (writeAll(activeFd_, buffer_.data(), size)) {
+    activeFileSize_ += size;
+    writtenBytes_ += size;
+    writeCount_++;
+    buffer_.erase(0, size);
+  }
+  else {
+    std::cerr << "Cannot write log file: " << strerror(errno) << std::endl;
+
+    if (buffer_.size() <= MaxBufferSize) {
+      return;
+    }
+    droppedBytes_ += buffer_.size();
+    buffer_.clear();
+  }
+
+  if (stagingFd_ >= 0) {
+    // Keep only what is still pending
+    if (ftruncate(stagingFd_, 0) != 0 || ! writeAll(stagingFd_, buffer_.data(), buffer_.size())) {
+      std::cerr << "Cannot write log staging file: " << strerror(errno) << std::endl;
+    }
+  }
+}
+
+
+void LogStorageBackendT::rotate() {
+  spill(true);
+
+  if (activeFd_ >= 0) {
+    close(activeFd_);
+    activeFd_ = -1;
+  }
+
+  char timeStr[32];
+  std::time_t now = std::time(nullptr);
+  std::tm localTime;
+  localtime_r(&now, &localTime);
+  std::strftime(timeStr, sizeof(timeStr), "%Y%m%d_%H%M%S", &localTime);
+
+  if (lastRotationTime_ != timeStr) {
+    lastRotationTime_ = timeStr;
+    rotationSeq_ = 0;
+  }
+
+  // Several rotations within a second get a zero-padded sequence
+  // number - this keeps the names sorted by age.
+  fs::path rotatedPath;
+  std::error_code ec;
+
+  do {
+    char suffix[16] = "";
+
+    if (rotationSeq_ > 0) {
+      snprintf(suffix, sizeof(suffix), "_%03d", rotationSeq_);
+    }
+    rotatedPath = fs::path(config_.logDir) / (std::string(RotatedFilePrefix) + timeStr + suffix + ".log");
+    rotationSeq_++;
+  } while (fs::exists(rotatedPath, ec) || fs::exists(rotatedPath.string() + ".gz", ec));
+  
+  fs::rename(fs::path(config_.logDir) / ActiveFileName, rotatedPath, ec);
+
+  activeFileDay_ = localTime.tm_yday;
+  openActiveFile();
+
+  if (! ec) {
+    rotatedHandler_(rotatedPath.string());
+  }
+}
+
+
+void LogStorageBackendT::consume(const boost::log::record_view & rec, const string_type & formattedMessage) {
+  size_t oldSize = buffer_.size();
+
+  buffer_.append(formattedMessage);
+
+  if (buffer_.empty() || buffer_.back() != '\n') {
+    buffer_.push_back('\n');
+  }
+
+  loggedBytes_ += buffer_.size() - oldSize;
+
+  if (stagingFd_ >= 0) {
+    writeAll(stagingFd_, buffer_.data() + oldSize, buffer_.size() - oldSize);
+  }
+
+  auto severity = rec[logging::trivial::severity];
+  
+  if (activeFileSize_ + buffer_.size() >= config_.rotationSize || getCurrentDay() != activeFileDay_) {
+    rotate();
+  }
+  else if (severity && severity.get() >= logging::trivial::error && stagingFd_ < 0) {
+    // Do not lose errors if the watchdog is killed
+    spill(true);
+  }
+  else if (buffer_.size() >= SpillSize) {
+    spill(false);
+  }
+}
+
+
+void LogStorageBackendT::flush() {
+  spill(true);
+}
+
+
+void LogStorageBackendT::getStats(LogStorageStatsT & stats) const {
+  stats.loggedBytes = loggedBytes_;
+  stats.writtenBytes = writtenBytes_;
+  stats.writeCount = writeCount_;
+  stats.droppedBytes = droppedBytes_;
+}
+
+
+
+LogStorageT::LogStorageT(const LogStorageConfigT & config) : config_(config), stop_(false), compressedBytes_(0), compressedToBytes_(0), deletedFileCount_(0) {
+  backend_ = boost::make_shared<LogStorageBackendT>(config_, [this](const std::string & path) { queueRotatedFile(path); });
+  sink_ = boost::make_shared<SinkT>(backend_);
+  sink_->set_formatter(logging::parse_formatter("[%TimeStamp%]: %Message%"));
+  logging::core::get()->add_sink(sink_);
+
+  // Rotated files a previous run did not compress any more
+  std::error_code ec;
+  
+  for (const fs::directory_entry & entry : fs::directory_iterator(config_.logDir, ec)) {
+    std::string fileName = entry.path().filename().string();
+
+    if (fileName.rfind(LogStorageBackendT::RotatedFilePrefix, 0) != 0) {
+      continue;
+    }
+    
+    if (entry.path().extension() == ".log") {
+      rotatedFiles_.push_back(entry.path().string());
+    }
+    else if (entry.path().extension() == ".tmp") {
+      fs::remove(entry.path(), ec);
+    }
+  }
+  
+  archiverThread_ = std::thread(&LogStorageT::run, this);
+}
+
+
+LogStorageT::~LogStorageT() {
+  stop();
+}
+
+
+void LogStorageT::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (stop_ && ! archiverThread_.joinable()) {
+      return;
+    }
+    stop_ = true;
+  }
+  cv_.notify_all();
+
+  if (archiverThread_.joinable()) {
+    archiverThread_.join();
+  }
+
+  if (sink_) {
+    logging::core::get()->remove_sink(sink_);
+    sink_->flush();
+  }
+}
+
+
+void LogStorageT::queueRotatedFile(const std::string & path) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    rotatedFiles_.push_back(path);
+  }
+  cv_.notify_all();
+}
+
+
+void LogStorageT::run() {
+  auto lastSpillTime = std::chrono::steady_clock::now();
+  auto lastReportTime = lastSpillTime;
+  LogStorageStatsT lastStats;
+
+  enforceDiskBudget();
+  
+  while (true) {
+    std::string rotatedFile;
+    
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+
+      cv_.wait_until(lock, lastSpillTime + config_.spillInterval, [this]() { return stop_ || ! rotatedFiles_.empty(); });
+
+      if (stop_) {
+	lock.unlock();
+	reportStats(std::chrono::steady_clock::now() - lastReportTime, lastStats);
+	break;
+      }
+      
+      if (! rotatedFiles_.empty()) {
+	rotatedFile = rotatedFiles_.front();
+	rotatedFiles_.pop_front();
+      }
+    }
+
+    // NOTE: Never hold mutex_ while logging or flushing - the sink calls
+    //       queueRotatedFile().
+    if (! rotatedFile.empty()) {
+      if (compress(rotatedFile)) {
+	enforceDiskBudget();
+      }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    
+    if (now - lastSpillTime >= config_.spillInterval) {
+      sink_->flush();
+      lastSpillTime = now;
+    }
+
+    if (now - lastReportTime >= std::chrono::hours(1)) {
+      reportStats(now - lastReportTime, lastStats);
+      lastReportTime = now;
+    }
+  }
+}
+
+
+bool LogStorageT::compress(const std::string & path) {
+  std::string compressedPath = path + ".gz";
+  std::string tmpPath = compressedPath + ".tmp";
+
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0) {
+    // It may have been deleted already to stay within the disk budget
+    if (errno != ENOENT) {
+      LOG(warning) << "Cannot open rotated log file '" << path << "'." << std::endl;
+    }
+    return false;
+  }
+
+  // Level 6 is a good compromise for a Raspberry Pi
+  gzFile gz = gzopen(tmpPath.c_str(), "wb6");
+  bool successful = (gz != nullptr);
+  uint64_t bytes = 0;
+
+  if (successful) {
+    std::vector<char> chunk(64 * 1024);
+    ssize_t bytesRead;
+
+    gzbuffer(gz, chunk.size());
+    
+    while (successful && (bytesRead = read(fd, chunk.data(), chunk.size())) > 0) {
+      successful = (gzwrite(gz, chunk.data(), bytesRead) == bytesRead);
+      bytes += bytesRead;
+    }
+    successful = (gzclose(gz) == Z_OK) && successful;
+  }
+  close(fd);
+
+  std::error_code ec;
+
+  if (successful) {
+    fs::rename(tmpPath, compressedPath, ec);
+    successful = ! ec;
+  }
+
+  if (! successful) {
+    LOG(warning) << "Cannot compress rotated log file '" << path << "'." << std::endl;
+    fs::remove(tmpPath, ec);
+    return false;
+  }
+  
+  fs::remove(path, ec);
+
+  uintmax_t compressedSize = fs::file_size(compressedPath, ec);
+  
+  LOG(debug) << "Compressed rotated log file '" << path << "' from " << bytes << " to " << compressedSize << " bytes." << std::endl;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  compressedBytes_ += bytes;
+  compressedToBytes_ += compressedSize;
+  
+  return true;
+}
+
+
+void LogStorageT::enforceDiskBudget() {
+  std::vector<std::pair<std::string, uintmax_t> > rotatedFiles;
+  uintmax_t totalSize = 0;
+  std::error_code ec;
+  
+  for (const fs::directory_entry & entry : fs::directory_iterator(config_.logDir, ec)) {
+    uintmax_t size = entry.file_size(ec);
+
+    if (ec) {
+      continue;
+    }
+    
+    std::string fileName = entry.path().filename().string();
+
+    if (fileName == LogStorageBackendT::ActiveFileName) {
+      totalSize += size;
+    }
+    else if (fileName.rfind(LogStorageBackendT::RotatedFilePrefix, 0) == 0) {
+      rotatedFiles.push_back(std::make_pair(entry.path().string(), size));
+      totalSize += size;
+    }
+  }
+
+  // The time stamp in the name sorts them oldest first
+  std::sort(rotatedFiles.begin(), rotatedFiles.end());
+
+  unsigned long deletedFileCount = 0;
+  
+  for (const auto & rotatedFile : rotatedFiles) {
+    if (totalSize <= config_.diskBudget) {
+      break;
+    }
+    
+    if (fs::remove(rotatedFile.first, ec)) {
+      LOG(info) << "Deleted log file '" << rotatedFile.first << "' to stay within the disk budget of " << config_.diskBudget << " bytes." << std::endl;
+      totalSize -= rotatedFile.second;
+      deletedFileCount++;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  deletedFileCount_ += deletedFileCount;
+}
+
+
+void LogStorageT::reportStats(std::chrono::steady_clock::duration period, LogStorageStatsT & lastStats) {
+  if (period < std::chrono::seconds(1)) {
+    return;
+  }
+  
+  LogStorageStatsT stats = getStats();
+  double hours = std::chrono::duration<double, std::ratio<3600> >(period).count();
+
+  LOG(info) << "Log storage: " << (uint64_t) ((stats.loggedBytes - lastStats.loggedBytes) / hours) << " bytes/h logged, "
+	    << (uint64_t) ((stats.writtenBytes - lastStats.writtenBytes) / hours) << " bytes/h written to '" << config_.logDir << "' in "
+	    << (uint64_t) ((stats.writeCount - lastStats.writeCount) / hours) << " writes/h (total: " << stats.writtenBytes << " bytes, dropped: "
+	    << stats.droppedBytes << " bytes, compressed " << stats.compressedBytes << " to " << stats.compressedToBytes << " bytes, deleted files: "
+	    << stats.deletedFileCount << ")." << std::endl;
+
+  lastStats = stats;
+}
+
+
+LogStorageStatsT LogStorageT::getStats() const {
+  LogStorageStatsT stats;
+
+  backend_->getStats(stats);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats.compressedBytes = compressedBytes_;
+  stats.compressedToBytes = compressedToBytes_;
+  stats.deletedFileCount = deletedFileCount_;
+  
+  return stats;
+}
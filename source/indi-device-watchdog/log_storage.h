@@ -0,0 +1,179 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_LOG_STORAGE_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_LOG_STORAGE_H_ SOURCE_INDI_DEVICE_WATCHDOG_LOG_STORAGE_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/log/sinks/basic_sink_backend.hpp>
+#include <boost/log/sinks/sync_frontend.hpp>
+
+
+struct LogStorageConfigT {
+  std::string logDir;
+  std::string stagingDir;
+  uintmax_t rotationSize;
+  uintmax_t diskBudget;
+  std::chrono::seconds spillInterval;
+
+  LogStorageConfigT() : rotationSize(10 * 1024 * 1024), diskBudget(100 * 1024 * 1024), spillInterval(60) {}
+};
+
+
+struct LogStorageStatsT {
+  uint64_t loggedBytes;
+  uint64_t writtenBytes;
+  uint64_t writeCount;
+  uint64_t droppedBytes;
+  uint64_t compressedBytes;
+  uint64_t compressedToBytes;
+  uint64_t deletedFileCount;
+
+  LogStorageStatsT() : loggedBytes(0), writtenBytes(0), writeCount(0), droppedBytes(0), compressedBytes(0), compressedToBytes(0), deletedFileCount(0) {}
+};
+
+
+/**
+ * Sink backend which keeps the log writes to e.g. an SD card rare and
+ * large: records are collected in memory and appended in blocks which end
+ * on a 4 KiB boundary of the file. The rest is written when the spill
+ * interval elapsed, on errors and on rotation.
+ *
+ * With a staging directory (tmpfs) each record is also written there
+ * immediately. The staging file always holds exactly the records not yet
+ * written to the log directory - a leftover from a crash is written on
+ * the next start.
+ *
+ * Only called by the synchronous sink frontend - which serializes all
+ * calls. The counters may be read from any thread.
+ */
+class LogStorageBackendT : public boost::log::sinks::basic_formatted_sink_backend<char, boost::log::sinks::combine_requirements<boost::log::sinks::synchronized_feeding, boost::log::sinks::flushing>::type> {
+ private:
+  static const size_t BlockSize = 4096;
+  static const size_t SpillSize = 16 * BlockSize;
+  static const size_t MaxBufferSize = 4 * 1024 * 1024;
+  
+  LogStorageConfigT config_;
+  std::function<void(const std::string &)> rotatedHandler_;
+
+  std::string buffer_;
+  int activeFd_;
+  int stagingFd_;
+  uintmax_t activeFileSize_;
+  int activeFileDay_;
+  std::string lastRotationTime_;
+  int rotationSeq_;
+
+  std::atomic<uint64_t> loggedBytes_;
+  std::atomic<uint64_t> writtenBytes_;
+  std::atomic<uint64_t> writeCount_;
+  std::atomic<uint64_t> droppedBytes_;
+  
+  void openActiveFile();
+  void openStagingFile();
+  void spill(bool all);
+  void rotate();
+  static int getCurrentDay();
+
+  // We do not want copies
+  LogStorageBackendT(const LogStorageBackendT &);
+  LogStorageBackendT &operator=(const LogStorageBackendT &);
+
+ public:
+  static const char * ActiveFileName;
+  static const char * RotatedFilePrefix;
+  
+  /**
+   * rotatedHandler is called with the path of each rotated file.
+   */
+  LogStorageBackendT(const LogStorageConfigT & config, const std::function<void(const std::string &)> & rotatedHandler);
+  ~LogStorageBackendT();
+
+  void consume(const boost::log::record_view & rec, const string_type & formattedMessage);
+  void flush();
+
+  void getStats(LogStorageStatsT & stats) const;
+};
+
+
+/**
+ * Installs a LogStorageBackendT as log sink and runs a background thread
+ * which periodically spills it, gzip-compresses rotated files and deletes
+ * the oldest rotated files when the log directory exceeds the disk
+ * budget. Once an hour the I/O volume is logged.
+ */
+class LogStorageT {
+ private:
+  typedef boost::log::sinks::synchronous_sink<LogStorageBackendT> SinkT;
+
+  LogStorageConfigT config_;
+  boost::shared_ptr<LogStorageBackendT> backend_;
+  boost::shared_ptr<SinkT> sink_;
+
+  std::thread archiverThread_;
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::string> rotatedFiles_;
+  bool stop_;
+
+  // Guarded by mutex_
+  uint64_t compressedBytes_;
+  uint64_t compressedToBytes_;
+  uint64_t deletedFileCount_;
+
+  void run();
+  void queueRotatedFile(const std::string & path);
+  bool compress(const std::string & path);
+  void enforceDiskBudget();
+  void reportStats(std::chrono::steady_clock::duration period, LogStorageStatsT & lastStats);
+
+  // We do not want copies
+  LogStorageT(const LogStorageT &);
+  LogStorageT &operator=(const LogStorageT &);
+
+ public:
+  explicit LogStorageT(const LogStorageConfigT & config);
+  ~LogStorageT();
+
+  void stop();
+
+  LogStorageStatsT getStats() const;
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_LOG_STORAGE_H_ */
@@ -22,8 +22,12 @@
  *
  ****************************************************************************/
 
+#include <algorithm>
+
 #include "logging.h"
 
+severity_level LoggingT::logSev_ = logging::trivial::debug;
+
 void LoggingT::init(const logging::trivial::severity_level &inLogSev, bool inWantConsoleLog, bool inWantLogFile) {
     if (inWantConsoleLog) {
         logging::add_console_log(
@@ -46,7 +50,106 @@ void LoggingT::init(const logging::trivial::severity_level &inLogSev, bool inWan
                 );
     }
 
+    logSev_ = inLogSev;
     logging::core::get()->set_filter(logging::trivial::severity >= inLogSev);
 
     logging::add_common_attributes();
 }
+
+bool LoggingT::isEnabled(const logging::trivial::severity_level &inLogSev) {
+    return inLogSev >= logSev_;
+}
+
+
+LogDeduplicatorT::LogDeduplicatorT() : repeatInterval_(600) {
+}
+
+LogDeduplicatorT & LogDeduplicatorT::get() {
+  static LogDeduplicatorT deduplicator;
+  return deduplicator;
+}
+
+void LogDeduplicatorT::setRepeatInterval(std::chrono::seconds repeatInterval) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  repeatInterval_ = repeatInterval;
+}
+
+bool LogDeduplicatorT::admit(const std::string & key, const std::string & text, unsigned long & repeatCount) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  repeatCount = 0;
+
+  if (repeatInterval_.count() <= 0) {
+    return true;
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  auto it = entries_.find(key);
+
+  if (it == entries_.end()) {
+    // Keys are bounded by the number of devices - this only protects
+    // against a caller accidentally using unbounded keys.
+    if (entries_.size() >= MaxEntries) {
+      entries_.clear();
+    }
+
+    EntryT & entry = entries_[key];
+    entry.lastText = text;
+    entry.lastLogTime = now;
+    return true;
+  }
+
+  EntryT & entry = it->second;
+
+  if (entry.lastText == text && now - entry.lastLogTime < repeatInterval_) {
+    ++entry.repeatCount;
+    return false;
+  }
+
+  repeatCount = entry.repeatCount;
+  entry.lastText = text;
+  entry.repeatCount = 0;
+  entry.lastLogTime = now;
+  return true;
+}
+
+std::ostream & operator<<(std::ostream & os, const LogDeduplicatorT::RepeatedT & repeated) {
+  if (repeated.count > 0) {
+    os << " (previous message repeated " << repeated.count << " times)";
+  }
+  return os;
+}
+
+
+LogRateLimiterT::LogRateLimiterT(double ratePerSec, unsigned int burst) :
+  ratePerSec_(ratePerSec), burst_(std::max(1U, burst)), tokens_(burst_), droppedCount_(0),
+  lastRefillTime_(std::chrono::steady_clock::now()) {
+}
+
+bool LogRateLimiterT::admit(unsigned long & droppedCount) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto now = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed = now - lastRefillTime_;
+
+  tokens_ = std::min(burst_, tokens_ + elapsed.count() * ratePerSec_);
+  lastRefillTime_ = now;
+
+  if (tokens_ < 1.0) {
+    ++droppedCount_;
+    droppedCount = 0;
+    return false;
+  }
+
+  tokens_ -= 1.0;
+  droppedCount = droppedCount_;
+  droppedCount_ = 0;
+  return true;
+}
+
+std::ostream & operator<<(std::ostream & os, const LogRateLimiterT::DroppedT & dropped) {
+  if (dropped.count > 0) {
+    os << "(" << dropped.count << " similar messages dropped) ";
+  }
+  return os;
+}
@@ -42,7 +42,12 @@
 #include <boost/log/sinks/text_ostream_backend.hpp>
 #include <boost/log/utility/setup/console.hpp>
 
+#include <chrono>
 #include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
 
 
 namespace logging = boost::log;
@@ -53,8 +58,47 @@ namespace keywords = boost::log::keywords;
 using namespace logging::trivial;
 
 
+// Statements below this level are removed at compile time (e.g. -DOPTION_MIN_LOG_LEVEL=info
+// for release builds). They cannot be enabled with -v then.
+#ifndef INDI_DEVICE_WATCHDOG_MIN_LOG_LEVEL
+#define INDI_DEVICE_WATCHDOG_MIN_LOG_LEVEL trace
+#endif
+
 // See http://stackoverflow.com/questions/24170577/simultaneous-logging-to-console-and-file-using-boost
-#define LOG(level) BOOST_LOG_SEV(global_logger::get(), logging::trivial::level)
+#define LOG(level) if (logging::trivial::level < logging::trivial::INDI_DEVICE_WATCHDOG_MIN_LOG_LEVEL) {} else BOOST_LOG_SEV(global_logger::get(), logging::trivial::level)
+
+/**
+ * Logs the message only if it differs from the last one logged with the
+ * same key (e.g. per device and message kind) - or if it was suppressed
+ * for longer than the repeat interval. The number of suppressed repeats
+ * is appended. The message is given as stream expression:
+ *
+ *   LOG_DEDUP(info, "processing:" + name, "Processing '" << name << "'...");
+ */
+#define LOG_DEDUP(level, key, streamExpr)				\
+  do {									\
+    if (LoggingT::isEnabled(logging::trivial::level)) {			\
+      std::ostringstream logDedupSs_;					\
+      unsigned long logRepeatCount_ = 0;				\
+      logDedupSs_ << streamExpr;					\
+									\
+      if (LogDeduplicatorT::get().admit((key), logDedupSs_.str(), logRepeatCount_)) { \
+	LOG(level) << logDedupSs_.str() << LogDeduplicatorT::RepeatedT(logRepeatCount_) << std::endl; \
+      }									\
+    }									\
+  } while (false)
+
+/**
+ * Token bucket per call site: at most "burst" messages at once, refilled
+ * with "ratePerSec" messages per second. The number of messages dropped
+ * since the last one is prepended.
+ *
+ *   LOG_RATE_LIMITED(debug, 1.0, 5) << "..." << std::endl;
+ */
+#define LOG_RATE_LIMITED(level, ratePerSec, burst) \
+  for (unsigned long logDroppedCount_ = 0, logOnce_ = ([]() -> LogRateLimiterT & { static LogRateLimiterT limiter((ratePerSec), (burst)); return limiter; }().admit(logDroppedCount_) ? 1 : 0); \
+       logOnce_ != 0; logOnce_ = 0)						\
+    LOG(level) << LogRateLimiterT::DroppedT(logDroppedCount_)
 
 typedef src::severity_channel_logger_mt<severity_level, std::string> global_logger_type;
 
@@ -62,14 +106,91 @@ BOOST_LOG_INLINE_GLOBAL_LOGGER_INIT(global_logger, global_logger_type) {
     return global_logger_type(boost::log::keywords::channel = "global_logger");
 }
 
+class LogDeduplicatorT {
+ public:
+  struct RepeatedT {
+    unsigned long count;
+    explicit RepeatedT(unsigned long count) : count(count) {}
+  };
+  
+ private:
+  struct EntryT {
+    std::string lastText;
+    unsigned long repeatCount;
+    std::chrono::steady_clock::time_point lastLogTime;
+
+    EntryT() : repeatCount(0) {}
+  };
+  
+  static const size_t MaxEntries = 1024;
+  
+  std::map<std::string, EntryT> entries_;
+  std::chrono::seconds repeatInterval_;
+  std::mutex mutex_;
+
+  LogDeduplicatorT();
+  
+ public:
+  static LogDeduplicatorT & get();
+
+  /**
+   * Repeated messages are logged again after the given interval
+   * (0 = deduplication disabled).
+   */
+  void setRepeatInterval(std::chrono::seconds repeatInterval);
+
+  /**
+   * Returns false if the message shall be suppressed. Otherwise
+   * repeatCount is the number of suppressed repeats since the last time.
+   */
+  bool admit(const std::string & key, const std::string & text, unsigned long & repeatCount);
+};
+
+std::ostream & operator<<(std::ostream & os, const LogDeduplicatorT::RepeatedT & repeated);
+
+
+class LogRateLimiterT {
+ public:
+  struct DroppedT {
+    unsigned long count;
+    explicit DroppedT(unsigned long count) : count(count) {}
+  };
+  
+ private:
+  double ratePerSec_;
+  double burst_;
+  double tokens_;
+  unsigned long droppedCount_;
+  std::chrono::steady_clock::time_point lastRefillTime_;
+  std::mutex mutex_;
+  
+ public:
+  LogRateLimiterT(double ratePerSec, unsigned int burst);
+
+  /**
+   * Returns true if a token is available. droppedCount is the number of
+   * messages dropped since the last admitted one.
+   */
+  bool admit(unsigned long & droppedCount);
+};
+
+std::ostream & operator<<(std::ostream & os, const LogRateLimiterT::DroppedT & dropped);
+
+
 // See http://www.boost.org/doc/libs/1_54_0/libs/log/doc/html/log/detailed/sources.html
 class LoggingT {
 private:
+  static severity_level logSev_;
 
 public:
   static void
   init(const logging::trivial::severity_level &inLogSev = logging::trivial::debug, bool inWantConsoleLog = false,
        bool inWantLogFile = true);
+
+  /**
+   * Allows to skip formatting messages which would be filtered anyway.
+   */
+  static bool isEnabled(const logging::trivial::severity_level &inLogSev);
 };
 
 
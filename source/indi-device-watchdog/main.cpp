@@ -29,6 +29,8 @@
 #include <iomanip>
 #include <filesystem>
 #include <string>
+#include <algorithm>
+#include <memory>
 #include <boost/program_options.hpp>
 #include <boost/property_tree/json_parser.hpp>
 
@@ -37,6 +39,9 @@
 #include "device_data_persistance.h"
 #include "option_level.h"
 #include "logging.h"
+#include "log_storage.h"
+#include "realtime.h"
+#include "presence_agent.h"
 
 
 std::string composeStartupMessage() {
@@ -49,6 +54,25 @@ std::string composeStartupMessage() {
   return ss.str();
 }
 
+/**
+ * Splits "[host:]port" - the host is left unchanged if not given.
+ */
+bool splitHostPort(const std::string & hostPort, std::string & host, int & port) {
+  size_t colonPos = hostPort.rfind(':');
+  std::string portStr = (colonPos != std::string::npos ? hostPort.substr(colonPos + 1) : hostPort);
+
+  if (portStr.empty() || portStr.find_first_not_of("0123456789") != std::string::npos) {
+    return false;
+  }
+  
+  if (colonPos != std::string::npos) {
+    host = hostPort.substr(0, colonPos);
+  }
+  port = std::stoi(portStr);
+  
+  return (port > 0 && port < 65536);
+}
+
 void printErrorHelp(const std::string & errorMsg, const boost::program_options::options_description & options) {
   std::cerr << std::endl << "Error: " << errorMsg << std::endl << std::endl;
   std::cerr << options << std::endl;
@@ -73,9 +97,51 @@ int main(int argc, char *argv[]) {
     ("hostname,H", value<std::string>()->default_value("localhost"), "Set hostname of INDI server")
     ("port,p", value<int>()->default_value(7624), "Port of INDI server.")
     ("timeout,T", value<int>()->default_value(3), "Timeout in seconds.")
+    ("reconnect-initial-delay", value<int>()->default_value(50), "Delay in ms before the first retry to connect to the INDI server.")
+    ("reconnect-max-delay", value<int>()->default_value(5000), "Maximum delay in ms between retries to connect to the INDI server.")
+    ("reconnect-jitter", value<double>()->default_value(0.2), "Random fraction (0..1) by which each reconnect delay is reduced.")
+    ("liveness-interval", value<int>()->default_value(5000), "Interval in ms of the INDI server liveness check (0 = disabled).")
+    ("liveness-timeout", value<int>()->default_value(3000), "Time in ms after which an unresponsive INDI server is considered lost.")
+    ("evaluation-threads", value<unsigned int>()->default_value(0), "Number of threads which evaluate the devices in parallel (0 = evaluate in the main loop).")
+    ("presence-sample-interval", value<int>()->default_value(100), "Interval in ms in which the presence of the Linux devices is sampled for flap detection (0 = disabled).")
+    ("presence-debounce", value<int>()->default_value(1000), "Time in ms the presence of a Linux device must be stable before the watchdog acts on it.")
+    ("flap-window", value<int>()->default_value(10000), "Time window in ms in which presence changes of a Linux device are counted.")
+    ("flap-threshold", value<unsigned int>()->default_value(6), "Number of presence changes within the flap window after which a device is quarantined (max. 16).")
+    ("flap-quarantine", value<int>()->default_value(60000), "Time in ms a flapping device must be stable before the watchdog acts on it again.")
+    ("presence-agent", value<std::string>()->default_value(""), "host:port of a presence agent which reports the Linux devices instead of the local filesystem (empty = local).")
+    ("presence-agent-listen", value<std::string>()->default_value(""), "Run as presence agent on the host of the Linux devices, listening on [address:]port, instead of monitoring (empty = disabled). Without an address only local connections are accepted.")
+    ("presence-agent-token", value<std::string>()->default_value(""), "Shared token of the presence agent and the watchdog. The agent rejects watchdogs with another token (empty = no token).")
     ("indi-bin,B", value<std::string>()->default_value("/usr/bin"), "Search path for INDI binaries.")
     ("indi-server-pipe,P", value<std::string>()->default_value("/tmp/indiserverFIFO"), "Pipe which should be used to write commands to the INDI server.")
-    ("device-config,D", value<std::string>()->required(), "Config file with devices to monitor.")
+    ("device-config,D", value<std::string>(), "Config file with devices to monitor.")
+    ("state-snapshot", value<std::string>()->default_value(""), "File to persist the device states to. Speeds up the next startup (empty = disabled).")
+    ("restart-state-file", value<std::string>()->default_value("indi_device_watchdog_restart_state.dat"), "File which keeps the INDI driver restart history across restarts of the watchdog (empty = in memory only).")
+    ("driver-restart-coalesce-window", value<int>()->default_value(30000), "Time in ms after an INDI driver restart in which further restart requests for the same driver are absorbed and its other devices wait for it to come back.")
+    ("driver-sample-interval", value<int>()->default_value(0), "Interval in ms in which CPU usage, RSS, open fds, threads and state of the INDI driver processes are sampled (0 = disabled).")
+    ("driver-max-rss", value<int>()->default_value(0), "RSS in MiB above which an INDI driver is restarted (0 = no limit).")
+    ("driver-max-fds", value<unsigned int>()->default_value(0), "Number of open fds above which an INDI driver is restarted (0 = no limit).")
+    ("driver-max-threads", value<unsigned int>()->default_value(0), "Number of threads above which an INDI driver is restarted (0 = no limit).")
+    ("driver-max-cpu", value<double>()->default_value(0), "CPU usage in percent of one core above which an INDI driver is restarted (0 = no limit).")
+    ("driver-max-uninterruptible", value<int>()->default_value(0), "Time in ms after which an INDI driver in uninterruptible sleep (state D, e.g. stuck in USB I/O) is restarted (0 = no limit).")
+    ("driver-limit-samples", value<unsigned int>()->default_value(3), "Number of consecutive samples which have to exceed the RSS, fd, thread or CPU limit before the INDI driver is restarted.")
+    ("control-socket", value<std::string>()->default_value(""), "Unix domain socket for the control and status API, e.g. /run/indi-device-watchdog.sock (empty = disabled).")
+    ("status-shm", value<std::string>()->default_value(INDI_DEVICE_WATCHDOG_STATUS_DEFAULT_NAME), "Name of the shared memory status table for other processes (empty = disabled).")
+    ("self-stats-interval", value<int>()->default_value(600), "Interval in seconds in which the watchdog logs its own resource usage (0 = disabled).")
+    ("recovery-stats-file", value<std::string>()->default_value(""), "File the recovery latency histograms of all devices are written to (JSON) along with the self stats report (empty = disabled).")
+    ("lock-memory", bool_switch()->default_value(false), "Lock the watchdog into memory and preallocate heap and stack - it is then neither paged out nor slowed down by page faults under memory pressure.")
+    ("realtime-priority", value<int>()->default_value(0), "Run the decision loop with this real-time priority (1..99, 0 = normal scheduling).")
+    ("realtime-policy", value<std::string>()->default_value("fifo"), "Real-time scheduling policy of the decision loop (fifo or rr).")
+    ("log-dir", value<std::string>()->default_value(""), "Directory for SD card friendly log storage: large block-aligned writes, gzip-compressed rotated files and a disk budget (empty = plain log files in the working directory).")
+    ("log-staging-dir", value<std::string>()->default_value(""), "Directory on a tmpfs (e.g. /run/indi-device-watchdog) where each log record is kept until it is written to the log directory (empty = memory only).")
+    ("log-spill-interval", value<int>()->default_value(60), "Interval in seconds in which pending log records are written to the log directory.")
+    ("log-disk-budget", value<int>()->default_value(100), "Maximum size in MiB of all log files in the log directory. The oldest rotated files are deleted first.")
+    ("log-repeat-interval", value<int>()->default_value(600), "Interval in seconds after which an unchanged per-device message is logged again. Repeats in between are counted (0 = log all repeats).")
+    ("soak-test-cycles", value<unsigned int>()->default_value(0), "Run the given number of INDI client reset / reconnect cycles against the INDI server and check for resource leaks instead of monitoring (0 = disabled).")
+    ("soak-test-max-growth", value<double>()->default_value(10.0), "Maximum growth of RSS and heap in percent which lets the soak test pass.")
+    ("sysfs-root", value<std::string>()->default_value("/sys"), "Root of the sysfs used for USB port re-authorization.")
+    ("indi-server-restart-command", value<std::string>()->default_value(""), "Command to restart the INDI server (last resort of the recovery ladder).")
+    ("supervise-indi-server", bool_switch()->default_value(false), "Spawn and supervise the INDI server as a child process.")
+    ("indi-server-binary", value<std::string>()->default_value("/usr/bin/indiserver"), "INDI server binary which is started in supervisor mode.")
     ("verbose,v", level_value(& optionLevel), "Print more verbose messages at each additional verbosity level.")
     ;
 
@@ -121,8 +187,45 @@ int main(int argc, char *argv[]) {
   
   std::cout << "Set log-level to: " << sev << std::endl;
   
-  LoggingT::init(sev, true /*console*/, true /*log file*/);
+  std::unique_ptr<LogStorageT> logStorage;
+  
+  if (vm["log-dir"].as<std::string>().empty()) {
+    LoggingT::init(sev, true /*console*/, true /*log file*/);
+  }
+  else {
+    LogStorageConfigT logStorageConfig;
+    logStorageConfig.logDir = vm["log-dir"].as<std::string>();
+    logStorageConfig.stagingDir = vm["log-staging-dir"].as<std::string>();
+    logStorageConfig.spillInterval = std::chrono::seconds(std::max(1, vm["log-spill-interval"].as<int>()));
+    logStorageConfig.diskBudget = (uintmax_t) std::max(1, vm["log-disk-budget"].as<int>()) * 1024 * 1024;
 
+    LoggingT::init(sev, true /*console*/, false /*log file*/);
+    logStorage = std::make_unique<LogStorageT>(logStorageConfig);
+  }
+  LogDeduplicatorT::get().setRepeatInterval(std::chrono::seconds(std::max(0, vm["log-repeat-interval"].as<int>())));
+
+  if (vm["lock-memory"].as<bool>()) {
+    realtime::lockMemory();
+  }
+
+  if (! vm["presence-agent-listen"].as<std::string>().empty()) {
+    std::string listenAddress;
+    int listenPort = 0;
+
+    if (! splitHostPort(vm["presence-agent-listen"].as<std::string>(), listenAddress, listenPort)) {
+      printErrorHelp("Invalid presence agent address '" + vm["presence-agent-listen"].as<std::string>() + "'.", options);
+      return 1;
+    }
+    
+    PresenceAgentT presenceAgent(listenAddress, listenPort, std::chrono::milliseconds(std::max(10, vm["presence-sample-interval"].as<int>())), vm["presence-agent-token"].as<std::string>());
+    
+    return (presenceAgent.run() ? 0 : 1);
+  }
+
+  if (vm.count("device-config") == 0) {
+    printErrorHelp("the option '--device-config' is required but missing", options);
+    return 1;
+  }
   
   try {  
     fs::path currentPath = fs::current_path();
@@ -136,14 +239,97 @@ int main(int argc, char *argv[]) {
     int timeoutSec = vm["timeout"].as<int>();
     std::string indiBinPath = vm["indi-bin"].as<std::string>();
     std::string indiServerPipePath = vm["indi-server-pipe"].as<std::string>();
+
+    std::shared_ptr<IndiServerSupervisorT> indiServerSupervisor;
+
+    if (vm["supervise-indi-server"].as<bool>()) {
+      std::vector<std::string> indiDriverNames;
+
+      for (const DeviceDataT & deviceData : devicesToMonitor) {
+	if (std::find(indiDriverNames.begin(), indiDriverNames.end(), deviceData.getIndiDeviceDriverName()) == indiDriverNames.end()) {
+	  indiDriverNames.push_back(deviceData.getIndiDeviceDriverName());
+	}
+      }
+      
+      indiServerSupervisor = std::make_shared<IndiServerSupervisorT>(vm["indi-server-binary"].as<std::string>(), indiPort, indiServerPipePath, indiBinPath, indiDriverNames);
+    }
+    
+    RecoveryActionFactoryT recoveryActionFactory(vm["sysfs-root"].as<std::string>(), vm["indi-server-restart-command"].as<std::string>(), indiServerSupervisor);
   
-    IndiDeviceWatchdogT indiDeviceWatchdog(indiHostname, indiPort, timeoutSec, devicesToMonitor, indiBinPath, indiServerPipePath);
+    ReconnectPolicyT reconnectPolicy(std::chrono::milliseconds(vm["reconnect-initial-delay"].as<int>()),
+				     std::chrono::milliseconds(vm["reconnect-max-delay"].as<int>()),
+				     2.0 /*multiplier*/,
+				     vm["reconnect-jitter"].as<double>());
+  
+    IndiDeviceWatchdogT indiDeviceWatchdog(indiHostname, indiPort, timeoutSec, devicesToMonitor, indiBinPath, indiServerPipePath, recoveryActionFactory, reconnectPolicy,
+					   std::chrono::milliseconds(vm["liveness-interval"].as<int>()),
+					   std::chrono::milliseconds(vm["liveness-timeout"].as<int>()),
+					   vm["evaluation-threads"].as<unsigned int>(),
+					   indiServerSupervisor);
+
+    indiDeviceWatchdog.setSelfStatsInterval(std::chrono::seconds(vm["self-stats-interval"].as<int>()));
+    indiDeviceWatchdog.setRecoveryStatsFilePath(vm["recovery-stats-file"].as<std::string>());
+    indiDeviceWatchdog.setHooks(device_data_persistance::loadHooks(deviceConfigFilename));
+    indiDeviceWatchdog.setMessagePatterns(device_data_persistance::loadMessagePatterns(deviceConfigFilename));
+    indiDeviceWatchdog.setStateSnapshotPath(vm["state-snapshot"].as<std::string>());
+    indiDeviceWatchdog.setRestartStateFilePath(vm["restart-state-file"].as<std::string>());
+    indiDeviceWatchdog.setDriverRestartCoalesceWindow(std::chrono::milliseconds(vm["driver-restart-coalesce-window"].as<int>()));
+
+    if (! vm["presence-agent"].as<std::string>().empty()) {
+      std::string presenceAgentHost = "localhost";
+      int presenceAgentPort = 0;
+      
+      if (! splitHostPort(vm["presence-agent"].as<std::string>(), presenceAgentHost, presenceAgentPort)) {
+	throw boost::program_options::invalid_option_value(vm["presence-agent"].as<std::string>());
+      }
+      indiDeviceWatchdog.enableRemotePresence(presenceAgentHost, presenceAgentPort, vm["presence-agent-token"].as<std::string>());
+    }
 
+    if (vm["presence-sample-interval"].as<int>() > 0) {
+      FlapPolicyT flapPolicy(std::chrono::milliseconds(vm["presence-debounce"].as<int>()),
+			     std::chrono::milliseconds(vm["flap-window"].as<int>()),
+			     vm["flap-threshold"].as<unsigned int>(),
+			     std::chrono::milliseconds(vm["flap-quarantine"].as<int>()));
+      
+      indiDeviceWatchdog.enableFlapDetection(std::chrono::milliseconds(vm["presence-sample-interval"].as<int>()), flapPolicy);
+    }
+
+    if (vm["driver-sample-interval"].as<int>() > 0) {
+      DriverProcessLimitsT driverProcessLimits;
+
+      driverProcessLimits.maxRssKb = vm["driver-max-rss"].as<int>() * 1024L;
+      driverProcessLimits.maxFdCount = vm["driver-max-fds"].as<unsigned int>();
+      driverProcessLimits.maxThreadCount = vm["driver-max-threads"].as<unsigned int>();
+      driverProcessLimits.maxCpuPercent = vm["driver-max-cpu"].as<double>();
+      driverProcessLimits.maxUninterruptibleTime = std::chrono::milliseconds(vm["driver-max-uninterruptible"].as<int>());
+      driverProcessLimits.sustainedSampleCount = vm["driver-limit-samples"].as<unsigned int>();
+      
+      indiDeviceWatchdog.enableDriverProcessMonitoring(std::chrono::milliseconds(vm["driver-sample-interval"].as<int>()), driverProcessLimits);
+    }
+
+    if (! vm["status-shm"].as<std::string>().empty()) {
+      indiDeviceWatchdog.enableStatusTable(vm["status-shm"].as<std::string>());
+    }
+
+    if (! vm["control-socket"].as<std::string>().empty()) {
+      indiDeviceWatchdog.enableControlServer(vm["control-socket"].as<std::string>());
+    }
+    
+    if (vm["soak-test-cycles"].as<unsigned int>() > 0) {
+      return (indiDeviceWatchdog.runSoakTest(vm["soak-test-cycles"].as<unsigned int>(), vm["soak-test-max-growth"].as<double>()) ? 0 : 2);
+    }
+    
+    if (vm["realtime-priority"].as<int>() > 0) {
+      indiDeviceWatchdog.setRealtimeScheduling(vm["realtime-policy"].as<std::string>(), vm["realtime-priority"].as<int>());
+    }
+    
     indiDeviceWatchdog.run();
   } catch (boost::property_tree::json_parser::json_parser_error & exc) {
     errorMsg = exc.what();
   } catch (boost::bad_any_cast & exc) {
     errorMsg = exc.what();
+  } catch (boost::program_options::invalid_option_value & exc) {
+    errorMsg = exc.what();
   }
 
   if (! errorMsg.empty()) {
@@ -0,0 +1,180 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <queue>
+
+#include "message_pattern_matcher.h"
+
+
+MessagePatternMatcherT::MessagePatternMatcherT() : columnCount_(1) {
+  memset(alphabet_, 0, sizeof(alphabet_));
+  compile();
+}
+
+
+void MessagePatternMatcherT::setOwnerNames(const std::vector<std::string> & ownerNames) {
+  ownerNames_ = ownerNames;
+  std::sort(ownerNames_.begin(), ownerNames_.end());
+  ownerNames_.erase(std::unique(ownerNames_.begin(), ownerNames_.end()), ownerNames_.end());
+}
+
+
+int MessagePatternMatcherT::getOwner(const std::string & ownerName) const {
+  auto ownerNameIt = std::lower_bound(ownerNames_.begin(), ownerNames_.end(), ownerName);
+
+  if (ownerNameIt == ownerNames_.end() || *ownerNameIt != ownerName) {
+    return -1;
+  }
+  return static_cast<int>(ownerNameIt - ownerNames_.begin());
+}
+
+
+int MessagePatternMatcherT::addPattern(const std::string & pattern, int owner) {
+  patterns_.push_back(pattern);
+  patternOwners_.push_back(owner);
+
+  return static_cast<int>(patterns_.size()) - 1;
+}
+
+
+void MessagePatternMatcherT::compile() {
+  // Upper and lower case of a letter share a column
+  memset(alphabet_, 0, sizeof(alphabet_));
+  columnCount_ = 1;
+  
+  for (const std::string & pattern : patterns_) {
+    for (unsigned char c : pattern) {
+      unsigned char lower = static_cast<unsigned char>(tolower(c));
+      
+      if (alphabet_[lower] == 0) {
+	alphabet_[lower] = static_cast<uint16_t>(columnCount_++);
+	alphabet_[toupper(lower)] = alphabet_[lower];
+      }
+    }
+  }
+
+  // Trie of all patterns (-1 = no edge)
+  transitions_.assign(columnCount_, -1);
+  std::vector<std::vector<int32_t> > outputs(1);
+
+  for (size_t patternId = 0; patternId < patterns_.size(); ++patternId) {
+    int32_t state = 0;
+
+    for (unsigned char c : patterns_[patternId]) {
+      int32_t & next = transitions_[state * columnCount_ + alphabet_[c]];
+
+      if (next < 0) {
+	next = static_cast<int32_t>(outputs.size());
+	outputs.emplace_back();
+	transitions_.resize(transitions_.size() + columnCount_, -1);
+      }
+      state = transitions_[state * columnCount_ + alphabet_[c]];
+    }
+
+    if (state > 0) {
+      outputs[state].push_back(static_cast<int32_t>(patternId));
+    }
+  }
+
+  // Breadth first: complete the missing edges via the failure links and
+  // inherit the outputs of the failure state.
+  size_t stateCount = outputs.size();
+  std::vector<int32_t> failure(stateCount, 0);
+  std::queue<int32_t> states;
+
+  for (size_t column = 0; column < columnCount_; ++column) {
+    int32_t & next = transitions_[column];
+
+    if (next < 0) {
+      next = 0;
+    }
+    else {
+      states.push(next);
+    }
+  }
+  
+  while (! states.empty()) {
+    int32_t state = states.front();
+    states.pop();
+
+    const std::vector<int32_t> & failureOutputs = outputs[failure[state]];
+    outputs[state].insert(outputs[state].end(), failureOutputs.begin(), failureOutputs.end());
+    
+    for (size_t column = 0; column < columnCount_; ++column) {
+      int32_t & next = transitions_[state * columnCount_ + column];
+      int32_t failureNext = transitions_[failure[state] * columnCount_ + column];
+
+      if (next < 0) {
+	next = failureNext;
+      }
+      else {
+	failure[next] = failureNext;
+	states.push(next);
+      }
+    }
+  }
+
+  outputOffsets_.assign(1, 0);
+  outputPatternIds_.clear();
+
+  for (const std::vector<int32_t> & stateOutputs : outputs) {
+    outputPatternIds_.insert(outputPatternIds_.end(), stateOutputs.begin(), stateOutputs.end());
+    outputOffsets_.push_back(static_cast<uint32_t>(outputPatternIds_.size()));
+  }
+}
+
+
+bool MessagePatternMatcherT::empty() const {
+  return patterns_.empty();
+}
+
+
+const std::string & MessagePatternMatcherT::getPattern(int patternId) const {
+  return patterns_.at(patternId);
+}
+
+
+int MessagePatternMatcherT::match(const char * text, size_t length, int owner) const {
+  int32_t state = 0;
+
+  for (size_t idx = 0; idx < length; ++idx) {
+    state = transitions_[state * columnCount_ + alphabet_[static_cast<unsigned char>(text[idx])]];
+
+    for (uint32_t outputIdx = outputOffsets_[state]; outputIdx < outputOffsets_[state + 1]; ++outputIdx) {
+      int32_t patternId = outputPatternIds_[outputIdx];
+      
+      if (patternOwners_[patternId] < 0 || patternOwners_[patternId] == owner) {
+	return patternId;
+      }
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,103 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_MESSAGE_PATTERN_MATCHER_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_MESSAGE_PATTERN_MATCHER_H_ SOURCE_INDI_DEVICE_WATCHDOG_MESSAGE_PATTERN_MATCHER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/**
+ * A text which an INDI driver reports when it fails (e.g. "Error reading
+ * from port"). An empty driver name applies to all drivers.
+ */
+struct MessagePatternConfigT {
+  std::string indiDriverName;
+  std::string pattern;
+
+  MessagePatternConfigT(const std::string & indiDriverName, const std::string & pattern) : indiDriverName(indiDriverName), pattern(pattern) {}
+};
+
+
+/**
+ * Finds any of a set of literal patterns in a text - case-insensitive and
+ * in a single pass over the text, regardless of the number of patterns
+ * (Aho-Corasick). All patterns are compiled into one automaton with a
+ * full transition table - each byte of the text costs one table lookup.
+ * Only the bytes which occur in the patterns get their own column.
+ *
+ * Each pattern belongs to an owner (e.g. the index of an INDI driver) or
+ * to all owners (-1). Immutable once compiled.
+ */
+class MessagePatternMatcherT {
+ private:
+  std::vector<std::string> patterns_;
+  std::vector<int> patternOwners_;
+  std::vector<std::string> ownerNames_; // Sorted - the owner is the index
+
+  uint16_t alphabet_[256]; // Byte -> column (0 = byte is not part of any pattern)
+  size_t columnCount_;
+  std::vector<int32_t> transitions_; // State x column -> state
+  std::vector<uint32_t> outputOffsets_; // State -> first entry in outputPatternIds_
+  std::vector<int32_t> outputPatternIds_; // Patterns which end in the state
+  
+ public:
+  MessagePatternMatcherT();
+
+  /**
+   * Names of the owners (e.g. INDI drivers). Duplicates are removed, the
+   * owner of a name is its index in the sorted list.
+   */
+  void setOwnerNames(const std::vector<std::string> & ownerNames);
+
+  /**
+   * Returns the owner of the given name, -1 if the name is unknown.
+   */
+  int getOwner(const std::string & ownerName) const;
+
+  /**
+   * Returns the id of the pattern. Takes effect with the next compile().
+   */
+  int addPattern(const std::string & pattern, int owner);
+  void compile();
+
+  bool empty() const;
+  const std::string & getPattern(int patternId) const;
+
+  /**
+   * Returns the id of the first pattern of the given owner (or of all
+   * owners) found in the text, -1 if there is none.
+   */
+  int match(const char * text, size_t length, int owner) const;
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_MESSAGE_PATTERN_MATCHER_H_ */
@@ -0,0 +1,397 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+
+#include "logging.h"
+#include "presence_agent.h"
+
+
+/**
+ * Compares in constant time - the time does not tell how many characters
+ * of a guessed token were right.
+ */
+static bool isTokenEqual(const std::string & token, const std::string & expectedToken) {
+  unsigned char diff = (token.size() != expectedToken.size() ? 1 : 0);
+
+  for (size_t idx = 0; idx < token.size(); ++idx) {
+    diff |= static_cast<unsigned char>(token[idx] ^ (expectedToken.empty() ? 0 : expectedToken[idx % expectedToken.size()]));
+  }
+  return (diff == 0);
+}
+
+
+// Events detected within this time are sent in one frame
+static const std::chrono::milliseconds DefaultBatchDelay(20);
+static const std::chrono::milliseconds DefaultHeartbeatInterval(1000);
+
+// A connection which did not subscribe by then is closed
+static const std::chrono::milliseconds SubscribeTimeout(3000);
+
+// Unacknowledged heartbeats close the connection of a vanished watchdog -
+// otherwise its reconnect would be rejected
+static const unsigned int UserTimeoutMs = 5000;
+
+
+PresenceAgentT::PresenceAgentT(const std::string & listenAddress, int port, std::chrono::milliseconds sampleInterval, const std::string & token, const std::string & deviceRoot) : listenAddress_(listenAddress), port_(port), sampleInterval_(sampleInterval), token_(token), deviceRoot_(std::filesystem::path(deviceRoot).lexically_normal()), batchDelay_(DefaultBatchDelay), heartbeatInterval_(DefaultHeartbeatInterval), stop_(false), listenFd_(-1), clientFd_(-1), subscribed_(false), sequence_(0) {
+}
+
+
+PresenceAgentT::~PresenceAgentT() {
+  closeClient();
+
+  if (listenFd_ >= 0) {
+    close(listenFd_);
+  }
+}
+
+
+bool PresenceAgentT::openListenSocket() {
+  addrinfo hints;
+  memset(& hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  addrinfo * addrInfos = nullptr;
+
+  // Without AI_PASSIVE no address means the loopback address
+  if (getaddrinfo(listenAddress_.empty() ? nullptr : listenAddress_.c_str(), std::to_string(port_).c_str(), & hints, & addrInfos) != 0 || addrInfos == nullptr) {
+    LOG(error) << "Cannot resolve presence agent address '" << listenAddress_ << "'." << std::endl;
+    return false;
+  }
+
+  listenFd_ = socket(addrInfos->ai_family, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+
+  int enable = 1;
+  bool listening = (listenFd_ >= 0
+		    && setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, & enable, sizeof(enable)) == 0
+		    && bind(listenFd_, addrInfos->ai_addr, addrInfos->ai_addrlen) == 0
+		    && listen(listenFd_, 4) == 0);
+  freeaddrinfo(addrInfos);
+
+  if (! listening) {
+    LOG(error) << "Cannot listen on port " << port_ << " for the presence agent: " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  LOG(info) << "Presence agent listening on " << (listenAddress_.empty() ? "localhost" : listenAddress_) << ":" << port_
+	    << (token_.empty() ? " (no token)." : ".") << std::endl;
+  
+  return true;
+}
+
+
+void PresenceAgentT::acceptClient() {
+  int fd = accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+
+  if (fd < 0) {
+    return;
+  }
+
+  if (clientFd_ >= 0) {
+    LOG_RATE_LIMITED(warning, 1.0, 5) << "Presence agent: already serving a watchdog - rejecting further connection." << std::endl;
+    close(fd);
+    return;
+  }
+
+  // A stuck watchdog must not block the sampling for long
+  int enable = 1;
+  unsigned int userTimeoutMs = UserTimeoutMs;
+  timeval sendTimeout = { 1, 0 };
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, & enable, sizeof(enable));
+  setsockopt(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, & userTimeoutMs, sizeof(userTimeoutMs));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, & sendTimeout, sizeof(sendTimeout));
+
+  clientFd_ = fd;
+  subscribed_ = false;
+  connectTime_ = std::chrono::steady_clock::now();
+  frameReader_.reset();
+  paths_.clear();
+  allowed_.clear();
+  pendingEvents_.clear();
+
+  LOG(info) << "Presence agent: watchdog connected." << std::endl;
+}
+
+
+void PresenceAgentT::closeClient() {
+  if (clientFd_ >= 0) {
+    close(clientFd_);
+    clientFd_ = -1;
+  }
+  subscribed_ = false;
+}
+
+
+bool PresenceAgentT::sendFrame(const std::string & frame) {
+  if (clientFd_ < 0) {
+    return false;
+  }
+  
+  if (send(clientFd_, frame.data(), frame.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(frame.size())) {
+    LOG(warning) << "Presence agent: cannot send to the watchdog - closing the connection." << std::endl;
+    closeClient();
+    return false;
+  }
+
+  lastSendTime_ = std::chrono::steady_clock::now();
+  return true;
+}
+
+
+void PresenceAgentT::receive() {
+  char buffer[4096];
+  ssize_t n = recv(clientFd_, buffer, sizeof(buffer), MSG_DONTWAIT);
+
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+    LOG(info) << "Presence agent: watchdog disconnected." << std::endl;
+    closeClient();
+    return;
+  }
+
+  if (n < 0) {
+    return;
+  }
+  
+  frameReader_.append(buffer, n);
+
+  presence_protocol::FrameT frame;
+  
+  while (clientFd_ >= 0 && frameReader_.next(frame)) {
+    handleFrame(frame);
+  }
+
+  if (frameReader_.isCorrupt()) {
+    LOG(warning) << "Presence agent: invalid frame from the watchdog - closing the connection." << std::endl;
+    closeClient();
+  }
+}
+
+
+void PresenceAgentT::handleFrame(const presence_protocol::FrameT & frame) {
+  using namespace presence_protocol;
+  
+  if (! subscribed_ && frame.type != FrameTypeT::SUBSCRIBE) {
+    LOG(warning) << "Presence agent: " << FrameTypeT::asStr(frame.type) << " before SUBSCRIBE - closing the connection." << std::endl;
+    closeClient();
+    return;
+  }
+  
+  switch (frame.type) {
+  case FrameTypeT::SUBSCRIBE: {
+    if (! token_.empty() && ! isTokenEqual(frame.token, token_)) {
+      LOG(warning) << "Presence agent: watchdog subscribed with a wrong token - closing the connection." << std::endl;
+      closeClient();
+      return;
+    }
+    
+    auto now = std::chrono::steady_clock::now();
+
+    subscribed_ = true;
+    paths_ = frame.paths;
+    allowed_.assign(paths_.size(), false);
+    present_.assign(paths_.size(), false);
+    changeTimes_.assign(paths_.size(), now);
+    pendingEvents_.clear();
+
+    for (size_t idx = 0; idx < paths_.size(); ++idx) {
+      allowed_[idx] = isAllowedPath(paths_[idx]);
+
+      if (! allowed_[idx]) {
+	LOG(warning) << "Presence agent: '" << paths_[idx] << "' is not below " << deviceRoot_.string() << " - reported as absent." << std::endl;
+      }
+      present_[idx] = probe(idx);
+    }
+    lastSampleTime_ = now;
+    
+    LOG(info) << "Presence agent: watchdog subscribed to " << paths_.size() << " Linux devices." << std::endl;
+    sendSnapshot();
+    break;
+  }
+    
+  case FrameTypeT::RESYNC:
+    LOG(info) << "Presence agent: resync requested (sequence " << sequence_ << ")." << std::endl;
+    flush(std::chrono::steady_clock::now());
+    sendSnapshot();
+    break;
+    
+  default:
+    LOG(warning) << "Presence agent: ignoring unexpected frame " << FrameTypeT::asStr(frame.type) << "." << std::endl;
+  }
+}
+
+
+/**
+ * Absolute paths below the device root only - "/dev/../etc/passwd" is not.
+ */
+bool PresenceAgentT::isAllowedPath(const std::string & path) const {
+  std::filesystem::path normalizedPath = std::filesystem::path(path).lexically_normal();
+
+  if (! normalizedPath.is_absolute()) {
+    return false;
+  }
+  
+  std::filesystem::path relativePath = normalizedPath.lexically_relative(deviceRoot_);
+
+  return (! relativePath.empty() && relativePath != "." && *relativePath.begin() != "..");
+}
+
+
+bool PresenceAgentT::probe(size_t idx) const {
+  std::error_code ec;
+  
+  return (allowed_[idx] && std::filesystem::exists(paths_[idx], ec));
+}
+
+
+void PresenceAgentT::sendSnapshot() {
+  auto now = std::chrono::steady_clock::now();
+  std::vector<presence_protocol::PresenceT> presences;
+  presences.reserve(paths_.size());
+
+  for (size_t idx = 0; idx < paths_.size(); ++idx) {
+    auto msSinceChange = std::chrono::duration_cast<std::chrono::milliseconds>(now - changeTimes_[idx]).count();
+    presences.emplace_back(static_cast<uint16_t>(idx), present_[idx], static_cast<uint32_t>(std::min<int64_t>(msSinceChange, UINT32_MAX)));
+  }
+
+  sendFrame(presence_protocol::encodeSnapshot(sequence_, presences));
+}
+
+
+void PresenceAgentT::sample(TimePointT now) {
+  lastSampleTime_ = now;
+  
+  for (size_t idx = 0; idx < paths_.size(); ++idx) {
+    bool present = probe(idx);
+
+    if (present != present_[idx]) {
+      present_[idx] = present;
+      changeTimes_[idx] = now;
+      pendingEvents_.push_back({ static_cast<uint16_t>(idx), present, now });
+
+      LOG(debug) << "Presence agent: '" << paths_[idx] << "' " << (present ? "appeared" : "vanished") << "." << std::endl;
+    }
+  }
+}
+
+
+void PresenceAgentT::flush(TimePointT now) {
+  lastFlushTime_ = now;
+  
+  if (pendingEvents_.empty()) {
+    return;
+  }
+  
+  std::vector<presence_protocol::PresenceT> events;
+  events.reserve(pendingEvents_.size());
+
+  for (const PendingEventT & pendingEvent : pendingEvents_) {
+    auto msSinceChange = std::chrono::duration_cast<std::chrono::milliseconds>(now - pendingEvent.changeTime).count();
+    events.emplace_back(pendingEvent.index, pendingEvent.present, static_cast<uint32_t>(msSinceChange));
+  }
+
+  uint64_t firstSequence = sequence_ + 1;
+  sequence_ += events.size();
+  pendingEvents_.clear();
+
+  // If sending fails the watchdog resyncs after reconnecting
+  sendFrame(presence_protocol::encodeEvents(firstSequence, events));
+}
+
+
+bool PresenceAgentT::run() {
+  if (listenFd_ < 0 && ! openListenSocket()) {
+    return false;
+  }
+
+  lastSampleTime_ = lastFlushTime_ = lastSendTime_ = std::chrono::steady_clock::now();
+  
+  while (! stop_) {
+    auto now = std::chrono::steady_clock::now();
+    auto nextSampleTime = lastSampleTime_ + sampleInterval_;
+    int timeoutMs = static_cast<int>(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::milliseconds>(nextSampleTime - now).count()));
+    
+    pollfd pfds[2] = { { listenFd_, POLLIN, 0 }, { clientFd_, POLLIN, 0 } };
+    int rc = poll(pfds, (clientFd_ >= 0 ? 2 : 1), std::min(timeoutMs, 100));
+
+    if (rc < 0 && errno != EINTR) {
+      LOG(error) << "Presence agent: poll failed: " << strerror(errno) << std::endl;
+      return false;
+    }
+
+    if (rc > 0 && (pfds[0].revents & POLLIN)) {
+      acceptClient();
+    }
+    else if (rc > 0 && clientFd_ >= 0 && (pfds[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+      receive();
+    }
+
+    if (clientFd_ < 0) {
+      continue;
+    }
+    
+    now = std::chrono::steady_clock::now();
+
+    if (! subscribed_) {
+      if (now - connectTime_ >= SubscribeTimeout) {
+	LOG(warning) << "Presence agent: no subscription within " << SubscribeTimeout.count() << " ms - closing the connection." << std::endl;
+	closeClient();
+      }
+      continue;
+    }
+
+    if (now >= nextSampleTime) {
+      sample(now);
+    }
+
+    if (! pendingEvents_.empty() && now - lastFlushTime_ >= batchDelay_) {
+      flush(now);
+    }
+
+    if (clientFd_ >= 0 && now - lastSendTime_ >= heartbeatInterval_) {
+      sendFrame(presence_protocol::encodeHeartbeat(sequence_));
+    }
+  }
+  
+  return true;
+}
+
+
+void PresenceAgentT::stop() {
+  stop_ = true;
+}
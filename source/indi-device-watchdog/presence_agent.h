@@ -0,0 +1,123 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_PRESENCE_AGENT_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_PRESENCE_AGENT_H_ SOURCE_INDI_DEVICE_WATCHDOG_PRESENCE_AGENT_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "presence_protocol.h"
+
+/**
+ * Agent mode: runs on the host the Linux devices are attached to (e.g.
+ * next to the INDI server on the pier) and reports their presence to a
+ * watchdog running elsewhere. The watchdog connects and subscribes to the
+ * paths of its Linux devices. The agent answers with a snapshot, then
+ * samples the paths and streams the changes in batches. If nothing
+ * changed, a heartbeat is sent every second.
+ *
+ * Only one watchdog is served at a time - further connections are
+ * rejected until it disconnects. A connection which does not subscribe
+ * with the shared token in time is closed. Only paths below the device
+ * root (/dev) are sampled, all others are reported as absent.
+ */
+class PresenceAgentT {
+ public:
+  typedef std::chrono::steady_clock::time_point TimePointT;
+
+ private:
+  struct PendingEventT {
+    uint16_t index;
+    bool present;
+    TimePointT changeTime;
+  };
+
+  std::string listenAddress_;
+  int port_;
+  std::chrono::milliseconds sampleInterval_;
+  std::string token_;
+  std::filesystem::path deviceRoot_;
+  std::chrono::milliseconds batchDelay_;
+  std::chrono::milliseconds heartbeatInterval_;
+  std::atomic<bool> stop_;
+  
+  int listenFd_;
+  int clientFd_;
+  bool subscribed_;
+  TimePointT connectTime_;
+  presence_protocol::FrameReaderT frameReader_;
+
+  std::vector<std::string> paths_;
+  std::vector<bool> allowed_; // Below the device root
+  std::vector<bool> present_;
+  std::vector<TimePointT> changeTimes_;
+  std::vector<PendingEventT> pendingEvents_;
+  uint64_t sequence_;
+  TimePointT lastSampleTime_;
+  TimePointT lastFlushTime_;
+  TimePointT lastSendTime_;
+
+  bool openListenSocket();
+  void acceptClient();
+  void closeClient();
+  bool sendFrame(const std::string & frame);
+  void receive();
+  void handleFrame(const presence_protocol::FrameT & frame);
+  bool isAllowedPath(const std::string & path) const;
+  bool probe(size_t idx) const;
+  void sendSnapshot();
+  void sample(TimePointT now);
+  void flush(TimePointT now);
+
+  // We do not want copies
+  PresenceAgentT(const PresenceAgentT &);
+  PresenceAgentT &operator=(const PresenceAgentT &);
+  
+ public:
+  /**
+   * An empty listen address only accepts connections from the loopback
+   * interface. All interfaces have to be given explicitly (e.g. 0.0.0.0).
+   * An empty token accepts every watchdog.
+   */
+  PresenceAgentT(const std::string & listenAddress, int port, std::chrono::milliseconds sampleInterval, const std::string & token = "", const std::string & deviceRoot = "/dev");
+  ~PresenceAgentT();
+
+  /**
+   * Serves watchdogs until stop() is called. Returns false if the listen
+   * socket cannot be opened.
+   */
+  bool run();
+  void stop();
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_PRESENCE_AGENT_H_ */
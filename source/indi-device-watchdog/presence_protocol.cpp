@@ -0,0 +1,256 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include "presence_protocol.h"
+
+namespace presence_protocol {
+
+  static void putU8(std::string & out, uint8_t value) {
+    out.push_back(static_cast<char>(value));
+  }
+
+  static void putU16(std::string & out, uint16_t value) {
+    putU8(out, static_cast<uint8_t>(value >> 8));
+    putU8(out, static_cast<uint8_t>(value));
+  }
+
+  static void putU32(std::string & out, uint32_t value) {
+    putU16(out, static_cast<uint16_t>(value >> 16));
+    putU16(out, static_cast<uint16_t>(value));
+  }
+
+  static void putU64(std::string & out, uint64_t value) {
+    putU32(out, static_cast<uint32_t>(value >> 32));
+    putU32(out, static_cast<uint32_t>(value));
+  }
+
+  
+  /**
+   * Reads big endian integers from a payload. Reading past the end sets
+   * the "short" flag instead of failing each single read.
+   */
+  class PayloadReaderT {
+  private:
+    const std::string & payload_;
+    size_t pos_;
+    bool short_;
+
+  public:
+    PayloadReaderT(const std::string & payload, size_t pos) : payload_(payload), pos_(pos), short_(false) {}
+
+    uint64_t get(size_t byteCount) {
+      uint64_t value = 0;
+
+      if (pos_ + byteCount > payload_.size()) {
+	short_ = true;
+	return 0;
+      }
+      
+      for (size_t idx = 0; idx < byteCount; ++idx) {
+	value = (value << 8) | static_cast<uint8_t>(payload_[pos_++]);
+      }
+      return value;
+    }
+
+    std::string getString(size_t length) {
+      if (pos_ + length > payload_.size()) {
+	short_ = true;
+	return "";
+      }
+
+      std::string str = payload_.substr(pos_, length);
+      pos_ += length;
+      return str;
+    }
+
+    bool isShort() const { return short_; }
+  };
+
+  
+  static std::string frame(FrameTypeT::TypeE type, const std::string & payload) {
+    std::string out;
+    out.reserve(HeaderSize + payload.size());
+
+    putU32(out, static_cast<uint32_t>(payload.size()));
+    putU8(out, static_cast<uint8_t>(type));
+    out += payload;
+
+    return out;
+  }
+
+  
+  std::string encodeSubscribe(const std::string & token, const std::vector<std::string> & paths) {
+    std::string payload;
+    putU16(payload, static_cast<uint16_t>(token.size()));
+    payload += token;
+    putU16(payload, static_cast<uint16_t>(paths.size()));
+
+    for (const std::string & path : paths) {
+      putU16(payload, static_cast<uint16_t>(path.size()));
+      payload += path;
+    }
+    return frame(FrameTypeT::SUBSCRIBE, payload);
+  }
+
+  
+  std::string encodeSnapshot(uint64_t sequence, const std::vector<PresenceT> & presences) {
+    std::string payload;
+    putU64(payload, sequence);
+    putU16(payload, static_cast<uint16_t>(presences.size()));
+
+    for (const PresenceT & presence : presences) {
+      putU8(payload, presence.present ? 1 : 0);
+      putU32(payload, presence.msSinceChange);
+    }
+    return frame(FrameTypeT::SNAPSHOT, payload);
+  }
+
+  
+  std::string encodeEvents(uint64_t firstSequence, const std::vector<PresenceT> & events) {
+    std::string payload;
+    putU64(payload, firstSequence);
+    putU16(payload, static_cast<uint16_t>(events.size()));
+
+    for (const PresenceT & event : events) {
+      putU16(payload, event.index);
+      putU8(payload, event.present ? 1 : 0);
+      putU32(payload, event.msSinceChange);
+    }
+    return frame(FrameTypeT::EVENTS, payload);
+  }
+
+  
+  std::string encodeHeartbeat(uint64_t sequence) {
+    std::string payload;
+    putU64(payload, sequence);
+
+    return frame(FrameTypeT::HEARTBEAT, payload);
+  }
+
+  
+  std::string encodeResync() {
+    return frame(FrameTypeT::RESYNC, "");
+  }
+
+
+  FrameReaderT::FrameReaderT() : corrupt_(false) {
+  }
+
+  
+  void FrameReaderT::append(const char * data, size_t size) {
+    buffer_.append(data, size);
+  }
+
+  
+  bool FrameReaderT::next(FrameT & frame) {
+    if (corrupt_ || buffer_.size() < HeaderSize) {
+      return false;
+    }
+
+    PayloadReaderT headerReader(buffer_, 0);
+    size_t payloadSize = headerReader.get(4);
+    uint8_t type = static_cast<uint8_t>(headerReader.get(1));
+    
+    if (payloadSize > MaxPayloadSize || type < FrameTypeT::SUBSCRIBE || type >= FrameTypeT::_Count) {
+      corrupt_ = true;
+      return false;
+    }
+
+    if (buffer_.size() < HeaderSize + payloadSize) {
+      return false;
+    }
+
+    std::string payload = buffer_.substr(HeaderSize, payloadSize);
+    buffer_.erase(0, HeaderSize + payloadSize);
+
+    PayloadReaderT reader(payload, 0);
+    
+    frame = FrameT();
+    frame.type = static_cast<FrameTypeT::TypeE>(type);
+
+    switch (frame.type) {
+    case FrameTypeT::SUBSCRIBE: {
+      frame.token = reader.getString(reader.get(2));
+      size_t count = reader.get(2);
+
+      for (size_t idx = 0; idx < count && ! reader.isShort(); ++idx) {
+	frame.paths.push_back(reader.getString(reader.get(2)));
+      }
+      break;
+    }
+      
+    case FrameTypeT::SNAPSHOT: {
+      frame.sequence = reader.get(8);
+      size_t count = reader.get(2);
+
+      for (size_t idx = 0; idx < count && ! reader.isShort(); ++idx) {
+	bool present = (reader.get(1) != 0);
+	frame.presences.emplace_back(static_cast<uint16_t>(idx), present, static_cast<uint32_t>(reader.get(4)));
+      }
+      break;
+    }
+      
+    case FrameTypeT::EVENTS: {
+      frame.sequence = reader.get(8);
+      size_t count = reader.get(2);
+
+      for (size_t idx = 0; idx < count && ! reader.isShort(); ++idx) {
+	uint16_t index = static_cast<uint16_t>(reader.get(2));
+	bool present = (reader.get(1) != 0);
+	frame.presences.emplace_back(index, present, static_cast<uint32_t>(reader.get(4)));
+      }
+      break;
+    }
+      
+    case FrameTypeT::HEARTBEAT:
+      frame.sequence = reader.get(8);
+      break;
+
+    default:
+      break;
+    }
+
+    if (reader.isShort()) {
+      corrupt_ = true;
+      return false;
+    }
+    
+    return true;
+  }
+
+  
+  bool FrameReaderT::isCorrupt() const {
+    return corrupt_;
+  }
+
+  
+  void FrameReaderT::reset() {
+    buffer_.clear();
+    corrupt_ = false;
+  }
+}
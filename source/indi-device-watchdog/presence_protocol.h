@@ -0,0 +1,140 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_PRESENCE_PROTOCOL_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_PRESENCE_PROTOCOL_H_ SOURCE_INDI_DEVICE_WATCHDOG_PRESENCE_PROTOCOL_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Binary protocol between the presence agent (on the host the Linux
+ * devices are attached to) and the watchdog. Each frame is
+ *
+ *   u32 payload length | u8 frame type | payload
+ *
+ * with all integers in network byte order:
+ *
+ * - SUBSCRIBE (watchdog -> agent): u16 token length, token, u16 count,
+ *   count x (u16 length, path). The token must match the shared token
+ *   of the agent. The position of a path is its index in all further
+ *   frames.
+ * - SNAPSHOT (agent -> watchdog): u64 sequence number, u16 count,
+ *   count x (u8 present, u32 ms since the last change).
+ * - EVENTS (agent -> watchdog): u64 sequence number of the first event,
+ *   u16 count, count x (u16 index, u8 present, u32 ms since the change).
+ * - HEARTBEAT (agent -> watchdog): u64 sequence number of the last event.
+ * - RESYNC (watchdog -> agent): no payload, answered by a SNAPSHOT.
+ *
+ * Each presence change increments the sequence number. A gap tells the
+ * watchdog that it missed events and has to resync.
+ */
+namespace presence_protocol {
+
+  static const size_t HeaderSize = 5;
+  static const size_t MaxPayloadSize = 64 * 1024;
+
+  struct FrameTypeT {
+    typedef enum {
+      SUBSCRIBE = 1,
+      SNAPSHOT,
+      EVENTS,
+      HEARTBEAT,
+      RESYNC,
+      _Count
+    } TypeE;
+
+    static const char *asStr(const TypeE &inType) {
+      switch (inType) {
+      case SUBSCRIBE:
+	return "SUBSCRIBE";
+      case SNAPSHOT:
+	return "SNAPSHOT";
+      case EVENTS:
+	return "EVENTS";
+      case HEARTBEAT:
+	return "HEARTBEAT";
+      case RESYNC:
+	return "RESYNC";
+      default:
+	return "<?>";
+      }
+    }
+  };
+
+  struct PresenceT {
+    uint16_t index;
+    bool present;
+    uint32_t msSinceChange;
+
+    PresenceT() : index(0), present(false), msSinceChange(0) {}
+    PresenceT(uint16_t index, bool present, uint32_t msSinceChange) : index(index), present(present), msSinceChange(msSinceChange) {}
+  };
+
+  struct FrameT {
+    FrameTypeT::TypeE type;
+    uint64_t sequence;                 // SNAPSHOT, EVENTS, HEARTBEAT
+    std::string token;                 // SUBSCRIBE
+    std::vector<std::string> paths;    // SUBSCRIBE
+    std::vector<PresenceT> presences;  // SNAPSHOT (index = position), EVENTS
+
+    FrameT() : type(FrameTypeT::HEARTBEAT), sequence(0) {}
+  };
+
+  std::string encodeSubscribe(const std::string & token, const std::vector<std::string> & paths);
+  std::string encodeSnapshot(uint64_t sequence, const std::vector<PresenceT> & presences);
+  std::string encodeEvents(uint64_t firstSequence, const std::vector<PresenceT> & events);
+  std::string encodeHeartbeat(uint64_t sequence);
+  std::string encodeResync();
+
+  /**
+   * Collects the received bytes and splits them into frames.
+   */
+  class FrameReaderT {
+  private:
+    std::string buffer_;
+    bool corrupt_;
+    
+  public:
+    FrameReaderT();
+
+    void append(const char * data, size_t size);
+
+    /**
+     * Returns false if no complete frame is available or the stream is
+     * corrupt (unknown frame type, size limit exceeded, short payload).
+     */
+    bool next(FrameT & frame);
+
+    bool isCorrupt() const;
+    void reset();
+  };
+}
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_PRESENCE_PROTOCOL_H_ */
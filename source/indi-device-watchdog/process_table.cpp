@@ -0,0 +1,134 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "process_table.h"
+
+
+namespace process_table {
+
+  /**
+   * Reads the state, the parent PID and the start time from
+   * /proc/<pid>/stat. The process name (field 2) may contain spaces -
+   * parsing starts behind it.
+   */
+  static bool readStat(const std::filesystem::path & procDir, pid_t & ppid, unsigned long long & startTime) {
+    std::ifstream statFile(procDir / "stat");
+    std::string stat((std::istreambuf_iterator<char>(statFile)), std::istreambuf_iterator<char>());
+    size_t commEnd = stat.rfind(')');
+
+    if (commEnd == std::string::npos) {
+      return false;
+    }
+
+    char state;
+    std::istringstream statFields(stat.substr(commEnd + 1));
+    std::string field;
+    
+    statFields >> state >> ppid;
+
+    // Field 22 is the start time - field 5 is the next one
+    for (int fieldIdx = 5; fieldIdx <= 22 && statFields >> field; ++fieldIdx) {
+      if (fieldIdx == 22) {
+	startTime = std::stoull(field);
+	return true;
+      }
+    }
+    return false;
+  }
+
+  
+  static std::string readArgv0BaseName(const std::filesystem::path & procDir) {
+    std::ifstream cmdlineFile(procDir / "cmdline");
+    std::string argv0;
+    std::getline(cmdlineFile, argv0, '\0');
+
+    return (argv0.empty() ? argv0 : std::filesystem::path(argv0).filename().string());
+  }
+
+  
+  template<typename VisitorT>
+  static void forEachProcess(VisitorT visitor) {
+    std::error_code ec;
+  
+    for (const auto & entry : std::filesystem::directory_iterator("/proc", ec)) {
+      const std::string pidStr = entry.path().filename().string();
+
+      if (pidStr.find_first_not_of("0123456789") != std::string::npos) {
+	continue;
+      }
+
+      pid_t ppid = 0;
+      unsigned long long startTime = 0;
+
+      // The process may have exited meanwhile
+      if (readStat(entry.path(), ppid, startTime)) {
+	visitor(entry.path(), static_cast<pid_t>(std::stol(pidStr)), ppid, startTime);
+      }
+    }
+  }
+
+  
+  std::map<std::string, pid_t> getChildProcesses(pid_t parentPid) {
+    std::map<std::string, pid_t> childProcesses;
+
+    if (parentPid <= 0) {
+      return childProcesses;
+    }
+
+    forEachProcess([parentPid, & childProcesses](const std::filesystem::path & procDir, pid_t pid, pid_t ppid, unsigned long long /*startTime*/) {
+      if (ppid == parentPid) {
+	std::string name = readArgv0BaseName(procDir);
+
+	if (! name.empty()) {
+	  childProcesses[name] = pid;
+	}
+      }
+    });
+    
+    return childProcesses;
+  }
+
+  
+  pid_t findProcess(const std::string & name) {
+    pid_t foundPid = -1;
+    unsigned long long foundStartTime = 0;
+
+    forEachProcess([& name, & foundPid, & foundStartTime](const std::filesystem::path & procDir, pid_t pid, pid_t /*ppid*/, unsigned long long startTime) {
+      if ((foundPid < 0 || startTime < foundStartTime) && readArgv0BaseName(procDir) == name) {
+	foundPid = pid;
+	foundStartTime = startTime;
+      }
+    });
+
+    return foundPid;
+  }
+}
@@ -0,0 +1,57 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_PROCESS_TABLE_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_PROCESS_TABLE_H_ SOURCE_INDI_DEVICE_WATCHDOG_PROCESS_TABLE_H_
+
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+
+/**
+ * Lookups in /proc. Each call walks the whole process table - callers
+ * cache the results.
+ */
+namespace process_table {
+
+  /**
+   * Children of the given process - base name of argv[0] -> PID. The
+   * comm field is not used since it is truncated to 15 chars.
+   */
+  std::map<std::string, pid_t> getChildProcesses(pid_t parentPid);
+
+  /**
+   * PID of the oldest process whose argv[0] has the given base name (e.g.
+   * "indiserver"). Returns -1 if there is none.
+   */
+  pid_t findProcess(const std::string & name);
+}
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_PROCESS_TABLE_H_ */
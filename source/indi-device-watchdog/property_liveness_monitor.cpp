@@ -0,0 +1,143 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include <cstring>
+
+#include "property_liveness_monitor.h"
+
+
+LivenessPropertyConfigT::LivenessPropertyConfigT() : maxUpdateInterval(0), maxBusyTime(0) {
+}
+
+
+LivenessPropertyConfigT::LivenessPropertyConfigT(const std::string & propertyName, std::chrono::milliseconds maxUpdateInterval, std::chrono::milliseconds maxBusyTime) : propertyName(propertyName), maxUpdateInterval(maxUpdateInterval), maxBusyTime(maxBusyTime) {
+}
+
+
+
+PropertyLivenessMonitorT::PropertyLivenessMonitorT() {
+}
+
+
+void PropertyLivenessMonitorT::addDevice(const std::string & indiDeviceName, const std::vector<LivenessPropertyConfigT> & livenessProperties) {
+  for (const LivenessPropertyConfigT & livenessProperty : livenessProperties) {
+    properties_.push_back(LivenessPropertyT { indiDeviceName, livenessProperty });
+  }
+
+  // Atomics cannot be moved - start over with fresh slots
+  slots_.reset(new SlotT[properties_.size()]);
+}
+
+
+bool PropertyLivenessMonitorT::hasLivenessProperties(const std::string & indiDeviceName) const {
+  for (const LivenessPropertyT & property : properties_) {
+    if (property.indiDeviceName == indiDeviceName) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+void PropertyLivenessMonitorT::update(const char * indiDeviceName, const char * propertyName, IPState propertyState, std::chrono::steady_clock::time_point now) {
+  int64_t ticks = now.time_since_epoch().count();
+  bool busy = (propertyState == IPS_BUSY);
+
+  for (size_t idx = 0; idx < properties_.size(); ++idx) {
+    const LivenessPropertyT & property = properties_[idx];
+    
+    if (strcmp(property.config.propertyName.c_str(), propertyName) != 0 || strcmp(property.indiDeviceName.c_str(), indiDeviceName) != 0) {
+      continue;
+    }
+
+    SlotT & slot = slots_[idx];
+
+    slot.lastUpdate.store(ticks, std::memory_order_relaxed);
+
+    // Only written on a state change. There is just one writer - the
+    // INDI client thread.
+    if (busy != (slot.busySince.load(std::memory_order_relaxed) != 0)) {
+      slot.busySince.store(busy ? ticks : 0, std::memory_order_relaxed);
+    }
+    return;
+  }
+}
+
+
+void PropertyLivenessMonitorT::reset(const std::string & indiDeviceName, std::chrono::steady_clock::time_point now) {
+  int64_t ticks = now.time_since_epoch().count();
+
+  for (size_t idx = 0; idx < properties_.size(); ++idx) {
+    if (properties_[idx].indiDeviceName == indiDeviceName) {
+      slots_[idx].lastUpdate.store(ticks, std::memory_order_relaxed);
+      slots_[idx].busySince.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+
+PropertyStalenessT PropertyLivenessMonitorT::check(const std::string & indiDeviceName, std::chrono::steady_clock::time_point now) const {
+  PropertyStalenessT staleness;
+  
+  for (size_t idx = 0; idx < properties_.size(); ++idx) {
+    const LivenessPropertyT & property = properties_[idx];
+
+    if (property.indiDeviceName != indiDeviceName) {
+      continue;
+    }
+
+    const SlotT & slot = slots_[idx];
+    int64_t lastUpdate = slot.lastUpdate.load(std::memory_order_relaxed);
+    int64_t busySince = slot.busySince.load(std::memory_order_relaxed);
+
+    if (busySince != 0 && property.config.maxBusyTime.count() > 0) {
+      auto busyFor = std::chrono::duration_cast<std::chrono::milliseconds>(now - std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(busySince)));
+      
+      if (busyFor > property.config.maxBusyTime) {
+	staleness.propertyName = property.config.propertyName.c_str();
+	staleness.busy = true;
+	staleness.age = busyFor;
+	staleness.limit = property.config.maxBusyTime;
+	return staleness;
+      }
+    }
+
+    // Nothing known before the device was connected for the first time
+    if (lastUpdate != 0 && property.config.maxUpdateInterval.count() > 0) {
+      auto updatedBefore = std::chrono::duration_cast<std::chrono::milliseconds>(now - std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(lastUpdate)));
+
+      if (updatedBefore > property.config.maxUpdateInterval) {
+	staleness.propertyName = property.config.propertyName.c_str();
+	staleness.age = updatedBefore;
+	staleness.limit = property.config.maxUpdateInterval;
+	return staleness;
+      }
+    }
+  }
+  return staleness;
+}
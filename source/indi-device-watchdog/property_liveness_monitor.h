@@ -0,0 +1,126 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_PROPERTY_LIVENESS_MONITOR_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_PROPERTY_LIVENESS_MONITOR_H_ SOURCE_INDI_DEVICE_WATCHDOG_PROPERTY_LIVENESS_MONITOR_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "indiapi.h"
+
+
+/**
+ * A property which a healthy driver keeps updating (e.g. CCD_TEMPERATURE).
+ * A limit of 0 disables the respective check.
+ */
+struct LivenessPropertyConfigT {
+  std::string propertyName;
+  std::chrono::milliseconds maxUpdateInterval; // Max. time between two updates
+  std::chrono::milliseconds maxBusyTime; // Max. time the property may stay busy
+
+  LivenessPropertyConfigT();
+  LivenessPropertyConfigT(const std::string & propertyName, std::chrono::milliseconds maxUpdateInterval, std::chrono::milliseconds maxBusyTime);
+};
+
+
+/**
+ * The first liveness property of a device which is stale.
+ */
+struct PropertyStalenessT {
+  const char * propertyName; // nullptr if all liveness properties are fine
+  bool busy; // Stuck in busy (otherwise not updated)
+  std::chrono::milliseconds age; // Since the last update or since it became busy
+  std::chrono::milliseconds limit;
+
+  PropertyStalenessT() : propertyName(nullptr), busy(false), age(0), limit(0) {}
+};
+
+
+/**
+ * Detects drivers which hang while their CONNECTION switch still is on.
+ * Each configured liveness property has a slot with the time of its last
+ * update and the time it became busy. The slots are written by the INDI
+ * client thread - usually with a single atomic store - and checked by the
+ * decision loop. The set of properties is fixed at construction, so
+ * neither side takes a lock.
+ */
+class PropertyLivenessMonitorT {
+ private:
+  struct LivenessPropertyT {
+    std::string indiDeviceName;
+    LivenessPropertyConfigT config;
+  };
+
+  struct SlotT {
+    std::atomic<int64_t> lastUpdate; // steady_clock ticks (0 = never)
+    std::atomic<int64_t> busySince; // steady_clock ticks (0 = not busy)
+
+    SlotT() : lastUpdate(0), busySince(0) {}
+  };
+
+  std::vector<LivenessPropertyT> properties_;
+  std::unique_ptr<SlotT[]> slots_;
+
+  // We do not want copies
+  PropertyLivenessMonitorT(const PropertyLivenessMonitorT &);
+  PropertyLivenessMonitorT & operator=(const PropertyLivenessMonitorT &);
+
+ public:
+  PropertyLivenessMonitorT();
+
+  /**
+   * Adds the liveness properties of a device. Must not be called once
+   * updates are reported.
+   */
+  void addDevice(const std::string & indiDeviceName, const std::vector<LivenessPropertyConfigT> & livenessProperties);
+
+  bool hasLivenessProperties(const std::string & indiDeviceName) const;
+
+  /**
+   * Called with each property update. Ignores all other properties.
+   */
+  void update(const char * indiDeviceName, const char * propertyName, IPState propertyState, std::chrono::steady_clock::time_point now);
+
+  /**
+   * The device was (re-)connected - the intervals start over.
+   */
+  void reset(const std::string & indiDeviceName, std::chrono::steady_clock::time_point now);
+
+  /**
+   * Only meaningful while the device is connected.
+   */
+  PropertyStalenessT check(const std::string & indiDeviceName, std::chrono::steady_clock::time_point now) const;
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_PROPERTY_LIVENESS_MONITOR_H_ */
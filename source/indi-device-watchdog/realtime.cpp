@@ -0,0 +1,124 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include <sys/mman.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "logging.h"
+#include "realtime.h"
+
+
+// Not known to older C libraries
+#ifndef MCL_ONFAULT
+#define MCL_ONFAULT 4
+#endif
+
+#ifndef SCHED_RESET_ON_FORK
+#define SCHED_RESET_ON_FORK 0x40000000
+#endif
+
+
+// Touched once by lockMemory() - the decision loop runs in the calling thread
+static const size_t StackReserveBytes = 256 * 1024;
+
+
+static void touchStack() {
+  volatile unsigned char stackReserve[StackReserveBytes];
+
+  memset(const_cast<unsigned char *>(stackReserve), 0, StackReserveBytes);
+}
+
+
+bool realtime::lockMemory(size_t heapReserveBytes) {
+  // Freed memory stays in the heap and is never mmap'ed freshly
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+
+  if (mlockall(MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT) != 0 && (errno != EINVAL || mlockall(MCL_CURRENT | MCL_FUTURE) != 0)) {
+    LOG(error) << "Cannot lock the memory of the watchdog: " << strerror(errno) << " (missing CAP_IPC_LOCK or RLIMIT_MEMLOCK?)." << std::endl;
+    return false;
+  }
+
+  if (heapReserveBytes > 0) {
+    unsigned char * heapReserve = static_cast<unsigned char *>(malloc(heapReserveBytes));
+
+    if (heapReserve != nullptr) {
+      long pageSize = sysconf(_SC_PAGESIZE);
+      
+      for (size_t offset = 0; offset < heapReserveBytes; offset += pageSize) {
+	heapReserve[offset] = 0;
+      }
+      // Stays faulted in and locked since the heap is not trimmed
+      free(heapReserve);
+    }
+  }
+
+  touchStack();
+  
+  LOG(info) << "Locked memory (reserved " << heapReserveBytes / 1024 << " KiB heap, " << StackReserveBytes / 1024 << " KiB stack)." << std::endl;
+  
+  return true;
+}
+
+
+bool realtime::setSchedulingPolicy(pthread_t thread, const std::string & policy, int priority) {
+  int schedPolicy;
+  
+  if (policy == "fifo") {
+    schedPolicy = SCHED_FIFO;
+  }
+  else if (policy == "rr") {
+    schedPolicy = SCHED_RR;
+  }
+  else {
+    LOG(error) << "Unknown real-time scheduling policy '" << policy << "'." << std::endl;
+    return false;
+  }
+
+  struct sched_param param;
+  memset(& param, 0, sizeof(param));
+  param.sched_priority = priority;
+
+  // Only this thread - the reset applies to new threads as well as to
+  // child processes
+  int rc = pthread_setschedparam(thread, schedPolicy | SCHED_RESET_ON_FORK, & param);
+  
+  if (rc != 0) {
+    LOG(error) << "Cannot set real-time scheduling policy '" << policy << "' with priority " << priority << ": " << strerror(rc)
+	       << " (missing CAP_SYS_NICE or RLIMIT_RTPRIO?)." << std::endl;
+    return false;
+  }
+  
+  return true;
+}
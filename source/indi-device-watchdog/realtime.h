@@ -0,0 +1,61 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_REALTIME_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_REALTIME_H_ SOURCE_INDI_DEVICE_WATCHDOG_REALTIME_H_
+
+#include <pthread.h>
+#include <cstddef>
+#include <string>
+
+/**
+ * Keeps the watchdog responsive when the imaging stack puts the system
+ * under memory pressure - which is exactly when devices tend to fail.
+ */
+namespace realtime {
+
+  /**
+   * Locks all current and future pages of the process into memory (only
+   * once they are touched - thread stacks are not locked completely),
+   * stops malloc from returning memory to the system and touches the
+   * given amount of heap and the stack of the calling thread once. Afterwards the decision loop
+   * neither pages nor faults.
+   */
+  bool lockMemory(size_t heapReserveBytes = 4 * 1024 * 1024);
+
+  /**
+   * Runs the given thread with the given real-time policy ("fifo" or
+   * "rr") and priority (1..99). Neither threads nor child processes
+   * (e.g. hooks or recovery scripts) created by it later inherit the
+   * policy - they run with normal scheduling.
+   */
+  bool setSchedulingPolicy(pthread_t thread, const std::string & policy, int priority);
+}
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_REALTIME_H_ */
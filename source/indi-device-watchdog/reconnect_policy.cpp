@@ -0,0 +1,75 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+
+#include "reconnect_policy.h"
+
+
+ReconnectPolicyT::ReconnectPolicyT() : ReconnectPolicyT(std::chrono::milliseconds(50), std::chrono::milliseconds(5000), 2.0, 0.2) {
+}
+
+
+ReconnectPolicyT::ReconnectPolicyT(std::chrono::milliseconds initialDelay, std::chrono::milliseconds maxDelay, double multiplier, double jitter) : initialDelay_(initialDelay), maxDelay_(std::max(initialDelay, maxDelay)), multiplier_(std::max(1.0, multiplier)), jitter_(std::clamp(jitter, 0.0, 1.0)), attempt_(0), randomGenerator_(std::random_device()()) {
+}
+
+
+std::chrono::milliseconds ReconnectPolicyT::nextDelay() {
+
+  double baseDelayMs = std::min(static_cast<double>(maxDelay_.count()), initialDelay_.count() * std::pow(multiplier_, attempt_));
+
+  std::uniform_real_distribution<double> jitterDistribution(0.0, jitter_);
+  double delayMs = baseDelayMs * (1.0 - jitterDistribution(randomGenerator_));
+
+  // Stop growing the exponent once the cap is reached
+  if (baseDelayMs < maxDelay_.count()) {
+    attempt_++;
+  }
+  
+  return std::chrono::milliseconds(static_cast<long>(std::lround(delayMs)));
+}
+
+
+void ReconnectPolicyT::reset() {
+  attempt_ = 0;
+}
+
+
+unsigned int ReconnectPolicyT::getAttempt() const {
+  return attempt_;
+}
+
+
+std::chrono::milliseconds ReconnectPolicyT::getInitialDelay() const {
+  return initialDelay_;
+}
+
+
+std::chrono::milliseconds ReconnectPolicyT::getMaxDelay() const {
+  return maxDelay_;
+}
@@ -0,0 +1,67 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_RECONNECT_POLICY_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_RECONNECT_POLICY_H_ SOURCE_INDI_DEVICE_WATCHDOG_RECONNECT_POLICY_H_
+
+#include <chrono>
+#include <random>
+
+/**
+ * Exponential backoff with jitter for reconnecting to the INDI server.
+ * The first retry happens quickly (tens of ms) so that a restarted INDI
+ * server is noticed right away. Each further failure doubles the delay
+ * up to the cap. A successful connect resets the policy.
+ */
+class ReconnectPolicyT {
+ private:
+  std::chrono::milliseconds initialDelay_;
+  std::chrono::milliseconds maxDelay_;
+  double multiplier_;
+  double jitter_;
+  unsigned int attempt_;
+  std::mt19937 randomGenerator_;
+  
+ public:
+  ReconnectPolicyT();
+  ReconnectPolicyT(std::chrono::milliseconds initialDelay, std::chrono::milliseconds maxDelay, double multiplier, double jitter);
+
+  /**
+   * Returns the delay before the next attempt and advances the policy.
+   * The delay is reduced by a random fraction of up to "jitter" so that
+   * several clients do not retry in lockstep.
+   */
+  std::chrono::milliseconds nextDelay();
+  
+  void reset();
+
+  unsigned int getAttempt() const;
+  std::chrono::milliseconds getInitialDelay() const;
+  std::chrono::milliseconds getMaxDelay() const;
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_RECONNECT_POLICY_H_ */
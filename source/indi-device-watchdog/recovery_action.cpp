@@ -0,0 +1,450 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#include <filesystem>
+#include <fstream>
+
+#include "logging.h"
+#include "device_data.h"
+#include "recovery_action.h"
+
+
+RecoveryStepConfigT::RecoveryStepConfigT() : actionType(RecoveryActionTypeT::RECONNECT), timeout(getDefaultTimeout(RecoveryActionTypeT::RECONNECT)) {
+}
+
+
+RecoveryStepConfigT::RecoveryStepConfigT(RecoveryActionTypeT::TypeE actionType, std::chrono::milliseconds timeout, const std::map<std::string, std::string> & parameters) : actionType(actionType), timeout(timeout), parameters(parameters) {
+}
+
+
+std::string RecoveryStepConfigT::getParameter(const std::string & name, const std::string & defaultValue) const {
+  auto it = parameters.find(name);
+  return (it != parameters.end() ? it->second : defaultValue);
+}
+
+
+/**
+ * A driver restart takes many seconds longer than a simple reconnect.
+ * The defaults reflect that.
+ */
+std::chrono::milliseconds RecoveryStepConfigT::getDefaultTimeout(RecoveryActionTypeT::TypeE actionType) {
+  using namespace std::chrono_literals;
+
+  switch (actionType) {
+  case RecoveryActionTypeT::RECONNECT:
+    return 5000ms;
+  case RecoveryActionTypeT::DISCONNECT_CONNECT_CYCLE:
+    return 10000ms;
+  case RecoveryActionTypeT::DRIVER_RESTART:
+    return 30000ms;
+  case RecoveryActionTypeT::USB_REAUTHORIZE:
+    return 15000ms;
+  case RecoveryActionTypeT::INDI_SERVER_RESTART:
+    return 60000ms;
+  case RecoveryActionTypeT::USER_SCRIPT:
+    return 30000ms;
+  default:
+    return 10000ms;
+  }
+}
+
+
+RecoveryActionT::RecoveryActionT(std::chrono::milliseconds timeout) : timeout_(timeout) {
+}
+
+std::chrono::milliseconds RecoveryActionT::getTimeout() const {
+  return timeout_;
+}
+
+bool RecoveryActionT::hasTimeout() const {
+  return (timeout_.count() > 0);
+}
+
+bool RecoveryActionT::isApplicable(const RecoveryActionContextT & /*context*/, const DeviceDataT & /*deviceData*/) const {
+  return true;
+}
+
+bool RecoveryActionT::isDeferred() const {
+  return false;
+}
+
+void RecoveryActionT::abort() {
+}
+
+bool RecoveryActionT::requiresClientReset() const {
+  return false;
+}
+
+RecoveryActionStatusT::TypeE RecoveryActionT::awaitIndiDevice(RecoveryActionContextT & context, DeviceDataT & deviceData, bool & connectSent) {
+
+  if (! context.hasIndiDevice(deviceData)) {
+    return RecoveryActionStatusT::IN_PROGRESS;
+  }
+  
+  if (context.hasConnectedIndiDevice(deviceData) || ! deviceData.getEnableAutoConnect()) {
+    return RecoveryActionStatusT::SUCCEEDED;
+  }
+
+  if (! connectSent) {
+    connectSent = true;
+
+    if (! context.sendConnectionRequest(deviceData, true)) {
+      return RecoveryActionStatusT::FAILED;
+    }
+  }
+  return RecoveryActionStatusT::IN_PROGRESS;
+}
+
+
+
+ReconnectActionT::ReconnectActionT(std::chrono::milliseconds timeout) : RecoveryActionT(timeout) {
+}
+
+RecoveryActionTypeT::TypeE ReconnectActionT::getType() const {
+  return RecoveryActionTypeT::RECONNECT;
+}
+
+/**
+ * Another connect request does not help a connected device whose driver
+ * hangs.
+ */
+bool ReconnectActionT::isApplicable(const RecoveryActionContextT & context, const DeviceDataT & deviceData) const {
+  return context.hasIndiDevice(deviceData) && ! context.hasConnectedIndiDevice(deviceData);
+}
+
+bool ReconnectActionT::start(RecoveryActionContextT & context, DeviceDataT & deviceData) {
+  return context.sendConnectionRequest(deviceData, true);
+}
+
+/**
+ * Without a timeout the connect request is sent again on each cycle - as
+ * long as it can be sent.
+ */
+RecoveryActionStatusT::TypeE ReconnectActionT::poll(RecoveryActionContextT & context, DeviceDataT & deviceData) {
+  if (context.hasConnectedIndiDevice(deviceData)) {
+    return RecoveryActionStatusT::SUCCEEDED;
+  }
+  if (! context.hasIndiDevice(deviceData)) {
+    return RecoveryActionStatusT::FAILED;
+  }
+  if (! hasTimeout() && ! context.sendConnectionRequest(deviceData, true)) {
+    return RecoveryActionStatusT::FAILED;
+  }
+  return RecoveryActionStatusT::IN_PROGRESS;
+}
+
+
+
+DisconnectConnectCycleActionT::DisconnectConnectCycleActionT(std::chrono::milliseconds timeout) : RecoveryActionT(timeout), connectSent_(false) {
+}
+
+RecoveryActionTypeT::TypeE DisconnectConnectCycleActionT::getType() const {
+  return RecoveryActionTypeT::DISCONNECT_CONNECT_CYCLE;
+}
+
+bool DisconnectConnectCycleActionT::isApplicable(const RecoveryActionContextT & context, const DeviceDataT & deviceData) const {
+  return context.hasIndiDevice(deviceData);
+}
+
+bool DisconnectConnectCycleActionT::start(RecoveryActionContextT & context, DeviceDataT & deviceData) {
+  auto cycleStatus = std::make_shared<std::atomic<RecoveryActionStatusT::TypeE> >(RecoveryActionStatusT::IN_PROGRESS);
+
+  connectSent_ = false;
+
+  // Preferably driven by the answers of the driver - the status may be
+  // set before cycleConnection() returns.
+  if (context.cycleConnection(deviceData, [cycleStatus](bool succeeded) {
+    *cycleStatus = (succeeded ? RecoveryActionStatusT::SUCCEEDED : RecoveryActionStatusT::FAILED);
+  })) {
+    cycleStatus_ = cycleStatus;
+    return true;
+  }
+
+  cycleStatus_ = nullptr;
+  return context.sendConnectionRequest(deviceData, false);
+}
+
+RecoveryActionStatusT::TypeE DisconnectConnectCycleActionT::poll(RecoveryActionContextT & context, DeviceDataT & deviceData) {
+
+  if (! context.hasIndiDevice(deviceData)) {
+    return RecoveryActionStatusT::FAILED;
+  }
+  
+  bool connected = context.hasConnectedIndiDevice(deviceData);
+
+  if (cycleStatus_ != nullptr) {
+    RecoveryActionStatusT::TypeE cycleStatus = *cycleStatus_;
+    return (cycleStatus == RecoveryActionStatusT::SUCCEEDED && ! connected ? RecoveryActionStatusT::IN_PROGRESS : cycleStatus);
+  }
+  
+  if (! connectSent_) {
+    // Wait until the disconnect went through, then connect again
+    if (! connected) {
+      connectSent_ = true;
+      
+      if (! context.sendConnectionRequest(deviceData, true)) {
+	return RecoveryActionStatusT::FAILED;
+      }
+    }
+    return RecoveryActionStatusT::IN_PROGRESS;
+  }
+  
+  return (connected ? RecoveryActionStatusT::SUCCEEDED : RecoveryActionStatusT::IN_PROGRESS);
+}
+
+
+
+DriverRestartActionT::DriverRestartActionT(std::chrono::milliseconds timeout) : RecoveryActionT(timeout), restarted_(false), deferred_(false), connectSent_(false) {
+}
+
+RecoveryActionTypeT::TypeE DriverRestartActionT::getType() const {
+  return RecoveryActionTypeT::DRIVER_RESTART;
+}
+
+bool DriverRestartActionT::start(RecoveryActionContextT & context, DeviceDataT & deviceData) {
+  DriverRestartResultT::TypeE result = context.restartIndiDriver(deviceData);
+
+  // Coalesced: the driver was just restarted for this or another device
+  // of the driver and comes back anyway.
+  connectSent_ = false;
+  restarted_ = (result == DriverRestartResultT::RESTARTED);
+  deferred_ = (result == DriverRestartResultT::REJECTED);
+  
+  return (result != DriverRestartResultT::REJECTED);
+}
+
+bool DriverRestartActionT::isDeferred() const {
+  return deferred_;
+}
+
+RecoveryActionStatusT::TypeE DriverRestartActionT::poll(RecoveryActionContextT & context, DeviceDataT & deviceData) {
+  // The driver is back once the INDI device shows up again
+  return awaitIndiDevice(context, deviceData, connectSent_);
+}
+
+bool DriverRestartActionT::requiresClientReset() const {
+  return restarted_;
+}
+
+
+
+UsbReauthorizeActionT::UsbReauthorizeActionT(std::chrono::milliseconds timeout, const std::string & sysfsRoot, const std::string & usbPort, bool useBind, std::chrono::milliseconds settleDelay) : RecoveryActionT(timeout), sysfsRoot_(sysfsRoot), usbPort_(usbPort), useBind_(useBind), settleDelay_(settleDelay), deauthorized_(false), linuxDeviceWasGone_(false), connectSent_(false) {
+}
+
+RecoveryActionTypeT::TypeE UsbReauthorizeActionT::getType() const {
+  return RecoveryActionTypeT::USB_REAUTHORIZE;
+}
+
+bool UsbReauthorizeActionT::isApplicable(const RecoveryActionContextT & /*context*/, const DeviceDataT & /*deviceData*/) const {
+  return ! usbPort_.empty();
+}
+
+bool UsbReauthorizeActionT::writeSysfsAttribute(const std::string & relativePath, const std::string & value) const {
+  std::filesystem::path attributePath = std::filesystem::path(sysfsRoot_) / relativePath;
+  std::ofstream attributeFile(attributePath);
+
+  if (! attributeFile.is_open()) {
+    LOG(error) << "ERROR: Cannot open '" << attributePath.string() << "'." << std::endl;
+    return false;
+  }
+
+  attributeFile << value << std::flush;
+
+  if (! attributeFile.good()) {
+    LOG(error) << "ERROR: Cannot write '" << value << "' to '" << attributePath.string() << "'." << std::endl;
+    return false;
+  }
+  
+  return true;
+}
+
+bool UsbReauthorizeActionT::deauthorize() {
+  return (useBind_ ? writeSysfsAttribute("bus/usb/drivers/usb/unbind", usbPort_) : writeSysfsAttribute("bus/usb/devices/" + usbPort_ + "/authorized", "0"));
+}
+
+bool UsbReauthorizeActionT::reauthorize() {
+  deauthorized_ = false;
+  
+  return (useBind_ ? writeSysfsAttribute("bus/usb/drivers/usb/bind", usbPort_) : writeSysfsAttribute("bus/usb/devices/" + usbPort_ + "/authorized", "1"));
+}
+
+bool UsbReauthorizeActionT::start(RecoveryActionContextT & /*context*/, DeviceDataT & deviceData) {
+
+  LOG(info) << "Re-authorizing USB port '" << usbPort_ << "' of device '" << deviceData.getIndiDeviceName() << "' (" << (useBind_ ? "unbind/bind" : "authorized")
+	    << ", settle delay " << settleDelay_.count() << " ms)..." << std::endl;
+
+  linuxDeviceWasGone_ = false;
+  connectSent_ = false;
+  deauthorizeTime_ = std::chrono::steady_clock::now();
+  deauthorized_ = deauthorize();
+  
+  return deauthorized_;
+}
+
+RecoveryActionStatusT::TypeE UsbReauthorizeActionT::poll(RecoveryActionContextT & context, DeviceDataT & deviceData) {
+
+  if (deauthorized_) {
+    if (std::chrono::steady_clock::now() - deauthorizeTime_ < settleDelay_) {
+      return RecoveryActionStatusT::IN_PROGRESS;
+    }
+
+    // The Linux device cannot come back before the port is authorized
+    // again - if it is still there, it is not attached to this port.
+    linuxDeviceWasGone_ = ! context.hasLinuxDevice(deviceData);
+
+    if (! reauthorize()) {
+      return RecoveryActionStatusT::FAILED;
+    }
+
+    if (! linuxDeviceWasGone_) {
+      LOG(warning) << "Linux device '" << deviceData.getLinuxDeviceName() << "' did not disappear while USB port '" << usbPort_ << "' was de-authorized." << std::endl;
+      return RecoveryActionStatusT::FAILED;
+    }
+    return RecoveryActionStatusT::IN_PROGRESS;
+  }
+
+  // Re-enumerated - the INDI device may have to be connected again
+  if (! context.hasLinuxDevice(deviceData)) {
+    return RecoveryActionStatusT::IN_PROGRESS;
+  }
+  return awaitIndiDevice(context, deviceData, connectSent_);
+}
+
+void UsbReauthorizeActionT::abort() {
+  // Never leave the port de-authorized
+  if (deauthorized_) {
+    reauthorize();
+  }
+}
+
+
+
+CommandActionT::CommandActionT(RecoveryActionTypeT::TypeE type, std::chrono::milliseconds timeout, const std::string & command) : RecoveryActionT(timeout), type_(type), command_(command) {
+}
+
+RecoveryActionTypeT::TypeE CommandActionT::getType() const {
+  return type_;
+}
+
+bool CommandActionT::isApplicable(const RecoveryActionContextT & /*context*/, const DeviceDataT & /*deviceData*/) const {
+  return ! command_.empty();
+}
+
+bool CommandActionT::start(RecoveryActionContextT & /*context*/, DeviceDataT & deviceData) {
+  LOG(info) << "Running " << RecoveryActionTypeT::asStr(type_) << " command '" << command_ << "' for device '" << deviceData.getIndiDeviceName() << "'..." << std::endl;
+
+  return process_.startShellCommand(command_, { deviceData.getIndiDeviceName(), deviceData.getIndiDeviceDriverName(), deviceData.getLinuxDeviceName() });
+}
+
+RecoveryActionStatusT::TypeE CommandActionT::poll(RecoveryActionContextT & /*context*/, DeviceDataT & /*deviceData*/) {
+
+  if (process_.poll() != ChildProcessStateT::EXITED) {
+    return RecoveryActionStatusT::IN_PROGRESS;
+  }
+
+  if (process_.getExitCode() != 0) {
+    LOG(warning) << "Command '" << command_ << "' failed with exit code " << process_.getExitCode() << "." << std::endl;
+    return RecoveryActionStatusT::FAILED;
+  }
+
+  return RecoveryActionStatusT::SUCCEEDED;
+}
+
+void CommandActionT::abort() {
+  process_.kill();
+}
+
+bool CommandActionT::requiresClientReset() const {
+  return (type_ == RecoveryActionTypeT::INDI_SERVER_RESTART);
+}
+
+
+
+SupervisedIndiServerRestartActionT::SupervisedIndiServerRestartActionT(std::chrono::milliseconds timeout, std::shared_ptr<IndiServerSupervisorT> indiServerSupervisor) : RecoveryActionT(timeout), indiServerSupervisor_(indiServerSupervisor), startGeneration_(0) {
+}
+
+RecoveryActionTypeT::TypeE SupervisedIndiServerRestartActionT::getType() const {
+  return RecoveryActionTypeT::INDI_SERVER_RESTART;
+}
+
+bool SupervisedIndiServerRestartActionT::start(RecoveryActionContextT & /*context*/, DeviceDataT & deviceData) {
+  LOG(warning) << "Restarting the supervised INDI server because of device '" << deviceData.getIndiDeviceName() << "'..." << std::endl;
+
+  startGeneration_ = indiServerSupervisor_->getGeneration();
+  indiServerSupervisor_->requestRestart();
+
+  return true;
+}
+
+RecoveryActionStatusT::TypeE SupervisedIndiServerRestartActionT::poll(RecoveryActionContextT & /*context*/, DeviceDataT & /*deviceData*/) {
+  // A failed replay of the driver starts is retried by the supervisor
+  bool restarted = (indiServerSupervisor_->getGeneration() != startGeneration_ && indiServerSupervisor_->isRunning());
+  
+  return (restarted ? RecoveryActionStatusT::SUCCEEDED : RecoveryActionStatusT::IN_PROGRESS);
+}
+
+bool SupervisedIndiServerRestartActionT::requiresClientReset() const {
+  return true;
+}
+
+
+
+RecoveryActionFactoryT::RecoveryActionFactoryT() : sysfsRoot_("/sys") {
+}
+
+RecoveryActionFactoryT::RecoveryActionFactoryT(const std::string & sysfsRoot, const std::string & indiServerRestartCommand, std::shared_ptr<IndiServerSupervisorT> indiServerSupervisor) : sysfsRoot_(sysfsRoot), indiServerRestartCommand_(indiServerRestartCommand), indiServerSupervisor_(indiServerSupervisor) {
+}
+
+std::shared_ptr<RecoveryActionT> RecoveryActionFactoryT::create(const RecoveryStepConfigT & stepConfig) const {
+
+  switch (stepConfig.actionType) {
+  case RecoveryActionTypeT::RECONNECT:
+    return std::make_shared<ReconnectActionT>(stepConfig.timeout);
+
+  case RecoveryActionTypeT::DISCONNECT_CONNECT_CYCLE:
+    return std::make_shared<DisconnectConnectCycleActionT>(stepConfig.timeout);
+
+  case RecoveryActionTypeT::DRIVER_RESTART:
+    return std::make_shared<DriverRestartActionT>(stepConfig.timeout);
+
+  case RecoveryActionTypeT::USB_REAUTHORIZE:
+    return std::make_shared<UsbReauthorizeActionT>(stepConfig.timeout, sysfsRoot_, stepConfig.getParameter("usbPort"), stepConfig.getParameter("method", "authorized") == "bind",
+						   std::chrono::milliseconds(std::stol(stepConfig.getParameter("settleMs", "1000"))));
+
+  case RecoveryActionTypeT::INDI_SERVER_RESTART:
+    if (indiServerSupervisor_ != nullptr && stepConfig.getParameter("command").empty()) {
+      return std::make_shared<SupervisedIndiServerRestartActionT>(stepConfig.timeout, indiServerSupervisor_);
+    }
+    return std::make_shared<CommandActionT>(stepConfig.actionType, stepConfig.timeout, stepConfig.getParameter("command", indiServerRestartCommand_));
+
+  case RecoveryActionTypeT::USER_SCRIPT:
+    return std::make_shared<CommandActionT>(stepConfig.actionType, stepConfig.timeout, stepConfig.getParameter("command"));
+
+  default:
+    return nullptr;
+  }
+}
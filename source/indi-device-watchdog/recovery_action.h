@@ -0,0 +1,355 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_RECOVERY_ACTION_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_RECOVERY_ACTION_H_ SOURCE_INDI_DEVICE_WATCHDOG_RECOVERY_ACTION_H_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "enum_helper.h"
+#include "child_process.h"
+#include "indi_server_supervisor.h"
+#include "indi_driver_restart_manager.h"
+
+class DeviceDataT;
+
+
+struct RecoveryActionTypeT {
+  typedef enum {
+    RECONNECT,
+    DISCONNECT_CONNECT_CYCLE,
+    DRIVER_RESTART,
+    USB_REAUTHORIZE,
+    INDI_SERVER_RESTART,
+    USER_SCRIPT,
+    _Count
+  } TypeE;
+
+  static const char *asStr(const TypeE &inType) {
+    switch (inType) {
+    case RECONNECT:
+      return "reconnect";
+    case DISCONNECT_CONNECT_CYCLE:
+      return "disconnectConnectCycle";
+    case DRIVER_RESTART:
+      return "driverRestart";
+    case USB_REAUTHORIZE:
+      return "usbReauthorize";
+    case INDI_SERVER_RESTART:
+      return "indiServerRestart";
+    case USER_SCRIPT:
+      return "userScript";
+    default:
+      return "<?>";
+    }
+  }
+
+  MAC_AS_TYPE(Type, E, _Count);
+};
+
+
+struct RecoveryActionStatusT {
+  typedef enum {
+    IN_PROGRESS,
+    SUCCEEDED,
+    FAILED,
+    _Count
+  } TypeE;
+
+  static const char *asStr(const TypeE &inType) {
+    switch (inType) {
+    case IN_PROGRESS:
+      return "IN_PROGRESS";
+    case SUCCEEDED:
+      return "SUCCEEDED";
+    case FAILED:
+      return "FAILED";
+    default:
+      return "<?>";
+    }
+  }
+};
+
+
+/**
+ * One step of a recovery ladder as read from the device configuration.
+ * Action specific settings (e.g. the USB port or a script) are kept as
+ * plain key/value pairs and interpreted by the respective action.
+ */
+struct RecoveryStepConfigT {
+  RecoveryActionTypeT::TypeE actionType;
+  std::chrono::milliseconds timeout;
+  std::map<std::string, std::string> parameters;
+
+  RecoveryStepConfigT();
+  RecoveryStepConfigT(RecoveryActionTypeT::TypeE actionType, std::chrono::milliseconds timeout, const std::map<std::string, std::string> & parameters = std::map<std::string, std::string>());
+
+  std::string getParameter(const std::string & name, const std::string & defaultValue = "") const;
+
+  static std::chrono::milliseconds getDefaultTimeout(RecoveryActionTypeT::TypeE actionType);
+};
+
+
+/**
+ * Operations the recovery actions need from the watchdog. Implemented by
+ * IndiDeviceWatchdogT so that the actions do not depend on the INDI client.
+ */
+class RecoveryActionContextT {
+ public:
+  virtual ~RecoveryActionContextT() = default;
+
+  typedef std::function<void(bool succeeded)> ConnectionCycleHandlerT;
+  
+  virtual bool sendConnectionRequest(DeviceDataT & deviceData, bool connect) = 0;
+
+  /**
+   * Disconnects the INDI device and connects it again - the connect
+   * request is only sent once the driver confirmed the disconnect. The
+   * handler is called once the driver answered the connect request (from
+   * another thread). Returns false if this is not available (built
+   * without C++20 coroutines) - the caller then sends the requests itself.
+   */
+  virtual bool cycleConnection(DeviceDataT & deviceData, ConnectionCycleHandlerT handler) = 0;
+  
+  virtual DriverRestartResultT::TypeE restartIndiDriver(DeviceDataT & deviceData) = 0;
+
+  virtual bool hasLinuxDevice(const DeviceDataT & deviceData) const = 0;
+  virtual bool hasIndiDevice(const DeviceDataT & deviceData) const = 0;
+  virtual bool hasConnectedIndiDevice(const DeviceDataT & deviceData) const = 0;
+};
+
+
+/**
+ * Base class of all recovery actions. An action is started once and then
+ * polled on each watchdog cycle until it reports success or failure. The
+ * per-step timeout is enforced by the RecoveryLadderT.
+ */
+class RecoveryActionT {
+ private:
+  std::chrono::milliseconds timeout_;
+
+ protected:
+  /**
+   * For actions after which the INDI device comes back disconnected (e.g.
+   * a driver restart). Sends one connect request once the INDI device is
+   * back - if auto connect is enabled. Succeeds once the device is back
+   * and, if required, connected.
+   */
+  static RecoveryActionStatusT::TypeE awaitIndiDevice(RecoveryActionContextT & context, DeviceDataT & deviceData, bool & connectSent);
+
+ public:
+  explicit RecoveryActionT(std::chrono::milliseconds timeout);
+  virtual ~RecoveryActionT() = default;
+
+  std::chrono::milliseconds getTimeout() const;
+
+  /**
+   * A step with a timeout of 0 runs until it succeeds or fails.
+   */
+  bool hasTimeout() const;
+
+  virtual RecoveryActionTypeT::TypeE getType() const = 0;
+
+  /**
+   * Returns false if the action cannot help in the current situation
+   * (e.g. reconnecting an INDI device which does not exist).
+   */
+  virtual bool isApplicable(const RecoveryActionContextT & context, const DeviceDataT & deviceData) const;
+
+  /**
+   * Returns false if the action could not even be issued.
+   */
+  virtual bool start(RecoveryActionContextT & context, DeviceDataT & deviceData) = 0;
+
+  /**
+   * True if the last start() was only held back for now (e.g. by the
+   * backoff of the INDI driver restarts). The ladder retries the step
+   * instead of escalating.
+   */
+  virtual bool isDeferred() const;
+
+  /**
+   * The success check of the action. SUCCEEDED only means that the action
+   * did its part - the ladder waits for the device to become healthy.
+   */
+  virtual RecoveryActionStatusT::TypeE poll(RecoveryActionContextT & context, DeviceDataT & deviceData) = 0;
+
+  virtual void abort();
+
+  /**
+   * True if the INDI client has to be reset after the action was started.
+   */
+  virtual bool requiresClientReset() const;
+};
+
+
+class ReconnectActionT : public RecoveryActionT {
+ public:
+  explicit ReconnectActionT(std::chrono::milliseconds timeout);
+
+  RecoveryActionTypeT::TypeE getType() const override;
+  bool isApplicable(const RecoveryActionContextT & context, const DeviceDataT & deviceData) const override;
+  bool start(RecoveryActionContextT & context, DeviceDataT & deviceData) override;
+  RecoveryActionStatusT::TypeE poll(RecoveryActionContextT & context, DeviceDataT & deviceData) override;
+};
+
+
+class DisconnectConnectCycleActionT : public RecoveryActionT {
+ private:
+  bool connectSent_;
+  std::shared_ptr<std::atomic<RecoveryActionStatusT::TypeE> > cycleStatus_; // Set by the connection cycle (nullptr if poll() sends the requests)
+
+ public:
+  explicit DisconnectConnectCycleActionT(std::chrono::milliseconds timeout);
+
+  RecoveryActionTypeT::TypeE getType() const override;
+  bool isApplicable(const RecoveryActionContextT & context, const DeviceDataT & deviceData) const override;
+  bool start(RecoveryActionContextT & context, DeviceDataT & deviceData) override;
+  RecoveryActionStatusT::TypeE poll(RecoveryActionContextT & context, DeviceDataT & deviceData) override;
+};
+
+
+class DriverRestartActionT : public RecoveryActionT {
+ private:
+  bool restarted_;
+  bool deferred_;
+  bool connectSent_;
+
+ public:
+  explicit DriverRestartActionT(std::chrono::milliseconds timeout);
+
+  RecoveryActionTypeT::TypeE getType() const override;
+  bool start(RecoveryActionContextT & context, DeviceDataT & deviceData) override;
+  bool isDeferred() const override;
+  RecoveryActionStatusT::TypeE poll(RecoveryActionContextT & context, DeviceDataT & deviceData) override;
+  bool requiresClientReset() const override;
+};
+
+
+/**
+ * Re-authorizes the USB port of the device via sysfs. Either by writing
+ * 0/1 to <sysfs>/bus/usb/devices/<port>/authorized or by writing the port
+ * to <sysfs>/bus/usb/drivers/usb/unbind and .../bind. The sysfs root is
+ * configurable so that the action can be tried against a temp. directory.
+ *
+ * The port is authorized again after the settle delay - by a later poll,
+ * the decision loop does not sleep. The Linux device has to disappear in
+ * between and to come back afterwards.
+ */
+class UsbReauthorizeActionT : public RecoveryActionT {
+ private:
+  std::string sysfsRoot_;
+  std::string usbPort_;
+  bool useBind_;
+  std::chrono::milliseconds settleDelay_;
+
+  bool deauthorized_;
+  bool linuxDeviceWasGone_;
+  bool connectSent_;
+  std::chrono::steady_clock::time_point deauthorizeTime_;
+
+  bool writeSysfsAttribute(const std::string & relativePath, const std::string & value) const;
+  bool deauthorize();
+  bool reauthorize();
+
+ public:
+  UsbReauthorizeActionT(std::chrono::milliseconds timeout, const std::string & sysfsRoot, const std::string & usbPort, bool useBind, std::chrono::milliseconds settleDelay);
+
+  RecoveryActionTypeT::TypeE getType() const override;
+  bool isApplicable(const RecoveryActionContextT & context, const DeviceDataT & deviceData) const override;
+  bool start(RecoveryActionContextT & context, DeviceDataT & deviceData) override;
+  RecoveryActionStatusT::TypeE poll(RecoveryActionContextT & context, DeviceDataT & deviceData) override;
+  void abort() override;
+};
+
+
+/**
+ * Runs an external command. Used for the INDI server restart (e.g.
+ * "systemctl restart indiserver") and for user provided scripts. The
+ * script receives the INDI device name, the INDI driver name and the
+ * Linux device name as $1, $2 and $3.
+ */
+class CommandActionT : public RecoveryActionT {
+ private:
+  RecoveryActionTypeT::TypeE type_;
+  std::string command_;
+  ChildProcessT process_;
+
+ public:
+  CommandActionT(RecoveryActionTypeT::TypeE type, std::chrono::milliseconds timeout, const std::string & command);
+
+  RecoveryActionTypeT::TypeE getType() const override;
+  bool isApplicable(const RecoveryActionContextT & context, const DeviceDataT & deviceData) const override;
+  bool start(RecoveryActionContextT & context, DeviceDataT & deviceData) override;
+  RecoveryActionStatusT::TypeE poll(RecoveryActionContextT & context, DeviceDataT & deviceData) override;
+  void abort() override;
+  bool requiresClientReset() const override;
+};
+
+
+/**
+ * Restarts the INDI server in supervisor mode. Succeeds once the
+ * supervisor started a new INDI server.
+ */
+class SupervisedIndiServerRestartActionT : public RecoveryActionT {
+ private:
+  std::shared_ptr<IndiServerSupervisorT> indiServerSupervisor_;
+  unsigned long startGeneration_;
+
+ public:
+  SupervisedIndiServerRestartActionT(std::chrono::milliseconds timeout, std::shared_ptr<IndiServerSupervisorT> indiServerSupervisor);
+
+  RecoveryActionTypeT::TypeE getType() const override;
+  bool start(RecoveryActionContextT & context, DeviceDataT & deviceData) override;
+  RecoveryActionStatusT::TypeE poll(RecoveryActionContextT & context, DeviceDataT & deviceData) override;
+  bool requiresClientReset() const override;
+};
+
+
+/**
+ * Creates the recovery actions from the step configuration. Holds the
+ * settings which are global for all devices.
+ */
+class RecoveryActionFactoryT {
+ private:
+  std::string sysfsRoot_;
+  std::string indiServerRestartCommand_;
+  std::shared_ptr<IndiServerSupervisorT> indiServerSupervisor_;
+
+ public:
+  RecoveryActionFactoryT();
+  RecoveryActionFactoryT(const std::string & sysfsRoot, const std::string & indiServerRestartCommand, std::shared_ptr<IndiServerSupervisorT> indiServerSupervisor = nullptr);
+
+  std::shared_ptr<RecoveryActionT> create(const RecoveryStepConfigT & stepConfig) const;
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_RECOVERY_ACTION_H_ */
@@ -0,0 +1,227 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#include "logging.h"
+#include "device_data.h"
+#include "recovery_ladder.h"
+
+
+RecoveryLadderT::RecoveryLadderT() : currentStep_(-1), stepCompleted_(false), stepDeferred_(false) {
+}
+
+
+RecoveryLadderT::RecoveryLadderT(const std::vector<RecoveryStepConfigT> & stepConfigs, const RecoveryActionFactoryT & actionFactory) : currentStep_(-1), stepCompleted_(false), stepDeferred_(false) {
+
+  for (const auto & stepConfig : stepConfigs) {
+    std::shared_ptr<RecoveryActionT> action = actionFactory.create(stepConfig);
+
+    if (action != nullptr) {
+      steps_.push_back(action);
+    }
+  }
+}
+
+
+/**
+ * Behaves like the watchdog always did: a connect request is sent on
+ * each cycle and the INDI driver is only restarted if the INDI device is
+ * missing or the request cannot be sent.
+ */
+std::vector<RecoveryStepConfigT> RecoveryLadderT::getDefaultStepConfigs() {
+  std::vector<RecoveryStepConfigT> stepConfigs;
+
+  stepConfigs.emplace_back(RecoveryActionTypeT::RECONNECT, std::chrono::milliseconds(0) /*no timeout*/);
+  stepConfigs.emplace_back(RecoveryActionTypeT::DRIVER_RESTART, RecoveryStepConfigT::getDefaultTimeout(RecoveryActionTypeT::DRIVER_RESTART));
+  
+  return stepConfigs;
+}
+
+
+bool RecoveryLadderT::isTimedOut(const RecoveryActionT & action) const {
+  return (action.hasTimeout() && std::chrono::steady_clock::now() - stepStartTime_ >= action.getTimeout());
+}
+
+
+bool RecoveryLadderT::isActive() const {
+  return (currentStep_ >= 0);
+}
+
+
+const RecoveryActionT * RecoveryLadderT::getCurrentAction() const {
+  return (isActive() ? steps_.at(currentStep_).get() : nullptr);
+}
+
+
+void RecoveryLadderT::reset() {
+  if (isActive() && ! stepDeferred_) {
+    steps_.at(currentStep_)->abort();
+  }
+  currentStep_ = -1;
+  stepDeferred_ = false;
+}
+
+
+/**
+ * Starts the given step. A deferred step becomes the current step without
+ * running - it is started again on the next cycle. Returns true if the
+ * step is running or deferred.
+ */
+bool RecoveryLadderT::startStep(RecoveryActionContextT & context, DeviceDataT & deviceData, int step) {
+  RecoveryActionT & action = *steps_.at(step);
+
+  if (action.start(context, deviceData)) {
+    if (currentStep_ == step && stepDeferred_) {
+      LOG(info) << "Recovery step '" << RecoveryActionTypeT::asStr(action.getType()) << "' of '" << deviceData.getIndiDeviceName() << "' is no longer held back - started." << std::endl;
+    }
+    currentStep_ = step;
+    stepCompleted_ = false;
+    stepDeferred_ = false;
+    stepStartTime_ = std::chrono::steady_clock::now();
+    return true;
+  }
+
+  if (action.isDeferred()) {
+    if (currentStep_ != step || ! stepDeferred_) {
+      LOG(info) << "Recovery step '" << RecoveryActionTypeT::asStr(action.getType()) << "' of '" << deviceData.getIndiDeviceName() << "' is held back for now - waiting." << std::endl;
+    }
+    currentStep_ = step;
+    stepDeferred_ = true;
+    return true;
+  }
+    
+  LOG(warning) << "Recovery step '" << RecoveryActionTypeT::asStr(action.getType()) << "' could not be started for '" << deviceData.getIndiDeviceName() << "'." << std::endl;
+  return false;
+}
+
+
+/**
+ * Starts the first applicable step at or above firstStep. Steps which
+ * cannot even be issued are skipped. Returns true if the started step
+ * requires an INDI client reset.
+ */
+bool RecoveryLadderT::startNextApplicableStep(RecoveryActionContextT & context, DeviceDataT & deviceData, int firstStep) {
+
+  for (int step = firstStep; step < static_cast<int>(steps_.size()); ++step) {
+    RecoveryActionT & action = *steps_.at(step);
+
+    if (! action.isApplicable(context, deviceData)) {
+      continue;
+    }
+
+    if (action.hasTimeout()) {
+      LOG(info) << "Recovery of '" << deviceData.getIndiDeviceName() << "' - step " << (step + 1) << "/" << steps_.size()
+		<< ": " << RecoveryActionTypeT::asStr(action.getType()) << " (timeout " << action.getTimeout().count() << " ms)." << std::endl;
+    }
+    else {
+      LOG(info) << "Recovery of '" << deviceData.getIndiDeviceName() << "' - step " << (step + 1) << "/" << steps_.size()
+		<< ": " << RecoveryActionTypeT::asStr(action.getType()) << " (no timeout)." << std::endl;
+    }
+
+    if (startStep(context, deviceData, step)) {
+      return (! stepDeferred_ && action.requiresClientReset());
+    }
+  }
+
+  LOG(warning) << "Recovery ladder of '" << deviceData.getIndiDeviceName() << "' exhausted - starting over with the next cycle." << std::endl;
+  
+  currentStep_ = -1;
+  stepDeferred_ = false;
+
+  return false;
+}
+
+
+bool RecoveryLadderT::process(RecoveryActionContextT & context, DeviceDataT & deviceData) {
+
+  if (! isActive()) {
+    return startNextApplicableStep(context, deviceData, 0);
+  }
+
+  RecoveryActionT & action = *steps_.at(currentStep_);
+
+  if (stepDeferred_) {
+    // E.g. a throttled INDI driver restart - escalating to a more drastic
+    // step would not respect the throttling.
+    if (startStep(context, deviceData, currentStep_)) {
+      return (! stepDeferred_ && action.requiresClientReset());
+    }
+    return startNextApplicableStep(context, deviceData, currentStep_ + 1);
+  }
+  
+  bool timedOut = isTimedOut(action);
+  RecoveryActionStatusT::TypeE status = (stepCompleted_ ? RecoveryActionStatusT::SUCCEEDED : action.poll(context, deviceData));
+
+  if (status == RecoveryActionStatusT::SUCCEEDED) {
+    if (! stepCompleted_) {
+      LOG(info) << "Recovery step '" << RecoveryActionTypeT::asStr(action.getType()) << "' of '" << deviceData.getIndiDeviceName() << "' completed - waiting for the device to become healthy." << std::endl;
+      stepCompleted_ = true;
+    }
+
+    // The ladder is reset once the device is healthy. Otherwise the step
+    // did not help and the next one is tried after its timeout - right
+    // away if it has none.
+    if (action.hasTimeout() && ! timedOut) {
+      return false;
+    }
+    
+    LOG(warning) << "Recovery step '" << RecoveryActionTypeT::asStr(action.getType()) << "' of '" << deviceData.getIndiDeviceName() << "' did not make the device healthy." << std::endl;
+  }
+  else if (status == RecoveryActionStatusT::IN_PROGRESS) {
+    if (! timedOut) {
+      return false;
+    }
+    
+    LOG(warning) << "Recovery step '" << RecoveryActionTypeT::asStr(action.getType()) << "' of '" << deviceData.getIndiDeviceName() << "' timed out." << std::endl;
+    action.abort();
+  }
+  else {
+    LOG(warning) << "Recovery step '" << RecoveryActionTypeT::asStr(action.getType()) << "' of '" << deviceData.getIndiDeviceName() << "' failed." << std::endl;
+  }
+
+  // Escalate
+  return startNextApplicableStep(context, deviceData, currentStep_ + 1);
+}
+
+
+void RecoveryLadderT::settle(RecoveryActionContextT & context, DeviceDataT & deviceData) {
+
+  if (! isActive()) {
+    return;
+  }
+
+  if (stepDeferred_) {
+    reset();
+    return;
+  }
+  
+  RecoveryActionT & action = *steps_.at(currentStep_);
+  RecoveryActionStatusT::TypeE status = (stepCompleted_ ? RecoveryActionStatusT::SUCCEEDED : action.poll(context, deviceData));
+  
+  if (status != RecoveryActionStatusT::IN_PROGRESS || isTimedOut(action)) {
+    reset();
+  }
+}
@@ -0,0 +1,85 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_RECOVERY_LADDER_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_RECOVERY_LADDER_H_ SOURCE_INDI_DEVICE_WATCHDOG_RECOVERY_LADDER_H_
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "recovery_action.h"
+
+/**
+ * Escalating sequence of recovery actions for one device. The cheap
+ * remedies come first. Each step gets its own timeout - if it fails or
+ * the device is not healthy again within the timeout, the next applicable
+ * step is started. A step which did its part (e.g. the restarted driver
+ * is back) keeps its position until the timeout. A step without timeout
+ * runs as long as it is in progress. Once all steps are exhausted the
+ * ladder starts over from the bottom.
+ *
+ * The ladder is reset by the watchdog as soon as the device is healthy.
+ */
+class RecoveryLadderT {
+ private:
+  std::vector<std::shared_ptr<RecoveryActionT> > steps_;
+  int currentStep_;
+  bool stepCompleted_; // The action reported success, but the device is not healthy yet
+  bool stepDeferred_; // The action may not be started yet - it is retried on each cycle
+  std::chrono::steady_clock::time_point stepStartTime_;
+
+  bool isTimedOut(const RecoveryActionT & action) const;
+  bool startStep(RecoveryActionContextT & context, DeviceDataT & deviceData, int step);
+  bool startNextApplicableStep(RecoveryActionContextT & context, DeviceDataT & deviceData, int firstStep);
+  
+ public:
+  RecoveryLadderT();
+  RecoveryLadderT(const std::vector<RecoveryStepConfigT> & stepConfigs, const RecoveryActionFactoryT & actionFactory);
+
+  bool isActive() const;
+  const RecoveryActionT * getCurrentAction() const;
+
+  /**
+   * Called on each cycle while the device needs recovery (i.e. is not
+   * healthy). Returns true if the INDI client has to be reset.
+   */
+  bool process(RecoveryActionContextT & context, DeviceDataT & deviceData);
+
+  /**
+   * Called on each cycle while the Linux device is absent. A running step
+   * is followed up until it finishes or times out, but no further step is
+   * started.
+   */
+  void settle(RecoveryActionContextT & context, DeviceDataT & deviceData);
+  
+  void reset();
+
+  static std::vector<RecoveryStepConfigT> getDefaultStepConfigs();
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_RECOVERY_LADDER_H_ */
@@ -0,0 +1,182 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include "recovery_timeline.h"
+
+
+DeviceRecoveryTimelineT::DeviceRecoveryTimelineT(std::chrono::milliseconds recoverySlo) : recoverySlo_(recoverySlo), lostEventTimeNs_(0), connectedEventTimeNs_(0), initialized_(false), healthy_(false), linuxDeviceExists_(false), awaitingAction_(false), awaitingConnection_(false), lastPlugInToConnected_(0), sloViolationCount_(0) {
+}
+
+
+int64_t DeviceRecoveryTimelineT::toNs(TimePointT timePoint) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(timePoint.time_since_epoch()).count();
+}
+
+
+DeviceRecoveryTimelineT::TimePointT DeviceRecoveryTimelineT::fromNs(int64_t timeNs) {
+  return TimePointT(std::chrono::duration_cast<TimePointT::duration>(std::chrono::nanoseconds(timeNs)));
+}
+
+
+void DeviceRecoveryTimelineT::reportLost(TimePointT time) {
+  lostEventTimeNs_ = toNs(time);
+}
+
+
+void DeviceRecoveryTimelineT::reportConnected(TimePointT time) {
+  connectedEventTimeNs_ = toNs(time);
+}
+
+
+bool DeviceRecoveryTimelineT::observe(bool healthy, bool linuxDeviceExists, TimePointT linuxDeviceChangeTime, bool indiDeviceConnected, TimePointT now) {
+  if (! initialized_) {
+    initialized_ = true;
+    healthy_ = healthy;
+    linuxDeviceExists_ = linuxDeviceExists;
+    healthySinceTime_ = now;
+    return false;
+  }
+
+  // Only events after the device became healthy can explain its loss
+  TimePointT healthySinceTime = healthySinceTime_;
+  auto isRecent = [healthySinceTime, now](TimePointT time) { return time > healthySinceTime && time <= now; };
+  
+  if (linuxDeviceExists && ! linuxDeviceExists_) {
+    plugInTime_ = (linuxDeviceChangeTime <= now ? linuxDeviceChangeTime : now);
+    awaitingConnection_ = true;
+  }
+  else if (! linuxDeviceExists) {
+    awaitingConnection_ = false;
+  }
+  
+  if (healthy_ && ! healthy) {
+    TimePointT lostTime = fromNs(lostEventTimeNs_);
+
+    if (! isRecent(lostTime)) {
+      lostTime = (! linuxDeviceExists && isRecent(linuxDeviceChangeTime) ? linuxDeviceChangeTime : now);
+    }
+    
+    detectionTime_ = now;
+    lossToDetection_.record(std::chrono::duration_cast<std::chrono::milliseconds>(now - lostTime));
+    awaitingAction_ = true;
+  }
+
+  bool sloViolated = false;
+  
+  if (awaitingConnection_ && indiDeviceConnected) {
+    TimePointT connectedTime = fromNs(connectedEventTimeNs_);
+
+    if (connectedTime < plugInTime_ || connectedTime > now) {
+      connectedTime = now;
+    }
+
+    lastPlugInToConnected_ = std::chrono::duration_cast<std::chrono::milliseconds>(connectedTime - plugInTime_);
+    plugInToConnected_.record(lastPlugInToConnected_);
+    awaitingConnection_ = false;
+
+    if (recoverySlo_.count() > 0 && lastPlugInToConnected_ > recoverySlo_) {
+      sloViolationCount_++;
+      sloViolated = true;
+    }
+  }
+
+  if (healthy) {
+    awaitingAction_ = false;
+
+    if (! healthy_) {
+      healthySinceTime_ = now;
+    }
+  }
+  
+  healthy_ = healthy;
+  linuxDeviceExists_ = linuxDeviceExists;
+  
+  return sloViolated;
+}
+
+
+void DeviceRecoveryTimelineT::recordAction(TimePointT now) {
+  if (awaitingAction_) {
+    detectionToAction_.record(std::chrono::duration_cast<std::chrono::milliseconds>(now - detectionTime_));
+    awaitingAction_ = false;
+  }
+}
+
+
+std::chrono::milliseconds DeviceRecoveryTimelineT::getRecoverySlo() const {
+  return recoverySlo_;
+}
+
+
+std::chrono::milliseconds DeviceRecoveryTimelineT::getLastPlugInToConnected() const {
+  return lastPlugInToConnected_;
+}
+
+
+unsigned long DeviceRecoveryTimelineT::getSloViolationCount() const {
+  return sloViolationCount_;
+}
+
+
+const LatencyHistogramT & DeviceRecoveryTimelineT::getLossToDetection() const {
+  return lossToDetection_;
+}
+
+
+const LatencyHistogramT & DeviceRecoveryTimelineT::getDetectionToAction() const {
+  return detectionToAction_;
+}
+
+
+const LatencyHistogramT & DeviceRecoveryTimelineT::getPlugInToConnected() const {
+  return plugInToConnected_;
+}
+
+
+void DeviceRecoveryTimelineT::resetCounters() {
+  lossToDetection_.reset();
+  detectionToAction_.reset();
+  plugInToConnected_.reset();
+  sloViolationCount_ = 0;
+}
+
+
+std::ostream &
+DeviceRecoveryTimelineT::printJson(std::ostream &os) const {
+  os << "{\"recoverySloMs\":" << recoverySlo_.count()
+     << ",\"sloViolations\":" << sloViolationCount_
+     << ",\"lossToDetection\":";
+  lossToDetection_.printJson(os);
+  os << ",\"detectionToAction\":";
+  detectionToAction_.printJson(os);
+  os << ",\"plugInToConnected\":";
+  plugInToConnected_.printJson(os);
+  os << "}";
+
+  return os;
+}
@@ -0,0 +1,111 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_RECOVERY_TIMELINE_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_RECOVERY_TIMELINE_H_ SOURCE_INDI_DEVICE_WATCHDOG_RECOVERY_TIMELINE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+#include "latency_histogram.h"
+
+/**
+ * Measures the recovery of a single device from event timestamps:
+ *
+ * - loss to detection: from the loss of the device (CONNECTION switched
+ *   off, INDI device removed or Linux device vanished) until a cycle
+ *   observed the device as unhealthy.
+ * - detection to action: from the detection until the first recovery
+ *   action (e.g. waiting for dependencies, debouncing or pausing).
+ * - plug-in to connected: from the Linux device (re-) appearing until the
+ *   INDI device reported CONNECTION=ON. This one has an SLO.
+ *
+ * The loss and connect events are reported by the INDI client thread, all
+ * other methods are called by the decision loop.
+ */
+class DeviceRecoveryTimelineT {
+ public:
+  typedef std::chrono::steady_clock::time_point TimePointT;
+
+ private:
+  std::chrono::milliseconds recoverySlo_;
+  
+  std::atomic<int64_t> lostEventTimeNs_;
+  std::atomic<int64_t> connectedEventTimeNs_;
+
+  bool initialized_;
+  bool healthy_;
+  bool linuxDeviceExists_;
+  bool awaitingAction_;
+  bool awaitingConnection_;
+  TimePointT healthySinceTime_;
+  TimePointT detectionTime_;
+  TimePointT plugInTime_;
+  
+  LatencyHistogramT lossToDetection_;
+  LatencyHistogramT detectionToAction_;
+  LatencyHistogramT plugInToConnected_;
+  std::chrono::milliseconds lastPlugInToConnected_;
+  unsigned long sloViolationCount_;
+
+  static int64_t toNs(TimePointT timePoint);
+  static TimePointT fromNs(int64_t timeNs);
+  
+ public:
+  explicit DeviceRecoveryTimelineT(std::chrono::milliseconds recoverySlo = std::chrono::milliseconds(0));
+
+  // Called by any thread
+  void reportLost(TimePointT time);
+  void reportConnected(TimePointT time);
+
+  /**
+   * Called for each observation of the device. The change time is the
+   * time the Linux device presence last changed (if known). Returns true
+   * if the device was plugged in and connected slower than the SLO.
+   */
+  bool observe(bool healthy, bool linuxDeviceExists, TimePointT linuxDeviceChangeTime, bool indiDeviceConnected, TimePointT now);
+
+  /**
+   * A recovery action was started for the device.
+   */
+  void recordAction(TimePointT now);
+
+  std::chrono::milliseconds getRecoverySlo() const;
+  std::chrono::milliseconds getLastPlugInToConnected() const;
+  unsigned long getSloViolationCount() const;
+  const LatencyHistogramT & getLossToDetection() const;
+  const LatencyHistogramT & getDetectionToAction() const;
+  const LatencyHistogramT & getPlugInToConnected() const;
+  void resetCounters();
+
+  std::ostream &printJson(std::ostream &os) const;
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_RECOVERY_TIMELINE_H_ */
@@ -0,0 +1,362 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+#include "logging.h"
+#include "remote_presence_client.h"
+
+
+// The agent sends a heartbeat every second
+static const std::chrono::milliseconds DefaultStaleTimeout(3000);
+static const std::chrono::milliseconds ConnectTimeout(3000);
+static const int PollIntervalMs = 200;
+
+
+RemotePresenceClientT::RemotePresenceClientT(const std::string & hostname, int port, const std::string & token, const std::vector<std::string> & linuxDeviceNames, const ReconnectPolicyT & reconnectPolicy) : hostname_(hostname), port_(port), token_(token), linuxDeviceNames_(linuxDeviceNames), reconnectPolicy_(reconnectPolicy), staleTimeout_(DefaultStaleTimeout), presences_(linuxDeviceNames.size()), synced_(false), stop_(false), socketFd_(-1), lastSequence_(0), connectCount_(0), resyncCount_(0), eventCount_(0) {
+  for (size_t idx = 0; idx < linuxDeviceNames_.size(); ++idx) {
+    linuxDeviceIndices_[linuxDeviceNames_[idx]] = idx;
+  }
+}
+
+
+RemotePresenceClientT::~RemotePresenceClientT() {
+  stop();
+}
+
+
+void RemotePresenceClientT::start() {
+  if (! clientThread_.joinable()) {
+    stop_ = false;
+    clientThread_ = std::thread(&RemotePresenceClientT::run, this);
+  }
+}
+
+
+void RemotePresenceClientT::stop() {
+  {
+    std::lock_guard<std::mutex> guard(clientMutex_);
+    stop_ = true;
+  }
+  clientCv_.notify_all();
+
+  if (clientThread_.joinable()) {
+    clientThread_.join();
+  }
+}
+
+
+/**
+ * Returns false if stop was requested.
+ */
+bool RemotePresenceClientT::sleepFor(std::chrono::milliseconds duration) {
+  std::unique_lock<std::mutex> lock(clientMutex_);
+  return ! clientCv_.wait_for(lock, duration, [this]() { return stop_; });
+}
+
+
+bool RemotePresenceClientT::openSocket() {
+  addrinfo hints;
+  memset(& hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  addrinfo * addrInfos = nullptr;
+  
+  if (getaddrinfo(hostname_.c_str(), std::to_string(port_).c_str(), & hints, & addrInfos) != 0 || addrInfos == nullptr) {
+    return false;
+  }
+
+  int fd = socket(addrInfos->ai_family, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+
+  if (fd < 0) {
+    freeaddrinfo(addrInfos);
+    return false;
+  }
+
+  int enable = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, & enable, sizeof(enable));
+  
+  int rc = connect(fd, addrInfos->ai_addr, addrInfos->ai_addrlen);
+  freeaddrinfo(addrInfos);
+
+  if (rc != 0 && errno == EINPROGRESS) {
+    pollfd pfd = { fd, POLLOUT, 0 };
+    int socketError = 0;
+    socklen_t socketErrorLen = sizeof(socketError);
+
+    rc = (poll(& pfd, 1, static_cast<int>(ConnectTimeout.count())) == 1
+	  && getsockopt(fd, SOL_SOCKET, SO_ERROR, & socketError, & socketErrorLen) == 0
+	  && socketError == 0) ? 0 : -1;
+  }
+
+  if (rc != 0) {
+    close(fd);
+    return false;
+  }
+
+  socketFd_ = fd;
+  frameReader_.reset();
+  
+  return true;
+}
+
+
+void RemotePresenceClientT::closeSocket() {
+  if (socketFd_ >= 0) {
+    close(socketFd_);
+    socketFd_ = -1;
+  }
+  synced_ = false;
+}
+
+
+bool RemotePresenceClientT::sendFrame(const std::string & frame) {
+  size_t sent = 0;
+
+  // The frames are small - waiting for the socket is the exception
+  while (sent < frame.size()) {
+    ssize_t n = send(socketFd_, frame.data() + sent, frame.size() - sent, MSG_NOSIGNAL);
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      pollfd pfd = { socketFd_, POLLOUT, 0 };
+
+      if (poll(& pfd, 1, static_cast<int>(ConnectTimeout.count())) != 1) {
+	return false;
+      }
+      continue;
+    }
+
+    if (n <= 0) {
+      return false;
+    }
+    sent += n;
+  }
+  return true;
+}
+
+
+/**
+ * Returns false if events were missed.
+ */
+bool RemotePresenceClientT::handleFrame(const presence_protocol::FrameT & frame) {
+  using namespace presence_protocol;
+
+  auto now = std::chrono::steady_clock::now();
+  
+  switch (frame.type) {
+  case FrameTypeT::SNAPSHOT: {
+    std::lock_guard<std::mutex> guard(presencesMutex_);
+    
+    for (const PresenceT & presence : frame.presences) {
+      if (presence.index < presences_.size()) {
+	presences_[presence.index].present = presence.present;
+	presences_[presence.index].changeTime = now - std::chrono::milliseconds(presence.msSinceChange);
+      }
+    }
+    lastSequence_ = frame.sequence;
+    synced_ = true;
+
+    LOG(info) << "Remote presence synced (sequence " << frame.sequence << ", " << frame.presences.size() << " Linux devices)." << std::endl;
+    return true;
+  }
+
+  case FrameTypeT::EVENTS: {
+    if (! synced_) {
+      // Waiting for the snapshot of a resync
+      return true;
+    }
+    
+    if (frame.sequence != lastSequence_ + 1) {
+      LOG(warning) << "Remote presence events " << frame.sequence << " - expected " << (lastSequence_ + 1) << "." << std::endl;
+      return false;
+    }
+    
+    std::lock_guard<std::mutex> guard(presencesMutex_);
+
+    for (const PresenceT & event : frame.presences) {
+      if (event.index < presences_.size()) {
+	presences_[event.index].present = event.present;
+	presences_[event.index].changeTime = now - std::chrono::milliseconds(event.msSinceChange);
+
+	LOG(debug) << "Remote Linux device '" << linuxDeviceNames_[event.index] << "' " << (event.present ? "appeared" : "vanished")
+		   << " " << event.msSinceChange << " ms ago." << std::endl;
+      }
+    }
+    lastSequence_ += frame.presences.size();
+    eventCount_ += frame.presences.size();
+    return true;
+  }
+
+  case FrameTypeT::HEARTBEAT:
+    if (synced_ && frame.sequence != lastSequence_) {
+      LOG(warning) << "Remote presence heartbeat at sequence " << frame.sequence << " - expected " << lastSequence_ << "." << std::endl;
+      return false;
+    }
+    return true;
+
+  default:
+    LOG(warning) << "Ignoring unexpected frame " << FrameTypeT::asStr(frame.type) << " from the presence agent." << std::endl;
+    return true;
+  }
+}
+
+
+void RemotePresenceClientT::serveConnection() {
+  if (! sendFrame(presence_protocol::encodeSubscribe(token_, linuxDeviceNames_))) {
+    return;
+  }
+
+  auto lastFrameTime = std::chrono::steady_clock::now();
+  
+  while (true) {
+    {
+      std::lock_guard<std::mutex> guard(clientMutex_);
+
+      if (stop_) {
+	return;
+      }
+    }
+    
+    pollfd pfd = { socketFd_, POLLIN, 0 };
+    int rc = poll(& pfd, 1, PollIntervalMs);
+
+    if (rc < 0 && errno != EINTR) {
+      return;
+    }
+
+    if (rc > 0) {
+      char buffer[4096];
+      ssize_t n = recv(socketFd_, buffer, sizeof(buffer), 0);
+
+      if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+	LOG(warning) << "Presence agent closed the connection." << std::endl;
+	return;
+      }
+
+      if (n > 0) {
+	frameReader_.append(buffer, n);
+	lastFrameTime = std::chrono::steady_clock::now();
+      }
+      
+      presence_protocol::FrameT frame;
+
+      while (frameReader_.next(frame)) {
+	if (! handleFrame(frame)) {
+	  resyncCount_++;
+	  synced_ = false;
+
+	  if (! sendFrame(presence_protocol::encodeResync())) {
+	    return;
+	  }
+	}
+      }
+
+      if (frameReader_.isCorrupt()) {
+	LOG(warning) << "Invalid frame from the presence agent." << std::endl;
+	return;
+      }
+    }
+
+    if (std::chrono::steady_clock::now() - lastFrameTime > staleTimeout_) {
+      LOG(warning) << "Presence agent silent for more than " << staleTimeout_.count() << " ms." << std::endl;
+      return;
+    }
+  }
+}
+
+
+void RemotePresenceClientT::run() {
+  do {
+    if (openSocket()) {
+      LOG(info) << "Connected to presence agent " << hostname_ << ":" << port_ << "." << std::endl;
+      
+      connectCount_++;
+      reconnectPolicy_.reset();
+      serveConnection();
+      closeSocket();
+    }
+    else {
+      LOG(debug) << "Cannot connect to presence agent " << hostname_ << ":" << port_ << "." << std::endl;
+    }
+  } while (sleepFor(reconnectPolicy_.nextDelay()));
+}
+
+
+bool RemotePresenceClientT::isSynced() const {
+  return synced_;
+}
+
+
+bool RemotePresenceClientT::isPresent(const std::string & linuxDeviceName) const {
+  bool present = false;
+  TimePointT changeTime;
+
+  return getPresence(linuxDeviceName, present, changeTime) && present;
+}
+
+
+bool RemotePresenceClientT::getPresence(const std::string & linuxDeviceName, bool & present, TimePointT & changeTime) const {
+  auto linuxDeviceIndexIt = linuxDeviceIndices_.find(linuxDeviceName);
+
+  if (linuxDeviceIndexIt == linuxDeviceIndices_.end()) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> guard(presencesMutex_);
+  const RemotePresenceT & presence = presences_.at(linuxDeviceIndexIt->second);
+
+  present = presence.present;
+  changeTime = presence.changeTime;
+  
+  return true;
+}
+
+
+unsigned long RemotePresenceClientT::getConnectCount() const {
+  return connectCount_;
+}
+
+
+unsigned long RemotePresenceClientT::getResyncCount() const {
+  return resyncCount_;
+}
+
+
+unsigned long RemotePresenceClientT::getEventCount() const {
+  return eventCount_;
+}
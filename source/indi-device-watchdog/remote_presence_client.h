@@ -0,0 +1,124 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_REMOTE_PRESENCE_CLIENT_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_REMOTE_PRESENCE_CLIENT_H_ SOURCE_INDI_DEVICE_WATCHDOG_REMOTE_PRESENCE_CLIENT_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "presence_protocol.h"
+#include "reconnect_policy.h"
+
+/**
+ * Receives the presence of the Linux devices from a presence agent on
+ * the device host (see PresenceAgentT). After each (re-) connect the
+ * client subscribes to its Linux devices and waits for the snapshot.
+ * Until then - or if the sequence numbers show a gap or the agent stays
+ * silent for too long - the presence is not "synced" and must not be
+ * acted on.
+ */
+class RemotePresenceClientT {
+ public:
+  typedef std::chrono::steady_clock::time_point TimePointT;
+
+ private:
+  struct RemotePresenceT {
+    bool present;
+    TimePointT changeTime;
+
+    RemotePresenceT() : present(false) {}
+  };
+  
+  std::string hostname_;
+  int port_;
+  std::string token_;
+  std::vector<std::string> linuxDeviceNames_;
+  std::map<std::string, size_t> linuxDeviceIndices_;
+  ReconnectPolicyT reconnectPolicy_;
+  std::chrono::milliseconds staleTimeout_;
+
+  std::vector<RemotePresenceT> presences_;
+  mutable std::mutex presencesMutex_;
+  std::atomic<bool> synced_;
+  
+  std::thread clientThread_;
+  std::mutex clientMutex_;
+  std::condition_variable clientCv_;
+  bool stop_;
+  int socketFd_;
+  presence_protocol::FrameReaderT frameReader_;
+  uint64_t lastSequence_;
+
+  std::atomic<unsigned long> connectCount_;
+  std::atomic<unsigned long> resyncCount_;
+  std::atomic<unsigned long> eventCount_;
+
+  bool openSocket();
+  void closeSocket();
+  bool sendFrame(const std::string & frame);
+  bool handleFrame(const presence_protocol::FrameT & frame);
+  void serveConnection();
+  void run();
+  bool sleepFor(std::chrono::milliseconds duration);
+
+  // We do not want copies
+  RemotePresenceClientT(const RemotePresenceClientT &);
+  RemotePresenceClientT &operator=(const RemotePresenceClientT &);
+  
+ public:
+  RemotePresenceClientT(const std::string & hostname, int port, const std::string & token, const std::vector<std::string> & linuxDeviceNames, const ReconnectPolicyT & reconnectPolicy);
+  ~RemotePresenceClientT();
+
+  void start();
+  void stop();
+
+  bool isSynced() const;
+
+  /**
+   * Last reported presence of the given Linux device (false if unknown).
+   */
+  bool isPresent(const std::string & linuxDeviceName) const;
+
+  /**
+   * Returns false if the given Linux device is not subscribed.
+   */
+  bool getPresence(const std::string & linuxDeviceName, bool & present, TimePointT & changeTime) const;
+
+  unsigned long getConnectCount() const;
+  unsigned long getResyncCount() const;
+  unsigned long getEventCount() const;
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_REMOTE_PRESENCE_CLIENT_H_ */
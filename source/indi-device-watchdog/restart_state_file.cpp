@@ -0,0 +1,216 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstddef>
+#include <cstring>
+#include <new>
+
+#include "logging.h"
+#include "restart_state_file.h"
+
+static const char sMagic[8] = { 'I', 'D', 'W', 'R', 'S', 'T', '0', '1' };
+static const uint32_t sVersion = 1;
+
+
+RestartStateFileT::RestartStateFileT(const std::string & filePath) : filePath_(filePath), fd_(-1), mapping_(MAP_FAILED), mappingSize_(sizeof(HeaderT) + MAX_DRIVERS * sizeof(SlotT)) {
+
+  if (! filePath_.empty()) {
+    fd_ = open(filePath_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    if (fd_ < 0) {
+      LOG(error) << "Cannot open restart state file '" << filePath_ << "': " << strerror(errno) << " - restart state is not persisted." << std::endl;
+    }
+    else if (ftruncate(fd_, mappingSize_) != 0) {
+      LOG(error) << "Cannot resize restart state file '" << filePath_ << "': " << strerror(errno) << " - restart state is not persisted." << std::endl;
+      close(fd_);
+      fd_ = -1;
+    }
+    else {
+      mapping_ = mmap(nullptr, mappingSize_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    }
+  }
+
+  if (mapping_ == MAP_FAILED) {
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+    mapping_ = mmap(nullptr, mappingSize_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  }
+
+  if (mapping_ == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  
+  if (memcmp(header()->magic, sMagic, sizeof(sMagic)) != 0 || header()->version != sVersion || header()->slotCount != MAX_DRIVERS) {
+    initialize();
+  }
+}
+
+RestartStateFileT::~RestartStateFileT() {
+  if (mapping_ != MAP_FAILED) {
+    if (fd_ >= 0) {
+      msync(mapping_, mappingSize_, MS_SYNC);
+    }
+    munmap(mapping_, mappingSize_);
+  }
+
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+
+RestartStateFileT::HeaderT * RestartStateFileT::header() const {
+  return static_cast<HeaderT *>(mapping_);
+}
+
+RestartStateFileT::SlotT * RestartStateFileT::slots() const {
+  return reinterpret_cast<SlotT *>(static_cast<char *>(mapping_) + sizeof(HeaderT));
+}
+
+
+void RestartStateFileT::initialize() {
+  memset(mapping_, 0, mappingSize_);
+
+  header()->version = sVersion;
+  header()->slotCount = MAX_DRIVERS;
+
+  // The magic is written last - a partially initialized file is invalid
+  memcpy(header()->magic, sMagic, sizeof(sMagic));
+
+  if (fd_ >= 0) {
+    msync(mapping_, mappingSize_, MS_ASYNC);
+  }
+}
+
+
+/**
+ * FNV-1a over the record (without seq and checksum).
+ */
+uint32_t RestartStateFileT::calcChecksum(const RecordT & record) {
+  const unsigned char * data = reinterpret_cast<const unsigned char *>(& record.driverName);
+  const size_t size = sizeof(RecordT) - offsetof(RecordT, driverName);
+  uint32_t hash = 2166136261u ^ record.seq;
+
+  for (size_t idx = 0; idx < size; ++idx) {
+    hash ^= data[idx];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+
+const RestartStateFileT::RecordT * RestartStateFileT::getValidCopy(const SlotT & slot) {
+  const RecordT * validCopy = nullptr;
+  
+  for (const RecordT & copy : slot.copies) {
+    if (copy.seq != 0 && copy.checksum == calcChecksum(copy) && (validCopy == nullptr || copy.seq > validCopy->seq)) {
+      validCopy = & copy;
+    }
+  }
+  return validCopy;
+}
+
+
+bool RestartStateFileT::isPersistent() const {
+  return fd_ >= 0;
+}
+
+
+bool RestartStateFileT::load(const std::string & driverName, DriverRestartStateT & state) const {
+  for (size_t slotIdx = 0; slotIdx < MAX_DRIVERS; ++slotIdx) {
+    const RecordT * record = getValidCopy(slots()[slotIdx]);
+
+    if (record != nullptr && strncmp(record->driverName, driverName.c_str(), sizeof(record->driverName)) == 0) {
+      state = record->state;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+bool RestartStateFileT::store(const std::string & driverName, const DriverRestartStateT & state) {
+  if (driverName.size() > MAX_DRIVER_NAME_LENGTH) {
+    return false;
+  }
+  
+  SlotT * targetSlot = nullptr;
+  const RecordT * currentRecord = nullptr;
+
+  // Slot of this driver - or the first free one
+  for (size_t slotIdx = 0; slotIdx < MAX_DRIVERS; ++slotIdx) {
+    const RecordT * record = getValidCopy(slots()[slotIdx]);
+
+    if (record == nullptr) {
+      if (targetSlot == nullptr) {
+	targetSlot = & slots()[slotIdx];
+      }
+    }
+    else if (strncmp(record->driverName, driverName.c_str(), sizeof(record->driverName)) == 0) {
+      targetSlot = & slots()[slotIdx];
+      currentRecord = record;
+      break;
+    }
+  }
+
+  if (targetSlot == nullptr) {
+    return false;
+  }
+
+  // Overwrite the copy which is not the current one
+  RecordT & copy = (currentRecord == & targetSlot->copies[0] ? targetSlot->copies[1] : targetSlot->copies[0]);
+  RecordT record;
+
+  memset(static_cast<void *>(& record), 0, sizeof(record));
+  record.seq = (currentRecord != nullptr ? currentRecord->seq + 1 : 1);
+  strncpy(record.driverName, driverName.c_str(), MAX_DRIVER_NAME_LENGTH);
+  record.state = state;
+  record.checksum = calcChecksum(record);
+
+  memcpy(static_cast<void *>(& copy), & record, sizeof(record));
+
+  if (fd_ >= 0) {
+    // Write back the page(s) of this record only
+    long pageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t start = reinterpret_cast<uintptr_t>(& copy) & ~(static_cast<uintptr_t>(pageSize) - 1);
+    uintptr_t end = reinterpret_cast<uintptr_t>(& copy) + sizeof(copy);
+    msync(reinterpret_cast<void *>(start), end - start, MS_ASYNC);
+  }
+  
+  return true;
+}
+
+
+void RestartStateFileT::clear() {
+  initialize();
+}
@@ -0,0 +1,116 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_RESTART_STATE_FILE_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_RESTART_STATE_FILE_H_ SOURCE_INDI_DEVICE_WATCHDOG_RESTART_STATE_FILE_H_
+
+#include <cstdint>
+#include <string>
+
+/**
+ * Restart history of one INDI driver.
+ */
+struct DriverRestartStateT {
+  uint32_t pendingRequestCount;      // Restart requests since the last restart
+  uint32_t totalRestartCount;
+  uint32_t consecutiveRestartCount;  // Restarts without the driver becoming healthy in between
+  uint32_t breakerOpen;
+  int64_t lastRestartTimeMs;         // Wall clock (ms since epoch)
+  int64_t nextAllowedRestartTimeMs;  // Wall clock (ms since epoch)
+
+  DriverRestartStateT() : pendingRequestCount(0), totalRestartCount(0), consecutiveRestartCount(0), breakerOpen(0), lastRestartTimeMs(0), nextAllowedRestartTimeMs(0) {}
+};
+
+
+/**
+ * Small memory mapped file which keeps the DriverRestartStateT of each
+ * INDI driver across restarts of the watchdog. The file consists of a
+ * header and a fixed number of slots. Each slot holds two copies of the
+ * record, each with a sequence number and a checksum. An update writes
+ * the older copy only - if the process dies in the middle, the other
+ * copy is still valid. Hence a record is updated in place without
+ * rewriting the file and loading it is just an mmap().
+ *
+ * With an empty path the records are kept in anonymous memory only.
+ */
+class RestartStateFileT {
+ public:
+  static const size_t MAX_DRIVERS = 64;
+  static const size_t MAX_DRIVER_NAME_LENGTH = 63;
+
+ private:
+  struct RecordT {
+    uint32_t seq;
+    uint32_t checksum;
+    char driverName[MAX_DRIVER_NAME_LENGTH + 1];
+    DriverRestartStateT state;
+  };
+
+  struct SlotT {
+    RecordT copies[2];
+  };
+
+  struct HeaderT {
+    char magic[8];
+    uint32_t version;
+    uint32_t slotCount;
+  };
+
+  std::string filePath_;
+  int fd_;
+  void * mapping_;
+  size_t mappingSize_;
+
+  HeaderT * header() const;
+  SlotT * slots() const;
+  static uint32_t calcChecksum(const RecordT & record);
+  static const RecordT * getValidCopy(const SlotT & slot);
+  void initialize();
+  
+ public:
+  explicit RestartStateFileT(const std::string & filePath);
+  ~RestartStateFileT();
+
+  RestartStateFileT(const RestartStateFileT &) = delete;
+  RestartStateFileT & operator=(const RestartStateFileT &) = delete;
+
+  bool isPersistent() const;
+  
+  /**
+   * Returns false if there is no record for the driver yet.
+   */
+  bool load(const std::string & driverName, DriverRestartStateT & state) const;
+  
+  /**
+   * Returns false if all slots are in use or the name is too long.
+   */
+  bool store(const std::string & driverName, const DriverRestartStateT & state);
+
+  void clear();
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_RESTART_STATE_FILE_H_ */
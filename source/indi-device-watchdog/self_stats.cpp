@@ -0,0 +1,83 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include <malloc.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "self_stats.h"
+
+
+SelfStatsT SelfStatsT::sample() {
+  SelfStatsT selfStats;
+  std::ifstream statusFile("/proc/self/status");
+  std::string line;
+
+  while (std::getline(statusFile, line)) {
+    if (line.compare(0, 6, "VmRSS:") == 0) {
+      selfStats.rssKb = std::stol(line.substr(6));
+    }
+    else if (line.compare(0, 8, "Threads:") == 0) {
+      selfStats.threadCount = std::stoul(line.substr(8));
+    }
+  }
+
+  std::error_code ec;
+  
+  for (auto it = std::filesystem::directory_iterator("/proc/self/fd", ec); ! ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+    selfStats.fdCount++;
+  }
+
+  // The directory iterator itself holds an fd while counting
+  if (selfStats.fdCount > 0) {
+    selfStats.fdCount--;
+  }
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  struct mallinfo2 mallocInfo = mallinfo2();
+  selfStats.heapInUseKb = static_cast<long>((mallocInfo.uordblks + mallocInfo.hblkhd) / 1024);
+#elif defined(__GLIBC__)
+  // The fields of mallinfo() overflow at 2 GB - good enough for the watchdog
+  struct mallinfo mallocInfo = mallinfo();
+  selfStats.heapInUseKb = static_cast<long>((static_cast<unsigned int>(mallocInfo.uordblks) + static_cast<unsigned int>(mallocInfo.hblkhd)) / 1024);
+#endif
+
+  return selfStats;
+}
+
+
+std::ostream &
+SelfStatsT::print(std::ostream &os) const {
+  os << "RSS: " << rssKb << " kB, heap in use: " << heapInUseKb << " kB, threads: " << threadCount << ", open fds: " << fdCount;
+  return os;
+}
+
+std::ostream &operator<<(std::ostream &os, const SelfStatsT &selfStats) {
+    return selfStats.print(os);
+}
@@ -0,0 +1,53 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_SELF_STATS_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_SELF_STATS_H_ SOURCE_INDI_DEVICE_WATCHDOG_SELF_STATS_H_
+
+#include <ostream>
+
+/**
+ * Resource usage of the watchdog process itself, sampled from /proc/self
+ * and the malloc statistics. Used by the periodic self-stats report and
+ * by the soak test to detect leaks.
+ */
+struct SelfStatsT {
+  long rssKb;
+  long heapInUseKb;
+  unsigned int threadCount;
+  unsigned int fdCount;
+
+  SelfStatsT() : rssKb(0), heapInUseKb(0), threadCount(0), fdCount(0) {}
+
+  static SelfStatsT sample();
+
+  std::ostream &print(std::ostream &os) const;
+  friend std::ostream &operator<<(std::ostream &os, const SelfStatsT &selfStats);
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_SELF_STATS_H_ */
@@ -0,0 +1,100 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#include <cstdio>
+#include <fstream>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#include "logging.h"
+#include "state_snapshot.h"
+
+namespace state_snapshot {
+
+  DeviceStateMapT load(const std::filesystem::path & snapshotFilePath) {
+    DeviceStateMapT deviceStates;
+
+    if (! std::filesystem::exists(snapshotFilePath)) {
+      return deviceStates;
+    }
+    
+    try {
+      boost::property_tree::ptree rootPt;
+      boost::property_tree::json_parser::read_json(snapshotFilePath.string(), rootPt);
+
+      for (const boost::property_tree::ptree::value_type & deviceNode : rootPt.get_child("devices")) {
+	const boost::property_tree::ptree & devicePt = deviceNode.second;
+	DeviceStateSnapshotT deviceState;
+	
+	deviceState.linuxDeviceExists = devicePt.get<bool>("linuxDeviceExists", false);
+	deviceState.indiDeviceExists = devicePt.get<bool>("indiDeviceExists", false);
+	deviceState.indiDeviceConnected = devicePt.get<bool>("indiDeviceConnected", false);
+
+	deviceStates[devicePt.get<std::string>("indiDeviceName")] = deviceState;
+      }
+    } catch (boost::property_tree::ptree_error & exc) {
+      LOG(warning) << "Ignoring invalid state snapshot '" << snapshotFilePath.string() << "': " << exc.what() << std::endl;
+      deviceStates.clear();
+    }
+    
+    return deviceStates;
+  }
+
+  
+  bool save(const DeviceStateMapT & deviceStates, const std::filesystem::path & snapshotFilePath) {
+    boost::property_tree::ptree rootPt;
+    boost::property_tree::ptree devicesPt;
+
+    for (const auto & deviceStateEntry : deviceStates) {
+      boost::property_tree::ptree devicePt;
+      devicePt.put<std::string>("indiDeviceName", deviceStateEntry.first);
+      devicePt.put<bool>("linuxDeviceExists", deviceStateEntry.second.linuxDeviceExists);
+      devicePt.put<bool>("indiDeviceExists", deviceStateEntry.second.indiDeviceExists);
+      devicePt.put<bool>("indiDeviceConnected", deviceStateEntry.second.indiDeviceConnected);
+
+      devicesPt.push_back(std::make_pair("", devicePt));
+    }
+    rootPt.add_child("devices", devicesPt);
+
+    std::filesystem::path tmpFilePath = snapshotFilePath;
+    tmpFilePath += ".tmp";
+    
+    try {
+      boost::property_tree::json_parser::write_json(tmpFilePath.string(), rootPt);
+    } catch (boost::property_tree::ptree_error & exc) {
+      LOG(warning) << "Cannot write state snapshot '" << tmpFilePath.string() << "': " << exc.what() << std::endl;
+      return false;
+    }
+
+    if (std::rename(tmpFilePath.c_str(), snapshotFilePath.c_str()) != 0) {
+      LOG(warning) << "Cannot rename state snapshot to '" << snapshotFilePath.string() << "'." << std::endl;
+      return false;
+    }
+    
+    return true;
+  }
+}
@@ -0,0 +1,68 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_STATE_SNAPSHOT_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_STATE_SNAPSHOT_H_ SOURCE_INDI_DEVICE_WATCHDOG_STATE_SNAPSHOT_H_
+
+#include <filesystem>
+#include <map>
+#include <string>
+
+/**
+ * Device states observed in the last cycle of the previous run. They are
+ * used at startup to know which INDI devices to expect.
+ */
+struct DeviceStateSnapshotT {
+  bool linuxDeviceExists;
+  bool indiDeviceExists;
+  bool indiDeviceConnected;
+
+  DeviceStateSnapshotT() : linuxDeviceExists(false), indiDeviceExists(false), indiDeviceConnected(false) {}
+
+  bool operator==(const DeviceStateSnapshotT & other) const {
+    return linuxDeviceExists == other.linuxDeviceExists && indiDeviceExists == other.indiDeviceExists && indiDeviceConnected == other.indiDeviceConnected;
+  }
+  bool operator!=(const DeviceStateSnapshotT & other) const { return ! (*this == other); }
+};
+
+namespace state_snapshot {
+
+  typedef std::map<std::string /*INDI device name*/, DeviceStateSnapshotT> DeviceStateMapT;
+
+  /**
+   * Returns an empty map if there is no (valid) snapshot.
+   */
+  DeviceStateMapT load(const std::filesystem::path & snapshotFilePath);
+
+  /**
+   * Writes to a temporary file which is then renamed so that a crash never
+   * leaves a partially written snapshot behind.
+   */
+  bool save(const DeviceStateMapT & deviceStates, const std::filesystem::path & snapshotFilePath);
+}
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_STATE_SNAPSHOT_H_ */
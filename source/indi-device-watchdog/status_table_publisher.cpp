@@ -0,0 +1,184 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+#include <new>
+
+#include "logging.h"
+#include "status_table_publisher.h"
+
+
+StatusTablePublisherT::StatusTablePublisherT(const std::string & name, const std::map<std::string, std::string> & indiDriverNames) : name_(name), table_(nullptr) {
+  using namespace indi_device_watchdog_status;
+  
+  if (indiDriverNames.size() > MaxDevices) {
+    LOG(warning) << "Status table only has room for " << MaxDevices << " devices." << std::endl;
+  }
+  
+  // Readers which still map the table of a previous run keep their (stale)
+  // copy - they notice it by the heartbeat.
+  shm_unlink(name_.c_str());
+  
+  int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+
+  if (fd < 0) {
+    LOG(error) << "Cannot create status table '" << name_ << "': " << strerror(errno) << std::endl;
+    return;
+  }
+
+  void * mapping = MAP_FAILED;
+  
+  if (ftruncate(fd, sizeof(TableT)) == 0) {
+    mapping = mmap(nullptr, sizeof(TableT), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+
+  if (mapping == MAP_FAILED) {
+    LOG(error) << "Cannot map status table '" << name_ << "': " << strerror(errno) << std::endl;
+    shm_unlink(name_.c_str());
+    return;
+  }
+
+  memset(mapping, 0, sizeof(TableT));
+  table_ = new (mapping) TableT();
+
+  uint32_t slotIdx = 0;
+  int64_t now = getWallClockTimeMs();
+  
+  for (auto it = indiDriverNames.begin(); it != indiDriverNames.end() && slotIdx < MaxDevices; ++it, ++slotIdx) {
+    DeviceSlotT & slot = table_->slots[slotIdx];
+    
+    strncpy(slot.indiDeviceName, it->first.c_str(), MaxNameLength - 1);
+    strncpy(slot.indiDriverName, it->second.c_str(), MaxNameLength - 1);
+    slot.state.store(IndiDeviceWatchdogDeviceStateT::UNKNOWN, std::memory_order_relaxed);
+    slot.lastChangeTimeMs.store(now, std::memory_order_relaxed);
+    slot.connectLatencyUs.store(-1, std::memory_order_relaxed);
+    
+    slotIndices_[it->first] = slotIdx;
+  }
+
+  table_->header.version = Version;
+  table_->header.deviceCount = slotIdx;
+  table_->header.writerPid = getpid();
+  table_->header.heartbeatTimeMs.store(now, std::memory_order_relaxed);
+
+  // The magic marks the table as valid
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(table_->header.magic, Magic, sizeof(Magic));
+
+  LOG(debug) << "Created status table '" << name_ << "' with " << slotIdx << " devices (" << sizeof(TableT) << " bytes)." << std::endl;
+}
+
+
+StatusTablePublisherT::~StatusTablePublisherT() {
+  if (table_ != nullptr) {
+    munmap(table_, sizeof(indi_device_watchdog_status::TableT));
+    shm_unlink(name_.c_str());
+  }
+}
+
+
+bool StatusTablePublisherT::isOpen() const {
+  return table_ != nullptr;
+}
+
+
+int64_t StatusTablePublisherT::getWallClockTimeMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+
+IndiDeviceWatchdogDeviceStateT::TypeE StatusTablePublisherT::getDeviceState(const DeviceStatusT & deviceStatus) {
+  if (deviceStatus.paused) {
+    return IndiDeviceWatchdogDeviceStateT::PAUSED;
+  }
+  if (deviceStatus.quarantined) {
+    return IndiDeviceWatchdogDeviceStateT::QUARANTINED;
+  }
+  if (deviceStatus.healthy) {
+    return IndiDeviceWatchdogDeviceStateT::HEALTHY;
+  }
+  if (! deviceStatus.linuxDeviceExists) {
+    return IndiDeviceWatchdogDeviceStateT::LINUX_DEVICE_MISSING;
+  }
+  if (! deviceStatus.indiDeviceExists) {
+    return IndiDeviceWatchdogDeviceStateT::INDI_DEVICE_MISSING;
+  }
+  return IndiDeviceWatchdogDeviceStateT::DISCONNECTED;
+}
+
+
+void StatusTablePublisherT::publish(const WatchdogStatusT & status) {
+  if (table_ == nullptr) {
+    return;
+  }
+
+  int64_t now = getWallClockTimeMs();
+  
+  for (const DeviceStatusT & deviceStatus : status.devices) {
+    auto slotIdxIt = slotIndices_.find(deviceStatus.indiDeviceName);
+
+    if (slotIdxIt == slotIndices_.end()) {
+      continue;
+    }
+
+    indi_device_watchdog_status::DeviceSlotT & slot = table_->slots[slotIdxIt->second];
+    uint32_t state = getDeviceState(deviceStatus);
+    bool stateChanged = (slot.state.load(std::memory_order_relaxed) != state);
+
+    if (! stateChanged
+	&& slot.driverRestartCount.load(std::memory_order_relaxed) == deviceStatus.driverRestartCount
+	&& slot.connectLatencyUs.load(std::memory_order_relaxed) == deviceStatus.connectLatencyUs) {
+      continue;
+    }
+
+    // Sequence lock - odd while the slot is written
+    uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+    slot.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.state.store(state, std::memory_order_relaxed);
+    slot.driverRestartCount.store(deviceStatus.driverRestartCount, std::memory_order_relaxed);
+    slot.connectLatencyUs.store(deviceStatus.connectLatencyUs, std::memory_order_relaxed);
+
+    if (stateChanged) {
+      slot.lastChangeTimeMs.store(now, std::memory_order_relaxed);
+    }
+    
+    slot.seq.store(seq + 2, std::memory_order_release);
+  }
+
+  table_->header.indiServerConnected.store(status.indiServerConnected ? 1 : 0, std::memory_order_relaxed);
+  table_->header.heartbeatTimeMs.store(now, std::memory_order_release);
+}
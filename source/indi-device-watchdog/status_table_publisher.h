@@ -0,0 +1,68 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_STATUS_TABLE_PUBLISHER_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_STATUS_TABLE_PUBLISHER_H_ SOURCE_INDI_DEVICE_WATCHDOG_STATUS_TABLE_PUBLISHER_H_
+
+#include <map>
+#include <string>
+
+#include "indi_device_watchdog_status.h"
+#include "watchdog_status.h"
+
+/**
+ * Writes the status of the devices into the shared memory status table
+ * (see indi_device_watchdog_status.h). Each device gets a fixed slot.
+ * A slot is only rewritten if its content changed.
+ */
+class StatusTablePublisherT {
+ private:
+  std::string name_;
+  indi_device_watchdog_status::TableT * table_;
+  std::map<std::string /*device name*/, uint32_t /*slot*/> slotIndices_;
+
+  static int64_t getWallClockTimeMs();
+  static IndiDeviceWatchdogDeviceStateT::TypeE getDeviceState(const DeviceStatusT & deviceStatus);
+
+  // We do not want copies
+  StatusTablePublisherT(const StatusTablePublisherT &);
+  StatusTablePublisherT &operator=(const StatusTablePublisherT &);
+  
+ public:
+  /**
+   * Creates the table for the given devices (device name -> driver name).
+   * A table of a previous run is replaced.
+   */
+  StatusTablePublisherT(const std::string & name, const std::map<std::string, std::string> & indiDriverNames);
+  ~StatusTablePublisherT();
+
+  bool isOpen() const;
+  void publish(const WatchdogStatusT & status);
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_STATUS_TABLE_PUBLISHER_H_ */
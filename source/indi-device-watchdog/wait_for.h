@@ -31,8 +31,8 @@
 #include <chrono>
 #include <thread>
 #include <functional>
-#include <sstream>
 #include <stdexcept>
+#include <string>
 
 static void wait_for(const std::function<bool()> &conditionToWaitFor, std::chrono::milliseconds maxWaitMillis) {
 
@@ -55,10 +55,7 @@ static void wait_for(const std::function<bool()> &conditionToWaitFor, std::chron
     } while (!conditionToWaitFor() && !hitTimeout);
 
     if (hitTimeout) {
-        std::stringstream ss;
-        ss << "Hit timeout after '" << maxWaitMillis.count() << "' ms."
-           << std::endl;
-        throw std::runtime_error(ss.str());
+        throw std::runtime_error("Hit timeout after '" + std::to_string(maxWaitMillis.count()) + "' ms.");
     }
 }
 
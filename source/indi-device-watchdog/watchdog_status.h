@@ -0,0 +1,130 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_WATCHDOG_STATUS_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_WATCHDOG_STATUS_H_ SOURCE_INDI_DEVICE_WATCHDOG_WATCHDOG_STATUS_H_
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "driver_process_monitor.h"
+#include "hook_executor.h"
+#include "self_stats.h"
+
+/**
+ * State of a single device at the end of a watchdog cycle.
+ */
+struct DeviceStatusT {
+  std::string indiDeviceName;
+  std::string indiDriverName;
+  bool linuxDeviceExists;
+  bool indiDeviceExists;
+  bool indiDeviceConnected;
+  bool healthy;
+  bool paused;
+  bool quarantined;
+  unsigned long presenceChangeCount;
+  unsigned int driverRestartCount;
+  bool breakerOpen;
+  int64_t connectLatencyUs; // Duration of the last successful connect request (-1 = unknown)
+  unsigned long sloViolationCount; // Plug-in to connected took longer than the recovery SLO
+  int64_t plugInToConnectedP50Ms;
+  int64_t plugInToConnectedP99Ms;
+  bool busy; // Exposing, slewing, moving, ...
+  bool actionDeferred; // The recovery waits for a busy coupled device
+  unsigned long deferredActionCount;
+  unsigned long framesSaved; // Exposures of coupled devices completed while a recovery was deferred
+  std::string staleProperty; // Liveness property which is not updated or stuck in busy (empty if none)
+  DriverProcessStatsT driverProcess; // Only sampled if driver process monitoring is enabled
+  unsigned long preemptiveRestartCount; // Restarts of the INDI driver because of its resource usage
+  std::string failedMessagePattern; // Failure message reported since the INDI device was connected (empty if none)
+  unsigned long failureMessageCount;
+
+  DeviceStatusT() : linuxDeviceExists(false), indiDeviceExists(false), indiDeviceConnected(false), healthy(false), paused(false), quarantined(false), presenceChangeCount(0), driverRestartCount(0), breakerOpen(false), connectLatencyUs(-1), sloViolationCount(0), plugInToConnectedP50Ms(0), plugInToConnectedP99Ms(0), busy(false), actionDeferred(false), deferredActionCount(0), framesSaved(0), preemptiveRestartCount(0), failureMessageCount(0) {}
+};
+
+
+/**
+ * Immutable status of the watchdog. A new one is published after each
+ * cycle - readers never wait for the decision loop.
+ */
+struct WatchdogStatusT {
+  std::chrono::steady_clock::time_point time;
+  unsigned long cycleCount;
+  bool indiServerConnected;
+  bool healthy; // Connected and all devices which are not paused are healthy
+  unsigned long reconnectCount;
+  unsigned long driverReplayFailureCount; // Supervisor mode: failed replays of the driver starts
+  HookExecutorStatsT hookStats;
+  SelfStatsT selfStats; // Last sample of the self-stats report (if enabled)
+  std::vector<DeviceStatusT> devices;
+
+  WatchdogStatusT() : cycleCount(0), indiServerConnected(false), healthy(false), reconnectCount(0), driverReplayFailureCount(0) {}
+};
+
+
+/**
+ * A command received via the control socket. It is executed by the
+ * decision loop at the beginning of the next cycle.
+ */
+struct ControlCommandT {
+  struct TypeT {
+    typedef enum {
+      RESTART_DRIVER,
+      PAUSE,
+      RESUME,
+      RESET_COUNTERS,
+      _Count
+    } TypeE;
+
+    static const char *asStr(const TypeE &inType) {
+      switch (inType) {
+      case RESTART_DRIVER:
+	return "RESTART_DRIVER";
+      case PAUSE:
+	return "PAUSE";
+      case RESUME:
+	return "RESUME";
+      case RESET_COUNTERS:
+	return "RESET_COUNTERS";
+      default:
+	return "<?>";
+      }
+    }
+  };
+
+  TypeT::TypeE type;
+  std::string indiDeviceName; // Empty = all devices (pause / resume)
+  std::string indiDriverName;
+
+  ControlCommandT() : type(TypeT::RESET_COUNTERS) {}
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_WATCHDOG_STATUS_H_ */
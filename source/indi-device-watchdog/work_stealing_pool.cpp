@@ -0,0 +1,175 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#include "realtime.h"
+#include "work_stealing_pool.h"
+
+
+WorkStealingPoolT::WorkStealingPoolT(unsigned int numThreads) : queuedTaskCount_(0), pendingTaskCount_(0), nextQueue_(0), stop_(false), executedTaskCount_(0), stolenTaskCount_(0) {
+
+  for (unsigned int i = 0; i < numThreads; ++i) {
+    queues_.push_back(std::make_unique<WorkerQueueT>());
+    queues_.back()->tasks.reserve(InitialQueueCapacity);
+  }
+  
+  for (unsigned int i = 0; i < numThreads; ++i) {
+    workers_.emplace_back(&WorkStealingPoolT::runWorker, this, i);
+  }
+}
+
+WorkStealingPoolT::~WorkStealingPoolT() {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stop_ = true;
+  }
+  workAvailableCv_.notify_all();
+
+  for (std::thread & worker : workers_) {
+    worker.join();
+  }
+}
+
+
+void WorkStealingPoolT::submit(TaskT task) {
+  if (workers_.empty()) {
+    task();
+    executedTaskCount_++;
+    return;
+  }
+
+  // Counted before the task is published - otherwise a worker may pop
+  // it and decrement the counters first
+  std::unique_lock<std::mutex> lock(mutex_);
+  unsigned int queueIdx = nextQueue_;
+  nextQueue_ = (nextQueue_ + 1) % queues_.size();
+  queuedTaskCount_++;
+  pendingTaskCount_++;
+  lock.unlock();
+
+  {
+    std::lock_guard<std::mutex> queueGuard(queues_[queueIdx]->mutex);
+    queues_[queueIdx]->tasks.push_back(std::move(task));
+  }
+
+  workAvailableCv_.notify_one();
+}
+
+
+void WorkStealingPoolT::waitIdle() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idleCv_.wait(lock, [this]() { return pendingTaskCount_ == 0; });
+}
+
+
+bool WorkStealingPoolT::setSchedulingPolicy(const std::string & policy, int priority) {
+  bool success = true;
+  
+  for (std::thread & worker : workers_) {
+    success = realtime::setSchedulingPolicy(worker.native_handle(), policy, priority) && success;
+  }
+
+  return success;
+}
+
+
+bool WorkStealingPoolT::popTask(unsigned int workerIdx, TaskT & task) {
+  // Own queue first (LIFO)...
+  {
+    WorkerQueueT & ownQueue = *queues_[workerIdx];
+    std::lock_guard<std::mutex> queueGuard(ownQueue.mutex);
+
+    if (! ownQueue.empty()) {
+      task = std::move(ownQueue.tasks.back());
+      ownQueue.tasks.pop_back();
+      ownQueue.shrink();
+      return true;
+    }
+  }
+
+  // ...then steal the oldest task of another worker (FIFO)
+  for (size_t offset = 1; offset < queues_.size(); ++offset) {
+    WorkerQueueT & otherQueue = *queues_[(workerIdx + offset) % queues_.size()];
+    std::lock_guard<std::mutex> queueGuard(otherQueue.mutex);
+
+    if (! otherQueue.empty()) {
+      task = std::move(otherQueue.tasks[otherQueue.head++]);
+      otherQueue.shrink();
+      stolenTaskCount_++;
+      return true;
+    }
+  }
+  
+  return false;
+}
+
+
+void WorkStealingPoolT::runWorker(unsigned int workerIdx) {
+  while(true) {
+    TaskT task;
+    
+    if (popTask(workerIdx, task)) {
+      {
+	std::lock_guard<std::mutex> guard(mutex_);
+	queuedTaskCount_--;
+      }
+      
+      task();
+      executedTaskCount_++;
+
+      bool idle;
+      {
+	std::lock_guard<std::mutex> guard(mutex_);
+	idle = (--pendingTaskCount_ == 0);
+      }
+
+      if (idle) {
+	idleCv_.notify_all();
+      }
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    workAvailableCv_.wait(lock, [this]() { return stop_ || queuedTaskCount_ > 0; });
+
+    if (stop_ && queuedTaskCount_ == 0) {
+      return;
+    }
+  }
+}
+
+
+unsigned int WorkStealingPoolT::getNumThreads() const {
+  return workers_.size();
+}
+
+unsigned long WorkStealingPoolT::getExecutedTaskCount() const {
+  return executedTaskCount_;
+}
+
+unsigned long WorkStealingPoolT::getStolenTaskCount() const {
+  return stolenTaskCount_;
+}
@@ -0,0 +1,114 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+#ifndef SOURCE_INDI_DEVICE_WATCHDOG_WORK_STEALING_POOL_H_
+#define SOURCE_INDI_DEVICE_WATCHDOG_WORK_STEALING_POOL_H_ SOURCE_INDI_DEVICE_WATCHDOG_WORK_STEALING_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Small thread pool where each worker has its own task queue. Tasks are
+ * distributed round robin. A worker takes tasks from the back of its own
+ * queue and - once that is empty - steals from the front of the queues
+ * of the other workers. Hence a single slow task (e.g. a hanging
+ * filesystem check) does not delay the tasks queued behind it.
+ *
+ * With zero threads submitted tasks are executed directly by the caller.
+ */
+class WorkStealingPoolT {
+ public:
+  typedef std::function<void()> TaskT;
+
+ private:
+  // A queue only grows beyond this if more tasks are queued at once
+  static const size_t InitialQueueCapacity = 32;
+
+  /**
+   * Tasks [head, tasks.size()) are queued. Once drained the vector is
+   * cleared - its storage is reused, so steady-state submits do not
+   * allocate (a deque allocates a new block every few push_back()s).
+   */
+  struct WorkerQueueT {
+    std::mutex mutex;
+    std::vector<TaskT> tasks;
+    size_t head = 0;
+
+    bool empty() const { return head == tasks.size(); }
+    void shrink() { if (empty()) { tasks.clear(); head = 0; } }
+  };
+
+  std::vector<std::unique_ptr<WorkerQueueT>> queues_;
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable workAvailableCv_;
+  std::condition_variable idleCv_;
+  size_t queuedTaskCount_;
+  size_t pendingTaskCount_;
+  unsigned int nextQueue_;
+  bool stop_;
+  
+  std::atomic<unsigned long> executedTaskCount_;
+  std::atomic<unsigned long> stolenTaskCount_;
+
+  bool popTask(unsigned int workerIdx, TaskT & task);
+  void runWorker(unsigned int workerIdx);
+  
+ public:
+  explicit WorkStealingPoolT(unsigned int numThreads);
+  ~WorkStealingPoolT();
+
+  WorkStealingPoolT(const WorkStealingPoolT &) = delete;
+  WorkStealingPoolT & operator=(const WorkStealingPoolT &) = delete;
+
+  void submit(TaskT task);
+
+  /**
+   * Blocks until all submitted tasks have been executed.
+   */
+  void waitIdle();
+
+  /**
+   * Runs all worker threads with the given real-time scheduling policy
+   * (see realtime::setSchedulingPolicy()). Otherwise a real-time thread
+   * waiting in waitIdle() would depend on workers which may starve.
+   */
+  bool setSchedulingPolicy(const std::string & policy, int priority);
+
+  unsigned int getNumThreads() const;
+  unsigned long getExecutedTaskCount() const;
+  unsigned long getStolenTaskCount() const;
+};
+
+#endif /* SOURCE_INDI_DEVICE_WATCHDOG_WORK_STEALING_POOL_H_ */
@@ -0,0 +1,161 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#define BOOST_TEST_MODULE decision_loop_allocation_test
+#include <boost/test/included/unit_test.hpp>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "allocation_counter.h"
+#include "fake_devices.h"
+#include "fake_indi_server.h"
+#include "indi_device_watchdog.h"
+#include "logging.h"
+
+
+/**
+ * A watchdog which monitors the given number of devices of a fake INDI
+ * server - all of them connected and healthy.
+ */
+struct HealthyDevicesFixtureT {
+  FakeIndiServerT indiServer;
+  std::vector<DeviceDataT> devices;
+
+  explicit HealthyDevicesFixtureT(unsigned int deviceCount) {
+    LoggingT::init(logging::trivial::warning, false /*console*/, false /*log file*/);
+    
+    devices = addFakeDevices(indiServer, deviceCount);
+  }
+
+  std::unique_ptr<IndiDeviceWatchdogT> createWatchdog(unsigned int evaluationThreadCount) const {
+    return std::make_unique<IndiDeviceWatchdogT>("127.0.0.1", indiServer.getPort(), 5, devices, "/usr/bin", "/nonexistent/indiserverFIFO",
+						 RecoveryActionFactoryT(), ReconnectPolicyT(), std::chrono::milliseconds(1000), std::chrono::milliseconds(3000),
+						 evaluationThreadCount);
+  }
+};
+
+
+static void checkSteadyStateDoesNotAllocate(unsigned int deviceCount, unsigned int evaluationThreadCount) {
+  // Otherwise 0 allocations would be reported in any case
+  BOOST_REQUIRE(allocation_counter::isEnabled());
+
+  HealthyDevicesFixtureT fixture(deviceCount);
+  BOOST_REQUIRE(fixture.indiServer.getPort() > 0);
+
+  auto watchdog = fixture.createWatchdog(evaluationThreadCount);
+
+  // Warm-up: both status buffers are filled, all lazily created state exists
+  BOOST_REQUIRE(watchdog->runCycles(10));
+
+  std::shared_ptr<const WatchdogStatusT> status = watchdog->getStatus();
+  BOOST_REQUIRE(status != nullptr);
+  BOOST_REQUIRE_EQUAL(status->devices.size(), deviceCount);
+  BOOST_CHECK(status->healthy);
+  status.reset();
+
+  uint64_t allocationCount = 0;
+
+  for (unsigned int cycle = 0; cycle < 200; ++cycle) {
+    BOOST_REQUIRE(watchdog->runCycles(1));
+    allocationCount += watchdog->getLastCycleAllocationCount();
+  }
+
+  BOOST_CHECK_EQUAL(allocationCount, 0U);
+  BOOST_CHECK_EQUAL(fixture.indiServer.getConnectRequestCount("Fake CCD Simulator 0"), 0U);
+}
+
+
+BOOST_AUTO_TEST_CASE(thread_counter_only_counts_own_thread) {
+  // Starting a thread allocates in the starting thread - so only let
+  // the already running thread allocate in between the measurements.
+  std::atomic<bool> allocate(false);
+  std::atomic<bool> allocated(false);
+
+  std::thread otherThread([& allocate, & allocated]() {
+    while (! allocate) {
+      std::this_thread::yield();
+    }
+    std::unique_ptr<int> value = std::make_unique<int>(42);
+    allocated = true;
+  });
+
+  uint64_t threadCountBefore = allocation_counter::getThreadAllocationCount();
+  uint64_t processCountBefore = allocation_counter::getAllocationCount();
+
+  allocate = true;
+
+  while (! allocated) {
+    std::this_thread::yield();
+  }
+  
+  uint64_t threadCountAfterOtherThread = allocation_counter::getThreadAllocationCount();
+  uint64_t processCountAfterOtherThread = allocation_counter::getAllocationCount();
+
+  std::unique_ptr<int> value = std::make_unique<int>(42);
+  uint64_t threadCountAfterOwnAllocation = allocation_counter::getThreadAllocationCount();
+
+  otherThread.join();
+
+  BOOST_CHECK_EQUAL(threadCountAfterOtherThread, threadCountBefore);
+  BOOST_CHECK_GT(processCountAfterOtherThread, processCountBefore);
+  BOOST_CHECK_EQUAL(threadCountAfterOwnAllocation, threadCountBefore + 1);
+}
+
+
+BOOST_AUTO_TEST_CASE(steady_state_cycle_does_not_allocate_inline_evaluation) {
+  checkSteadyStateDoesNotAllocate(4, 0);
+}
+
+
+BOOST_AUTO_TEST_CASE(steady_state_cycle_does_not_allocate_with_evaluation_threads) {
+  checkSteadyStateDoesNotAllocate(4, 2);
+}
+
+
+BOOST_AUTO_TEST_CASE(held_status_is_not_overwritten) {
+  HealthyDevicesFixtureT fixture(2);
+  auto watchdog = fixture.createWatchdog(0);
+
+  BOOST_REQUIRE(watchdog->runCycles(3));
+
+  // A reader holds on to a status while further cycles are published
+  std::shared_ptr<const WatchdogStatusT> heldStatus = watchdog->getStatus();
+  unsigned long heldCycleCount = heldStatus->cycleCount;
+
+  BOOST_REQUIRE(watchdog->runCycles(5));
+
+  BOOST_CHECK_EQUAL(heldStatus->cycleCount, heldCycleCount);
+  BOOST_CHECK_EQUAL(heldStatus->devices.size(), 2U);
+  BOOST_CHECK_EQUAL(watchdog->getStatus()->cycleCount, heldCycleCount + 5);
+  BOOST_CHECK(watchdog->getStatus() != heldStatus);
+
+}
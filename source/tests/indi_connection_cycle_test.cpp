@@ -0,0 +1,220 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#define BOOST_TEST_MODULE indi_connection_cycle_test
+#include <boost/test/included/unit_test.hpp>
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "fake_indi_server.h"
+#include "indi_client.h"
+#include "indi_connection_cycle.h"
+#include "logging.h"
+
+using namespace std::chrono_literals;
+
+
+/**
+ * An INDI client connected to a fake INDI server with one device.
+ */
+struct ConnectedClientFixtureT {
+  const std::string indiDeviceName = "Fake CCD Simulator";
+  FakeIndiServerT indiServer;
+  IndiClientT client;
+
+  ConnectedClientFixtureT() {
+    LoggingT::init(logging::trivial::warning, false /*console*/, false /*log file*/);
+    
+    indiServer.addDevice(indiDeviceName, true);
+
+    client.setServer("127.0.0.1", indiServer.getPort());
+    client.connect();
+    BOOST_REQUIRE(client.waitForConnection(5s));
+
+    auto deadline = std::chrono::steady_clock::now() + 5s;
+
+    while (! hasConnectionProperty() && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(1ms);
+    }
+    BOOST_REQUIRE(hasConnectionProperty());
+  }
+
+  bool hasConnectionProperty() {
+#if INDI_MAJOR_VERSION < 2
+    INDI::BaseDevice * baseDevice = client.getDevice(indiDeviceName.c_str());
+    return (baseDevice != nullptr && baseDevice->getSwitch("CONNECTION") != nullptr);
+#else
+    return client.getDevice(indiDeviceName.c_str()).getSwitch("CONNECTION").isValid();
+#endif
+  }
+
+  /**
+   * Sets the switch with the callback API - the future gets the result.
+   */
+  std::future<IndiOperationResultT::TypeE> setSwitch(const std::string & elementName, std::chrono::milliseconds timeout = 5s) {
+    auto result = std::make_shared<std::promise<IndiOperationResultT::TypeE> >();
+    
+    BOOST_REQUIRE(client.setSwitch(indiDeviceName, "CONNECTION", elementName, timeout, [result](IndiOperationResultT::TypeE operationResult) {
+      result->set_value(operationResult);
+    }));
+    return result->get_future();
+  }
+};
+
+
+BOOST_FIXTURE_TEST_SUITE(indi_client_operations, ConnectedClientFixtureT)
+
+BOOST_AUTO_TEST_CASE(element_which_is_on_is_not_sent) {
+  std::future<IndiOperationResultT::TypeE> result = setSwitch("CONNECT");
+
+  BOOST_REQUIRE(result.wait_for(0s) == std::future_status::ready);
+  BOOST_CHECK_EQUAL(result.get(), IndiOperationResultT::ALREADY_SET);
+  BOOST_CHECK_EQUAL(client.getPendingOperationCount(), 0U);
+
+  std::this_thread::sleep_for(50ms);
+  BOOST_CHECK_EQUAL(indiServer.getConnectRequestCount(indiDeviceName), 0U);
+}
+
+
+BOOST_AUTO_TEST_CASE(repeated_state_does_not_resolve_operation) {
+  indiServer.setAnswerDelay(300ms);
+  auto startTime = std::chrono::steady_clock::now();
+  
+  std::future<IndiOperationResultT::TypeE> result = setSwitch("DISCONNECT");
+
+  // The driver repeats its (old) state while it is busy
+  std::this_thread::sleep_for(50ms);
+  indiServer.sendUpdate(indiDeviceName, "Ok");
+  
+  BOOST_CHECK(result.wait_for(100ms) == std::future_status::timeout);
+  BOOST_REQUIRE(result.wait_for(5s) == std::future_status::ready);
+  BOOST_CHECK_EQUAL(result.get(), IndiOperationResultT::SUCCEEDED);
+  BOOST_CHECK(std::chrono::steady_clock::now() - startTime >= 300ms);
+  BOOST_CHECK(! indiServer.isConnected(indiDeviceName));
+}
+
+
+BOOST_AUTO_TEST_CASE(rejected_change_fails) {
+  indiServer.setRefuseConnect(indiDeviceName, true);
+
+  std::future<IndiOperationResultT::TypeE> disconnectResult = setSwitch("DISCONNECT");
+  BOOST_REQUIRE(disconnectResult.wait_for(5s) == std::future_status::ready);
+  BOOST_CHECK_EQUAL(disconnectResult.get(), IndiOperationResultT::SUCCEEDED);
+  
+  std::future<IndiOperationResultT::TypeE> connectResult = setSwitch("CONNECT");
+  BOOST_REQUIRE(connectResult.wait_for(5s) == std::future_status::ready);
+  BOOST_CHECK_EQUAL(connectResult.get(), IndiOperationResultT::FAILED);
+}
+
+
+#ifdef INDI_DEVICE_WATCHDOG_HAVE_COROUTINES
+
+BOOST_AUTO_TEST_CASE(connection_cycle_connects_after_disconnect_was_confirmed) {
+  indiServer.setAnswerDelay(200ms);
+  
+  auto result = std::make_shared<std::promise<IndiOperationResultT::TypeE> >();
+  std::future<IndiOperationResultT::TypeE> resultFuture = result->get_future();
+
+  cycleIndiDeviceConnection(client, indiDeviceName, 5s, [result](IndiOperationResultT::TypeE operationResult) {
+    result->set_value(operationResult);
+  });
+
+  // The disconnect is still busy - no connect yet
+  std::this_thread::sleep_for(100ms);
+  BOOST_CHECK_EQUAL(indiServer.getDisconnectRequestCount(indiDeviceName), 1U);
+  BOOST_CHECK_EQUAL(indiServer.getConnectRequestCount(indiDeviceName), 0U);
+
+  BOOST_REQUIRE(resultFuture.wait_for(5s) == std::future_status::ready);
+  BOOST_CHECK_EQUAL(resultFuture.get(), IndiOperationResultT::SUCCEEDED);
+  BOOST_CHECK_EQUAL(indiServer.getConnectRequestCount(indiDeviceName), 1U);
+  BOOST_CHECK(indiServer.isConnected(indiDeviceName));
+  BOOST_CHECK_EQUAL(client.getPendingOperationCount(), 0U);
+}
+
+
+BOOST_AUTO_TEST_CASE(connection_cycle_reports_refused_connect) {
+  indiServer.setRefuseConnect(indiDeviceName, true);
+  
+  auto result = std::make_shared<std::promise<IndiOperationResultT::TypeE> >();
+  std::future<IndiOperationResultT::TypeE> resultFuture = result->get_future();
+
+  cycleIndiDeviceConnection(client, indiDeviceName, 5s, [result](IndiOperationResultT::TypeE operationResult) {
+    result->set_value(operationResult);
+  });
+
+  BOOST_REQUIRE(resultFuture.wait_for(5s) == std::future_status::ready);
+  BOOST_CHECK_EQUAL(resultFuture.get(), IndiOperationResultT::FAILED);
+  BOOST_CHECK(! indiServer.isConnected(indiDeviceName));
+}
+
+
+BOOST_AUTO_TEST_CASE(connection_cycle_of_unknown_device_is_not_sent) {
+  IndiOperationResultT::TypeE result = IndiOperationResultT::SUCCEEDED;
+
+  // Completes right away - nothing to wait for
+  cycleIndiDeviceConnection(client, "Unknown device", 5s, [& result](IndiOperationResultT::TypeE operationResult) {
+    result = operationResult;
+  });
+
+  BOOST_CHECK_EQUAL(result, IndiOperationResultT::NOT_SENT);
+  BOOST_CHECK_EQUAL(indiServer.getDisconnectRequestCount(indiDeviceName), 0U);
+}
+
+
+BOOST_AUTO_TEST_CASE(connection_cycle_is_cancelled_with_the_client) {
+  indiServer.setAnswerDelay(1s);
+  
+  auto connectionCycleClient = std::make_unique<IndiClientT>();
+  connectionCycleClient->setServer("127.0.0.1", indiServer.getPort());
+  connectionCycleClient->connect();
+  BOOST_REQUIRE(connectionCycleClient->waitForConnection(5s));
+  std::this_thread::sleep_for(100ms);
+  
+  IndiOperationResultT::TypeE result = IndiOperationResultT::SUCCEEDED;
+  bool completed = false;
+
+  cycleIndiDeviceConnection(*connectionCycleClient, indiDeviceName, 5s, [& result, & completed](IndiOperationResultT::TypeE operationResult) {
+    result = operationResult;
+    completed = true;
+  });
+
+  // The suspended coroutine is resumed by the destructor
+  connectionCycleClient.reset();
+
+  BOOST_CHECK(completed);
+  BOOST_CHECK_EQUAL(result, IndiOperationResultT::CANCELLED);
+  BOOST_CHECK_EQUAL(indiServer.getConnectRequestCount(indiDeviceName), 0U);
+}
+
+#endif /* INDI_DEVICE_WATCHDOG_HAVE_COROUTINES */
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,190 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#define BOOST_TEST_MODULE message_pattern_matcher_test
+#include <boost/test/included/unit_test.hpp>
+
+#include <string>
+#include <vector>
+
+#include "message_pattern_matcher.h"
+
+
+static int match(const MessagePatternMatcherT & matcher, const std::string & text, int owner) {
+  return matcher.match(text.data(), text.size(), owner);
+}
+
+
+BOOST_AUTO_TEST_CASE(empty_matcher_matches_nothing) {
+  MessagePatternMatcherT matcher;
+
+  BOOST_CHECK(matcher.empty());
+  BOOST_CHECK_EQUAL(match(matcher, "Error reading from port", -1), -1);
+  BOOST_CHECK_EQUAL(match(matcher, "", 0), -1);
+}
+
+
+BOOST_AUTO_TEST_CASE(finds_pattern_anywhere_in_text) {
+  MessagePatternMatcherT matcher;
+  int errorId = matcher.addPattern("Error reading from port", -1);
+  matcher.compile();
+
+  BOOST_CHECK(! matcher.empty());
+  BOOST_CHECK_EQUAL(match(matcher, "Error reading from port", 0), errorId);
+  BOOST_CHECK_EQUAL(match(matcher, "2026-10-19T01:23:45: [ERROR] Error reading from port /dev/ttyUSB0", 0), errorId);
+  BOOST_CHECK_EQUAL(match(matcher, "Error reading from por", 0), -1);
+  BOOST_CHECK_EQUAL(match(matcher, "Error reading frXom port", 0), -1);
+  BOOST_CHECK_EQUAL(matcher.getPattern(errorId), "Error reading from port");
+}
+
+
+BOOST_AUTO_TEST_CASE(folds_case_of_letters_only) {
+  MessagePatternMatcherT matcher;
+  int errorId = matcher.addPattern("Error reading from port", -1);
+  int upperId = matcher.addPattern("USB TRANSFER FAILED", -1);
+  int bracketId = matcher.addPattern("[x]", -1);
+  matcher.compile();
+
+  BOOST_CHECK_EQUAL(match(matcher, "ERROR READING FROM PORT", 0), errorId);
+  BOOST_CHECK_EQUAL(match(matcher, "error Reading FROM pOrT", 0), errorId);
+  BOOST_CHECK_EQUAL(match(matcher, "libusb: usb transfer failed (-7)", 0), upperId);
+  BOOST_CHECK_EQUAL(match(matcher, "state [X]", 0), bracketId);
+
+  // '{' and '[' differ by 0x20 like 'a' and 'A' - they must not be folded
+  BOOST_CHECK_EQUAL(match(matcher, "state {x}", 0), -1);
+}
+
+
+BOOST_AUTO_TEST_CASE(finds_overlapping_patterns) {
+  MessagePatternMatcherT matcher;
+  int heId = matcher.addPattern("he", -1);
+  int sheId = matcher.addPattern("she", -1);
+  int hisId = matcher.addPattern("his", -1);
+  matcher.addPattern("hers", -1);
+  matcher.compile();
+
+  // "she" and its suffix "he" end at the same byte - the longer one wins
+  BOOST_CHECK_EQUAL(match(matcher, "ushers", 0), sheId);
+  BOOST_CHECK_EQUAL(match(matcher, "xhe", 0), heId);
+
+  // Found via the failure links - "hi" is left for "his"
+  BOOST_CHECK_EQUAL(match(matcher, "ahis", 0), hisId);
+  BOOST_CHECK_EQUAL(match(matcher, "hhis", 0), hisId);
+
+  // The first pattern which ends in the text is reported
+  BOOST_CHECK_EQUAL(match(matcher, "hishers", 0), hisId);
+
+  // A pattern found only after a partial match of another one
+  MessagePatternMatcherT otherMatcher;
+  int portId = otherMatcher.addPattern("port error", -1);
+  int ignoredId = otherMatcher.addPattern("errors ignored", -1);
+  otherMatcher.compile();
+
+  BOOST_CHECK_EQUAL(match(otherMatcher, "port errport error", 0), portId);
+  BOOST_CHECK_EQUAL(match(otherMatcher, "port errors ignored", 0), portId);
+  BOOST_CHECK_EQUAL(match(otherMatcher, "port erro errors ignored", 0), ignoredId);
+}
+
+
+BOOST_AUTO_TEST_CASE(handles_bytes_outside_of_the_patterns) {
+  MessagePatternMatcherT matcher;
+  int errorId = matcher.addPattern("error", -1);
+  matcher.compile();
+
+  std::string text = "\xff\x01\x80 erro\xffr error\n";
+  
+  BOOST_CHECK_EQUAL(match(matcher, text, 0), errorId);
+  BOOST_CHECK_EQUAL(match(matcher, std::string("erro\0r", 6), 0), -1);
+}
+
+
+BOOST_AUTO_TEST_CASE(matches_patterns_of_the_owner_only) {
+  MessagePatternMatcherT matcher;
+  int portId = matcher.addPattern("Error reading from port", 0);
+  int usbId = matcher.addPattern("USB transfer failed", 1);
+  int timeoutId = matcher.addPattern("timeout", -1);
+  matcher.compile();
+
+  BOOST_CHECK_EQUAL(match(matcher, "Error reading from port", 0), portId);
+  BOOST_CHECK_EQUAL(match(matcher, "Error reading from port", 1), -1);
+  BOOST_CHECK_EQUAL(match(matcher, "USB transfer failed", 1), usbId);
+  BOOST_CHECK_EQUAL(match(matcher, "USB transfer failed", 0), -1);
+
+  // Patterns of all owners apply to unknown owners as well
+  BOOST_CHECK_EQUAL(match(matcher, "Exposure TIMEOUT", 0), timeoutId);
+  BOOST_CHECK_EQUAL(match(matcher, "Exposure TIMEOUT", 1), timeoutId);
+  BOOST_CHECK_EQUAL(match(matcher, "Exposure TIMEOUT", -1), timeoutId);
+  BOOST_CHECK_EQUAL(match(matcher, "Error reading from port", -1), -1);
+
+  // A pattern of another owner does not hide a later one of the own owner
+  BOOST_CHECK_EQUAL(match(matcher, "Error reading from port, USB transfer failed", 1), usbId);
+}
+
+
+BOOST_AUTO_TEST_CASE(shared_suffix_of_different_owners) {
+  MessagePatternMatcherT matcher;
+  int longId = matcher.addPattern("cannot read port", 0);
+  int shortId = matcher.addPattern("read port", 1);
+  matcher.compile();
+
+  // Both end at the same byte - each owner gets its own pattern
+  BOOST_CHECK_EQUAL(match(matcher, "ccd: cannot read port", 0), longId);
+  BOOST_CHECK_EQUAL(match(matcher, "ccd: cannot read port", 1), shortId);
+  BOOST_CHECK_EQUAL(match(matcher, "ccd: cannot read port", 2), -1);
+}
+
+
+BOOST_AUTO_TEST_CASE(owner_names_map_to_sorted_indices) {
+  MessagePatternMatcherT matcher;
+  matcher.setOwnerNames({ "indi_qhy_ccd", "indi_asi_ccd", "indi_qhy_ccd", "indi_eqmod_telescope" });
+
+  BOOST_CHECK_EQUAL(matcher.getOwner("indi_asi_ccd"), 0);
+  BOOST_CHECK_EQUAL(matcher.getOwner("indi_eqmod_telescope"), 1);
+  BOOST_CHECK_EQUAL(matcher.getOwner("indi_qhy_ccd"), 2);
+  BOOST_CHECK_EQUAL(matcher.getOwner("indi_unknown"), -1);
+  BOOST_CHECK_EQUAL(matcher.getOwner(""), -1);
+
+  int qhyId = matcher.addPattern("QHYCCD|SetQHYCCDParam failed", matcher.getOwner("indi_qhy_ccd"));
+  matcher.compile();
+
+  BOOST_CHECK_EQUAL(match(matcher, "qhyccd|setqhyccdparam FAILED", matcher.getOwner("indi_qhy_ccd")), qhyId);
+  BOOST_CHECK_EQUAL(match(matcher, "qhyccd|setqhyccdparam FAILED", matcher.getOwner("indi_asi_ccd")), -1);
+}
+
+
+BOOST_AUTO_TEST_CASE(recompile_picks_up_new_patterns) {
+  MessagePatternMatcherT matcher;
+  int firstId = matcher.addPattern("first", -1);
+  matcher.compile();
+  int secondId = matcher.addPattern("second", -1);
+
+  BOOST_CHECK_EQUAL(match(matcher, "second", 0), -1);
+  matcher.compile();
+  BOOST_CHECK_EQUAL(match(matcher, "second", 0), secondId);
+  BOOST_CHECK_EQUAL(match(matcher, "first", 0), firstId);
+}
@@ -0,0 +1,462 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+
+#define BOOST_TEST_MODULE presence_agent_test
+#include <boost/test/included/unit_test.hpp>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logging.h"
+#include "presence_agent.h"
+#include "presence_protocol.h"
+#include "reconnect_policy.h"
+#include "remote_presence_client.h"
+
+namespace fs = std::filesystem;
+
+static const std::string Token = "secret";
+static const std::chrono::milliseconds SampleInterval(10);
+
+
+static bool waitUntil(const std::function<bool()> & condition, std::chrono::milliseconds timeout = std::chrono::seconds(10)) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+
+  while (! condition()) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return true;
+}
+
+
+static int openLoopbackSocket(int port, bool listening) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_in addr;
+  memset(& addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  int rc = (listening ? bind(fd, reinterpret_cast<sockaddr *>(& addr), sizeof(addr)) || listen(fd, 4)
+	    : connect(fd, reinterpret_cast<sockaddr *>(& addr), sizeof(addr)));
+
+  if (rc != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+
+static int getLocalPort(int fd) {
+  sockaddr_in addr;
+  socklen_t addrLen = sizeof(addr);
+  getsockname(fd, reinterpret_cast<sockaddr *>(& addr), & addrLen);
+
+  return ntohs(addr.sin_port);
+}
+
+
+/**
+ * A port nobody listens on - the agent binds it with SO_REUSEADDR.
+ */
+static int findFreePort() {
+  int fd = openLoopbackSocket(0, true);
+  int port = getLocalPort(fd);
+  close(fd);
+
+  return port;
+}
+
+
+/**
+ * Returns true if the peer closed the connection within the timeout.
+ */
+static bool isClosedByPeer(int fd, std::chrono::milliseconds timeout = std::chrono::seconds(5)) {
+  pollfd pfd = { fd, POLLIN, 0 };
+  char buffer[256];
+
+  return (poll(& pfd, 1, static_cast<int>(timeout.count())) == 1 && recv(fd, buffer, sizeof(buffer), 0) == 0);
+}
+
+
+/**
+ * Runs a presence agent on its own thread on the loopback interface.
+ */
+class AgentThreadT {
+ private:
+  PresenceAgentT agent_;
+  std::thread thread_;
+
+ public:
+  AgentThreadT(int port, const fs::path & deviceRoot) : agent_("127.0.0.1", port, SampleInterval, Token, deviceRoot.string()) {
+    thread_ = std::thread([this]() { agent_.run(); });
+  }
+  
+  ~AgentThreadT() {
+    agent_.stop();
+    thread_.join();
+  }
+};
+
+
+/**
+ * Sits between the client and the agent. Records the frames of the agent
+ * and drops EVENTS frames on request - which leaves a sequence gap.
+ */
+class FrameProxyT {
+ private:
+  int listenFd_;
+  int agentPort_;
+  std::atomic<bool> stop_;
+  std::thread thread_;
+
+  mutable std::mutex mutex_;
+  std::vector<presence_protocol::FrameT> agentFrames_;
+  unsigned int dropEventFrameCount_;
+
+  void run() {
+    while (! stop_) {
+      pollfd pfd = { listenFd_, POLLIN, 0 };
+
+      if (poll(& pfd, 1, 50) != 1) {
+	continue;
+      }
+
+      int clientFd = accept(listenFd_, nullptr, nullptr);
+      int agentFd = openLoopbackSocket(agentPort_, false);
+
+      if (clientFd >= 0 && agentFd >= 0) {
+	forward(clientFd, agentFd);
+      }
+      
+      close(clientFd);
+      close(agentFd);
+    }
+  }
+
+  void forward(int clientFd, int agentFd) {
+    std::string agentBuffer;
+    
+    while (! stop_) {
+      pollfd pfds[2] = { { clientFd, POLLIN, 0 }, { agentFd, POLLIN, 0 } };
+
+      if (poll(pfds, 2, 50) <= 0) {
+	continue;
+      }
+
+      char buffer[4096];
+      
+      if (pfds[0].revents != 0) {
+	ssize_t n = recv(clientFd, buffer, sizeof(buffer), 0);
+
+	if (n <= 0 || send(agentFd, buffer, n, MSG_NOSIGNAL) != n) {
+	  return;
+	}
+      }
+
+      if (pfds[1].revents != 0) {
+	ssize_t n = recv(agentFd, buffer, sizeof(buffer), 0);
+
+	if (n <= 0) {
+	  return;
+	}
+	agentBuffer.append(buffer, n);
+
+	if (! forwardAgentFrames(clientFd, agentBuffer)) {
+	  return;
+	}
+      }
+    }
+  }
+
+  bool forwardAgentFrames(int clientFd, std::string & agentBuffer) {
+    using namespace presence_protocol;
+    
+    while (agentBuffer.size() >= HeaderSize) {
+      size_t payloadSize = 0;
+
+      for (size_t idx = 0; idx < 4; ++idx) {
+	payloadSize = (payloadSize << 8) | static_cast<uint8_t>(agentBuffer[idx]);
+      }
+
+      if (agentBuffer.size() < HeaderSize + payloadSize) {
+	return true;
+      }
+
+      std::string rawFrame = agentBuffer.substr(0, HeaderSize + payloadSize);
+      agentBuffer.erase(0, HeaderSize + payloadSize);
+
+      FrameReaderT frameReader;
+      FrameT frame;
+      frameReader.append(rawFrame.data(), rawFrame.size());
+      frameReader.next(frame);
+
+      bool drop;
+      {
+	std::lock_guard<std::mutex> guard(mutex_);
+	agentFrames_.push_back(frame);
+	drop = (frame.type == FrameTypeT::EVENTS && dropEventFrameCount_ > 0);
+
+	if (drop) {
+	  dropEventFrameCount_--;
+	}
+      }
+
+      if (! drop && send(clientFd, rawFrame.data(), rawFrame.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(rawFrame.size())) {
+	return false;
+      }
+    }
+    return true;
+  }
+  
+ public:
+  explicit FrameProxyT(int agentPort) : listenFd_(openLoopbackSocket(0, true)), agentPort_(agentPort), stop_(false), dropEventFrameCount_(0) {
+    thread_ = std::thread(&FrameProxyT::run, this);
+  }
+
+  ~FrameProxyT() {
+    stop_ = true;
+    thread_.join();
+    close(listenFd_);
+  }
+
+  int getPort() const {
+    return getLocalPort(listenFd_);
+  }
+
+  void dropEventFrames(unsigned int count) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    dropEventFrameCount_ = count;
+  }
+
+  std::vector<presence_protocol::FrameT> getAgentFrames(presence_protocol::FrameTypeT::TypeE type) const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    std::vector<presence_protocol::FrameT> frames;
+
+    for (const presence_protocol::FrameT & frame : agentFrames_) {
+      if (frame.type == type) {
+	frames.push_back(frame);
+      }
+    }
+    return frames;
+  }
+};
+
+
+/**
+ * Linux devices in a temporary device root. The camera and the focuser
+ * hang off one "bus" directory - renaming it removes both at once.
+ */
+struct PresenceFixtureT {
+  fs::path deviceRoot;
+  fs::path busPath;
+  std::string cameraPath;
+  std::string focuserPath;
+  std::string filterWheelPath;
+  std::string outsidePath;
+  std::vector<std::string> paths;
+
+  PresenceFixtureT() {
+    LoggingT::init(logging::trivial::error, false /*console*/, false /*log file*/);
+
+    deviceRoot = fs::temp_directory_path() / ("presence_agent_test_" + std::to_string(getpid()));
+    busPath = deviceRoot / "bus";
+    cameraPath = (busPath / "camera").string();
+    focuserPath = (busPath / "focuser").string();
+    filterWheelPath = (deviceRoot / "filter_wheel").string();
+
+    // Exists, but is not below the device root
+    outsidePath = (deviceRoot.string() + "_outside");
+
+    fs::create_directories(busPath);
+    std::ofstream(cameraPath).put('\n');
+    std::ofstream(focuserPath).put('\n');
+    std::ofstream(outsidePath).put('\n');
+
+    paths = { cameraPath, focuserPath, filterWheelPath, outsidePath };
+  }
+
+  ~PresenceFixtureT() {
+    std::error_code ec;
+    fs::remove_all(deviceRoot, ec);
+    fs::remove(outsidePath, ec);
+  }
+
+  void unplugBus() {
+    fs::rename(busPath, deviceRoot / "bus_unplugged");
+  }
+
+  std::unique_ptr<RemotePresenceClientT> createClient(int port) const {
+    auto client = std::make_unique<RemotePresenceClientT>("127.0.0.1", port, Token, paths,
+							  ReconnectPolicyT(std::chrono::milliseconds(10), std::chrono::milliseconds(100), 2.0, 0.0));
+    client->start();
+    return client;
+  }
+};
+
+
+BOOST_FIXTURE_TEST_CASE(initial_snapshot_reports_the_current_presence, PresenceFixtureT) {
+  int port = findFreePort();
+  AgentThreadT agent(port, deviceRoot);
+  auto client = createClient(port);
+
+  BOOST_REQUIRE(waitUntil([&]() { return client->isSynced(); }));
+
+  BOOST_CHECK(client->isPresent(cameraPath));
+  BOOST_CHECK(client->isPresent(focuserPath));
+  BOOST_CHECK(! client->isPresent(filterWheelPath));
+  BOOST_CHECK(! client->isPresent(outsidePath));
+  BOOST_CHECK(! client->isPresent("/not/subscribed"));
+  BOOST_CHECK_EQUAL(client->getConnectCount(), 1U);
+  BOOST_CHECK_EQUAL(client->getEventCount(), 0U);
+}
+
+
+BOOST_FIXTURE_TEST_CASE(changes_of_one_sample_are_sent_in_one_batch, PresenceFixtureT) {
+  using namespace presence_protocol;
+  
+  int agentPort = findFreePort();
+  AgentThreadT agent(agentPort, deviceRoot);
+  FrameProxyT proxy(agentPort);
+  auto client = createClient(proxy.getPort());
+
+  BOOST_REQUIRE(waitUntil([&]() { return client->isSynced(); }));
+
+  unplugBus();
+
+  BOOST_REQUIRE(waitUntil([&]() { return ! client->isPresent(cameraPath) && ! client->isPresent(focuserPath); }));
+
+  std::vector<FrameT> eventFrames = proxy.getAgentFrames(FrameTypeT::EVENTS);
+  
+  BOOST_REQUIRE_EQUAL(eventFrames.size(), 1U);
+  BOOST_CHECK_EQUAL(eventFrames[0].sequence, 1U);
+  BOOST_REQUIRE_EQUAL(eventFrames[0].presences.size(), 2U);
+  BOOST_CHECK(! eventFrames[0].presences[0].present);
+  BOOST_CHECK(! eventFrames[0].presences[1].present);
+  BOOST_CHECK_EQUAL(client->getEventCount(), 2U);
+  BOOST_CHECK(client->isSynced());
+}
+
+
+BOOST_FIXTURE_TEST_CASE(sequence_gap_is_resolved_by_a_resync, PresenceFixtureT) {
+  using namespace presence_protocol;
+  
+  int agentPort = findFreePort();
+  AgentThreadT agent(agentPort, deviceRoot);
+  FrameProxyT proxy(agentPort);
+  auto client = createClient(proxy.getPort());
+
+  BOOST_REQUIRE(waitUntil([&]() { return client->isSynced(); }));
+
+  // The next heartbeat reveals the lost events
+  proxy.dropEventFrames(1);
+  unplugBus();
+
+  BOOST_REQUIRE(waitUntil([&]() { return client->getResyncCount() == 1 && client->isSynced(); }));
+
+  BOOST_CHECK(! client->isPresent(cameraPath));
+  BOOST_CHECK(! client->isPresent(focuserPath));
+  BOOST_CHECK_EQUAL(client->getEventCount(), 0U);
+  BOOST_CHECK_EQUAL(client->getConnectCount(), 1U);
+
+  std::vector<FrameT> snapshotFrames = proxy.getAgentFrames(FrameTypeT::SNAPSHOT);
+
+  BOOST_REQUIRE_EQUAL(snapshotFrames.size(), 2U);
+  BOOST_CHECK_EQUAL(snapshotFrames[1].sequence, 2U);
+}
+
+
+BOOST_FIXTURE_TEST_CASE(client_reconnects_after_the_agent_restarted, PresenceFixtureT) {
+  int port = findFreePort();
+  auto agent = std::make_unique<AgentThreadT>(port, deviceRoot);
+  auto client = createClient(port);
+
+  BOOST_REQUIRE(waitUntil([&]() { return client->isSynced(); }));
+
+  agent.reset();
+
+  BOOST_REQUIRE(waitUntil([&]() { return ! client->isSynced(); }));
+
+  // Changed while nobody watched - reported by the snapshot
+  unplugBus();
+  agent = std::make_unique<AgentThreadT>(port, deviceRoot);
+
+  BOOST_REQUIRE(waitUntil([&]() { return client->isSynced(); }));
+
+  BOOST_CHECK_EQUAL(client->getConnectCount(), 2U);
+  BOOST_CHECK(! client->isPresent(cameraPath));
+  BOOST_CHECK(! client->isPresent(focuserPath));
+}
+
+
+BOOST_FIXTURE_TEST_CASE(agent_rejects_wrong_token_and_second_watchdog, PresenceFixtureT) {
+  int port = findFreePort();
+  AgentThreadT agent(port, deviceRoot);
+  int strangerFd = -1;
+
+  BOOST_REQUIRE(waitUntil([&]() { return (strangerFd = openLoopbackSocket(port, false)) >= 0; }));
+
+  std::string subscribe = presence_protocol::encodeSubscribe("wrong", paths);
+  BOOST_REQUIRE_EQUAL(send(strangerFd, subscribe.data(), subscribe.size(), MSG_NOSIGNAL), static_cast<ssize_t>(subscribe.size()));
+  BOOST_CHECK(isClosedByPeer(strangerFd));
+  close(strangerFd);
+  
+  auto client = createClient(port);
+
+  BOOST_REQUIRE(waitUntil([&]() { return client->isSynced(); }));
+
+  // Does not replace the served watchdog
+  strangerFd = openLoopbackSocket(port, false);
+  BOOST_REQUIRE(strangerFd >= 0);
+  BOOST_CHECK(isClosedByPeer(strangerFd));
+  close(strangerFd);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  
+  BOOST_CHECK(client->isSynced());
+  BOOST_CHECK_EQUAL(client->getConnectCount(), 1U);
+}
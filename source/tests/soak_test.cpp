@@ -0,0 +1,91 @@
+/*****************************************************************************
+ *
+ *  INDI device watchdog  - Monitors the specified INDI devices and optionally
+ *  the corresponding Linux devices and tries to keep them connected. Under
+ *  certain conditions the device watchdog restarts the respective INDI driver
+ *  without restarting the complete INDI server.
+ *
+ *  Copyright(C) 2024 Carsten Schmitt <c [at] lost-infinity.com>
+ *
+ *  More info on https://www.lost-infinity.com
+ *
+ *  This program is free software ; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation ; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY ; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program ; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ ****************************************************************************/
+
+
+#define BOOST_TEST_MODULE soak_test
+#include <boost/test/included/unit_test.hpp>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "fake_devices.h"
+#include "fake_indi_server.h"
+#include "indi_client.h"
+#include "indi_device_watchdog.h"
+#include "logging.h"
+
+
+BOOST_AUTO_TEST_CASE(reset_reconnect_cycles_do_not_leak) {
+  LoggingT::init(logging::trivial::error, false /*console*/, false /*log file*/);
+
+  FakeIndiServerT indiServer;
+  BOOST_REQUIRE(indiServer.getPort() > 0);
+  
+  std::vector<DeviceDataT> devices = addFakeDevices(indiServer, 4);
+  const unsigned int cycleCount = 300;
+
+  {
+    IndiDeviceWatchdogT watchdog("127.0.0.1", indiServer.getPort(), 5, devices, "/usr/bin", "/nonexistent/indiserverFIFO",
+				 RecoveryActionFactoryT(), ReconnectPolicyT(), std::chrono::milliseconds(0), std::chrono::milliseconds(0), 2);
+
+    BOOST_CHECK(watchdog.runSoakTest(cycleCount, 10.0));
+    BOOST_CHECK_EQUAL(IndiClientT::getActiveConnectionThreadCount(), 0);
+  }
+
+  // One connection per cycle - each closed again
+  BOOST_CHECK_EQUAL(indiServer.getAcceptedClientCount(), cycleCount);
+  
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+  while (indiServer.getClientCount() > 0 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  BOOST_CHECK_EQUAL(indiServer.getClientCount(), 0U);
+  BOOST_CHECK_EQUAL(indiServer.getConnectRequestCount("Fake CCD Simulator 0"), 0U);
+}
+
+
+BOOST_AUTO_TEST_CASE(unreachable_indi_server_does_not_leak_connection_threads) {
+  LoggingT::init(logging::trivial::fatal, false /*console*/, false /*log file*/);
+
+  unsigned short port;
+  {
+    // A port nobody listens on any more
+    FakeIndiServerT indiServer;
+    port = indiServer.getPort();
+  }
+  
+  std::vector<DeviceDataT> devices { DeviceDataT("Fake CCD Simulator", "/dev/null", "indi_fake_ccd", true) };
+  IndiDeviceWatchdogT watchdog("127.0.0.1", port, 1, devices, "/usr/bin", "/nonexistent/indiserverFIFO",
+			       RecoveryActionFactoryT(), ReconnectPolicyT(), std::chrono::milliseconds(0), std::chrono::milliseconds(0), 0);
+
+  // The connection attempts fail - the reset clients must still take
+  // their connection threads with them.
+  watchdog.runSoakTest(3, 100.0);
+  BOOST_CHECK_EQUAL(IndiClientT::getActiveConnectionThreadCount(), 0);
+}